@@ -6,11 +6,23 @@
  ************************************************************************/
 
 #include <stdint.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
 #include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
 #include <random>
 
 #include <utils/elapsed_time.h>
 #include <log/log.h>
+#include <log/log_format.h>
 
 #define LOG_TAG "bench"
 
@@ -34,25 +46,389 @@ std::string generate_random_string(int length)
     return random_string;
 }
 
-int main()
+// 单独测量格式化开销: std::string接口与写入调用方缓存的接口
+void bench_format(int recycle)
 {
-    eular::log::InitLog(eular::LogLevel::LEVEL_INFO);
-    eular::log::SetPath("./");
+    std::string msg = generate_random_string(128);
+    eular::LogEvent ev;
+    memset(&ev, 0, sizeof(ev));
+    eular::LogEventTime(ev);
+    ev.pid = getpid();
+    ev.tid = gettid();
+    ev.level = eular::LogLevel::LEVEL_INFO;
+    strcpy(ev.tag, LOG_TAG);
+    ev.msg = &msg[0];
+
+    size_t total = 0;
+    eular::ElapsedTime et(ElapsedTimeType::NANOSECOND);
+    et.start();
+    for (int i = 0; i < recycle; i++) {
+        std::string line = eular::LogFormat::Format(&ev);
+        total += line.length();
+    }
+    et.stop();
+    printf("Format(std::string): %luns/line\n", et.elapsedTime() / recycle);
+
+    eular::LogBuffer buffer;
+    et.reset();
+    et.start();
+    for (int i = 0; i < recycle; i++) {
+        buffer.clear();
+        total += buffer.append(&ev);
+    }
+    et.stop();
+    printf("Format(buffer):      %luns/line\n", et.elapsedTime() / recycle);
+
+    if (total == 0) {
+        printf("unexpected empty output\n");
+    }
+}
+
+/**
+ * 每次调用的耗时记入对数线性直方图: 按2的幂分段, 每段再等分为HIST_SUB_BUCKETS份,
+ * 相对误差不超过1/HIST_SUB_BUCKETS. 直方图可直接相加, 多线程、多进程的结果合并到共享内存中.
+ */
+#define HIST_SUB_BITS       (5)
+#define HIST_SUB_BUCKETS    (1 << HIST_SUB_BITS)
+#define HIST_BUCKETS        ((64 - HIST_SUB_BITS) * HIST_SUB_BUCKETS)
+
+struct Histogram {
+    std::atomic<uint64_t>   counts[HIST_BUCKETS];
+    std::atomic<uint64_t>   total;
+    std::atomic<uint64_t>   max;
+};
+
+static inline uint32_t BucketIndex(uint64_t ns)
+{
+    if (ns < HIST_SUB_BUCKETS) {
+        return ns;
+    }
+    uint32_t shift = 63 - __builtin_clzll(ns) - HIST_SUB_BITS;
+    return (shift + 1) * HIST_SUB_BUCKETS + ((ns >> shift) - HIST_SUB_BUCKETS);
+}
+
+// 桶的上界, 作为该桶内样本的估计值
+static inline uint64_t BucketValue(uint32_t index)
+{
+    if (index < HIST_SUB_BUCKETS) {
+        return index;
+    }
+    uint32_t shift = index / HIST_SUB_BUCKETS - 1;
+    uint64_t base = HIST_SUB_BUCKETS + index % HIST_SUB_BUCKETS;
+    return ((base + 1) << shift) - 1;
+}
+
+static uint64_t Percentile(const Histogram *hist, double ratio)
+{
+    uint64_t total = hist->total.load();
+    uint64_t rank = (uint64_t)(total * ratio);
+    uint64_t seen = 0;
+    for (uint32_t i = 0; i < HIST_BUCKETS; ++i) {
+        seen += hist->counts[i].load(std::memory_order_relaxed);
+        if (seen > rank) {
+            return BucketValue(i);
+        }
+    }
+    return hist->max.load();
+}
+
+struct BenchConfig {
+    std::vector<std::string>    sinks;
+    std::vector<int>            threads;
+    std::vector<int>            procs;
+    std::vector<int>            sizes;
+    int                         lines;          // 每个线程写入的条数
+    std::string                 path;
+};
+
+struct SinkInfo {
+    const char *name;
+    int32_t     type;   // 输出节点类型, -1表示不添加输出节点
+    const char *brief;
+};
+
+static const SinkInfo gSinks[] = {
+    { "off",     -1,                          "LOGD below INFO level, filtered out at the call site" },
+    { "null",    eular::LogWrite::STDOUT,     "stdout redirected to /dev/null" },
+    { "file",    eular::LogWrite::FILEOUT,    "file, synchronous write per line" },
+    { "batch",   eular::LogWrite::FILEOUT,    "file with SetFileBatch()" },
+    { "mmap",    eular::LogWrite::MMAPOUT,    "mmap segments, one file per process" },
+    { "bin",     eular::LogWrite::BINOUT,     "binary log, decode with logdecode" },
+    { "shm",     eular::LogWrite::SHMOUT,     "shared memory rings, collected by one thread" },
+    { "console", eular::LogWrite::CONSOLEOUT, "logcat socket, start logcat first or it measures the offline path" },
+};
+
+static const SinkInfo *FindSink(const std::string &name)
+{
+    for (const auto &sink : gSinks) {
+        if (name == sink.name) {
+            return &sink;
+        }
+    }
+    return nullptr;
+}
+
+static std::vector<std::string> SplitList(const char *arg)
+{
+    std::vector<std::string> out;
+    std::string item;
+    for (const char *p = arg; ; ++p) {
+        if (*p == ',' || *p == '\0') {
+            if (!item.empty()) {
+                out.push_back(item);
+            }
+            item.clear();
+            if (*p == '\0') {
+                break;
+            }
+        } else {
+            item.push_back(*p);
+        }
+    }
+    return out;
+}
+
+static std::vector<int> SplitIntList(const char *arg)
+{
+    std::vector<int> out;
+    for (const auto &item : SplitList(arg)) {
+        int value = atoi(item.c_str());
+        if (value > 0) {
+            out.push_back(value);
+        }
+    }
+    return out;
+}
+
+// 单个线程的写入循环, 只统计LOGx调用本身的耗时
+static void WriterThread(const SinkInfo *sink, const std::string &msg, int lines, std::atomic<bool> *go, Histogram *hist)
+{
+    std::vector<uint64_t> counts(HIST_BUCKETS, 0);
+    uint64_t maxNs = 0;
+    while (!go->load(std::memory_order_acquire)) {
+        std::this_thread::yield();
+    }
+
+    bool filtered = sink->type < 0;
+    for (int i = 0; i < lines; ++i) {
+        auto begin = std::chrono::steady_clock::now();
+        if (filtered) {
+            LOGD("%d %s", i, msg.c_str());
+        } else {
+            LOGI("%d %s", i, msg.c_str());
+        }
+        auto end = std::chrono::steady_clock::now();
+        uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count();
+        ++counts[BucketIndex(ns)];
+        if (ns > maxNs) {
+            maxNs = ns;
+        }
+    }
+
+    for (uint32_t i = 0; i < HIST_BUCKETS; ++i) {
+        if (counts[i] > 0) {
+            hist->counts[i].fetch_add(counts[i], std::memory_order_relaxed);
+        }
+    }
+    hist->total.fetch_add(lines, std::memory_order_relaxed);
+    uint64_t old = hist->max.load();
+    while (old < maxNs && !hist->max.compare_exchange_weak(old, maxNs)) {
+    }
+}
+
+static void RunThreads(const SinkInfo *sink, const std::string &msg, int threads, int lines, Histogram *hist)
+{
+    std::atomic<bool> go(false);
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; ++t) {
+        workers.emplace_back(WriterThread, sink, std::cref(msg), lines, &go, hist);
+    }
+    go.store(true, std::memory_order_release);
+    for (auto &worker : workers) {
+        worker.join();
+    }
+    eular::log::Flush();
+}
+
+/**
+ * @brief 运行一个场景: 添加输出节点后fork出procs个进程, 每个进程threads个线程各写lines条
+ *
+ * @return 从开始写入到全部写出(含Flush)的耗时
+ */
+static double RunScenario(const BenchConfig &cfg, const SinkInfo *sink, int size, int threads, int procs, Histogram *hist)
+{
+    std::string msg = generate_random_string(size);
+    memset((void *)hist, 0, sizeof(Histogram));
+
+    if (sink->type >= 0) {
+        if (strcmp(sink->name, "batch") == 0) {
+            eular::log::SetFileBatch();
+        }
+        eular::log::addOutputNode(sink->type);
+    }
+
+    // 子进程等待管道关闭后同时开始
+    int startPipe[2];
+    if (pipe(startPipe) != 0) {
+        perror("pipe");
+        exit(1);
+    }
+
+    std::vector<pid_t> children;
+    for (int p = 1; p < procs; ++p) {
+        pid_t pid = fork();
+        if (pid == 0) {
+            close(startPipe[1]);
+            char c;
+            while (read(startPipe[0], &c, 1) < 0 && errno == EINTR) {
+            }
+            RunThreads(sink, msg, threads, cfg.lines, hist);
+            exit(0);
+        }
+        if (pid > 0) {
+            children.push_back(pid);
+        }
+    }
+    close(startPipe[0]);
+
+    auto begin = std::chrono::steady_clock::now();
+    close(startPipe[1]);
+    RunThreads(sink, msg, threads, cfg.lines, hist);
+    for (pid_t pid : children) {
+        int status = 0;
+        waitpid(pid, &status, 0);
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    if (sink->type >= 0) {
+        eular::log::delOutputNode(sink->type);
+        if (strcmp(sink->name, "batch") == 0) {
+            eular::log::SetFileBatch(0, 0);
+        }
+    }
+    return std::chrono::duration<double>(end - begin).count();
+}
+
+static void Usage(const char *name)
+{
+    printf("usage: %s [options]\n", name);
+    printf("  -s sinks      comma separated, default off,null,file,batch\n");
+    printf("  -t threads    threads per process, comma separated, default 1,4\n");
+    printf("  -p procs      processes, comma separated, default 1\n");
+    printf("  -m sizes      message sizes in bytes, comma separated, default 64,512,4096\n");
+    printf("  -n lines      lines per thread, default 100000\n");
+    printf("  -d path       log directory, default ./bench_log/\n");
+    printf("  -a            async mode (InitLog with AsyncOptions)\n");
+    printf("  -F            run the format micro benchmark first\n");
+    printf("sinks:\n");
+    for (const auto &sink : gSinks) {
+        printf("  %-8s %s\n", sink.name, sink.brief);
+    }
+    exit(0);
+}
+
+int main(int argc, char **argv)
+{
+    BenchConfig cfg;
+    cfg.sinks = SplitList("off,null,file,batch");
+    cfg.threads = { 1, 4 };
+    cfg.procs = { 1 };
+    // 4096超出消息缓存的内联空间(2KiB), 覆盖首次格式化放不下时的第二次格式化
+    cfg.sizes = { 64, 512, 4096 };
+    cfg.lines = 100000;
+    cfg.path = "./bench_log/";
+    bool async = false;
+    bool format = false;
+
+    int cmd = 0;
+    while ((cmd = ::getopt(argc, argv, "hs:t:p:m:n:d:aF")) != -1) {
+        switch (cmd) {
+        case 's':
+            cfg.sinks = SplitList(optarg);
+            break;
+        case 't':
+            cfg.threads = SplitIntList(optarg);
+            break;
+        case 'p':
+            cfg.procs = SplitIntList(optarg);
+            break;
+        case 'm':
+            cfg.sizes = SplitIntList(optarg);
+            break;
+        case 'n':
+            cfg.lines = atoi(optarg);
+            break;
+        case 'd':
+            cfg.path = optarg;
+            break;
+        case 'a':
+            async = true;
+            break;
+        case 'F':
+            format = true;
+            break;
+        default:
+            Usage(argv[0]);
+            break;
+        }
+    }
+
+    for (const auto &name : cfg.sinks) {
+        if (FindSink(name) == nullptr) {
+            printf("unknown sink %s\n", name.c_str());
+            Usage(argv[0]);
+        }
+    }
+
+    if (format) {
+        bench_format(1000000);
+    }
+
+    // 结果写到原来的stdout, 日志的stdout重定向到/dev/null
+    int resultFd = dup(STDOUT_FILENO);
+    FILE *result = fdopen(resultFd, "w");
+    setvbuf(result, nullptr, _IOLBF, 0);
+    fflush(stdout);
+    int nullFd = open("/dev/null", O_WRONLY);
+    dup2(nullFd, STDOUT_FILENO);
+    close(nullFd);
+
+    if (async) {
+        eular::AsyncOptions opt;
+        eular::log::InitLog(eular::LogLevel::LEVEL_INFO, opt);
+    } else {
+        eular::log::InitLog(eular::LogLevel::LEVEL_INFO);
+    }
+    eular::log::SetPath(cfg.path.c_str());
     eular::log::delOutputNode(eular::LogWrite::STDOUT);
-    eular::log::addOutputNode(eular::LogWrite::FILEOUT);
 
-    std::string logMsg(512, '\0');
+    // 共享内存, 子进程的统计结果直接累加
+    Histogram *hist = (Histogram *)mmap(nullptr, sizeof(Histogram), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (hist == MAP_FAILED) {
+        perror("mmap");
+        return 1;
+    }
 
-    int recycle = 50000;
-    eular::ElapsedTime et(ElapsedTimeType::NANOSECOND);
-    for (int i = 0; i < recycle; i++)
-    {
-        logMsg = std::to_string(i) + ": " + generate_random_string(128);
-        et.start();
-        LOGW("%s", logMsg.c_str());
-        et.stop();
+    fprintf(result, "mode %s, %d lines per thread, latency of each LOGx call in ns\n", async ? "async" : "sync", cfg.lines);
+    fprintf(result, "%-8s %6s %4s %4s %10s %9s %7s %7s %7s %9s\n",
+        "sink", "size", "thr", "proc", "lines", "Mline/s", "p50", "p99", "p999", "max");
+    for (const auto &name : cfg.sinks) {
+        const SinkInfo *sink = FindSink(name);
+        for (int size : cfg.sizes) {
+            for (int procs : cfg.procs) {
+                for (int threads : cfg.threads) {
+                    double seconds = RunScenario(cfg, sink, size, threads, procs, hist);
+                    uint64_t total = hist->total.load();
+                    fprintf(result, "%-8s %6d %4d %4d %10lu %9.3f %7lu %7lu %7lu %9lu\n",
+                        sink->name, size, threads, procs, (unsigned long)total, total / seconds / 1e6,
+                        (unsigned long)Percentile(hist, 0.5), (unsigned long)Percentile(hist, 0.99),
+                        (unsigned long)Percentile(hist, 0.999), (unsigned long)hist->max.load());
+                }
+            }
+        }
     }
 
-    printf("Elapsed time: %luns\n", et.elapsedTime() / recycle);
+    munmap(hist, sizeof(Histogram));
+    fclose(result);
     return 0;
 }
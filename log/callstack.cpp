@@ -9,18 +9,216 @@
 #include "callstack.h"
 #include "log.h"
 #include <cxxabi.h>
+#include <dlfcn.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <link.h>
 #include <libunwind/libunwind.h>
+#include <pthread.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <unordered_map>
+#include <vector>
+
+#define SYMBOL_CACHE_SIZE   (4096)  // 缓存的地址数上限, 超出时清空
 
 namespace eular {
+struct ElfSymbol {
+    uintptr_t   addr;
+    uintptr_t   size;
+    uint32_t    name;   // 在names中的偏移
+
+    bool operator<(const ElfSymbol &other) const { return addr < other.addr; }
+};
+
+// 一个已加载模块的函数符号, 首次解析该模块中的地址时从文件读取
+struct ModuleSymbols {
+    std::vector<ElfSymbol>  symbols;
+    std::string             names;
+    uintptr_t               vaddrBase;  // 首个PT_LOAD段按页对齐的虚拟地址, 对应dladdr的dli_fbase
+};
+
+static pthread_mutex_t gSymbolMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t gSymbolOnce = PTHREAD_ONCE_INIT;
+static std::unordered_map<uintptr_t, std::string> *gSymbolCache = nullptr;
+static std::unordered_map<uintptr_t, ModuleSymbols> *gModuleCache = nullptr;   // 以dli_fbase为键
+
+static void SymbolAtForkPrepare()
+{
+    pthread_mutex_lock(&gSymbolMutex);
+}
+
+static void SymbolAtForkParent()
+{
+    pthread_mutex_unlock(&gSymbolMutex);
+}
+
+static void SymbolInit()
+{
+    // 不释放, 避免退出阶段其他线程仍在打印调用栈
+    gSymbolCache = new std::unordered_map<uintptr_t, std::string>();
+    gModuleCache = new std::unordered_map<uintptr_t, ModuleSymbols>();
+    pthread_atfork(SymbolAtForkPrepare, SymbolAtForkParent, SymbolAtForkParent);
+}
+
+// 读取.symtab(已strip时为.dynsym)中的函数符号, 包括未导出的static函数
+static void LoadModuleSymbols(const char *path, ModuleSymbols &module)
+{
+    module.vaddrBase = 0;
+    int32_t fd = ::open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(ElfW(Ehdr))) {
+        ::close(fd);
+        return;
+    }
+    void *addr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (addr == MAP_FAILED) {
+        return;
+    }
+
+    const char *base = static_cast<const char *>(addr);
+    size_t fileSize = st.st_size;
+    const ElfW(Ehdr) *ehdr = reinterpret_cast<const ElfW(Ehdr) *>(base);
+    if (memcmp(ehdr->e_ident, ELFMAG, SELFMAG) != 0 ||
+        ehdr->e_phoff + (size_t)ehdr->e_phnum * sizeof(ElfW(Phdr)) > fileSize ||
+        ehdr->e_shoff + (size_t)ehdr->e_shnum * sizeof(ElfW(Shdr)) > fileSize) {
+        munmap(addr, fileSize);
+        return;
+    }
+
+    const ElfW(Phdr) *phdr = reinterpret_cast<const ElfW(Phdr) *>(base + ehdr->e_phoff);
+    uintptr_t pageMask = sysconf(_SC_PAGESIZE) - 1;
+    for (uint32_t i = 0; i < ehdr->e_phnum; ++i) {
+        if (phdr[i].p_type == PT_LOAD) {
+            module.vaddrBase = phdr[i].p_vaddr & ~pageMask;
+            break;
+        }
+    }
+
+    const ElfW(Shdr) *shdr = reinterpret_cast<const ElfW(Shdr) *>(base + ehdr->e_shoff);
+    const ElfW(Shdr) *symtab = nullptr;
+    for (uint32_t i = 0; i < ehdr->e_shnum; ++i) {
+        if (shdr[i].sh_type == SHT_SYMTAB) {
+            symtab = &shdr[i];
+            break;
+        }
+        if (shdr[i].sh_type == SHT_DYNSYM) {
+            symtab = &shdr[i];
+        }
+    }
+    if (symtab == nullptr || symtab->sh_link >= ehdr->e_shnum ||
+        symtab->sh_offset + symtab->sh_size > fileSize) {
+        munmap(addr, fileSize);
+        return;
+    }
+    const ElfW(Shdr) *strtab = &shdr[symtab->sh_link];
+    if (strtab->sh_offset + strtab->sh_size > fileSize) {
+        munmap(addr, fileSize);
+        return;
+    }
+
+    module.names.assign(base + strtab->sh_offset, strtab->sh_size);
+    const ElfW(Sym) *sym = reinterpret_cast<const ElfW(Sym) *>(base + symtab->sh_offset);
+    size_t count = symtab->sh_size / sizeof(ElfW(Sym));
+    for (size_t i = 0; i < count; ++i) {
+        uint32_t type = ELF64_ST_TYPE(sym[i].st_info);
+        if ((type != STT_FUNC && type != STT_GNU_IFUNC) || sym[i].st_shndx == SHN_UNDEF ||
+            sym[i].st_value == 0 || sym[i].st_name >= module.names.size()) {
+            continue;
+        }
+        module.symbols.push_back({ (uintptr_t)sym[i].st_value, (uintptr_t)sym[i].st_size, sym[i].st_name });
+    }
+    std::sort(module.symbols.begin(), module.symbols.end());
+    munmap(addr, fileSize);
+}
+
+// 需持有gSymbolMutex
+static const char *FindModuleSymbol(const Dl_info &info, uintptr_t pc, uintptr_t &offset)
+{
+    auto it = gModuleCache->find((uintptr_t)info.dli_fbase);
+    if (it == gModuleCache->end()) {
+        // 主程序的dli_fname为argv[0], 可能是相对路径
+        const char *path = info.dli_fname;
+        if (path == nullptr || strcmp(path, program_invocation_name) == 0 || path[0] == '\0') {
+            path = "/proc/self/exe";
+        }
+        it = gModuleCache->emplace((uintptr_t)info.dli_fbase, ModuleSymbols()).first;
+        LoadModuleSymbols(path, it->second);
+    }
+
+    const ModuleSymbols &module = it->second;
+    uintptr_t loadBias = (uintptr_t)info.dli_fbase - module.vaddrBase;
+    uintptr_t vaddr = pc - 1 - loadBias;
+    ElfSymbol key = { vaddr, 0, 0 };
+    auto sym = std::upper_bound(module.symbols.begin(), module.symbols.end(), key);
+    if (sym == module.symbols.begin()) {
+        return nullptr;
+    }
+    --sym;
+    if (vaddr >= sym->addr + (sym->size > 0 ? sym->size : 1)) {
+        return nullptr;
+    }
+    offset = pc - loadBias - sym->addr;
+    return module.names.c_str() + sym->name;
+}
+
+// 函数名取自模块的符号表, 找不到时以所在模块及偏移表示, 可用addr2line还原
+static std::string SymbolizeUncached(uintptr_t pc)
+{
+    char buf[1024] = {0};
+    Dl_info info;
+    // 返回地址可能已越过函数末尾(noreturn调用), 减一后查找所在函数
+    if (dladdr((void *)(pc - 1), &info) == 0) {
+        return "(unable to obtain symbol name for this frame)";
+    }
+
+    uintptr_t offset = 0;
+    pthread_mutex_lock(&gSymbolMutex);
+    const char *symbol = FindModuleSymbol(info, pc, offset);
+    std::string name = symbol != nullptr ? symbol : "";
+    pthread_mutex_unlock(&gSymbolMutex);
+    if (name.empty() && info.dli_sname != nullptr && info.dli_saddr != nullptr) {
+        name = info.dli_sname;
+        offset = pc - (uintptr_t)info.dli_saddr;
+    }
+
+    if (!name.empty()) {
+        int status = -1;
+        char *demangled = abi::__cxa_demangle(name.c_str(), nullptr, nullptr, &status);
+        snprintf(buf, sizeof(buf), "-0x%012lx: (%s + 0x%lx)", pc,
+            (status == 0 && demangled != nullptr) ? demangled : name.c_str(), offset);
+        free(demangled);
+    } else if (info.dli_fname != nullptr) {
+        const char *module = strrchr(info.dli_fname, '/');
+        module = module != nullptr ? module + 1 : info.dli_fname;
+        snprintf(buf, sizeof(buf), "-0x%012lx: (%s + 0x%lx)", pc, module, pc - (uintptr_t)info.dli_fbase);
+    } else {
+        return "(unable to obtain symbol name for this frame)";
+    }
+
+    return buf;
+}
+
 CallStack::CallStack() :
+    mCount(0),
     mSkip(2),
     mSkipEnd(0)
 {
 
 }
 
-CallStack::CallStack(const char* logtag, int32_t ignoreDepth)
+CallStack::CallStack(const char* logtag, int32_t ignoreDepth) :
+    mCount(0),
+    mSkip(2),
+    mSkipEnd(0)
 {
     this->update(ignoreDepth + 1);
     this->log(logtag);
@@ -35,54 +233,58 @@ void CallStack::update(uint32_t ignoreDepth, uint32_t ignoreEnd)
 {
     mSkip = ignoreDepth;
     mSkipEnd = ignoreEnd;
-    unw_cursor_t cursor;
-    unw_context_t context;
-
-    mStackFrame.clear();
-    unw_getcontext(&context);
-    unw_init_local(&cursor, &context);
-    char buf[1024] = {0};
 
-    while (unw_step(&cursor) > 0)
-    {
-        unw_word_t offset, funcPointer;
-        unw_get_reg(&cursor, UNW_REG_IP, &funcPointer);
-        if (funcPointer == 0) {
+    // 多取一层, 去掉update自身
+    void *frames[CALLSTACK_MAX_DEPTH + 1];
+    int32_t count = unw_backtrace(frames, CALLSTACK_MAX_DEPTH + 1);
+    mCount = 0;
+    for (int32_t i = 1; i < count; ++i) {
+        if (frames[i] == nullptr) {
             break;
         }
+        mFrames[mCount++] = (uintptr_t)frames[i];
+    }
+}
 
-        char sym[256] = {0};
-        if (unw_get_proc_name(&cursor, sym, sizeof(sym), &offset) == 0) {
-            char *nameptr = sym;
-            int status = -1;
-            char *demangled = abi::__cxa_demangle(sym, nullptr, nullptr, &status);
-            if (status == 0 && demangled != nullptr) {
-                nameptr = demangled;
-            }
-
-            snprintf(buf, sizeof(buf), "-0x%012lx: (%s + 0x%lx)", funcPointer, nameptr, offset);
-            mStackFrame.push_back(std::string(buf));
-            if (demangled) {
-                free(demangled);
-            }
-        } else {
-            mStackFrame.push_back(std::string("(unable to obtain symbol name for this frame)"));
-        }
+std::string CallStack::Symbolize(uintptr_t pc)
+{
+    pthread_once(&gSymbolOnce, SymbolInit);
+
+    pthread_mutex_lock(&gSymbolMutex);
+    auto it = gSymbolCache->find(pc);
+    if (it != gSymbolCache->end()) {
+        std::string symbol = it->second;
+        pthread_mutex_unlock(&gSymbolMutex);
+        return symbol;
+    }
+    pthread_mutex_unlock(&gSymbolMutex);
+
+    // dladdr与demangle在锁外进行, 同一地址被并发解析时结果相同
+    std::string symbol = SymbolizeUncached(pc);
+    pthread_mutex_lock(&gSymbolMutex);
+    if (gSymbolCache->size() >= SYMBOL_CACHE_SIZE) {
+        gSymbolCache->clear();
     }
+    gSymbolCache->emplace(pc, symbol);
+    pthread_mutex_unlock(&gSymbolMutex);
+    return symbol;
 }
 
 void CallStack::log(const char* logtag, LogLevel::Level level) const
 {
-    for (size_t i = mSkipEnd; i < mStackFrame.size() - mSkip; ++i) {
-        log_write(level, logtag, "%s\n", mStackFrame[i].c_str());
+    if (mCount <= mSkip) {
+        return;
+    }
+    for (size_t i = mSkipEnd; i < mCount - mSkip; ++i) {
+        log_write(level, logtag, "%s\n", Symbolize(mFrames[i]).c_str());
     }
 }
 
 std::string CallStack::toString() const
 {
     std::string str;
-    for (size_t i = 0; i < mStackFrame.size(); ++i) {
-        str += mStackFrame[i];
+    for (size_t i = 0; i < mCount; ++i) {
+        str += Symbolize(mFrames[i]);
         str += "\n";
     }
 
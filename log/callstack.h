@@ -10,18 +10,24 @@
 
 #include "log_level.h"
 #include <stdio.h>
+#include <stdint.h>
 #include <string>
-#include <vector>
+
+#define CALLSTACK_MAX_DEPTH     (64)    // 最多记录的栈帧数
 
 namespace eular {
 
+/**
+ * update只记录各栈帧的返回地址, 不分配内存也不解析符号;
+ * 符号在toString/log时才解析并demangle, 结果按地址缓存在进程内, 同一地址只解析一次
+ */
 class CallStack {
 public:
     CallStack();
     CallStack(const char* logtag, int32_t ignoreDepth = 1);
     ~CallStack();
 
-    void clear() { mStackFrame.clear(); }
+    void clear() { mCount = 0; }
 
     // dump the stack of the current call.
     // ignoreDepth: 可忽略的起始调用函数层级；ignoreEnd：可忽略的最后调用函数层级
@@ -34,10 +40,17 @@ public:
     std::string toString() const;
 
     // Get the count of stack frames that are in this call stack.
-    size_t size() const { return mStackFrame.size(); }
+    size_t size() const { return mCount; }
+
+    // 第index层的返回地址, 0为调用update的函数
+    uintptr_t frame(size_t index) const { return index < mCount ? mFrames[index] : 0; }
+
+    // 解析单个地址, 格式与toString中的一行相同
+    static std::string Symbolize(uintptr_t pc);
 
 private:
-    std::vector<std::string> mStackFrame;
+    uintptr_t                mFrames[CALLSTACK_MAX_DEPTH];
+    uint32_t                 mCount;
     uint32_t                 mSkip;
     uint32_t                 mSkipEnd;
 };
@@ -12,12 +12,21 @@
 
 #define MSG_BUF_SIZE    (1024)
 #define EXPAND_SIZE     (8)     // for \n \0
+#define LIMIT_REPORT_INTERVAL   (1) // 限流汇总间隔, 秒
 
 namespace eular {
 static LogManager *gLogManager = nullptr;
-static std::atomic<int32_t> gLevel{LogLevel::LEVEL_DEBUG};
+static std::atomic<AsyncLogger *> gAsyncLogger{nullptr};
+static pthread_once_t gAsyncOnce = PTHREAD_ONCE_INIT;
 static volatile bool gEnableLogoutColor = true;
+static std::atomic<bool> gCoarseClock{false};
 static thread_local char g_buf[MSG_BUF_SIZE + EXPAND_SIZE] = {0};
+static thread_local LogBuffer gMsgBuffer;   // 消息缓存, 容量只增不减
+
+static inline void GetLogTime(LogEvent &ev)
+{
+    LogEventTime(ev, gCoarseClock.load(std::memory_order_relaxed) ? CLOCK_REALTIME_COARSE : CLOCK_REALTIME);
+}
 
 namespace log {
 void getLogManager()
@@ -30,13 +39,84 @@ void getLogManager()
 void InitLog(LogLevel::Level lev)
 {
     getLogManager();
-    gLevel.store(lev, std::memory_order_release);
+    log_set_global_level(lev);
+}
+
+static void AsyncAtForkPrepare()
+{
+    AsyncLogger *async = gAsyncLogger.load(std::memory_order_acquire);
+    if (async != nullptr) {
+        async->prepareFork();
+    }
+}
+
+static void AsyncAtForkParent()
+{
+    AsyncLogger *async = gAsyncLogger.load(std::memory_order_acquire);
+    if (async != nullptr) {
+        async->parentAfterFork();
+    }
+}
+
+static void AsyncAtForkChild()
+{
+    AsyncLogger *async = gAsyncLogger.load(std::memory_order_acquire);
+    if (async != nullptr) {
+        async->detachAfterFork();
+    }
+}
+
+static void AsyncAtExit()
+{
+    // 置空后新的调用走同步路径; 置空前已取得指针的线程可能仍在push,
+    // 故只停止写线程并写出队列中的日志, 不释放对象(同CallStack的缓存, 进程退出时回收)
+    AsyncLogger *async = gAsyncLogger.exchange(nullptr, std::memory_order_acq_rel);
+    if (async != nullptr) {
+        async->stop();
+    }
+}
+
+static void AsyncRegisterOnce()
+{
+    pthread_atfork(AsyncAtForkPrepare, AsyncAtForkParent, AsyncAtForkChild);
+    // 晚于LogManager注册, 先于其析构执行
+    ::atexit(AsyncAtExit);
+}
+
+void InitLog(LogLevel::Level lev, const AsyncOptions &opt)
+{
+    InitLog(lev);
+    if (gAsyncLogger.load(std::memory_order_acquire) != nullptr) {
+        return;
+    }
+
+    AsyncLogger *async = new AsyncLogger(opt);
+    if (!async->start()) {
+        delete async;
+        return;
+    }
+
+    AsyncLogger *expected = nullptr;
+    if (!gAsyncLogger.compare_exchange_strong(expected, async, std::memory_order_acq_rel)) {
+        delete async;
+        return;
+    }
+    pthread_once(&gAsyncOnce, AsyncRegisterOnce);
+}
+
+void GetAsyncStats(AsyncStats &stats)
+{
+    memset(&stats, 0, sizeof(stats));
+    AsyncLogger *async = gAsyncLogger.load(std::memory_order_acquire);
+    if (async != nullptr) {
+        async->stats(stats);
+    }
 }
 
 void SetLevel(LogLevel::Level lev)
 {
     getLogManager();
-    gLevel.store(lev, std::memory_order_release);
+    log_set_global_level(lev);
 }
 
 void SetPath(const char *path)
@@ -45,12 +125,44 @@ void SetPath(const char *path)
     gLogManager->setPath(path);
 }
 
+void SetFileBatch(uint32_t maxBytes, uint32_t maxDelayMs)
+{
+    getLogManager();
+    gLogManager->setFileBatch(maxBytes, maxDelayMs);
+}
+
+void SetFileRotate(const LogRotatePolicy &policy)
+{
+    getLogManager();
+    gLogManager->setFileRotate(policy);
+}
+
+void Flush()
+{
+    log_limit_report();
+
+    AsyncLogger *async = gAsyncLogger.load(std::memory_order_acquire);
+    if (async != nullptr) {
+        async->flush();
+    }
+
+    getLogManager();
+    if (gLogManager != nullptr) {
+        gLogManager->Flush();
+    }
+}
+
 void EnableLogColor(bool flag)
 {
     getLogManager();
     gEnableLogoutColor = flag;
 }
 
+void EnableCoarseClock(bool flag)
+{
+    gCoarseClock.store(flag, std::memory_order_relaxed);
+}
+
 void addOutputNode(int32_t type)
 {
     getLogManager();
@@ -68,87 +180,291 @@ void delOutputNode(int32_t type)
 }
 } // namespace log
 
-void log_write(int32_t level, const char *tag, const char *fmt, ...)
+static void log_writev(int32_t level, const char *tag, const char *fmt, va_list ap)
 {
-    if (gLevel.load(std::memory_order_acquire) > level) {
-        return;
-    }
-
-    char *out = g_buf;
-    bool needFree = false;
+    bool skipBinary = false;
     LogEvent ev;
-    struct timeval tv;
-    gettimeofday(&tv, nullptr);
-    size_t len = 0;
+    GetLogTime(ev);
 
     ev.enableColor = gEnableLogoutColor;
     ev.level = (LogLevel::Level)level;
     assert(strlen(tag) < LOG_TAG_SIZE);
     strcpy(ev.tag, tag);
-    ev.time = tv;
     ev.pid = getpid();
     ev.tid = gettid();
+    ev.fields = nullptr;
+    ev.fieldCount = 0;
 
-    va_list ap, tmpArgs;
-    va_start(ap, fmt);
-    va_copy(tmpArgs, ap);
-    int32_t n = vsnprintf(nullptr, 0, fmt, tmpArgs);
-    va_end(tmpArgs);
+    va_list tmpArgs;
+    AsyncLogger *async = gAsyncLogger.load(std::memory_order_acquire);
+    if (async != nullptr && async->running()) {
+        async->push(ev, fmt, ap);
+        if (level >= LogLevel::LEVEL_FATAL) {
+            // 写线程处理FATAL日志时会刷新所有输出节点
+            async->flush();
+        }
+        return;
+    }
 
-    uint32_t outSize = MSG_BUF_SIZE;
-    if (n > MSG_BUF_SIZE) { // 扩充buffer
-        outSize = n;
-        needFree = true;
-        out = (char *)malloc(outSize + EXPAND_SIZE);
-        if (out == nullptr) {
-            out = g_buf;
-            outSize = MSG_BUF_SIZE;
-            needFree = false;
+    log::getLogManager();
+    if (gLogManager != nullptr && gLogManager->hasBinaryWrite()) {
+        // 二进制输出节点只编码参数, 没有文本输出节点时无需格式化
+        va_copy(tmpArgs, ap);
+        skipBinary = true;
+        bool needText = gLogManager->WriteBinary(&ev, fmt, tmpArgs);
+        va_end(tmpArgs);
+        if (!needText) {
+            // 只有二进制输出节点时不格式化, 崩溃记录中保存格式串
+            log_crash_record(ev, fmt, strlen(fmt));
+            return;
         }
     }
-    int32_t formatSize = vsnprintf(out, outSize, fmt, ap);
-    va_end(ap);
-    if (formatSize < 0) {
+
+    // 先直接格式化到线程缓存, 超出时扩充后再格式化一次
+    LogBuffer &buffer = gMsgBuffer;
+    buffer.clear();
+    size_t capacity = buffer.capacity() - EXPAND_SIZE;
+    va_copy(tmpArgs, ap);
+    int32_t n = vsnprintf(buffer.data(), capacity, fmt, tmpArgs);
+    va_end(tmpArgs);
+    if (n < 0) {
         perror("vsnprintf error");
-        goto need_free;
+        return;
     }
 
-    out[outSize - 1] = '\0';
+    char *out = buffer.data();
+    size_t len = n;
+    if (len >= capacity) {
+        out = buffer.tail(len + EXPAND_SIZE);
+        if (out != nullptr) {
+            vsnprintf(out, len + 1, fmt, ap);
+        } else {
+            // 内存不足, 使用截断的消息
+            out = buffer.data();
+            len = capacity - 1;
+        }
+    }
 
-    len = formatSize;
     if (len && out[len - 1] != '\n') {
-        out[len] = '\n';
+        out[len++] = '\n';
+        out[len] = '\0';
     }
     ev.msg = out;
-    log::getLogManager();
+    log_crash_record(ev, out, len);
     if (gLogManager) {
+        gLogManager->WriteLog(&ev, skipBinary);
+    }
+}
+
+void log_write(int32_t level, const char *tag, const char *fmt, ...)
+{
+    if (log_tag_level(tag) > level) {
+        return;
+    }
+
+    va_list ap;
+    va_start(ap, fmt);
+    log_writev(level, tag, fmt, ap);
+    va_end(ap);
+}
+
+void log_write_site(LogSite *site, int32_t level, const char *fmt, ...)
+{
+    int32_t siteLevel = site->level.load(std::memory_order_relaxed);
+    if (siteLevel == LOG_SITE_UNRESOLVED) {
+        siteLevel = log_site_resolve(site);
+    }
+    if (siteLevel > level) {
+        return;
+    }
+
+    va_list ap;
+    va_start(ap, fmt);
+    log_writev(level, site->tag, fmt, ap);
+    va_end(ap);
+}
+
+void log_write_fields(LogSite *site, int32_t level, const char *msg, const LogField *fields, uint32_t count)
+{
+    int32_t siteLevel = site->level.load(std::memory_order_relaxed);
+    if (siteLevel == LOG_SITE_UNRESOLVED) {
+        siteLevel = log_site_resolve(site);
+    }
+    if (siteLevel > level) {
+        return;
+    }
+
+    LogEvent ev;
+    GetLogTime(ev);
+    ev.enableColor = gEnableLogoutColor;
+    ev.level = (LogLevel::Level)level;
+    assert(strlen(site->tag) < LOG_TAG_SIZE);
+    strcpy(ev.tag, site->tag);
+    ev.pid = getpid();
+    ev.tid = gettid();
+    ev.msg = const_cast<char *>(msg != nullptr ? msg : "");
+    ev.fields = fields;
+    ev.fieldCount = count;
+
+    AsyncLogger *async = gAsyncLogger.load(std::memory_order_acquire);
+    if (async != nullptr && async->running()) {
+        async->push(ev);
+        if (level >= LogLevel::LEVEL_FATAL) {
+            async->flush();
+        }
+        return;
+    }
+
+    // 字段由各输出节点按自己的格式渲染, 二进制输出节点也经WriteLog写入
+    log_crash_record(ev, ev.msg, strlen(ev.msg));
+    log::getLogManager();
+    if (gLogManager != nullptr) {
         gLogManager->WriteLog(&ev);
     }
+}
+
+static std::atomic<LogLimit *> gLimitList{nullptr};  // 已登记的限流调用点
+static std::atomic<bool> gLimitReporting{false};     // 汇总线程是否在运行
+static pthread_once_t gLimitOnce = PTHREAD_ONCE_INIT;
+static pthread_mutex_t gLimitMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t gLimitCond;
+static pthread_t gLimitThread;
+static std::atomic<bool> gLimitExit{false};
+
+void log_limit_report()
+{
+    LogLimit *limit = gLimitList.load(std::memory_order_acquire);
+    for (; limit != nullptr; limit = limit->next) {
+        uint32_t suppressed = limit->suppressed.exchange(0, std::memory_order_relaxed);
+        if (suppressed > 0) {
+            log_write_site(limit->site, limit->level, "suppressed %u messages\n", suppressed);
+        }
+    }
+}
+
+static void *LimitReportThread(void *)
+{
+    pthread_mutex_lock(&gLimitMutex);
+    while (!gLimitExit.load(std::memory_order_relaxed)) {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        ts.tv_sec += LIMIT_REPORT_INTERVAL;
+        pthread_cond_timedwait(&gLimitCond, &gLimitMutex, &ts);
+        if (gLimitExit.load(std::memory_order_relaxed)) {
+            break;
+        }
+
+        pthread_mutex_unlock(&gLimitMutex);
+        log_limit_report();
+        pthread_mutex_lock(&gLimitMutex);
+    }
+    pthread_mutex_unlock(&gLimitMutex);
+    return nullptr;
+}
 
-need_free:
-    if (needFree) {
-        free(out);
+static void LimitInitCond()
+{
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&gLimitCond, &attr);
+    pthread_condattr_destroy(&attr);
+}
+
+static void LimitAtExit()
+{
+    pthread_mutex_lock(&gLimitMutex);
+    gLimitExit.store(true, std::memory_order_relaxed);
+    bool running = gLimitReporting.exchange(false, std::memory_order_acq_rel);
+    pthread_cond_signal(&gLimitCond);
+    pthread_mutex_unlock(&gLimitMutex);
+    if (running) {
+        pthread_join(gLimitThread, nullptr);
     }
+
+    // 退出前写出最后一次汇总
+    log_limit_report();
+}
+
+static void LimitAtForkChild()
+{
+    // 子进程内没有汇总线程, 下次限流输出时重新创建
+    pthread_mutex_init(&gLimitMutex, nullptr);
+    LimitInitCond();
+    gLimitReporting.store(false, std::memory_order_relaxed);
+}
+
+static void LimitRegisterOnce()
+{
+    LimitInitCond();
+    pthread_atfork(nullptr, nullptr, LimitAtForkChild);
+    // 晚于LogManager注册, 先于其析构执行
+    ::atexit(LimitAtExit);
+}
+
+static void LimitStartReporter()
+{
+    log::getLogManager();
+    pthread_once(&gLimitOnce, LimitRegisterOnce);
+
+    pthread_mutex_lock(&gLimitMutex);
+    if (!gLimitExit.load(std::memory_order_relaxed) && !gLimitReporting.load(std::memory_order_relaxed)) {
+        if (pthread_create(&gLimitThread, nullptr, LimitReportThread, nullptr) == 0) {
+            gLimitReporting.store(true, std::memory_order_release);
+        }
+    }
+    pthread_mutex_unlock(&gLimitMutex);
+}
+
+static void LimitRegister(LogSite *site, LogLimit *limit, int32_t level)
+{
+    bool expected = false;
+    if (!limit->registered.compare_exchange_strong(expected, true, std::memory_order_relaxed)) {
+        return;
+    }
+
+    limit->site = site;
+    limit->level = level;
+    LogLimit *head = gLimitList.load(std::memory_order_relaxed);
+    do {
+        limit->next = head;
+    } while (!gLimitList.compare_exchange_weak(head, limit, std::memory_order_release, std::memory_order_relaxed));
+}
+
+void log_write_limit(LogSite *site, LogLimit *limit, int32_t level, const char *fmt, ...)
+{
+    // 第一条总是输出, 登记后丢弃的条数才会被汇总线程看到
+    if (!limit->registered.load(std::memory_order_relaxed)) {
+        LimitRegister(site, limit, level);
+    }
+    if (!gLimitReporting.load(std::memory_order_relaxed) && !gLimitExit.load(std::memory_order_relaxed)) {
+        LimitStartReporter();
+    }
+
+    va_list ap;
+    va_start(ap, fmt);
+    log_writev(level, site->tag, fmt, ap);
+    va_end(ap);
 }
 
 void log_write_assertv(const LogEvent *ev);
 
 void log_write_assert(int32_t level, const char *expr, const char *tag, const char *fmt, ...)
 {
-    if (gLevel.load(std::memory_order_acquire) > level) {
+    if (log_tag_level(tag) > level) {
         return;
     }
 
     LogEvent ev;
-    struct timeval tv;
-    gettimeofday(&tv, nullptr);
+    GetLogTime(ev);
 
     ev.level = (LogLevel::Level)level;
     assert(strlen(tag) < LOG_TAG_SIZE);
     strcpy(ev.tag, tag);
-    ev.time = tv;
     ev.pid = getpid();
     ev.tid = gettid();
+    ev.fields = nullptr;
+    ev.fieldCount = 0;
 
     size_t index = snprintf(g_buf, MSG_BUF_SIZE - 1, "assertion \"%s\" failed. ", expr);
     va_list ap;
@@ -158,7 +474,8 @@ void log_write_assert(int32_t level, const char *expr, const char *tag, const ch
 
     size_t len = strlen(g_buf);
     if (len > 0 && g_buf[len - 1] != '\n') {
-        g_buf[len] = '\n';
+        g_buf[len++] = '\n';
+        g_buf[len] = '\0';
     }
     ev.msg = g_buf;
     log_write_assertv(&ev);
@@ -166,19 +483,23 @@ void log_write_assert(int32_t level, const char *expr, const char *tag, const ch
 
 void log_write_assertv(const LogEvent *ev)
 {
+    // 先将队列中的日志写出, 避免abort后丢失
+    AsyncLogger *async = gAsyncLogger.load(std::memory_order_acquire);
+    if (async != nullptr) {
+        async->flush();
+    }
+
+    log_crash_record(*ev, ev->msg, strlen(ev->msg));
     log::getLogManager();
     if (gLogManager != nullptr) {
-        std::string msgString = LogFormat::Format(ev);
-        std::list<LogWrite*> logWriteList = gLogManager->GetLogWrite();
-        for (LogManager::LogWriteIt it = logWriteList.begin(); it != logWriteList.end(); ++it) {
-            if (*it != nullptr) {
-                (*it)->WriteToFile(msgString);
-            }
-        }
+        LogBuffer buffer;
+        size_t len = buffer.append(ev);
+        gLogManager->WriteRaw(buffer.data(), len);
     }
     CallStack cs;
     cs.update(2, 2);
     cs.log("Stack", LogLevel::LEVEL_ERROR);
+    log::Flush();
     abort();
 }
 
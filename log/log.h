@@ -2,26 +2,147 @@
 #define _LOG_H_
 
 #include "log_main.h"
+#include "log_async.h"
+#include "log_tag.h"
+#include "log_limit.h"
+#include "log_crash.h"
 #include <stdarg.h>
 
+/**
+ * 编译期最小级别, 如-DEULAR_LOG_MIN_LEVEL=LEVEL_INFO, 也可以是数值.
+ * 低于该级别的LOGD等宏条件为常量false, 整条语句被编译器删除, 参数不会求值(仍做格式检查)
+ */
+#ifndef EULAR_LOG_MIN_LEVEL
+#define EULAR_LOG_MIN_LEVEL LEVEL_DEBUG
+#endif
+
+/**
+ * 每个调用点一个静态LogSite(常量初始化), 首次调用时注册并解析级别;
+ * 之后级别不足时只有一次relaxed读取, 不会求值参数.
+ * 级别由全局级别与SetTagLevel共同决定, 修改后立即对所有调用点生效
+ */
+#define LOG_SITE_WRITE(lev, ...)                                                        \
+    ({                                                                                  \
+        if (eular::LogMinLevel::value <= (lev)) {                                       \
+            static eular::LogSite __log_site = { LOG_TAG, {LOG_SITE_UNRESOLVED}, nullptr }; \
+            int32_t __log_level = __log_site.level.load(std::memory_order_relaxed);     \
+            if (__builtin_expect(__log_level == LOG_SITE_UNRESOLVED, 0)) {              \
+                __log_level = eular::log_site_resolve(&__log_site);                     \
+            }                                                                           \
+            if (__log_level <= (lev)) {                                                 \
+                eular::log_write_site(&__log_site, (lev), __VA_ARGS__);                 \
+            }                                                                           \
+        }                                                                               \
+        (void)0;                                                                        \
+    })
+
 #ifndef LOGD
-#define LOGD(...) ((void)eular::log_write(eular::LogLevel::Level::LEVEL_DEBUG, LOG_TAG, __VA_ARGS__))
+#define LOGD(...) LOG_SITE_WRITE(eular::LogLevel::Level::LEVEL_DEBUG, __VA_ARGS__)
 #endif
 
 #ifndef LOGI
-#define LOGI(...) ((void)eular::log_write(eular::LogLevel::Level::LEVEL_INFO, LOG_TAG, __VA_ARGS__))
+#define LOGI(...) LOG_SITE_WRITE(eular::LogLevel::Level::LEVEL_INFO, __VA_ARGS__)
 #endif
 
 #ifndef LOGW
-#define LOGW(...) ((void)eular::log_write(eular::LogLevel::Level::LEVEL_WARN, LOG_TAG, __VA_ARGS__))
+#define LOGW(...) LOG_SITE_WRITE(eular::LogLevel::Level::LEVEL_WARN, __VA_ARGS__)
 #endif
 
 #ifndef LOGE
-#define LOGE(...) ((void)eular::log_write(eular::LogLevel::Level::LEVEL_ERROR, LOG_TAG, __VA_ARGS__))
+#define LOGE(...) LOG_SITE_WRITE(eular::LogLevel::Level::LEVEL_ERROR, __VA_ARGS__)
 #endif
 
 #ifndef LOGF
-#define LOGF(...) ((void)eular::log_write(eular::LogLevel::Level::LEVEL_FATAL, LOG_TAG, __VA_ARGS__))
+#define LOGF(...) LOG_SITE_WRITE(eular::LogLevel::Level::LEVEL_FATAL, __VA_ARGS__)
+#endif
+
+/**
+ * 限流输出, 每个调用点独立计数, 级别不足时不参与计数.
+ * LOGx_EVERY_N(n, ...):           每n条输出一条
+ * LOGx_EVERY_MS(ms, ...):         两条之间至少间隔ms毫秒
+ * LOGx_RATE_LIMIT(rate, burst, ...): 令牌桶, 每秒rate条, 允许burst条突发
+ * 丢弃的条数由后台线程每秒以"suppressed N messages"汇总, 级别与tag同该调用点; Flush()与进程退出时也会汇总
+ */
+#define LOG_SITE_LIMIT(lev, pass, ...)                                                  \
+    ({                                                                                  \
+        if (eular::LogMinLevel::value <= (lev)) {                                       \
+            static eular::LogSite __log_site = { LOG_TAG, {LOG_SITE_UNRESOLVED}, nullptr }; \
+            static eular::LogLimit __log_limit = { {0}, {0}, {false}, nullptr, 0, nullptr }; \
+            int32_t __log_level = __log_site.level.load(std::memory_order_relaxed);     \
+            if (__builtin_expect(__log_level == LOG_SITE_UNRESOLVED, 0)) {              \
+                __log_level = eular::log_site_resolve(&__log_site);                     \
+            }                                                                           \
+            if (__log_level <= (lev) && (pass)) {                                       \
+                eular::log_write_limit(&__log_site, &__log_limit, (lev), __VA_ARGS__);  \
+            }                                                                           \
+        }                                                                               \
+        (void)0;                                                                        \
+    })
+
+#define LOG_EVERY_N(lev, n, ...) \
+    LOG_SITE_LIMIT(lev, eular::log_limit_every_n(&__log_limit, (n)), __VA_ARGS__)
+#define LOG_EVERY_MS(lev, ms, ...) \
+    LOG_SITE_LIMIT(lev, eular::log_limit_every_ms(&__log_limit, (ms)), __VA_ARGS__)
+#define LOG_RATE_LIMIT(lev, rate, burst, ...) \
+    LOG_SITE_LIMIT(lev, eular::log_limit_rate(&__log_limit, (rate), (burst)), __VA_ARGS__)
+
+#ifndef LOGD_EVERY_N
+#define LOGD_EVERY_N(n, ...) LOG_EVERY_N(eular::LogLevel::Level::LEVEL_DEBUG, n, __VA_ARGS__)
+#define LOGD_EVERY_MS(ms, ...) LOG_EVERY_MS(eular::LogLevel::Level::LEVEL_DEBUG, ms, __VA_ARGS__)
+#define LOGD_RATE_LIMIT(rate, burst, ...) LOG_RATE_LIMIT(eular::LogLevel::Level::LEVEL_DEBUG, rate, burst, __VA_ARGS__)
+#endif
+
+#ifndef LOGI_EVERY_N
+#define LOGI_EVERY_N(n, ...) LOG_EVERY_N(eular::LogLevel::Level::LEVEL_INFO, n, __VA_ARGS__)
+#define LOGI_EVERY_MS(ms, ...) LOG_EVERY_MS(eular::LogLevel::Level::LEVEL_INFO, ms, __VA_ARGS__)
+#define LOGI_RATE_LIMIT(rate, burst, ...) LOG_RATE_LIMIT(eular::LogLevel::Level::LEVEL_INFO, rate, burst, __VA_ARGS__)
+#endif
+
+#ifndef LOGW_EVERY_N
+#define LOGW_EVERY_N(n, ...) LOG_EVERY_N(eular::LogLevel::Level::LEVEL_WARN, n, __VA_ARGS__)
+#define LOGW_EVERY_MS(ms, ...) LOG_EVERY_MS(eular::LogLevel::Level::LEVEL_WARN, ms, __VA_ARGS__)
+#define LOGW_RATE_LIMIT(rate, burst, ...) LOG_RATE_LIMIT(eular::LogLevel::Level::LEVEL_WARN, rate, burst, __VA_ARGS__)
+#endif
+
+#ifndef LOGE_EVERY_N
+#define LOGE_EVERY_N(n, ...) LOG_EVERY_N(eular::LogLevel::Level::LEVEL_ERROR, n, __VA_ARGS__)
+#define LOGE_EVERY_MS(ms, ...) LOG_EVERY_MS(eular::LogLevel::Level::LEVEL_ERROR, ms, __VA_ARGS__)
+#define LOGE_RATE_LIMIT(rate, burst, ...) LOG_RATE_LIMIT(eular::LogLevel::Level::LEVEL_ERROR, rate, burst, __VA_ARGS__)
+#endif
+
+#ifndef LOGF_EVERY_N
+#define LOGF_EVERY_N(n, ...) LOG_EVERY_N(eular::LogLevel::Level::LEVEL_FATAL, n, __VA_ARGS__)
+#define LOGF_EVERY_MS(ms, ...) LOG_EVERY_MS(eular::LogLevel::Level::LEVEL_FATAL, ms, __VA_ARGS__)
+#define LOGF_RATE_LIMIT(rate, burst, ...) LOG_RATE_LIMIT(eular::LogLevel::Level::LEVEL_FATAL, rate, burst, __VA_ARGS__)
+#endif
+
+/**
+ * 结构化日志: LOGI_KV("request done", "latency_us", lat, "status", code)
+ * 消息与键为字符串常量, 值可以是整数、浮点、bool、枚举、C字符串或std::string, 调用点不做格式化.
+ * 文本输出节点渲染为"request done latency_us=12 status=200", CONSOLEOUT与BINOUT保留字段类型.
+ * 级别判断与LOGx相同, 级别不足时不求值参数
+ */
+#define LOG_SITE_WRITE_KV(lev, msg, ...)                                                \
+    ({                                                                                  \
+        if (eular::LogMinLevel::value <= (lev)) {                                       \
+            static eular::LogSite __log_site = { LOG_TAG, {LOG_SITE_UNRESOLVED}, nullptr }; \
+            int32_t __log_level = __log_site.level.load(std::memory_order_relaxed);     \
+            if (__builtin_expect(__log_level == LOG_SITE_UNRESOLVED, 0)) {              \
+                __log_level = eular::log_site_resolve(&__log_site);                     \
+            }                                                                           \
+            if (__log_level <= (lev)) {                                                 \
+                eular::log_write_kv(&__log_site, (lev), (msg), ##__VA_ARGS__);          \
+            }                                                                           \
+        }                                                                               \
+        (void)0;                                                                        \
+    })
+
+#ifndef LOGD_KV
+#define LOGD_KV(msg, ...) LOG_SITE_WRITE_KV(eular::LogLevel::Level::LEVEL_DEBUG, msg, ##__VA_ARGS__)
+#define LOGI_KV(msg, ...) LOG_SITE_WRITE_KV(eular::LogLevel::Level::LEVEL_INFO, msg, ##__VA_ARGS__)
+#define LOGW_KV(msg, ...) LOG_SITE_WRITE_KV(eular::LogLevel::Level::LEVEL_WARN, msg, ##__VA_ARGS__)
+#define LOGE_KV(msg, ...) LOG_SITE_WRITE_KV(eular::LogLevel::Level::LEVEL_ERROR, msg, ##__VA_ARGS__)
+#define LOGF_KV(msg, ...) LOG_SITE_WRITE_KV(eular::LogLevel::Level::LEVEL_FATAL, msg, ##__VA_ARGS__)
 #endif
 
 #ifndef LOG_ASSERT
@@ -35,6 +156,10 @@
 #endif
 
 namespace eular {
+// 在LogLevel作用域内展开EULAR_LOG_MIN_LEVEL, 使LEVEL_INFO这类写法可用
+struct LogMinLevel : public LogLevel {
+    static constexpr int32_t value = EULAR_LOG_MIN_LEVEL;
+};
 
 namespace log {
 /**
@@ -42,16 +167,50 @@ namespace log {
  * @param lev 最小输出级别
  */
 void InitLog(LogLevel::Level lev = LogLevel::LEVEL_DEBUG);
+/**
+ * @brief 以异步模式初始化日志, 日志由后台线程批量格式化并写入输出节点
+ *
+ * @param lev 最小输出级别
+ * @param opt 队列容量、批大小及队列满时的处理策略
+ */
+void InitLog(LogLevel::Level lev, const AsyncOptions &opt);
+/**
+ * @brief 获取异步模式下的入队/丢弃统计, 同步模式下全部为0
+ */
+void GetAsyncStats(AsyncStats &stats);
 /**
  * @param lev 设置最小输出级别
  */
 void SetLevel(LogLevel::Level lev);
+// 按tag设置级别见log_tag.h: SetTagLevel/ResetTagLevel/GetTagLevel
 
 /**
  * @brief 设置日志输出路径。建议使用全局路径, 使用相对路径时取决于bash执行时的路径, 相对不稳定
  */
 void SetPath(const char *path);
 
+/**
+ * @brief 开启文件输出的批量写入, 日志缓存到maxBytes或停留超过maxDelayMs后一次写入.
+ *        FATAL级别日志、Flush及程序退出时会立即写出
+ *
+ * @param maxBytes 缓存大小, 为0时关闭批量写入
+ * @param maxDelayMs 最长延迟
+ */
+void SetFileBatch(uint32_t maxBytes = FILE_BATCH_BYTES, uint32_t maxDelayMs = FILE_BATCH_DELAY_MS);
+
+/**
+ * @brief 设置文件输出的切换与保留策略. 新文件由后台线程预先创建, 切换出的文件在后台关闭、
+ *        压缩(可选), 并按文件数与总大小删除最旧的文件, 写日志的线程不会等待这些文件操作
+ *
+ * @param policy 默认5MB切换, 不按时间切换, 不压缩, 不删除旧文件
+ */
+void SetFileRotate(const LogRotatePolicy &policy);
+
+/**
+ * @brief 将异步队列及各输出节点缓存中的日志全部写出
+ */
+void Flush();
+
 /**
  * @brief 使输出在stdout的日志携带颜色
  * 
@@ -60,17 +219,36 @@ void SetPath(const char *path);
 void EnableLogColor(bool flag);
 
 /**
- * @param type 输出节点类型；STDOUT，FILEOUT，CONSOLEOUT.
+ * @brief 使用CLOCK_REALTIME_COARSE获取日志时间, 开销更低, 精度为内核时钟节拍(通常1~4ms)
+ *
+ * @param flag
+ */
+void EnableCoarseClock(bool flag);
+
+/**
+ * @param type 输出节点类型；STDOUT，FILEOUT，CONSOLEOUT，MMAPOUT，BINOUT，SHMOUT.
  */
 void addOutputNode(int32_t type);
 /**
- * @param type 输出节点类型；STDOUT，FILEOUT，CONSOLEOUT.
+ * @param type 输出节点类型；STDOUT，FILEOUT，CONSOLEOUT，MMAPOUT，BINOUT，SHMOUT.
  */
 void delOutputNode(int32_t type);
 }
 
 void log_write(int32_t level, const char *tag, const char *fmt, ...) __attribute__((format(printf, 3, 4)));
+void log_write_site(LogSite *site, int32_t level, const char *fmt, ...) __attribute__((format(printf, 3, 4)));
 void log_write_assert(int32_t level, const char *expr, const char *tag, const char *fmt, ...) __attribute__((format(printf, 4, 5)));
+void log_write_fields(LogSite *site, int32_t level, const char *msg, const LogField *fields, uint32_t count);
+
+template <typename... Args>
+static inline void log_write_kv(LogSite *site, int32_t level, const char *msg, const Args &... args)
+{
+    static_assert(sizeof...(Args) % 2 == 0, "LOGx_KV expects key, value pairs");
+    static_assert(sizeof...(Args) / 2 <= LOG_FIELD_MAX, "too many fields in LOGx_KV");
+    LogField fields[sizeof...(Args) / 2 + 1];
+    uint32_t count = LogFieldFill(fields, args...);
+    log_write_fields(site, level, msg, fields, count);
+}
 
 }
 
@@ -0,0 +1,403 @@
+/*************************************************************************
+    > File Name: log_async.cpp
+    > Author: hsz
+    > Brief:
+    > Created Time: 2026年10月18日 星期日 10时12分30秒
+ ************************************************************************/
+
+#include "log_async.h"
+#include "log_main.h"
+#include "log_crash.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <sched.h>
+#include <unistd.h>
+#include <new>
+
+#define SPIN_BEFORE_SLEEP   (64)
+
+namespace eular {
+static uint64_t RoundUpPowerOf2(uint64_t v)
+{
+    uint64_t size = 2;
+    while (size < v) {
+        size <<= 1;
+    }
+    return size;
+}
+
+AsyncLogger::AsyncLogger(const AsyncOptions &opt) :
+    mOptions(opt),
+    mSlots(nullptr),
+    mMask(0),
+    mBatch(nullptr),
+    mEnqueuePos(0),
+    mDequeuePos(0),
+    mSleeping(false),
+    mRunning(false),
+    mExit(false),
+    mEnqueued(0),
+    mWritten(0),
+    mStarted(false)
+{
+    for (int32_t i = 0; i < ASYNC_LEVEL_COUNT; ++i) {
+        mDropped[i].store(0, std::memory_order_relaxed);
+    }
+
+    if (mOptions.batchSize == 0) {
+        mOptions.batchSize = ASYNC_DEFAULT_BATCH;
+    }
+    if (mOptions.flushIntervalMs == 0) {
+        mOptions.flushIntervalMs = 1;
+    }
+
+    uint64_t capacity = RoundUpPowerOf2(mOptions.queueSize ? mOptions.queueSize : ASYNC_DEFAULT_QUEUE);
+    mSlots = (LogSlot *)malloc(sizeof(LogSlot) * capacity);
+    mBatch = (LogEvent **)malloc(sizeof(LogEvent *) * mOptions.batchSize);
+    if (mSlots != nullptr) {
+        mMask = capacity - 1;
+        for (uint64_t i = 0; i < capacity; ++i) {
+            new (&mSlots[i].seq) std::atomic<uint64_t>(i);
+            mSlots[i].heapMsg = nullptr;
+            mSlots[i].ev.fields = nullptr;
+        }
+    }
+
+    pthread_mutex_init(&mMutex, nullptr);
+    pthread_mutex_init(&mDrainMutex, nullptr);
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&mCond, &attr);
+    pthread_condattr_destroy(&attr);
+}
+
+AsyncLogger::~AsyncLogger()
+{
+    stop();
+    free(mSlots);
+    free(mBatch);
+    pthread_cond_destroy(&mCond);
+    pthread_mutex_destroy(&mMutex);
+    pthread_mutex_destroy(&mDrainMutex);
+}
+
+bool AsyncLogger::start()
+{
+    if (mStarted) {
+        return true;
+    }
+    if (mSlots == nullptr || mBatch == nullptr) {
+        return false;
+    }
+
+    mExit.store(false, std::memory_order_release);
+    if (pthread_create(&mThread, nullptr, WorkThread, this) != 0) {
+        perror("pthread_create error");
+        return false;
+    }
+
+    mStarted = true;
+    mRunning.store(true, std::memory_order_release);
+    return true;
+}
+
+void AsyncLogger::stop()
+{
+    mRunning.store(false, std::memory_order_release);
+    if (!mStarted) {
+        return;
+    }
+
+    mExit.store(true, std::memory_order_release);
+    pthread_mutex_lock(&mMutex);
+    pthread_cond_signal(&mCond);
+    pthread_mutex_unlock(&mMutex);
+    pthread_join(mThread, nullptr);
+    mStarted = false;
+
+    // 写线程退出时仍在写入的生产者
+    drain();
+}
+
+void AsyncLogger::detachAfterFork()
+{
+    pthread_mutex_unlock(&mDrainMutex);
+    mRunning.store(false, std::memory_order_release);
+    mStarted = false;
+
+    // 父进程写线程可能正在等待, 继承的锁与条件变量状态在子进程内无效
+    pthread_mutex_init(&mMutex, nullptr);
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&mCond, &attr);
+    pthread_condattr_destroy(&attr);
+}
+
+bool AsyncLogger::push(const LogEvent &ev, const char *fmt, va_list ap)
+{
+    uint64_t pos = 0;
+    LogSlot *slot = claim(ev.level, pos);
+    if (slot == nullptr) {
+        if (ev.level >= LogLevel::LEVEL_DEBUG && ev.level < ASYNC_LEVEL_COUNT) {
+            mDropped[ev.level].fetch_add(1, std::memory_order_relaxed);
+        }
+        return false;
+    }
+
+    memcpy(&slot->ev, &ev, sizeof(LogEvent));
+    slot->heapMsg = nullptr;
+
+    va_list tmpArgs;
+    va_copy(tmpArgs, ap);
+    int32_t n = vsnprintf(slot->msg, ASYNC_INLINE_MSG_SIZE - 1, fmt, tmpArgs);
+    va_end(tmpArgs);
+
+    char *out = slot->msg;
+    if (n < 0) {
+        n = 0;
+        out[0] = '\0';
+    } else if (n >= ASYNC_INLINE_MSG_SIZE - 1) {
+        // 预留\n\0
+        slot->heapMsg = (char *)malloc(n + 2);
+        if (slot->heapMsg != nullptr) {
+            out = slot->heapMsg;
+            vsnprintf(out, n + 1, fmt, ap);
+        } else {
+            n = ASYNC_INLINE_MSG_SIZE - 2;
+        }
+    }
+
+    if (n > 0 && out[n - 1] != '\n') {
+        out[n++] = '\n';
+        out[n] = '\0';
+    }
+    slot->ev.msg = out;
+    slot->ev.fields = nullptr;
+    slot->ev.fieldCount = 0;
+    // 在发布前记录, 崩溃时队列中未写出的日志也能输出
+    log_crash_record(slot->ev, out, n);
+
+    publish(slot, pos);
+    return true;
+}
+
+bool AsyncLogger::push(const LogEvent &ev)
+{
+    uint64_t pos = 0;
+    LogSlot *slot = claim(ev.level, pos);
+    if (slot == nullptr) {
+        if (ev.level >= LogLevel::LEVEL_DEBUG && ev.level < ASYNC_LEVEL_COUNT) {
+            mDropped[ev.level].fetch_add(1, std::memory_order_relaxed);
+        }
+        return false;
+    }
+
+    memcpy(&slot->ev, &ev, sizeof(LogEvent));
+    slot->heapMsg = nullptr;
+
+    size_t n = strlen(ev.msg);
+    char *out = slot->msg;
+    if (n >= ASYNC_INLINE_MSG_SIZE) {
+        slot->heapMsg = (char *)malloc(n + 1);
+        if (slot->heapMsg != nullptr) {
+            out = slot->heapMsg;
+        } else {
+            n = ASYNC_INLINE_MSG_SIZE - 1;
+        }
+    }
+    memcpy(out, ev.msg, n);
+    out[n] = '\0';
+    slot->ev.msg = out;
+
+    // 字段引用调用方的栈与字符串, 拷贝到一块内存中, 由写线程释放
+    slot->ev.fields = nullptr;
+    slot->ev.fieldCount = 0;
+    if (ev.fieldCount > 0) {
+        LogField *fields = LogFieldCodec::Clone(ev.fields, ev.fieldCount);
+        if (fields != nullptr) {
+            slot->ev.fields = fields;
+            slot->ev.fieldCount = ev.fieldCount;
+        }
+    }
+    log_crash_record(slot->ev, out, n);
+
+    publish(slot, pos);
+    return true;
+}
+
+void AsyncLogger::publish(LogSlot *slot, uint64_t pos)
+{
+    slot->seq.store(pos + 1, std::memory_order_release);
+    mEnqueued.fetch_add(1, std::memory_order_relaxed);
+
+    // 与写线程的mSleeping形成Dekker同步, 保证至少一方能看到对方
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (mSleeping.load(std::memory_order_relaxed)) {
+        pthread_mutex_lock(&mMutex);
+        pthread_cond_signal(&mCond);
+        pthread_mutex_unlock(&mMutex);
+    }
+}
+
+bool AsyncLogger::flush(uint32_t timeoutMs)
+{
+    if (!mStarted) {
+        return true;
+    }
+
+    uint64_t target = mEnqueuePos.load(std::memory_order_acquire);
+    pthread_mutex_lock(&mMutex);
+    pthread_cond_signal(&mCond);
+    pthread_mutex_unlock(&mMutex);
+
+    struct timespec begin, now;
+    clock_gettime(CLOCK_MONOTONIC, &begin);
+    while (mDequeuePos.load(std::memory_order_acquire) < target) {
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        uint64_t elapsedMs = (now.tv_sec - begin.tv_sec) * 1000 + (now.tv_nsec - begin.tv_nsec) / 1000000;
+        if (elapsedMs >= timeoutMs) {
+            return false;
+        }
+        usleep(100);
+    }
+
+    return true;
+}
+
+void AsyncLogger::stats(AsyncStats &out) const
+{
+    out.enqueued = mEnqueued.load(std::memory_order_relaxed);
+    out.written = mWritten.load(std::memory_order_relaxed);
+    out.dropped = 0;
+    for (int32_t i = 0; i < ASYNC_LEVEL_COUNT; ++i) {
+        out.droppedByLevel[i] = mDropped[i].load(std::memory_order_relaxed);
+        out.dropped += out.droppedByLevel[i];
+    }
+}
+
+AsyncLogger::LogSlot *AsyncLogger::claim(int32_t level, uint64_t &pos)
+{
+    const bool dropDebug = mOptions.policy == AsyncOptions::DROP_DEBUG_FIRST && level <= LogLevel::LEVEL_DEBUG;
+    const uint64_t highWater = (mMask + 1) - ((mMask + 1) >> 2);
+    uint32_t spin = 0;
+
+    pos = mEnqueuePos.load(std::memory_order_relaxed);
+    for (;;) {
+        LogSlot *slot = &mSlots[pos & mMask];
+        uint64_t seq = slot->seq.load(std::memory_order_acquire);
+        int64_t dif = (int64_t)seq - (int64_t)pos;
+        if (dif == 0) {
+            if (dropDebug && pos - mDequeuePos.load(std::memory_order_relaxed) >= highWater) {
+                return nullptr;
+            }
+            if (mEnqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                return slot;
+            }
+        } else if (dif < 0) {
+            // 队列已满
+            if (mOptions.policy == AsyncOptions::DROP_NEWEST || dropDebug) {
+                return nullptr;
+            }
+            if (mExit.load(std::memory_order_relaxed)) {
+                return nullptr;
+            }
+
+            if (++spin < SPIN_BEFORE_SLEEP) {
+                sched_yield();
+            } else {
+                pthread_mutex_lock(&mMutex);
+                pthread_cond_signal(&mCond);
+                pthread_mutex_unlock(&mMutex);
+                usleep(50);
+            }
+            pos = mEnqueuePos.load(std::memory_order_relaxed);
+        } else {
+            pos = mEnqueuePos.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+bool AsyncLogger::hasPending() const
+{
+    uint64_t pos = mDequeuePos.load(std::memory_order_relaxed);
+    return mSlots[pos & mMask].seq.load(std::memory_order_acquire) == pos + 1;
+}
+
+uint32_t AsyncLogger::drain()
+{
+    uint64_t pos = mDequeuePos.load(std::memory_order_relaxed);
+    uint32_t count = 0;
+    while (count < mOptions.batchSize) {
+        LogSlot *slot = &mSlots[(pos + count) & mMask];
+        if (slot->seq.load(std::memory_order_acquire) != pos + count + 1) {
+            break;
+        }
+        mBatch[count++] = &slot->ev;
+    }
+
+    if (count == 0) {
+        return 0;
+    }
+
+    LogManager *manager = LogManager::getInstance();
+    if (manager != nullptr) {
+        manager->WriteLog(mBatch, count);
+    }
+
+    for (uint32_t i = 0; i < count; ++i) {
+        LogSlot *slot = &mSlots[(pos + i) & mMask];
+        if (slot->heapMsg != nullptr) {
+            free(slot->heapMsg);
+            slot->heapMsg = nullptr;
+        }
+        if (slot->ev.fields != nullptr) {
+            free((void *)slot->ev.fields);
+            slot->ev.fields = nullptr;
+        }
+        slot->seq.store(pos + i + mMask + 1, std::memory_order_release);
+    }
+
+    mDequeuePos.store(pos + count, std::memory_order_release);
+    mWritten.fetch_add(count, std::memory_order_relaxed);
+    return count;
+}
+
+void *AsyncLogger::WorkThread(void *arg)
+{
+    AsyncLogger *self = static_cast<AsyncLogger *>(arg);
+
+    for (;;) {
+        pthread_mutex_lock(&self->mDrainMutex);
+        uint32_t count = self->drain();
+        pthread_mutex_unlock(&self->mDrainMutex);
+        if (count > 0) {
+            continue;
+        }
+
+        if (self->mExit.load(std::memory_order_acquire)) {
+            break;
+        }
+
+        pthread_mutex_lock(&self->mMutex);
+        self->mSleeping.store(true, std::memory_order_seq_cst);
+        if (!self->hasPending() && !self->mExit.load(std::memory_order_acquire)) {
+            struct timespec ts;
+            clock_gettime(CLOCK_MONOTONIC, &ts);
+            ts.tv_nsec += (long)self->mOptions.flushIntervalMs * 1000000;
+            ts.tv_sec += ts.tv_nsec / 1000000000;
+            ts.tv_nsec %= 1000000000;
+            pthread_cond_timedwait(&self->mCond, &self->mMutex, &ts);
+        }
+        self->mSleeping.store(false, std::memory_order_relaxed);
+        pthread_mutex_unlock(&self->mMutex);
+    }
+
+    return nullptr;
+}
+
+} // namespace eular
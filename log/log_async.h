@@ -0,0 +1,128 @@
+/*************************************************************************
+    > File Name: log_async.h
+    > Author: hsz
+    > Brief: 异步日志: 多生产者无锁环形队列 + 后台写线程
+    > Created Time: 2026年10月18日 星期日 10时12分30秒
+ ************************************************************************/
+
+#ifndef __LOG_ASYNC_H__
+#define __LOG_ASYNC_H__
+
+#include "log_event.h"
+#include "log_level.h"
+#include <stdarg.h>
+#include <stdint.h>
+#include <atomic>
+#include <pthread.h>
+
+#define ASYNC_INLINE_MSG_SIZE   (256)       // 槽内联消息缓存, 超出时使用堆内存
+#define ASYNC_DEFAULT_QUEUE     (4096)
+#define ASYNC_DEFAULT_BATCH     (128)
+#define ASYNC_LEVEL_COUNT       (LogLevel::LEVEL_FATAL + 1)
+
+namespace eular {
+struct AsyncOptions {
+    enum OverflowPolicy {
+        BLOCK               = 0,    // 队列满时生产者等待
+        DROP_NEWEST         = 1,    // 队列满时丢弃当前日志
+        DROP_DEBUG_FIRST    = 2,    // 队列超过3/4时丢弃DEBUG日志, 其余级别满时等待
+    };
+
+    uint32_t        queueSize;          // 队列容量, 向上取整为2的幂
+    uint32_t        batchSize;          // 写线程单次最多处理的日志条数
+    uint32_t        flushIntervalMs;    // 写线程空闲时的最长休眠时间
+    OverflowPolicy  policy;
+
+    AsyncOptions() :
+        queueSize(ASYNC_DEFAULT_QUEUE),
+        batchSize(ASYNC_DEFAULT_BATCH),
+        flushIntervalMs(10),
+        policy(BLOCK)
+    {
+    }
+};
+
+struct AsyncStats {
+    uint64_t    enqueued;                           // 成功入队数
+    uint64_t    written;                            // 写线程已处理数
+    uint64_t    dropped;                            // 丢弃总数
+    uint64_t    droppedByLevel[ASYNC_LEVEL_COUNT];  // 各级别丢弃数
+};
+
+class AsyncLogger {
+public:
+    AsyncLogger(const AsyncOptions &opt);
+    ~AsyncLogger();
+
+    AsyncLogger(const AsyncLogger&) = delete;
+    AsyncLogger& operator=(const AsyncLogger&) = delete;
+
+    bool start();
+    // 处理完队列中剩余日志后退出写线程
+    void stop();
+    bool running() const { return mRunning.load(std::memory_order_acquire); }
+
+    /**
+     * @brief 将日志写入队列, 消息直接格式化到槽内
+     *
+     * @param ev 已填充时间/pid/tid/level/tag的日志事件, msg字段被忽略
+     * @return 入队成功返回true, 被丢弃返回false
+     */
+    bool push(const LogEvent &ev, const char *fmt, va_list ap);
+    // 写入已有消息的日志(结构化日志), 消息与字段拷贝到槽内
+    bool push(const LogEvent &ev);
+
+    // 等待写线程处理完当前已入队的日志, 超时返回false
+    bool flush(uint32_t timeoutMs = 1000);
+    void stats(AsyncStats &out) const;
+
+    // fork前等待写线程处理完当前批次, 防止子进程继承其持有的锁(如localtime的时区锁)
+    void prepareFork() { pthread_mutex_lock(&mDrainMutex); }
+    void parentAfterFork() { pthread_mutex_unlock(&mDrainMutex); }
+    // fork后子进程内无写线程, 切换为同步模式
+    void detachAfterFork();
+
+private:
+    struct LogSlot {
+        std::atomic<uint64_t>   seq;
+        LogEvent                ev;
+        char *                  heapMsg;
+        char                    msg[ASYNC_INLINE_MSG_SIZE];
+    };
+
+    LogSlot *   claim(int32_t level, uint64_t &pos);
+    void        publish(LogSlot *slot, uint64_t pos);
+    bool        hasPending() const;
+    uint32_t    drain();
+    static void *WorkThread(void *arg);
+
+private:
+    AsyncOptions            mOptions;
+    LogSlot *               mSlots;
+    uint64_t                mMask;
+    LogEvent **             mBatch;
+
+    // 生产者与写线程各自修改的位置分开存放, 避免伪共享
+    char                    mPad0[64];
+    std::atomic<uint64_t>   mEnqueuePos;
+    char                    mPad1[64];
+    std::atomic<uint64_t>   mDequeuePos;
+    char                    mPad2[64];
+    std::atomic<bool>       mSleeping;
+    std::atomic<bool>       mRunning;
+    std::atomic<bool>       mExit;
+
+    std::atomic<uint64_t>   mEnqueued;
+    std::atomic<uint64_t>   mWritten;
+    std::atomic<uint64_t>   mDropped[ASYNC_LEVEL_COUNT];
+
+    bool                    mStarted;
+    pthread_t               mThread;
+    pthread_mutex_t         mMutex;
+    pthread_mutex_t         mDrainMutex;    // 写线程处理批次时持有
+    pthread_cond_t          mCond;
+};
+
+} // namespace eular
+
+#endif // __LOG_ASYNC_H__
@@ -0,0 +1,637 @@
+/*************************************************************************
+    > File Name: log_binary.cpp
+    > Author: hsz
+    > Brief:
+    > Created Time: 2026年10月18日 星期日 13时05分12秒
+ ************************************************************************/
+
+#include "log_binary.h"
+#include <ctype.h>
+#include <errno.h>
+#include <string.h>
+#include <stdlib.h>
+
+#define DICT_INIT_CAPACITY  (256)
+
+namespace eular {
+// 单个转换说明, 如"%-8.*lld"
+struct FormatSpec {
+    const char *    begin;          // '%'
+    const char *    lengthBegin;    // 长度修饰符起始
+    const char *    lengthEnd;
+    const char *    end;            // 转换字符之后
+    int32_t         stars;          // 宽度与精度中'*'的个数
+    int32_t         precision;      // 数字精度, -1表示未指定
+    bool            precisionStar;
+    bool            wide;           // l ll j z t q, 按8字节保存
+    bool            longDouble;     // L
+    char            conv;
+};
+
+static bool ParseSpec(const char *p, FormatSpec &spec)
+{
+    spec.begin = p++;
+    spec.stars = 0;
+    spec.precision = -1;
+    spec.precisionStar = false;
+    spec.wide = false;
+    spec.longDouble = false;
+
+    while (*p != '\0' && strchr("-+ #0'I", *p) != nullptr) {
+        ++p;
+    }
+    if (*p == '*') {
+        ++spec.stars;
+        ++p;
+    } else {
+        while (isdigit((unsigned char)*p)) {
+            ++p;
+        }
+    }
+    if (*p == '$') {
+        // 位置参数
+        return false;
+    }
+    if (*p == '.') {
+        ++p;
+        if (*p == '*') {
+            ++spec.stars;
+            spec.precisionStar = true;
+            ++p;
+        } else {
+            spec.precision = 0;
+            while (isdigit((unsigned char)*p)) {
+                spec.precision = spec.precision * 10 + (*p - '0');
+                ++p;
+            }
+        }
+    }
+    if (*p == '$') {
+        return false;
+    }
+
+    spec.lengthBegin = p;
+    switch (*p) {
+    case 'h':
+        p += (p[1] == 'h') ? 2 : 1;
+        break;
+    case 'l':
+        p += (p[1] == 'l') ? 2 : 1;
+        spec.wide = true;
+        break;
+    case 'q':
+    case 'j':
+    case 'z':
+    case 'Z':
+    case 't':
+        ++p;
+        spec.wide = true;
+        break;
+    case 'L':
+        ++p;
+        spec.longDouble = true;
+        break;
+    default:
+        break;
+    }
+    spec.lengthEnd = p;
+    spec.conv = *p;
+    if (*p == '\0') {
+        return false;
+    }
+    spec.end = p + 1;
+    if (spec.longDouble && strchr("diouxX", spec.conv) != nullptr) {
+        // glibc中%Ld等同于%lld
+        spec.wide = true;
+    }
+
+    switch (spec.conv) {
+    case 'd': case 'i': case 'o': case 'u': case 'x': case 'X':
+    case 'e': case 'E': case 'f': case 'F': case 'g': case 'G': case 'a': case 'A':
+    case 'p': case '%':
+        return true;
+    case 'c':
+    case 's':
+        // %lc %ls 为宽字符, 其他长度修饰无意义
+        return spec.lengthBegin == spec.lengthEnd;
+    default:
+        // %n %m %C %S 等
+        return false;
+    }
+}
+
+static inline void Put(LogBuffer &out, const void *data, size_t len)
+{
+    char *tail = out.tail(len);
+    if (tail != nullptr) {
+        memcpy(tail, data, len);
+        out.commit(len);
+    }
+}
+
+void BinaryCodec::EncodeString(LogBuffer &out, const char *str, size_t len)
+{
+    if (len > BINARY_MAX_STRING) {
+        len = BINARY_MAX_STRING;
+    }
+    uint32_t size = len;
+    Put(out, &size, sizeof(size));
+    Put(out, str, len);
+}
+
+bool BinaryCodec::EncodeArgs(LogBuffer &out, const char *fmt, va_list ap)
+{
+    const char *p = fmt;
+    while ((p = strchr(p, '%')) != nullptr) {
+        FormatSpec spec;
+        if (!ParseSpec(p, spec)) {
+            return false;
+        }
+        p = spec.end;
+        if (spec.conv == '%') {
+            continue;
+        }
+
+        int32_t star = 0;
+        for (int32_t i = 0; i < spec.stars; ++i) {
+            star = va_arg(ap, int);
+            Put(out, &star, sizeof(star));
+        }
+        if (spec.precisionStar) {
+            spec.precision = star < 0 ? -1 : star;
+        }
+
+        switch (spec.conv) {
+        case 'd':
+        case 'i':
+            if (spec.wide) {
+                int64_t value = va_arg(ap, int64_t);
+                Put(out, &value, sizeof(value));
+            } else {
+                int32_t value = va_arg(ap, int);
+                Put(out, &value, sizeof(value));
+            }
+            break;
+        case 'o':
+        case 'u':
+        case 'x':
+        case 'X':
+            if (spec.wide) {
+                uint64_t value = va_arg(ap, uint64_t);
+                Put(out, &value, sizeof(value));
+            } else {
+                uint32_t value = va_arg(ap, unsigned int);
+                Put(out, &value, sizeof(value));
+            }
+            break;
+        case 'c': {
+            int32_t value = va_arg(ap, int);
+            Put(out, &value, sizeof(value));
+            break;
+        }
+        case 'p': {
+            uint64_t value = (uintptr_t)va_arg(ap, void *);
+            Put(out, &value, sizeof(value));
+            break;
+        }
+        case 's': {
+            const char *str = va_arg(ap, const char *);
+            if (str == nullptr) {
+                str = "(null)";
+            }
+            // 指定精度时字符串可以不以\0结尾
+            size_t maxLen = BINARY_MAX_STRING;
+            if (spec.precision >= 0 && (size_t)spec.precision < maxLen) {
+                maxLen = spec.precision;
+            }
+            EncodeString(out, str, strnlen(str, maxLen));
+            break;
+        }
+        default:
+            if (spec.longDouble) {
+                long double value = va_arg(ap, long double);
+                Put(out, &value, sizeof(value));
+            } else {
+                double value = va_arg(ap, double);
+                Put(out, &value, sizeof(value));
+            }
+            break;
+        }
+    }
+
+    return true;
+}
+
+class ArgReader {
+public:
+    ArgReader(const char *data, size_t size) : mData(data), mSize(size), mPos(0) {}
+
+    template<typename T>
+    bool read(T &value)
+    {
+        if (mPos + sizeof(T) > mSize) {
+            return false;
+        }
+        memcpy(&value, mData + mPos, sizeof(T));
+        mPos += sizeof(T);
+        return true;
+    }
+
+    bool readString(std::string &value)
+    {
+        uint32_t len = 0;
+        if (!read(len) || mPos + len > mSize) {
+            return false;
+        }
+        value.assign(mData + mPos, len);
+        mPos += len;
+        return true;
+    }
+
+private:
+    const char *    mData;
+    size_t          mSize;
+    size_t          mPos;
+};
+
+template<typename T>
+static void AppendFormat(std::string &out, const char *fmt, T value)
+{
+    char buf[256];
+    int32_t n = snprintf(buf, sizeof(buf), fmt, value);
+    if (n < 0) {
+        return;
+    }
+    if ((size_t)n < sizeof(buf)) {
+        out.append(buf, n);
+        return;
+    }
+
+    size_t offset = out.size();
+    out.resize(offset + n + 1);
+    snprintf(&out[offset], n + 1, fmt, value);
+    out.resize(offset + n);
+}
+
+bool BinaryCodec::DecodeArgs(const char *fmt, const char *args, size_t size, std::string &out)
+{
+    ArgReader reader(args, size);
+    std::string sub;
+    const char *p = fmt;
+    for (;;) {
+        const char *pct = strchr(p, '%');
+        if (pct == nullptr) {
+            out.append(p);
+            break;
+        }
+        out.append(p, pct - p);
+
+        FormatSpec spec;
+        if (!ParseSpec(pct, spec)) {
+            return false;
+        }
+        p = spec.end;
+        if (spec.conv == '%') {
+            out.push_back('%');
+            continue;
+        }
+
+        // 重新组装单个转换: '*'替换为记录的数值, 长度修饰统一为参数的保存宽度
+        sub.clear();
+        for (const char *it = spec.begin; it < spec.lengthBegin; ++it) {
+            if (*it == '*') {
+                int32_t star = 0;
+                if (!reader.read(star)) {
+                    return false;
+                }
+                if (star < 0 && it[-1] == '.') {
+                    // 负精度等同于未指定
+                    sub.pop_back();
+                    continue;
+                }
+                sub += std::to_string(star);
+            } else {
+                sub.push_back(*it);
+            }
+        }
+        // 只有整数转换需要长度修饰; 浮点的%lf与%f相同, 不能写成%llf(等同于%Lf)
+        bool integer = strchr("diouxX", spec.conv) != nullptr;
+        if (integer && spec.wide) {
+            sub += "ll";
+        } else if (integer && *spec.lengthBegin == 'h') {
+            sub.append(spec.lengthBegin, spec.lengthEnd);
+        } else if (spec.longDouble && !integer && spec.conv != 'p') {
+            sub += "L";
+        }
+        sub.push_back(spec.conv);
+
+        switch (spec.conv) {
+        case 'd':
+        case 'i':
+            if (spec.wide) {
+                int64_t value = 0;
+                if (!reader.read(value)) {
+                    return false;
+                }
+                AppendFormat(out, sub.c_str(), (long long)value);
+            } else {
+                int32_t value = 0;
+                if (!reader.read(value)) {
+                    return false;
+                }
+                AppendFormat(out, sub.c_str(), (int)value);
+            }
+            break;
+        case 'o':
+        case 'u':
+        case 'x':
+        case 'X':
+            if (spec.wide) {
+                uint64_t value = 0;
+                if (!reader.read(value)) {
+                    return false;
+                }
+                AppendFormat(out, sub.c_str(), (unsigned long long)value);
+            } else {
+                uint32_t value = 0;
+                if (!reader.read(value)) {
+                    return false;
+                }
+                AppendFormat(out, sub.c_str(), (unsigned int)value);
+            }
+            break;
+        case 'c': {
+            int32_t value = 0;
+            if (!reader.read(value)) {
+                return false;
+            }
+            AppendFormat(out, sub.c_str(), (int)value);
+            break;
+        }
+        case 'p': {
+            uint64_t value = 0;
+            if (!reader.read(value)) {
+                return false;
+            }
+            AppendFormat(out, sub.c_str(), (void *)(uintptr_t)value);
+            break;
+        }
+        case 's': {
+            std::string value;
+            if (!reader.readString(value)) {
+                return false;
+            }
+            AppendFormat(out, sub.c_str(), value.c_str());
+            break;
+        }
+        default:
+            if (spec.longDouble) {
+                long double value = 0;
+                if (!reader.read(value)) {
+                    return false;
+                }
+                AppendFormat(out, sub.c_str(), value);
+            } else {
+                double value = 0;
+                if (!reader.read(value)) {
+                    return false;
+                }
+                AppendFormat(out, sub.c_str(), value);
+            }
+            break;
+        }
+    }
+
+    return true;
+}
+
+static uint64_t HashString(const char *str)
+{
+    // FNV-1a
+    uint64_t hash = 14695981039346656037ULL;
+    for (const unsigned char *p = (const unsigned char *)str; *p; ++p) {
+        hash ^= *p;
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+BinaryDictionary::BinaryDictionary() :
+    mEntries(nullptr),
+    mCapacity(0),
+    mCount(0)
+{
+}
+
+BinaryDictionary::~BinaryDictionary()
+{
+    for (uint32_t i = 0; i < mCapacity; ++i) {
+        free(mEntries[i].str);
+    }
+    free(mEntries);
+}
+
+bool BinaryDictionary::grow()
+{
+    uint32_t capacity = mCapacity ? mCapacity * 2 : DICT_INIT_CAPACITY;
+    Entry *entries = (Entry *)calloc(capacity, sizeof(Entry));
+    if (entries == nullptr) {
+        return false;
+    }
+
+    for (uint32_t i = 0; i < mCapacity; ++i) {
+        if (mEntries[i].str == nullptr) {
+            continue;
+        }
+        uint32_t index = mEntries[i].hash & (capacity - 1);
+        while (entries[index].str != nullptr) {
+            index = (index + 1) & (capacity - 1);
+        }
+        entries[index] = mEntries[i];
+    }
+
+    free(mEntries);
+    mEntries = entries;
+    mCapacity = capacity;
+    return true;
+}
+
+uint32_t BinaryDictionary::intern(const char *str, uint32_t fileGen, bool &needWrite)
+{
+    needWrite = false;
+    if ((mCount + 1) * 4 > mCapacity * 3 && !grow()) {
+        return 0;
+    }
+
+    uint64_t hash = HashString(str);
+    uint32_t index = hash & (mCapacity - 1);
+    while (mEntries[index].str != nullptr) {
+        Entry &entry = mEntries[index];
+        if (entry.hash == hash && strcmp(entry.str, str) == 0) {
+            if (entry.fileGen != fileGen) {
+                entry.fileGen = fileGen;
+                needWrite = true;
+            }
+            return entry.id;
+        }
+        index = (index + 1) & (mCapacity - 1);
+    }
+
+    char *copy = strdup(str);
+    if (copy == nullptr) {
+        return 0;
+    }
+    Entry &entry = mEntries[index];
+    entry.hash = hash;
+    entry.str = copy;
+    entry.id = ++mCount;
+    entry.fileGen = fileGen;
+    needWrite = true;
+    return entry.id;
+}
+
+BinaryLogReader::BinaryLogReader() :
+    mFile(nullptr)
+{
+}
+
+BinaryLogReader::~BinaryLogReader()
+{
+    close();
+}
+
+bool BinaryLogReader::open(const char *path)
+{
+    close();
+    mError.clear();
+    mStrings.clear();
+
+    mFile = fopen(path, "rb");
+    if (mFile == nullptr) {
+        mError = strerror(errno);
+        return false;
+    }
+
+    BinaryFileHeader header;
+    if (fread(&header, sizeof(header), 1, mFile) != 1 ||
+        memcmp(header.magic, BINARY_LOG_MAGIC, sizeof(header.magic)) != 0) {
+        mError = "not a binary log file";
+        close();
+        return false;
+    }
+    if (header.version != BINARY_LOG_VERSION) {
+        mError = "unsupported version " + std::to_string(header.version);
+        close();
+        return false;
+    }
+    if (header.headerSize > sizeof(header)) {
+        fseek(mFile, header.headerSize, SEEK_SET);
+    }
+
+    return true;
+}
+
+void BinaryLogReader::close()
+{
+    if (mFile != nullptr) {
+        fclose(mFile);
+        mFile = nullptr;
+    }
+}
+
+const std::string &BinaryLogReader::lookup(uint32_t id)
+{
+    static const std::string empty;
+    if (id < mStrings.size()) {
+        return mStrings[id];
+    }
+    return empty;
+}
+
+bool BinaryLogReader::next(LogEvent &ev, std::string &msg)
+{
+    if (mFile == nullptr) {
+        return false;
+    }
+
+    for (;;) {
+        BinaryEntryHeader entry;
+        size_t n = fread(&entry, 1, sizeof(entry), mFile);
+        if (n == 0) {
+            return false;
+        }
+        mPayload.resize(entry.length);
+        if (n != sizeof(entry) || (entry.length && fread(&mPayload[0], entry.length, 1, mFile) != 1)) {
+            // 进程崩溃时最后一条可能不完整
+            mError = "truncated entry";
+            return false;
+        }
+
+        if (entry.type == BINARY_ENTRY_STRING) {
+            uint32_t id = 0;
+            if (entry.length < sizeof(id)) {
+                mError = "bad string entry";
+                return false;
+            }
+            memcpy(&id, mPayload.data(), sizeof(id));
+            if (id >= mStrings.size()) {
+                mStrings.resize(id + 1);
+            }
+            mStrings[id].assign(mPayload.data() + sizeof(id), entry.length - sizeof(id));
+            continue;
+        }
+        if (entry.type != BINARY_ENTRY_RECORD) {
+            // 未知条目, 跳过
+            continue;
+        }
+
+        BinaryRecord record;
+        if (entry.length < sizeof(record)) {
+            mError = "bad record entry";
+            return false;
+        }
+        memcpy(&record, mPayload.data(), sizeof(record));
+
+        memset(&ev, 0, sizeof(ev));
+        ev.time.tv_sec = record.timeNs / 1000000000;
+        ev.time.tv_usec = record.timeNs % 1000000000 / 1000;
+        ev.nsec = record.timeNs % 1000000000;
+        ev.pid = record.pid;
+        ev.tid = record.tid;
+        ev.level = (LogLevel::Level)record.level;
+        if (record.tagId != 0) {
+            snprintf(ev.tag, sizeof(ev.tag), "%s", lookup(record.tagId).c_str());
+        }
+
+        msg.clear();
+        const std::string &fmt = lookup(record.fmtId);
+        if (entry.flags & BINARY_RECORD_FIELDS) {
+            const char *data = mPayload.data() + sizeof(record);
+            size_t size = entry.length - sizeof(record);
+            uint32_t fieldsLen = 0;
+            if (size < sizeof(fieldsLen)) {
+                mError = "bad field record";
+                return false;
+            }
+            memcpy(&fieldsLen, data, sizeof(fieldsLen));
+            if (size - sizeof(fieldsLen) < fieldsLen ||
+                !LogFieldCodec::Decode(data + sizeof(fieldsLen), fieldsLen, mFields)) {
+                mFields.clear();
+                msg = "<undecodable fields> ";
+            }
+            msg += fmt;
+            ev.msg = &msg[0];
+            ev.fields = mFields.data();
+            ev.fieldCount = mFields.size();
+            return true;
+        }
+        if (!BinaryCodec::DecodeArgs(fmt.c_str(), mPayload.data() + sizeof(record),
+                entry.length - sizeof(record), msg)) {
+            msg = "<undecodable record: " + fmt + ">";
+        }
+        ev.msg = &msg[0];
+        return true;
+    }
+}
+
+} // namespace eular
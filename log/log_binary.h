@@ -0,0 +1,143 @@
+/*************************************************************************
+    > File Name: log_binary.h
+    > Author: hsz
+    > Brief: 二进制日志格式: 记录只保存格式串ID与原始参数, 由logdecode离线还原文本
+    > Created Time: 2026年10月18日 星期日 13时05分12秒
+ ************************************************************************/
+
+#ifndef __LOG_BINARY_H__
+#define __LOG_BINARY_H__
+
+#include "log_event.h"
+#include "log_format.h"
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#define BINARY_LOG_MAGIC        "EULARLOG"
+#define BINARY_LOG_VERSION      (1)
+#define BINARY_MAX_STRING       (16 * 1024)     // 单个%s参数最多保存的字节数
+#define BINARY_TEXT_FORMAT      "%s"            // 无法编码参数时以文本保存
+#define BINARY_RECORD_FIELDS    (0x0001)        // 记录带结构化字段, BinaryEntryHeader::flags
+
+/**
+ * 文件布局: BinaryFileHeader + 若干条目, 每个条目为BinaryEntryHeader + length字节负载.
+ *  BINARY_ENTRY_STRING: uint32_t id + 字符串(不含\0), 在文件内首次引用前写入
+ *  BINARY_ENTRY_RECORD: BinaryRecord + 按格式串顺序编码的参数
+ *   带BINARY_RECORD_FIELDS时fmtId为原样的消息, 负载为BinaryRecord + uint32_t长度 + LogFieldCodec编码的字段
+ * 参数编码: 整数按是否带l/ll/j/z/t长度修饰保存4或8字节, 浮点8字节(%L为long double),
+ *  指针8字节, 字符串为uint32_t长度+内容, 宽度/精度的'*'各占4字节并位于参数之前.
+ * 所有数值为本机字节序.
+ */
+namespace eular {
+struct BinaryFileHeader {
+    char        magic[8];
+    uint32_t    version;
+    uint32_t    headerSize;
+};
+
+struct BinaryEntryHeader {
+    uint16_t    type;
+    uint16_t    flags;
+    uint32_t    length;
+};
+
+enum BinaryEntryType {
+    BINARY_ENTRY_STRING = 1,
+    BINARY_ENTRY_RECORD = 2,
+};
+
+struct BinaryRecord {
+    uint64_t    timeNs;
+    int32_t     pid;
+    int32_t     tid;
+    uint32_t    tagId;      // 0表示无tag的原始文本, 还原时不加前缀
+    uint32_t    fmtId;
+    int8_t      level;
+    uint8_t     reserved[3];
+};
+
+class BinaryCodec {
+public:
+    /**
+     * @brief 按printf格式串将参数编码追加到out
+     *
+     * @return 格式串含不支持的转换(%n, %m, %ls, 位置参数)时返回false, 此时out内容无效
+     */
+    static bool EncodeArgs(LogBuffer &out, const char *fmt, va_list ap);
+    // 追加一个字符串参数
+    static void EncodeString(LogBuffer &out, const char *str, size_t len);
+    // 按格式串与参数还原消息文本
+    static bool DecodeArgs(const char *fmt, const char *args, size_t size, std::string &out);
+};
+
+// 进程内字符串字典, 记录每个字符串所属的文件代数, 换文件后重新写入
+class BinaryDictionary {
+public:
+    BinaryDictionary();
+    ~BinaryDictionary();
+
+    BinaryDictionary(const BinaryDictionary&) = delete;
+    BinaryDictionary& operator=(const BinaryDictionary&) = delete;
+
+    /**
+     * @brief 查找或分配字符串ID
+     *
+     * @param fileGen 当前文件代数
+     * @param needWrite 字符串尚未写入当前文件时置为true
+     * @return 字符串ID, 从1开始; 内存不足返回0
+     */
+    uint32_t intern(const char *str, uint32_t fileGen, bool &needWrite);
+
+private:
+    struct Entry {
+        uint64_t    hash;
+        char *      str;
+        uint32_t    id;
+        uint32_t    fileGen;
+    };
+
+    bool        grow();
+
+    Entry *     mEntries;
+    uint32_t    mCapacity;
+    uint32_t    mCount;
+};
+
+// 顺序读取二进制日志文件
+class BinaryLogReader {
+public:
+    BinaryLogReader();
+    ~BinaryLogReader();
+
+    BinaryLogReader(const BinaryLogReader&) = delete;
+    BinaryLogReader& operator=(const BinaryLogReader&) = delete;
+
+    bool open(const char *path);
+    void close();
+
+    /**
+     * @brief 读取下一条日志, 字典条目在内部处理
+     *
+     * @param ev 日志事件, msg指向msg的内容, fields在下一次调用前有效
+     * @param msg 还原后的消息
+     * @return 文件结束或格式错误时返回false, 可通过error()区分
+     */
+    bool next(LogEvent &ev, std::string &msg);
+    const std::string &error() const { return mError; }
+
+private:
+    const std::string &lookup(uint32_t id);
+
+    FILE *                      mFile;
+    std::string                 mError;
+    std::string                 mPayload;
+    std::vector<std::string>    mStrings;
+    std::vector<LogField>       mFields;
+};
+
+} // namespace eular
+
+#endif // __LOG_BINARY_H__
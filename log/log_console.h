@@ -0,0 +1,115 @@
+/*************************************************************************
+    > File Name: log_console.h
+    > Author: hsz
+    > Brief: 日志进程与logcat之间本地套接字的二进制帧格式
+    > Created Time: 2026年10月18日 星期日 18时05分12秒
+ ************************************************************************/
+
+#ifndef __LOG_CONSOLE_H__
+#define __LOG_CONSOLE_H__
+
+#include "log_event.h"
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#define CONSOLE_SEP_STR         "\r\n\r\n"  // JSON消息的分隔符
+#define CONSOLE_FRAME_MAGIC     (0xEB)      // JSON消息以'{'开头, 据首字节区分两种消息
+#define CONSOLE_FRAME_VERSION   (2)
+#define CONSOLE_FRAME_MAX       (1024 * 1024)
+
+/**
+ * 连接建立后日志进程先发送JSON格式的notice, 其中"frame"为支持的帧版本;
+ * logcat回复{"id": "frame", "version": N}后日志进程改为发送不高于N版本的二进制帧, 未回复的旧版logcat仍收到JSON.
+ * 帧为ConsoleFrameHeader + tag + msg, 版本2起之后为LogFieldCodec编码的fieldCount个字段(帧的剩余部分),
+ * 只在本机传输, 字段为本机字节序.
+ */
+namespace eular {
+enum ConsoleFrameType {
+    CONSOLE_FRAME_LOG = 1,
+};
+
+struct ConsoleFrameHeader {
+    uint8_t     magic;
+    uint8_t     version;
+    uint8_t     type;
+    int8_t      level;
+    uint32_t    length;     // 帧总长度, 含头部
+    uint64_t    timeMs;
+    int32_t     pid;
+    int32_t     tid;
+    uint16_t    tagLen;
+    uint16_t    fieldCount; // 版本1中为保留字段, 恒为0
+    uint32_t    msgLen;
+};
+
+static inline size_t ConsoleFrameSize(size_t tagLen, size_t msgLen, size_t fieldsLen = 0)
+{
+    return sizeof(ConsoleFrameHeader) + tagLen + msgLen + fieldsLen;
+}
+
+/**
+ * @brief 编码一帧, out至少有ConsoleFrameSize(tagLen, msgLen, fieldsLen)字节
+ *
+ * @param version 与logcat协商的帧版本
+ * @param fieldsLen 为LogFieldCodec::EncodeSize(ev.fields, ev.fieldCount)时携带字段, 为0时不携带; 版本1须为0
+ */
+static inline size_t ConsoleFrameEncode(char *out, const LogEvent &ev, uint8_t version, size_t tagLen, size_t msgLen,
+    size_t fieldsLen = 0)
+{
+    ConsoleFrameHeader header;
+    header.magic = CONSOLE_FRAME_MAGIC;
+    header.version = version;
+    header.type = CONSOLE_FRAME_LOG;
+    header.level = (int8_t)ev.level;
+    header.length = (uint32_t)ConsoleFrameSize(tagLen, msgLen, fieldsLen);
+    header.timeMs = (uint64_t)ev.time.tv_sec * 1000 + ev.time.tv_usec / 1000;
+    header.pid = ev.pid;
+    header.tid = (int32_t)ev.tid;
+    header.tagLen = (uint16_t)tagLen;
+    header.fieldCount = fieldsLen > 0 ? (uint16_t)ev.fieldCount : 0;
+    header.msgLen = (uint32_t)msgLen;
+
+    memcpy(out, &header, sizeof(header));
+    memcpy(out + sizeof(header), ev.tag, tagLen);
+    memcpy(out + sizeof(header) + tagLen, ev.msg, msgLen);
+    if (fieldsLen > 0) {
+        LogFieldCodec::Encode(ev.fields, ev.fieldCount, out + sizeof(header) + tagLen + msgLen);
+    }
+    return header.length;
+}
+
+/**
+ * @brief 解析data开头的一帧
+ *
+ * @return 帧长度; 数据不完整返回0; 格式错误返回-1
+ */
+static inline int64_t ConsoleFrameParse(const char *data, size_t size, ConsoleFrameHeader *header)
+{
+    if (size < sizeof(ConsoleFrameHeader)) {
+        return 0;
+    }
+
+    memcpy(header, data, sizeof(ConsoleFrameHeader));
+    if (header->version == 0 || header->version > CONSOLE_FRAME_VERSION ||
+        (header->version < 2 && header->fieldCount != 0)) {
+        return -1;
+    }
+    if (header->magic != CONSOLE_FRAME_MAGIC || header->length > CONSOLE_FRAME_MAX ||
+        header->length < ConsoleFrameSize(header->tagLen, header->msgLen) ||
+        (header->fieldCount == 0 && header->length != ConsoleFrameSize(header->tagLen, header->msgLen))) {
+        return -1;
+    }
+
+    return size < header->length ? 0 : header->length;
+}
+
+// 帧中字段编码的长度, 位于tag与msg之后
+static inline size_t ConsoleFrameFieldsLen(const ConsoleFrameHeader &header)
+{
+    return header.length - ConsoleFrameSize(header.tagLen, header.msgLen);
+}
+
+} // namespace eular
+
+#endif // __LOG_CONSOLE_H__
@@ -0,0 +1,516 @@
+/*************************************************************************
+    > File Name: log_crash.cpp
+    > Author: hsz
+    > Brief:
+    > Created Time: 2026年10月18日 星期日 19时20分47秒
+ ************************************************************************/
+
+#define UNW_LOCAL_ONLY
+#include "log_crash.h"
+#include "log_main.h"
+#include "log_format.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <libunwind/libunwind.h>
+#include <new>
+
+#define CRASH_MIN_RECORDS       (16)
+#define CRASH_ALT_STACK_SIZE    (64 * 1024)
+#define CRASH_LINE_SIZE         (1024)
+
+namespace eular {
+std::atomic<CrashRecorder *> gCrashRecorder{nullptr};
+
+static const int32_t gCrashSignals[] = { SIGSEGV, SIGBUS, SIGFPE, SIGILL, SIGABRT };
+#define CRASH_SIGNAL_COUNT  (sizeof(gCrashSignals) / sizeof(gCrashSignals[0]))
+
+static struct sigaction gOldActions[CRASH_SIGNAL_COUNT];
+static pthread_mutex_t gInstallMutex = PTHREAD_MUTEX_INITIALIZER;
+static std::atomic<int32_t> gCrashFd{-1};
+static std::atomic<int32_t> gCrashingTid{0};
+static int32_t gOwnedFd = -1;       // 按路径安装时打开的fd
+static long gUtcOffset = 0;         // 安装时的本地时区偏移, 信号处理函数中不能调用localtime
+
+/**
+ * 信号处理函数中使用的输出, 只做内存拷贝和write
+ */
+class CrashWriter {
+public:
+    CrashWriter(int32_t fd) : mFd(fd), mLen(0) {}
+    ~CrashWriter() { flush(); }
+
+    void str(const char *s, size_t len)
+    {
+        while (len > 0) {
+            if (mLen == sizeof(mBuf)) {
+                flush();
+            }
+            size_t n = sizeof(mBuf) - mLen;
+            if (n > len) {
+                n = len;
+            }
+            memcpy(mBuf + mLen, s, n);
+            mLen += n;
+            s += n;
+            len -= n;
+        }
+    }
+
+    void str(const char *s) { str(s, strlen(s)); }
+
+    void dec(int64_t value, uint32_t width = 0, char fill = ' ')
+    {
+        char digits[24];
+        uint32_t n = 0;
+        bool negative = value < 0;
+        uint64_t v = negative ? -(uint64_t)value : (uint64_t)value;
+        do {
+            digits[n++] = '0' + v % 10;
+            v /= 10;
+        } while (v > 0);
+        if (negative) {
+            digits[n++] = '-';
+        }
+        for (; width > n; --width) {
+            str(&fill, 1);
+        }
+        while (n > 0) {
+            str(&digits[--n], 1);
+        }
+    }
+
+    void hex(uint64_t value)
+    {
+        static const char hexChars[] = "0123456789abcdef";
+        char digits[16];
+        uint32_t n = 0;
+        do {
+            digits[n++] = hexChars[value & 0xF];
+            value >>= 4;
+        } while (value > 0);
+        str("0x", 2);
+        while (n > 0) {
+            str(&digits[--n], 1);
+        }
+    }
+
+    void flush()
+    {
+        size_t offset = 0;
+        while (offset < mLen) {
+            ssize_t n = ::write(mFd, mBuf + offset, mLen - offset);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                break;
+            }
+            offset += n;
+        }
+        mLen = 0;
+    }
+
+private:
+    int32_t mFd;
+    size_t  mLen;
+    char    mBuf[CRASH_LINE_SIZE];
+};
+
+// 写入"MM-DD HH:MM:SS.mmm", 按公历日期计算, 不依赖时区数据库
+static void WriteTime(CrashWriter &out, int64_t timeUs)
+{
+    int64_t sec = timeUs / 1000000 + gUtcOffset;
+    int64_t days = sec / 86400;
+    int64_t rem = sec % 86400;
+    if (rem < 0) {
+        rem += 86400;
+        --days;
+    }
+
+    // days转换为年月日, 以0000-03-01为起点
+    int64_t z = days + 719468;
+    int64_t era = (z >= 0 ? z : z - 146096) / 146097;
+    int64_t doe = z - era * 146097;
+    int64_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    int64_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    int64_t mp = (5 * doy + 2) / 153;
+    int64_t day = doy - (153 * mp + 2) / 5 + 1;
+    int64_t month = mp < 10 ? mp + 3 : mp - 9;
+
+    out.dec(month, 2, '0');
+    out.str("-", 1);
+    out.dec(day, 2, '0');
+    out.str(" ", 1);
+    out.dec(rem / 3600, 2, '0');
+    out.str(":", 1);
+    out.dec(rem / 60 % 60, 2, '0');
+    out.str(":", 1);
+    out.dec(rem % 60, 2, '0');
+    out.str(".", 1);
+    out.dec(timeUs / 1000 % 1000, 3, '0');
+}
+
+static const char *LevelString(int32_t level)
+{
+    static const char *levelString[] = { "[D]", "[I]", "[W]", "[E]", "[F]" };
+    if (level < LogLevel::LEVEL_DEBUG || level > LogLevel::LEVEL_FATAL) {
+        return "[?]";
+    }
+    return levelString[level];
+}
+
+CrashRecorder::CrashRecorder(uint32_t records) :
+    mRecords(nullptr),
+    mMask(0),
+    mPos(0)
+{
+    uint64_t count = CRASH_MIN_RECORDS;
+    while (count < records) {
+        count <<= 1;
+    }
+
+    mRecords = new (std::nothrow) CrashRecord[count];
+    if (mRecords == nullptr) {
+        return;
+    }
+    for (uint64_t i = 0; i < count; ++i) {
+        mRecords[i].seq.store(0, std::memory_order_relaxed);
+    }
+    mMask = count - 1;
+}
+
+CrashRecorder::~CrashRecorder()
+{
+    delete[] mRecords;
+}
+
+void CrashRecorder::record(const LogEvent &ev, const char *msg, size_t len)
+{
+    uint64_t pos = mPos.fetch_add(1, std::memory_order_relaxed);
+    CrashRecord &rec = mRecords[pos & mMask];
+
+    // 环绕后可能有多个线程写同一槽位: 以CAS占用, 槽位正被写入或已是更新的记录时放弃本条
+    uint64_t seq = rec.seq.load(std::memory_order_relaxed);
+    if ((seq & 1) || seq > pos * 2 ||
+        !rec.seq.compare_exchange_strong(seq, pos * 2 + 1, std::memory_order_relaxed)) {
+        return;
+    }
+    std::atomic_thread_fence(std::memory_order_release);
+
+    rec.timeUs = (int64_t)ev.time.tv_sec * 1000000 + ev.time.tv_usec;
+    rec.pid = ev.pid;
+    rec.tid = (int32_t)ev.tid;
+    rec.level = ev.level;
+    strncpy(rec.tag, ev.tag, LOG_TAG_SIZE - 1);
+    rec.tag[LOG_TAG_SIZE - 1] = '\0';
+    while (len > 0 && msg[len - 1] == '\n') {
+        --len;
+    }
+    if (len > CRASH_MSG_SIZE) {
+        len = CRASH_MSG_SIZE;
+    }
+    memcpy(rec.msg, msg, len);
+    if (ev.fieldCount > 0) {
+        len += LogFieldCodec::Format(ev.fields, ev.fieldCount, rec.msg + len, CRASH_MSG_SIZE - len);
+    }
+    rec.msgLen = len;
+
+    rec.seq.store(pos * 2 + 2, std::memory_order_release);
+}
+
+void CrashRecorder::dump(int32_t fd) const
+{
+    CrashWriter out(fd);
+    uint64_t end = mPos.load(std::memory_order_acquire);
+    uint64_t begin = end > mMask + 1 ? end - mMask - 1 : 0;
+    CrashRecord copy;
+
+    for (uint64_t pos = begin; pos < end; ++pos) {
+        const CrashRecord &rec = mRecords[pos & mMask];
+        uint64_t expected = pos * 2 + 2;
+        if (rec.seq.load(std::memory_order_acquire) != expected) {
+            // 正在写入或已被覆盖
+            continue;
+        }
+        copy.timeUs = rec.timeUs;
+        copy.pid = rec.pid;
+        copy.tid = rec.tid;
+        copy.level = rec.level;
+        copy.msgLen = rec.msgLen;
+        memcpy(copy.tag, rec.tag, LOG_TAG_SIZE);
+        memcpy(copy.msg, rec.msg, CRASH_MSG_SIZE);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (rec.seq.load(std::memory_order_relaxed) != expected) {
+            continue;
+        }
+
+        copy.tag[LOG_TAG_SIZE - 1] = '\0';
+        WriteTime(out, copy.timeUs);
+        out.str(" ", 1);
+        out.dec(copy.pid, 5);
+        out.str(" ", 1);
+        out.dec(copy.tid, 5);
+        out.str(" ", 1);
+        out.str(LevelString(copy.level));
+        out.str(" ", 1);
+        out.str(copy.tag);
+        out.str(": ", 2);
+        out.str(copy.msg, copy.msgLen < CRASH_MSG_SIZE ? copy.msgLen : CRASH_MSG_SIZE);
+        out.str("\n", 1);
+    }
+}
+
+static const char *SignalName(int32_t sig)
+{
+    switch (sig) {
+    case SIGSEGV:
+        return "SIGSEGV";
+    case SIGBUS:
+        return "SIGBUS";
+    case SIGFPE:
+        return "SIGFPE";
+    case SIGILL:
+        return "SIGILL";
+    case SIGABRT:
+        return "SIGABRT";
+    default:
+        break;
+    }
+    return "UNKNOWN";
+}
+
+// libunwind的本地回溯与unw_get_proc_name可在信号处理函数中使用, 符号名不做demangle(需要分配内存)
+static void WriteBacktrace(CrashWriter &out)
+{
+    unw_context_t context;
+    unw_cursor_t cursor;
+    if (unw_getcontext(&context) != 0 || unw_init_local(&cursor, &context) != 0) {
+        out.str("(unable to unwind)\n");
+        return;
+    }
+
+    char sym[256];
+    for (int32_t frame = 0; frame < CRASH_MAX_FRAMES && unw_step(&cursor) > 0; ++frame) {
+        unw_word_t ip = 0;
+        unw_word_t offset = 0;
+        unw_get_reg(&cursor, UNW_REG_IP, &ip);
+        if (ip == 0) {
+            break;
+        }
+
+        out.str("#");
+        out.dec(frame, 2, '0');
+        out.str(" ");
+        out.hex(ip);
+        if (unw_get_proc_name(&cursor, sym, sizeof(sym), &offset) == 0) {
+            out.str(" ");
+            out.str(sym);
+            out.str("+");
+            out.hex(offset);
+        }
+        out.str("\n");
+    }
+}
+
+// 只输出可执行段, 配合回溯地址使用addr2line
+static void WriteExecMaps(CrashWriter &out)
+{
+    int32_t fd = ::open("/proc/self/maps", O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return;
+    }
+
+    char buf[4096];
+    char line[512];
+    size_t lineLen = 0;
+    bool overflow = false;
+    while (true) {
+        ssize_t n = ::read(fd, buf, sizeof(buf));
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            break;
+        }
+        for (ssize_t i = 0; i < n; ++i) {
+            if (buf[i] != '\n') {
+                if (lineLen < sizeof(line)) {
+                    line[lineLen++] = buf[i];
+                } else {
+                    overflow = true;
+                }
+                continue;
+            }
+            // 地址 权限 ...: "7f..-7f.. r-xp ..."
+            const char *perm = (const char *)memchr(line, ' ', lineLen);
+            if (!overflow && perm != nullptr && perm + 3 < line + lineLen && perm[3] == 'x') {
+                out.str(line, lineLen);
+                out.str("\n", 1);
+            }
+            lineLen = 0;
+            overflow = false;
+        }
+    }
+    ::close(fd);
+}
+
+static void RestoreHandlers()
+{
+    for (size_t i = 0; i < CRASH_SIGNAL_COUNT; ++i) {
+        sigaction(gCrashSignals[i], &gOldActions[i], nullptr);
+    }
+}
+
+static void CrashHandler(int32_t sig, siginfo_t *info, void *ucontext)
+{
+    (void)ucontext;
+    int32_t savedErrno = errno;
+    int32_t tid = (int32_t)syscall(SYS_gettid);
+    int32_t expected = 0;
+    if (!gCrashingTid.compare_exchange_strong(expected, tid)) {
+        if (expected != tid) {
+            // 其他线程正在输出, 等待其结束进程
+            while (true) {
+                pause();
+            }
+        }
+        // 输出过程中再次崩溃, 直接按原处理方式结束
+        RestoreHandlers();
+        raise(sig);
+        return;
+    }
+
+    int32_t fd = gCrashFd.load(std::memory_order_acquire);
+    CrashRecorder *recorder = gCrashRecorder.load(std::memory_order_acquire);
+    if (fd >= 0) {
+        CrashWriter out(fd);
+        out.str("\n*** crash: signal ");
+        out.dec(sig);
+        out.str(" (");
+        out.str(SignalName(sig));
+        out.str("), code ");
+        out.dec(info != nullptr ? info->si_code : 0);
+        if (sig != SIGABRT && info != nullptr) {
+            out.str(", addr ");
+            out.hex((uint64_t)info->si_addr);
+        }
+        out.str(", pid ");
+        out.dec(getpid());
+        out.str(", tid ");
+        out.dec(tid);
+        out.str(" ***\n--- last log records ---\n");
+        out.flush();
+
+        if (recorder != nullptr) {
+            recorder->dump(fd);
+        }
+
+        out.str("--- backtrace ---\n");
+        WriteBacktrace(out);
+        out.str("--- executable mappings ---\n");
+        WriteExecMaps(out);
+        out.str("*** end of crash ***\n");
+        out.flush();
+    }
+
+    // 最后写出批量缓存, 缓存状态可能已被破坏
+    LogManager::FlushOnCrash();
+
+    // 信号在处理期间被屏蔽, 返回后按原处理方式重新处理
+    RestoreHandlers();
+    raise(sig);
+    errno = savedErrno;
+}
+
+static void SetupAltStack()
+{
+    stack_t old;
+    if (sigaltstack(nullptr, &old) == 0 && !(old.ss_flags & SS_DISABLE)) {
+        return;
+    }
+
+    void *stack = mmap(nullptr, CRASH_ALT_STACK_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (stack == MAP_FAILED) {
+        return;
+    }
+    stack_t ss;
+    ss.ss_sp = stack;
+    ss.ss_size = CRASH_ALT_STACK_SIZE;
+    ss.ss_flags = 0;
+    if (sigaltstack(&ss, nullptr) != 0) {
+        munmap(stack, CRASH_ALT_STACK_SIZE);
+    }
+}
+
+namespace log {
+bool InstallCrashHandler(int32_t fd, uint32_t records)
+{
+    if (fd < 0) {
+        return false;
+    }
+
+    pthread_mutex_lock(&gInstallMutex);
+    if (gCrashRecorder.load(std::memory_order_acquire) == nullptr) {
+        CrashRecorder *recorder = new (std::nothrow) CrashRecorder(records);
+        if (recorder == nullptr || !recorder->valid()) {
+            delete recorder;
+            pthread_mutex_unlock(&gInstallMutex);
+            return false;
+        }
+
+        struct tm tmNow;
+        LogFormat::LocalTime(time(nullptr), &tmNow);
+        gUtcOffset = tmNow.tm_gmtoff;
+        SetupAltStack();
+
+        struct sigaction action;
+        memset(&action, 0, sizeof(action));
+        action.sa_sigaction = CrashHandler;
+        action.sa_flags = SA_SIGINFO | SA_ONSTACK;
+        sigemptyset(&action.sa_mask);
+        for (size_t i = 0; i < CRASH_SIGNAL_COUNT; ++i) {
+            sigaction(gCrashSignals[i], &action, &gOldActions[i]);
+        }
+
+        // 信号处理函数随时可能使用, 不释放
+        gCrashRecorder.store(recorder, std::memory_order_release);
+    }
+
+    int32_t oldFd = gCrashFd.exchange(fd, std::memory_order_acq_rel);
+    if (oldFd >= 0 && oldFd == gOwnedFd && oldFd != fd) {
+        ::close(oldFd);
+        gOwnedFd = -1;
+    }
+    pthread_mutex_unlock(&gInstallMutex);
+    return true;
+}
+
+bool InstallCrashHandler(const char *path, uint32_t records)
+{
+    if (path == nullptr) {
+        return false;
+    }
+
+    int32_t fd = ::open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0664);
+    if (fd < 0) {
+        return false;
+    }
+    if (!InstallCrashHandler(fd, records)) {
+        ::close(fd);
+        return false;
+    }
+
+    pthread_mutex_lock(&gInstallMutex);
+    gOwnedFd = fd;
+    pthread_mutex_unlock(&gInstallMutex);
+    return true;
+}
+} // namespace log
+
+} // namespace eular
@@ -0,0 +1,88 @@
+/*************************************************************************
+    > File Name: log_crash.h
+    > Author: hsz
+    > Brief: 崩溃时的日志保全: 最近N条日志的无锁环, 信号处理函数中只使用异步信号安全的操作
+    > Created Time: 2026年10月18日 星期日 19时20分41秒
+ ************************************************************************/
+
+#ifndef __LOG_CRASH_H__
+#define __LOG_CRASH_H__
+
+#include "log_event.h"
+#include <stdint.h>
+#include <stddef.h>
+#include <unistd.h>
+#include <atomic>
+
+#define CRASH_DEFAULT_RECORDS   (256)   // 默认保留的日志条数, 向上取整为2的幂
+#define CRASH_MSG_SIZE          (240)   // 每条日志保留的消息长度, 超出部分截断
+#define CRASH_MAX_FRAMES        (64)    // 回溯的最大栈帧数
+
+namespace eular {
+/**
+ * 安装后每条日志在调用线程中额外拷贝一份到固定大小的环中(与异步队列、批量缓存无关),
+ * 写入以每条记录的序号做seqlock, 不加锁也不分配内存, 槽位正被其他线程写入时放弃该条.
+ * 收到SIGSEGV/SIGBUS/SIGFPE/SIGILL/SIGABRT时, 信号处理函数只调用write/open/read等异步信号安全的接口, 依次向预先打开的fd写出:
+ * 信号信息、最近N条日志(含尚在异步队列中未写出的日志)、原始栈回溯与可执行段映射,
+ * 然后将文件输出节点批量缓存中的内容直接写入文件, 最后恢复原处理函数并重新触发信号.
+ */
+struct CrashRecord {
+    std::atomic<uint64_t>   seq;        // 写入中为奇数, 写完为2 * (序号 + 1), 以CAS占用
+    int64_t                 timeUs;
+    int32_t                 pid;
+    int32_t                 tid;
+    int32_t                 level;
+    uint32_t                msgLen;
+    char                    tag[LOG_TAG_SIZE];
+    char                    msg[CRASH_MSG_SIZE];
+};
+
+class CrashRecorder {
+public:
+    CrashRecorder(uint32_t records);
+    ~CrashRecorder();
+
+    CrashRecorder(const CrashRecorder&) = delete;
+    CrashRecorder& operator=(const CrashRecorder&) = delete;
+
+    bool    valid() const { return mRecords != nullptr; }
+    void    record(const LogEvent &ev, const char *msg, size_t len);
+    // 按时间顺序写出最近的日志, 异步信号安全
+    void    dump(int32_t fd) const;
+
+private:
+    CrashRecord *           mRecords;
+    uint64_t                mMask;
+    std::atomic<uint64_t>   mPos;
+};
+
+extern std::atomic<CrashRecorder *> gCrashRecorder;
+
+// 未安装崩溃处理时只有一次relaxed读取
+static inline void log_crash_record(const LogEvent &ev, const char *msg, size_t len)
+{
+    CrashRecorder *recorder = gCrashRecorder.load(std::memory_order_relaxed);
+    if (recorder != nullptr) {
+        recorder->record(ev, msg, len);
+    }
+}
+
+namespace log {
+/**
+ * @brief 安装崩溃处理. 只有第一次调用时创建日志环, 之后的调用只替换输出fd.
+ *        栈溢出导致的SIGSEGV需要备用信号栈, 这里只为调用线程设置
+ *
+ * @param fd 崩溃信息的输出, 需预先打开, 默认为stderr
+ * @param records 保留的日志条数
+ * @return 成功返回true
+ */
+bool InstallCrashHandler(int32_t fd = STDERR_FILENO, uint32_t records = CRASH_DEFAULT_RECORDS);
+/**
+ * @brief 安装崩溃处理, 崩溃信息追加到path, 文件在安装时打开
+ */
+bool InstallCrashHandler(const char *path, uint32_t records = CRASH_DEFAULT_RECORDS);
+} // namespace log
+
+} // namespace eular
+
+#endif // __LOG_CRASH_H__
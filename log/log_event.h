@@ -9,6 +9,7 @@
 #define __LOG_EVENT_H__
 
 #include "log_level.h"
+#include "log_field.h"
 #include <time.h> 
 #include <sys/time.h> 
 #include <sys/types.h>
@@ -18,18 +19,33 @@
 namespace eular {
 struct LogEvent {
     struct timeval  time;       // 时间
+    uint32_t        nsec;       // 秒内的纳秒, time.tv_usec由其截断得到
     int             pid;        // 进程ID
     pthread_t       tid;        // 线程ID
     LogLevel::Level level;      // 日志级别
     char            tag[LOG_TAG_SIZE];  // tag
     char *          msg;        // 日志消息
     bool            enableColor;// 是否启用颜色
+    const LogField *fields;     // 结构化字段, 文本输出时追加在消息之后
+    uint32_t        fieldCount;
 };
 
+// 以clock_gettime取当前时间, 同时填写time与nsec
+static inline void LogEventTime(LogEvent &ev, clockid_t clock = CLOCK_REALTIME)
+{
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    ev.time.tv_sec = ts.tv_sec;
+    ev.time.tv_usec = ts.tv_nsec / 1000;
+    ev.nsec = ts.tv_nsec;
+}
+
 static inline LogEvent LogEventDump(const LogEvent *ev)
 {
     LogEvent ret;
     memcpy(&ret, ev, sizeof(LogEvent));
+    ret.fields = nullptr;
+    ret.fieldCount = 0;
     ret.msg = (char *)malloc(strlen(ev->msg) + 1);
     if (ret.msg != nullptr) {
         memcpy(ret.msg, ev->msg, strlen(ev->msg));
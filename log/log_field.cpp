@@ -0,0 +1,282 @@
+/*************************************************************************
+    > File Name: log_field.cpp
+    > Author: hsz
+    > Brief:
+    > Created Time: 2026年10月18日 星期日 20时02分41秒
+ ************************************************************************/
+
+#include "log_field.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define FIELD_NUMBER_SIZE   (32)    // 数值的最大文本长度
+
+namespace eular {
+static inline bool NeedQuote(const char *str, size_t len)
+{
+    if (len == 0) {
+        return true;
+    }
+    for (size_t i = 0; i < len; ++i) {
+        unsigned char c = str[i];
+        if (c <= ' ' || c == '"' || c == '=' || c == '\\' || c == 0x7F) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static inline uint32_t KeyLength(const LogField &field)
+{
+    return field.keyLen < LOG_FIELD_MAX_KEY ? field.keyLen : LOG_FIELD_MAX_KEY;
+}
+
+static inline uint32_t StringLength(const LogField &field)
+{
+    return field.len < LOG_FIELD_MAX_STRING ? field.len : LOG_FIELD_MAX_STRING;
+}
+
+size_t LogFieldCodec::FormatSize(const LogField *fields, uint32_t count)
+{
+    size_t size = 0;
+    for (uint32_t i = 0; i < count; ++i) {
+        size += 2 + fields[i].keyLen;
+        if (fields[i].type == LOG_FIELD_STRING) {
+            // 最坏情况每个字符转义为\xHH
+            size += 2 + fields[i].len * 4;
+        } else {
+            size += FIELD_NUMBER_SIZE;
+        }
+    }
+    return size;
+}
+
+// 写入一个字段, 空间不足返回0
+static size_t FormatField(const LogField &field, char *buf, size_t size)
+{
+    char number[FIELD_NUMBER_SIZE];
+    const char *value = number;
+    size_t valueLen = 0;
+    bool quote = false;
+    switch (field.type) {
+    case LOG_FIELD_INT:
+        valueLen = snprintf(number, sizeof(number), "%lld", (long long)field.value.i);
+        break;
+    case LOG_FIELD_UINT:
+        valueLen = snprintf(number, sizeof(number), "%llu", (unsigned long long)field.value.u);
+        break;
+    case LOG_FIELD_DOUBLE:
+        valueLen = snprintf(number, sizeof(number), "%g", field.value.d);
+        break;
+    case LOG_FIELD_BOOL:
+        value = field.value.b ? "true" : "false";
+        valueLen = strlen(value);
+        break;
+    case LOG_FIELD_STRING:
+        value = field.value.s;
+        valueLen = field.len;
+        quote = NeedQuote(value, valueLen);
+        break;
+    default:
+        value = "?";
+        valueLen = 1;
+        break;
+    }
+
+    size_t need = 2 + field.keyLen + valueLen + (quote ? 2 : 0);
+    if (need > size) {
+        return 0;
+    }
+
+    size_t len = 0;
+    buf[len++] = ' ';
+    memcpy(buf + len, field.key, field.keyLen);
+    len += field.keyLen;
+    buf[len++] = '=';
+    if (!quote) {
+        memcpy(buf + len, value, valueLen);
+        return len + valueLen;
+    }
+
+    static const char hexChars[] = "0123456789abcdef";
+    buf[len++] = '"';
+    for (size_t i = 0; i < valueLen; ++i) {
+        unsigned char c = value[i];
+        // 预留结尾的引号
+        if (len + 5 > size) {
+            return 0;
+        }
+        if (c == '"' || c == '\\') {
+            buf[len++] = '\\';
+            buf[len++] = c;
+        } else if (c == '\n') {
+            buf[len++] = '\\';
+            buf[len++] = 'n';
+        } else if (c < ' ' || c == 0x7F) {
+            buf[len++] = '\\';
+            buf[len++] = 'x';
+            buf[len++] = hexChars[c >> 4];
+            buf[len++] = hexChars[c & 0xF];
+        } else {
+            buf[len++] = c;
+        }
+    }
+    buf[len++] = '"';
+    return len;
+}
+
+size_t LogFieldCodec::Format(const LogField *fields, uint32_t count, char *buf, size_t size)
+{
+    size_t len = 0;
+    for (uint32_t i = 0; i < count; ++i) {
+        size_t n = FormatField(fields[i], buf + len, size - len);
+        if (n == 0) {
+            break;
+        }
+        len += n;
+    }
+    return len;
+}
+
+size_t LogFieldCodec::EncodeSize(const LogField *fields, uint32_t count)
+{
+    size_t size = 0;
+    for (uint32_t i = 0; i < count; ++i) {
+        size += 2 + KeyLength(fields[i]);
+        switch (fields[i].type) {
+        case LOG_FIELD_BOOL:
+            size += 1;
+            break;
+        case LOG_FIELD_STRING:
+            size += sizeof(uint32_t) + StringLength(fields[i]);
+            break;
+        default:
+            size += sizeof(uint64_t);
+            break;
+        }
+    }
+    return size;
+}
+
+size_t LogFieldCodec::Encode(const LogField *fields, uint32_t count, char *out)
+{
+    char *p = out;
+    for (uint32_t i = 0; i < count; ++i) {
+        const LogField &field = fields[i];
+        uint8_t keyLen = KeyLength(field);
+        *p++ = field.type;
+        *p++ = keyLen;
+        memcpy(p, field.key, keyLen);
+        p += keyLen;
+        switch (field.type) {
+        case LOG_FIELD_BOOL:
+            *p++ = field.value.b ? 1 : 0;
+            break;
+        case LOG_FIELD_STRING: {
+            uint32_t len = StringLength(field);
+            memcpy(p, &len, sizeof(len));
+            memcpy(p + sizeof(len), field.value.s, len);
+            p += sizeof(len) + len;
+            break;
+        }
+        default:
+            memcpy(p, &field.value.u, sizeof(uint64_t));
+            p += sizeof(uint64_t);
+            break;
+        }
+    }
+    return p - out;
+}
+
+bool LogFieldCodec::Decode(const char *data, size_t size, std::vector<LogField> &out)
+{
+    out.clear();
+    size_t offset = 0;
+    while (offset < size) {
+        if (size - offset < 2) {
+            return false;
+        }
+        LogField field;
+        memset(&field, 0, sizeof(field));
+        field.type = data[offset];
+        field.keyLen = (uint8_t)data[offset + 1];
+        offset += 2;
+        if (size - offset < field.keyLen) {
+            return false;
+        }
+        field.key = data + offset;
+        offset += field.keyLen;
+
+        switch (field.type) {
+        case LOG_FIELD_BOOL:
+            if (size - offset < 1) {
+                return false;
+            }
+            field.value.b = data[offset] != 0;
+            offset += 1;
+            break;
+        case LOG_FIELD_STRING: {
+            uint32_t len = 0;
+            if (size - offset < sizeof(len)) {
+                return false;
+            }
+            memcpy(&len, data + offset, sizeof(len));
+            offset += sizeof(len);
+            if (size - offset < len) {
+                return false;
+            }
+            field.value.s = data + offset;
+            field.len = len;
+            offset += len;
+            break;
+        }
+        case LOG_FIELD_INT:
+        case LOG_FIELD_UINT:
+        case LOG_FIELD_DOUBLE:
+            if (size - offset < sizeof(uint64_t)) {
+                return false;
+            }
+            memcpy(&field.value.u, data + offset, sizeof(uint64_t));
+            offset += sizeof(uint64_t);
+            break;
+        default:
+            return false;
+        }
+        out.push_back(field);
+    }
+    return true;
+}
+
+LogField *LogFieldCodec::Clone(const LogField *fields, uint32_t count)
+{
+    size_t size = sizeof(LogField) * count;
+    for (uint32_t i = 0; i < count; ++i) {
+        size += fields[i].keyLen + 1;
+        if (fields[i].type == LOG_FIELD_STRING) {
+            size += fields[i].len + 1;
+        }
+    }
+
+    LogField *clone = (LogField *)malloc(size);
+    if (clone == nullptr) {
+        return nullptr;
+    }
+    memcpy(clone, fields, sizeof(LogField) * count);
+
+    char *p = reinterpret_cast<char *>(clone + count);
+    for (uint32_t i = 0; i < count; ++i) {
+        memcpy(p, fields[i].key, fields[i].keyLen);
+        p[fields[i].keyLen] = '\0';
+        clone[i].key = p;
+        p += fields[i].keyLen + 1;
+        if (fields[i].type == LOG_FIELD_STRING) {
+            memcpy(p, fields[i].value.s, fields[i].len);
+            p[fields[i].len] = '\0';
+            clone[i].value.s = p;
+            p += fields[i].len + 1;
+        }
+    }
+    return clone;
+}
+
+} // namespace eular
@@ -0,0 +1,137 @@
+/*************************************************************************
+    > File Name: log_field.h
+    > Author: hsz
+    > Brief: 结构化日志字段: 调用点只记录键与原始值, 由输出节点渲染为文本、JSON或二进制
+    > Created Time: 2026年10月18日 星期日 20时02分36秒
+ ************************************************************************/
+
+#ifndef __LOG_FIELD_H__
+#define __LOG_FIELD_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <type_traits>
+
+#define LOG_FIELD_MAX           (32)            // 单条日志最多的字段数
+#define LOG_FIELD_MAX_KEY       (255)           // 编码时键的最大长度
+#define LOG_FIELD_MAX_STRING    (16 * 1024)     // 编码时字符串值的最大长度
+
+namespace eular {
+enum LogFieldType {
+    LOG_FIELD_INT       = 1,
+    LOG_FIELD_UINT      = 2,
+    LOG_FIELD_DOUBLE    = 3,
+    LOG_FIELD_BOOL      = 4,
+    LOG_FIELD_STRING    = 5,
+};
+
+/**
+ * 键与字符串值只保存指针, 在写日志的调用期间有效; 异步模式入队时整体拷贝.
+ * 解码得到的键与字符串不以\0结尾, 使用keyLen与len
+ */
+struct LogField {
+    const char *    key;
+    uint16_t        keyLen;
+    uint8_t         type;
+    uint32_t        len;        // 字符串值的长度
+    union {
+        int64_t     i;
+        uint64_t    u;
+        double      d;
+        bool        b;
+        const char *s;
+    } value;
+};
+
+static inline void LogFieldSet(LogField &f, bool v) { f.type = LOG_FIELD_BOOL; f.value.b = v; }
+static inline void LogFieldSet(LogField &f, char v) { f.type = LOG_FIELD_INT; f.value.i = v; }
+static inline void LogFieldSet(LogField &f, signed char v) { f.type = LOG_FIELD_INT; f.value.i = v; }
+static inline void LogFieldSet(LogField &f, short v) { f.type = LOG_FIELD_INT; f.value.i = v; }
+static inline void LogFieldSet(LogField &f, int v) { f.type = LOG_FIELD_INT; f.value.i = v; }
+static inline void LogFieldSet(LogField &f, long v) { f.type = LOG_FIELD_INT; f.value.i = v; }
+static inline void LogFieldSet(LogField &f, long long v) { f.type = LOG_FIELD_INT; f.value.i = v; }
+static inline void LogFieldSet(LogField &f, unsigned char v) { f.type = LOG_FIELD_UINT; f.value.u = v; }
+static inline void LogFieldSet(LogField &f, unsigned short v) { f.type = LOG_FIELD_UINT; f.value.u = v; }
+static inline void LogFieldSet(LogField &f, unsigned int v) { f.type = LOG_FIELD_UINT; f.value.u = v; }
+static inline void LogFieldSet(LogField &f, unsigned long v) { f.type = LOG_FIELD_UINT; f.value.u = v; }
+static inline void LogFieldSet(LogField &f, unsigned long long v) { f.type = LOG_FIELD_UINT; f.value.u = v; }
+static inline void LogFieldSet(LogField &f, float v) { f.type = LOG_FIELD_DOUBLE; f.value.d = v; }
+static inline void LogFieldSet(LogField &f, double v) { f.type = LOG_FIELD_DOUBLE; f.value.d = v; }
+
+static inline void LogFieldSet(LogField &f, const char *v)
+{
+    if (v == nullptr) {
+        v = "(null)";
+    }
+    f.type = LOG_FIELD_STRING;
+    f.value.s = v;
+    f.len = strlen(v);
+}
+
+// 引用调用方的字符串, 临时对象在整条日志语句结束前有效
+static inline void LogFieldSet(LogField &f, const std::string &v)
+{
+    f.type = LOG_FIELD_STRING;
+    f.value.s = v.data();
+    f.len = v.length();
+}
+
+template <typename T>
+static inline typename std::enable_if<std::is_enum<T>::value>::type LogFieldSet(LogField &f, T v)
+{
+    f.type = LOG_FIELD_INT;
+    f.value.i = (int64_t)v;
+}
+
+static inline uint32_t LogFieldFill(LogField *)
+{
+    return 0;
+}
+
+// 按"键, 值, 键, 值..."依次填充, 返回字段数
+template <typename V, typename... Rest>
+static inline uint32_t LogFieldFill(LogField *out, const char *key, const V &value, const Rest &... rest)
+{
+    out->key = key;
+    out->keyLen = strlen(key);
+    out->len = 0;
+    LogFieldSet(*out, value);
+    return 1 + LogFieldFill(out + 1, rest...);
+}
+
+/**
+ * 文本形式: 每个字段为" key=value", 字符串含空白、引号、'='或为空时加双引号并转义.
+ * 紧凑编码(CONSOLEOUT帧): 每个字段为uint8类型 + uint8键长 + 键 + 值,
+ *  整数与浮点8字节, bool 1字节, 字符串为uint32长度 + 内容; 本机字节序
+ */
+class LogFieldCodec {
+public:
+    // 文本形式所需的最大字节数
+    static size_t FormatSize(const LogField *fields, uint32_t count);
+    /**
+     * @brief 以文本形式写入buf, 空间不足时在字段边界截断
+     *
+     * @return 写入的字节数, 不写入\0
+     */
+    static size_t Format(const LogField *fields, uint32_t count, char *buf, size_t size);
+
+    static size_t EncodeSize(const LogField *fields, uint32_t count);
+    // out至少有EncodeSize字节, 返回写入的字节数
+    static size_t Encode(const LogField *fields, uint32_t count, char *out);
+    // 解码结果指向data, 格式错误返回false
+    static bool   Decode(const char *data, size_t size, std::vector<LogField> &out);
+
+    /**
+     * @brief 将字段及其键、字符串拷贝到一块连续内存, 用free释放
+     *
+     * @return 内存不足返回nullptr
+     */
+    static LogField *Clone(const LogField *fields, uint32_t count);
+};
+
+} // namespace eular
+
+#endif // __LOG_FIELD_H__
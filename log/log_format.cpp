@@ -1,4 +1,6 @@
 #include "log_format.h"
+#include <stdio.h>
+#include <pthread.h>
 
 #define CLR_CLR         "\033[0m"       // 恢复颜色
 #define CLR_BLACK       "\033[30m"      // 黑色字
@@ -33,19 +35,28 @@
 namespace eular {
 std::string LogFormat::Format(const LogEvent *ev)
 {
+    LogBuffer buffer;
+    size_t len = buffer.append(ev);
+    if (!ev->enableColor) {
+        return std::string(buffer.data(), len);
+    }
+
     std::string ret;
-    char output[PERFIX_SIZE] = {0};
-    size_t msglen = strlen(ev->msg);
-    ret.resize(msglen + PERFIX_SIZE + CLR_MAX_SIZE);
-    const char *color = nullptr;
-    ret = "";
+    ret.reserve(len + CLR_MAX_SIZE);
+    ret += ColorBegin(ev->level);
+    ret.append(buffer.data(), len);
+    // 清空颜色
+    ret += ColorEnd();
+    return ret;
+}
 
+const char *LogFormat::ColorBegin(LogLevel::Level level)
+{
 #define XXX(level, clr) \
     case level:         \
-        color = clr;    \
-        break;          \
+        return clr;     \
 
-    switch (ev->level) {
+    switch (level) {
         COLOR_MAP(XXX)
 
         default:
@@ -53,30 +64,135 @@ std::string LogFormat::Format(const LogEvent *ev)
     }
 #undef XXX
 
-    if (ev->enableColor) {
-        snprintf(output, PERFIX_SIZE, "%s", color);
-        ret += output;
+    return CLR_CLR;
+}
+
+const char *LogFormat::ColorEnd()
+{
+    return CLR_CLR;
+}
+
+static const char *LevelFormatString(LogLevel::Level level)
+{
+    static const char *levelString[] = { "[D]", "[I]", "[W]", "[E]", "[F]" };
+    if (level < LogLevel::LEVEL_DEBUG || level > LogLevel::LEVEL_FATAL) {
+        return "[?]";
+    }
+    return levelString[level];
+}
+
+static pthread_mutex_t gLocalTimeMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t gLocalTimeOnce = PTHREAD_ONCE_INIT;
+
+static void LocalTimeAtForkPrepare()
+{
+    pthread_mutex_lock(&gLocalTimeMutex);
+}
+
+static void LocalTimeAtForkParent()
+{
+    pthread_mutex_unlock(&gLocalTimeMutex);
+}
+
+void LogFormat::RegisterForkHandler()
+{
+    pthread_once(&gLocalTimeOnce, []() {
+        pthread_atfork(LocalTimeAtForkPrepare, LocalTimeAtForkParent, LocalTimeAtForkParent);
+    });
+}
+
+void LogFormat::LocalTime(time_t sec, struct tm *out)
+{
+    RegisterForkHandler();
+    pthread_mutex_lock(&gLocalTimeMutex);
+    localtime_r(&sec, out);
+    pthread_mutex_unlock(&gLocalTimeMutex);
+}
+
+// 线程内缓存到秒的时间文本"MM-DD HH:MM:SS.", 秒数变化时才调用localtime_r
+struct TimeCache {
+    time_t  sec;
+    char    text[TIME_PREFIX_SIZE];
+};
+
+static thread_local TimeCache gTimeCache = { -1, {0} };
+
+static inline void PutDigits2(char *out, int32_t value)
+{
+    out[0] = '0' + value / 10;
+    out[1] = '0' + value % 10;
+}
+
+static inline void PutDigits3(char *out, int32_t value)
+{
+    out[0] = '0' + value / 100;
+    out[1] = '0' + value / 10 % 10;
+    out[2] = '0' + value % 10;
+}
+
+// 写入"MM-DD HH:MM:SS.mmm", 返回长度
+static size_t FormatTime(const struct timeval &tv, char *out)
+{
+    TimeCache &cache = gTimeCache;
+    if (cache.sec != tv.tv_sec) {
+        struct tm tmNow;
+        LogFormat::LocalTime(tv.tv_sec, &tmNow);
+        char *p = cache.text;
+        PutDigits2(p, tmNow.tm_mon + 1);
+        p[2] = '-';
+        PutDigits2(p + 3, tmNow.tm_mday);
+        p[5] = ' ';
+        PutDigits2(p + 6, tmNow.tm_hour);
+        p[8] = ':';
+        PutDigits2(p + 9, tmNow.tm_min);
+        p[11] = ':';
+        PutDigits2(p + 12, tmNow.tm_sec);
+        p[14] = '.';
+        cache.sec = tv.tv_sec;
+    }
+
+    memcpy(out, cache.text, TIME_PREFIX_SIZE);
+    PutDigits3(out + TIME_PREFIX_SIZE, tv.tv_usec / 1000 % 1000);
+    return TIME_PREFIX_SIZE + 3;
+}
+
+size_t LogFormat::Format(const LogEvent *ev, char *buf, size_t size)
+{
+    if (buf == nullptr || size < PERFIX_SIZE) {
+        return 0;
     }
 
     // time pid tid level tag:
-    struct tm *pTime = localtime(&(ev->time.tv_sec));
-    snprintf(output, PERFIX_SIZE, "%.2d-%.2d %.2d:%.2d:%.2d.%.3ld %5d %5ld %s %s: ",
-        pTime->tm_mon + 1, pTime->tm_mday, pTime->tm_hour, pTime->tm_min, pTime->tm_sec, ev->time.tv_usec / 1000,
-        ev->pid, ev->tid, LogLevel::ToFormatString(ev->level).c_str(), ev->tag);
-
-    ret += output;
-    ret += ev->msg;
-    if (ev->msg[msglen - 1] != '\n') {
-        ret += "\n";
+    size_t len = FormatTime(ev->time, buf);
+    int32_t n = snprintf(buf + len, size - len, " %5d %5ld %s %s: ",
+        ev->pid, ev->tid, LevelFormatString(ev->level), ev->tag);
+    len += n < 0 ? 0 : (size_t)n;
+    if (len > size - 2) {
+        len = size - 2;
     }
 
-    // 清空颜色
-    if (ev->enableColor) {
-        snprintf(output, PERFIX_SIZE, "%s", CLR_CLR);
-        ret += output;
+    // 预留\n\0
+    size_t msglen = strlen(ev->msg);
+    if (ev->fieldCount > 0) {
+        // 字段追加在消息之后, 消息自带的换行去掉
+        while (msglen > 0 && ev->msg[msglen - 1] == '\n') {
+            --msglen;
+        }
+    }
+    if (msglen > size - 2 - len) {
+        msglen = size - 2 - len;
     }
+    memcpy(buf + len, ev->msg, msglen);
+    len += msglen;
+    if (ev->fieldCount > 0) {
+        len += LogFieldCodec::Format(ev->fields, ev->fieldCount, buf + len, size - 2 - len);
+    }
+    if (len == 0 || buf[len - 1] != '\n') {
+        buf[len++] = '\n';
+    }
+    buf[len] = '\0';
 
-    return ret;
+    return len;
 }
 
 } // namespace eular
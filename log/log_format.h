@@ -17,6 +17,7 @@
 #include <atomic>
 
 #define PERFIX_SIZE (128)
+#define TIME_PREFIX_SIZE (15)   // MM-DD HH:MM:SS.
 #define LOG_BUF_SIZE (2048)
 
 // 05-24 10:10:10.100 12345 12345 I TAG: msg(\n)
@@ -31,7 +32,97 @@ public:
 
     static std::string Format(const LogEvent *ev);
 
+    /**
+     * @brief 将日志前缀与消息格式化到调用方提供的缓存, 不分配内存
+     *
+     * @param ev 日志事件, 忽略enableColor, 颜色由输出节点自行添加
+     * @param buf 输出缓存, 结果以\n结尾并以\0结束, 空间不足时截断消息
+     * @param size 缓存大小, 不小于FormatSize(ev)时不会截断
+     * @return 写入的字节数, 不含\0
+     */
+    static size_t Format(const LogEvent *ev, char *buf, size_t size);
+    // 完整格式化ev所需的缓存大小
+    static size_t FormatSize(const LogEvent *ev)
+    {
+        return PERFIX_SIZE + strlen(ev->msg) + 2 + LogFieldCodec::FormatSize(ev->fields, ev->fieldCount);
+    }
+
+    static const char *ColorBegin(LogLevel::Level level);
+    static const char *ColorEnd();
+    /**
+     * @brief localtime_r持有libc的时区锁, fork时若被其他线程持有, 子进程再调用会死锁.
+     *        日志模块统一经此调用, fork期间持有同一把锁
+     */
+    static void LocalTime(time_t sec, struct tm *out);
+    // 须早于输出节点注册, 使fork前最后加锁(输出节点持锁时可能调用LocalTime)
+    static void RegisterForkHandler();
+};
+
+// 线程内复用的格式化缓存, 容量只增不减, 小于LOG_BUF_SIZE时不分配内存
+class LogBuffer {
+public:
+    LogBuffer() : mData(mInline), mSize(0), mCapacity(sizeof(mInline)) {}
+    ~LogBuffer()
+    {
+        // 恢复为内联缓存: 线程局部对象析构后, 主线程的atexit回调仍可能写日志
+        if (mData != mInline) {
+            free(mData);
+        }
+        mData = mInline;
+        mSize = 0;
+        mCapacity = sizeof(mInline);
+    }
+
+    LogBuffer(const LogBuffer&) = delete;
+    LogBuffer& operator=(const LogBuffer&) = delete;
+
+    char *      data() const { return mData; }
+    size_t      size() const { return mSize; }
+    size_t      capacity() const { return mCapacity; }
+    void        clear() { mSize = 0; }
+
+    // 保证尾部至少有n字节可写, 内存不足返回nullptr
+    char *tail(size_t n)
+    {
+        if (mSize + n > mCapacity) {
+            size_t capacity = mCapacity * 2;
+            while (capacity < mSize + n) {
+                capacity *= 2;
+            }
+            char *data = (char *)malloc(capacity);
+            if (data == nullptr) {
+                return nullptr;
+            }
+            memcpy(data, mData, mSize);
+            if (mData != mInline) {
+                free(mData);
+            }
+            mData = data;
+            mCapacity = capacity;
+        }
+        return mData + mSize;
+    }
+    void        commit(size_t n) { mSize += n; }
+
+    // 格式化ev并追加到尾部, 返回追加的长度
+    size_t append(const LogEvent *ev)
+    {
+        size_t need = LogFormat::FormatSize(ev);
+        char *out = tail(need);
+        if (out == nullptr) {
+            need = mCapacity - mSize;
+            out = mData + mSize;
+        }
+        size_t len = LogFormat::Format(ev, out, need);
+        commit(len);
+        return len;
+    }
+
 private:
+    char *      mData;
+    size_t      mSize;
+    size_t      mCapacity;
+    char        mInline[LOG_BUF_SIZE];
 };
 
 } // namespace eular
@@ -0,0 +1,51 @@
+/*************************************************************************
+    > File Name: log_limit.cpp
+    > Author: hsz
+    > Brief:
+    > Created Time: 2026年10月18日 星期日 15时02分44秒
+ ************************************************************************/
+
+#include "log_limit.h"
+#include <time.h>
+
+namespace eular {
+static inline uint64_t MonotonicNs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+bool log_limit_every_ms(LogLimit *limit, uint32_t ms)
+{
+    uint64_t now = MonotonicNs();
+    uint64_t last = limit->state.load(std::memory_order_relaxed);
+    if ((last == 0 || now - last >= (uint64_t)ms * 1000000) &&
+        limit->state.compare_exchange_strong(last, now, std::memory_order_relaxed)) {
+        return true;
+    }
+
+    // 时间未到或其他线程已抢先输出
+    limit->suppressed.fetch_add(1, std::memory_order_relaxed);
+    return false;
+}
+
+bool log_limit_rate(LogLimit *limit, uint32_t perSecond, uint32_t burst)
+{
+    uint64_t interval = 1000000000 / (perSecond ? perSecond : 1);
+    uint64_t tolerance = interval * (burst ? burst : 1);
+    uint64_t now = MonotonicNs();
+    uint64_t tat = limit->state.load(std::memory_order_relaxed);
+    while (true) {
+        uint64_t base = tat > now ? tat : now;
+        if (base + interval - now > tolerance) {
+            limit->suppressed.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        if (limit->state.compare_exchange_weak(tat, base + interval, std::memory_order_relaxed)) {
+            return true;
+        }
+    }
+}
+
+} // namespace eular
@@ -0,0 +1,59 @@
+/*************************************************************************
+    > File Name: log_limit.h
+    > Author: hsz
+    > Brief: 调用点级别的日志限流: 每N条输出一条、时间间隔、令牌桶
+    > Created Time: 2026年10月18日 星期日 15时02分44秒
+ ************************************************************************/
+
+#ifndef __LOG_LIMIT_H__
+#define __LOG_LIMIT_H__
+
+#include "log_tag.h"
+#include <stdint.h>
+#include <atomic>
+
+namespace eular {
+/**
+ * @brief 每个限流调用点一个静态LogLimit, 常量初始化, 判断全部为无锁原子操作.
+ *        被丢弃的条数记录在suppressed中; 调用点首次输出时加入全局链表,
+ *        后台线程每秒及Flush()时为有丢弃的调用点写一行汇总
+ */
+struct LogLimit {
+    std::atomic<uint64_t>   state;      // EVERY_N: 计数; EVERY_MS: 上次输出时间; RATE: 令牌桶理论到达时间(ns)
+    std::atomic<uint32_t>   suppressed;
+    std::atomic<bool>       registered;
+    LogSite *               site;       // 以下在加入链表前写入, 之后只读
+    int32_t                 level;
+    LogLimit *              next;
+};
+
+// 每n条输出一条, 第一条总是输出
+static inline bool log_limit_every_n(LogLimit *limit, uint32_t n)
+{
+    if (n <= 1 || limit->state.fetch_add(1, std::memory_order_relaxed) % n == 0) {
+        return true;
+    }
+    limit->suppressed.fetch_add(1, std::memory_order_relaxed);
+    return false;
+}
+
+// 距上次输出不少于ms毫秒时输出
+bool log_limit_every_ms(LogLimit *limit, uint32_t ms);
+
+/**
+ * @brief 令牌桶, 按GCRA实现, 只需一个原子变量
+ *
+ * @param perSecond 每秒补充的令牌数
+ * @param burst 桶容量, 允许的突发条数
+ */
+bool log_limit_rate(LogLimit *limit, uint32_t perSecond, uint32_t burst);
+
+// 输出本条日志, 首次调用时登记调用点并启动汇总线程
+void log_write_limit(LogSite *site, LogLimit *limit, int32_t level, const char *fmt, ...) __attribute__((format(printf, 4, 5)));
+
+// 为所有有丢弃的调用点输出"suppressed N messages"并清零
+void log_limit_report();
+
+} // namespace eular
+
+#endif // __LOG_LIMIT_H__
@@ -1,28 +1,249 @@
 #include "log_main.h"
-#include <mutex>
 #include <memory>
+#include <pthread.h>
+#include <sched.h>
 
-static std::once_flag       gOnceFlag;
+// 不使用std::call_once: libutils导出的__once_proxy会覆盖libstdc++的同名符号
+static pthread_once_t       gOnceFlag = PTHREAD_ONCE_INIT;
 static eular::LogManager*   gLogManager = nullptr;
+static thread_local eular::LogBuffer gFormatBuffer;
+static thread_local std::vector<size_t> gFormatEnds;
+
+/**
+ * 每个线程占用一个hazard槽位, 记录正在读取的快照; 线程退出后槽位归还复用, 不释放.
+ * depth只由所属线程访问, 支持输出节点内部再次写日志
+ */
+struct LogHazard {
+    std::atomic<const void *>   ptr;
+    std::atomic<bool>           used;
+    LogHazard *                 next;
+    uint32_t                    depth;
+};
+
+static std::atomic<LogHazard *> gHazardList{nullptr};
+
+class LogHazardHolder {
+public:
+    LogHazardHolder() : mHazard(nullptr) {}
+    ~LogHazardHolder()
+    {
+        // 析构后若仍被使用(线程退出阶段写日志)会重新申请槽位
+        if (mHazard != nullptr) {
+            mHazard->ptr.store(nullptr, std::memory_order_release);
+            mHazard->depth = 0;
+            mHazard->used.store(false, std::memory_order_release);
+            mHazard = nullptr;
+        }
+    }
+
+    LogHazard *get()
+    {
+        if (mHazard == nullptr) {
+            mHazard = acquire();
+        }
+        return mHazard;
+    }
+
+    LogHazard *peek() const { return mHazard; }
+
+private:
+    static LogHazard *acquire()
+    {
+        for (LogHazard *h = gHazardList.load(std::memory_order_acquire); h != nullptr; h = h->next) {
+            bool expected = false;
+            if (!h->used.load(std::memory_order_relaxed) &&
+                h->used.compare_exchange_strong(expected, true, std::memory_order_acquire)) {
+                return h;
+            }
+        }
+
+        LogHazard *h = new LogHazard();
+        h->ptr.store(nullptr, std::memory_order_relaxed);
+        h->used.store(true, std::memory_order_relaxed);
+        h->depth = 0;
+        h->next = gHazardList.load(std::memory_order_relaxed);
+        while (!gHazardList.compare_exchange_weak(h->next, h, std::memory_order_release)) {
+        }
+        return h;
+    }
+
+    LogHazard *mHazard;
+};
+
+static thread_local LogHazardHolder gHazardHolder;
+// 本线程在读取快照期间替换下的旧快照, 最外层读取结束后释放
+static thread_local std::vector<eular::LogWriteSnapshot *> gRetired;
+
+/**
+ * 等待所有线程的hazard指针为空或指向当前快照. 快照替换不再由锁串行化,
+ * 此时比当前快照更早的快照都已不被引用, 可以释放
+ */
+static void WaitForReaders(const std::atomic<eular::LogWriteSnapshot *> &current)
+{
+    while (true) {
+        const void *snapshot = current.load(std::memory_order_seq_cst);
+        bool busy = false;
+        for (LogHazard *h = gHazardList.load(std::memory_order_acquire); h != nullptr; h = h->next) {
+            const void *ptr = h->ptr.load(std::memory_order_seq_cst);
+            if (ptr != nullptr && ptr != snapshot) {
+                busy = true;
+                break;
+            }
+        }
+        if (!busy) {
+            break;
+        }
+        sched_yield();
+    }
+}
 
 namespace eular {
-LogManager::LogManager()
+class LogManager::SnapshotGuard {
+public:
+    SnapshotGuard(LogManager *manager) :
+        mManager(manager),
+        mHazard(gHazardHolder.get())
+    {
+        if (mHazard->depth++ > 0) {
+            // 嵌套调用沿用外层快照, 外层的hazard指针仍然有效
+            mSnapshot = static_cast<const LogWriteSnapshot *>(mHazard->ptr.load(std::memory_order_relaxed));
+            return;
+        }
+
+        // 发布hazard指针后再次确认快照未被替换, 否则写线程可能已跳过本线程
+        LogWriteSnapshot *snapshot = manager->mSnapshot.load(std::memory_order_acquire);
+        while (true) {
+            mHazard->ptr.store(snapshot, std::memory_order_seq_cst);
+            LogWriteSnapshot *current = manager->mSnapshot.load(std::memory_order_seq_cst);
+            if (current == snapshot) {
+                break;
+            }
+            snapshot = current;
+        }
+        mSnapshot = snapshot;
+    }
+
+    ~SnapshotGuard()
+    {
+        if (--mHazard->depth == 0) {
+            mHazard->ptr.store(nullptr, std::memory_order_release);
+            if (!gRetired.empty()) {
+                std::vector<LogWriteSnapshot *> retired;
+                retired.swap(gRetired);
+                WaitForReaders(mManager->mSnapshot);
+                LogManager::freeRetired(retired);
+            }
+        }
+    }
+
+    const std::vector<LogWrite *> &writes() const { return mSnapshot->writes; }
+    uint32_t binaryCount() const { return mSnapshot->binaryCount; }
+
+private:
+    LogManager *                mManager;
+    LogHazard *                 mHazard;
+    const LogWriteSnapshot *    mSnapshot;
+};
+
+LogManager::LogManager() :
+    mSnapshot(nullptr),
+    mBatchBytes(0),
+    mBatchDelayMs(FILE_BATCH_DELAY_MS),
+    mBinaryCount(0)
 {
     pthread_mutex_init(&mListMutex, nullptr);
+    LogFormat::RegisterForkHandler();
+    FileLogWrite::RegisterForkHandler();
+    BinaryLogWrite::RegisterForkHandler();
+    MmapLogWrite::RegisterForkHandler();
+    ShmLogWrite::RegisterForkHandler();
+    ConsoleLogWrite::RegisterForkHandler();
+    // 晚于输出节点注册, fork前先于节点的锁加锁
+    pthread_atfork(AtForkPrepare, AtForkParent, AtForkChild);
     mLogWriteList.push_back(new StdoutLogWrite());
+    mSnapshot.store(new LogWriteSnapshot{{mLogWriteList.begin(), mLogWriteList.end()}, 0, nullptr});
     ::atexit(deleteInstance);
 }
 
 LogManager::~LogManager()
 {
-    if (mLogWriteList.size() > 0) {
-        for (LogWriteIt it = mLogWriteList.begin(); it != mLogWriteList.end();) {
-            if (*it != nullptr) {
-                delete *it;
-                it = mLogWriteList.erase(it);
-            } else {
-                ++it;
-            }
+    LogWriteSnapshot *snapshot = mSnapshot.exchange(nullptr);
+    if (snapshot != nullptr) {
+        WaitForReaders(mSnapshot);
+        delete snapshot;
+    }
+    for (LogWriteIt it = mLogWriteList.begin(); it != mLogWriteList.end(); ++it) {
+        delete *it;
+    }
+    mLogWriteList.clear();
+}
+
+LogWriteSnapshot *LogManager::publishLocked(LogWrite *removed)
+{
+    LogWriteSnapshot *snapshot = new LogWriteSnapshot();
+    snapshot->binaryCount = 0;
+    snapshot->removed = nullptr;
+    for (LogWriteIt it = mLogWriteList.begin(); it != mLogWriteList.end(); ++it) {
+        snapshot->writes.push_back(*it);
+        if ((*it)->type() == LogWrite::BINOUT) {
+            ++snapshot->binaryCount;
+        }
+    }
+
+    LogWriteSnapshot *old = mSnapshot.exchange(snapshot, std::memory_order_seq_cst);
+    mBinaryCount.store(snapshot->binaryCount, std::memory_order_relaxed);
+    old->removed = removed;
+    return old;
+}
+
+void LogManager::reclaim(LogWriteSnapshot *old)
+{
+    LogHazard *self = gHazardHolder.peek();
+    if (self != nullptr && self->depth > 0) {
+        // 输出节点内部增删节点, 等待会等到本线程自己
+        gRetired.push_back(old);
+        return;
+    }
+
+    WaitForReaders(mSnapshot);
+    freeRetired(std::vector<LogWriteSnapshot *>(1, old));
+}
+
+void LogManager::freeRetired(const std::vector<LogWriteSnapshot *> &retired)
+{
+    for (LogWriteSnapshot *snapshot : retired) {
+        delete snapshot->removed;
+        delete snapshot;
+    }
+}
+
+void LogManager::AtForkPrepare()
+{
+    if (gLogManager != nullptr) {
+        pthread_mutex_lock(&gLogManager->mListMutex);
+    }
+}
+
+void LogManager::AtForkParent()
+{
+    if (gLogManager != nullptr) {
+        pthread_mutex_unlock(&gLogManager->mListMutex);
+    }
+}
+
+void LogManager::AtForkChild()
+{
+    if (gLogManager != nullptr) {
+        pthread_mutex_init(&gLogManager->mListMutex, nullptr);
+    }
+
+    // 其他线程在子进程中不存在, 其槽位不会再被释放
+    LogHazard *self = gHazardHolder.peek();
+    for (LogHazard *h = gHazardList.load(std::memory_order_acquire); h != nullptr; h = h->next) {
+        if (h != self) {
+            h->ptr.store(nullptr, std::memory_order_relaxed);
+            h->depth = 0;
+            h->used.store(false, std::memory_order_relaxed);
         }
     }
 }
@@ -32,53 +253,146 @@ void LogManager::setPath(const std::string &path)
     mBasePath = path;
 }
 
-/**
- * @brief 非线程安全，禁止在程序运行后在添加日志节点，加锁影响性能
- * 
- * @param event 
- */
-void LogManager::WriteLog(LogEvent *event)
+void LogManager::setFileBatch(uint32_t maxBytes, uint32_t maxDelayMs)
 {
-    // pthread_mutex_lock(&mListMutex);
+    pthread_mutex_lock(&mListMutex);
+    mBatchBytes = maxBytes;
+    mBatchDelayMs = maxDelayMs;
     for (LogWriteIt it = mLogWriteList.begin(); it != mLogWriteList.end(); ++it) {
-        if (*it != nullptr) {
-            if ((*it)->type() != LogWrite::STDOUT) {
-                event->enableColor = false;
-            }
+        if ((*it)->type() == LogWrite::FILEOUT) {
+            static_cast<FileLogWrite *>(*it)->setBatch(mBatchBytes, mBatchDelayMs);
+        }
+    }
+    pthread_mutex_unlock(&mListMutex);
+}
+
+void LogManager::setFileRotate(const LogRotatePolicy &policy)
+{
+    pthread_mutex_lock(&mListMutex);
+    mRotatePolicy = policy;
+    for (LogWriteIt it = mLogWriteList.begin(); it != mLogWriteList.end(); ++it) {
+        if ((*it)->type() == LogWrite::FILEOUT) {
+            static_cast<FileLogWrite *>(*it)->setRotatePolicy(mRotatePolicy);
+        }
+    }
+    pthread_mutex_unlock(&mListMutex);
+}
+
+void LogManager::Flush()
+{
+    SnapshotGuard guard(this);
+    for (LogWrite *logWrite : guard.writes()) {
+        logWrite->Flush();
+    }
+}
+
+void LogManager::FlushOnCrash()
+{
+    // 崩溃时不再发布hazard指针, 快照在此期间被替换的概率可以忽略
+    LogManager *manager = gLogManager;
+    if (manager == nullptr) {
+        return;
+    }
+    LogWriteSnapshot *snapshot = manager->mSnapshot.load(std::memory_order_acquire);
+    if (snapshot == nullptr) {
+        return;
+    }
+    for (LogWrite *logWrite : snapshot->writes) {
+        logWrite->FlushOnCrash();
+    }
+}
+
+void LogManager::WriteLog(LogEvent *event, bool skipBinary)
+{
+    // 每条日志只格式化一次, 所有文本输出节点共用
+    LogBuffer &buffer = gFormatBuffer;
+    buffer.clear();
+    size_t len = buffer.append(event);
 
-            if ((*it)->type() == LogWrite::CONSOLEOUT)
-            {
-                (*it)->WriteToFile(*event);
+    {
+        SnapshotGuard guard(this);
+        for (LogWrite *logWrite : guard.writes()) {
+            if (skipBinary && logWrite->type() == LogWrite::BINOUT) {
+                continue;
             }
-            else
-            {
-                std::string log = LogFormat::Format(event);
-                (*it)->WriteToFile(log);
+            logWrite->WriteToFile(*event, buffer.data(), len);
+        }
+    }
+
+    if (event->level >= LogLevel::LEVEL_FATAL) {
+        Flush();
+    }
+}
+
+bool LogManager::WriteBinary(LogEvent *event, const char *fmt, va_list ap)
+{
+    bool needText = false;
+    {
+        SnapshotGuard guard(this);
+        for (LogWrite *logWrite : guard.writes()) {
+            if (logWrite->type() == LogWrite::BINOUT) {
+                static_cast<BinaryLogWrite *>(logWrite)->WriteFormat(*event, fmt, ap);
             }
         }
+        needText = guard.writes().size() > guard.binaryCount();
+    }
+
+    if (!needText && event->level >= LogLevel::LEVEL_FATAL) {
+        Flush();
+    }
+    return needText;
+}
+
+void LogManager::WriteLog(LogEvent **events, uint32_t count)
+{
+    if (count == 0) {
+        return;
+    }
+
+    LogBuffer &buffer = gFormatBuffer;
+    std::vector<size_t> &ends = gFormatEnds;
+    buffer.clear();
+    ends.clear();
+    bool hasFatal = false;
+
+    // 整批格式化一次, 由各输出节点决定合并写入还是按条写入
+    for (uint32_t i = 0; i < count; ++i) {
+        hasFatal = hasFatal || events[i]->level >= LogLevel::LEVEL_FATAL;
+        buffer.append(events[i]);
+        ends.push_back(buffer.size());
+    }
+
+    {
+        // 整批使用同一快照
+        SnapshotGuard guard(this);
+        for (LogWrite *logWrite : guard.writes()) {
+            logWrite->WriteBatch(events, count, buffer.data(), ends.data());
+        }
+    }
+
+    if (hasFatal) {
+        Flush();
     }
-    // pthread_mutex_unlock(&mListMutex);
 }
 
-const std::list<LogWrite *> &LogManager::GetLogWrite() const
+void LogManager::WriteRaw(const char *msg, size_t len)
 {
-    return mLogWriteList;
+    SnapshotGuard guard(this);
+    for (LogWrite *logWrite : guard.writes()) {
+        logWrite->WriteToFile(msg, len);
+    }
 }
 
 void LogManager::addLogWriteToList(int type)
 {
     LogWrite *logWrite = nullptr;
+    LogWriteSnapshot *old = nullptr;
 
     pthread_mutex_lock(&mListMutex);
-    for (LogWriteIt it = mLogWriteList.begin(); it != mLogWriteList.end();) {
-        if (*it == nullptr) {           // new 出来的对象为空
-            it = mLogWriteList.erase(it);
-            continue;
-        }
+    for (LogWriteIt it = mLogWriteList.begin(); it != mLogWriteList.end(); ++it) {
         if ((*it)->type() == type) {    // 如果已存在则直接返回
             goto unlock;
         }
-        ++it;
     }
 
     switch (type) {
@@ -88,42 +402,62 @@ void LogManager::addLogWriteToList(int type)
         case LogWrite::FILEOUT:
             logWrite = new FileLogWrite();
             logWrite->setBasePath(mBasePath);
+            static_cast<FileLogWrite *>(logWrite)->setBatch(mBatchBytes, mBatchDelayMs);
+            static_cast<FileLogWrite *>(logWrite)->setRotatePolicy(mRotatePolicy);
+            // 第一个文件在添加节点时打开, 之后的切换由后台线程准备
+            logWrite->CreateNewFile(logWrite->getFileName());
             break;
         case LogWrite::CONSOLEOUT:
             logWrite = new ConsoleLogWrite();
             break;
+        case LogWrite::MMAPOUT:
+            logWrite = new MmapLogWrite();
+            logWrite->setBasePath(mBasePath);
+            break;
+        case LogWrite::BINOUT:
+            logWrite = new BinaryLogWrite();
+            logWrite->setBasePath(mBasePath);
+            break;
+        case LogWrite::SHMOUT:
+            logWrite = new ShmLogWrite();
+            logWrite->setBasePath(mBasePath);
+            break;
         default:
             goto unlock;
     }
 
     mLogWriteList.push_back(logWrite);
+    old = publishLocked();
 
 unlock:
     pthread_mutex_unlock(&mListMutex);
+    if (old != nullptr) {
+        reclaim(old);
+    }
 }
 
 void LogManager::delLogWriteFromList(int type)
 {
+    LogWriteSnapshot *old = nullptr;
     pthread_mutex_lock(&mListMutex);
-    for (LogWriteIt it = mLogWriteList.begin(); it != mLogWriteList.end();) {
-        if (*it == nullptr) {
-            it = mLogWriteList.erase(it);
-            continue;
-        }
+    for (LogWriteIt it = mLogWriteList.begin(); it != mLogWriteList.end(); ++it) {
         if ((*it)->type() == type) {
-            delete (*it);
-            *it = nullptr;      // erase出错导致未删除此处节点时起作用
+            LogWrite *logWrite = *it;
             mLogWriteList.erase(it);
+            // 正在写入该节点的线程退出后才会析构
+            old = publishLocked(logWrite);
             break;
         }
-        ++it;
     }
     pthread_mutex_unlock(&mListMutex);
+    if (old != nullptr) {
+        reclaim(old);
+    }
 }
 
 LogManager *LogManager::getInstance()
 {
-    std::call_once(gOnceFlag, []() {
+    pthread_once(&gOnceFlag, []() {
         gLogManager = new LogManager();
     });
 
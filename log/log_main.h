@@ -16,10 +16,25 @@
 #include <queue>
 #include <pthread.h>
 #include <list>
+#include <vector>
+#include <atomic>
+#include <stdarg.h>
 
 #define MAX_QUEUE_SIZE (1024 * 10)
 
 namespace eular {
+// 输出节点列表的只读快照, 发布后不再修改
+struct LogWriteSnapshot {
+    std::vector<LogWrite *> writes;
+    uint32_t                binaryCount;
+    LogWrite *              removed;        // 被替换时删除的节点, 随本快照一起释放
+};
+
+/**
+ * 写日志的线程只读取当前快照, 不加锁; 增删输出节点时在mListMutex下生成新快照并原子替换,
+ * 释放mListMutex后等待所有线程的hazard指针为空或指向当前快照, 再释放旧快照及被删除的节点.
+ * 输出节点内部增删节点时本线程仍在使用旧快照, 推迟到该线程最外层的读取结束后释放
+ */
 class LogManager {
 public:
     typedef std::list<LogWrite *>::iterator LogWriteIt;
@@ -28,20 +43,54 @@ public:
     LogManager& operator=(const LogManager&) = delete;
 
     void setPath(const std::string &path);
-    void WriteLog(LogEvent *event);
+    // 设置文件输出节点的批量写入参数, maxBytes为0时关闭
+    void setFileBatch(uint32_t maxBytes, uint32_t maxDelayMs);
+    // 设置文件输出节点的切换与保留策略
+    void setFileRotate(const LogRotatePolicy &policy);
+    // 将所有输出节点缓存中的日志写出
+    void Flush();
+    // skipBinary为true时跳过已由WriteBinary写入的二进制输出节点
+    void WriteLog(LogEvent *event, bool skipBinary = false);
+    /**
+     * @brief 二进制输出节点直接编码格式串与参数
+     *
+     * @return 是否还有文本输出节点需要格式化后的消息
+     */
+    bool WriteBinary(LogEvent *event, const char *fmt, va_list ap);
+    bool hasBinaryWrite() const { return mBinaryCount.load(std::memory_order_relaxed) > 0; }
+    // 批量写入, 文本输出节点合并为一次写
+    void WriteLog(LogEvent **events, uint32_t count);
     static LogManager *getInstance();
     static void deleteInstance();
+    // 崩溃时写出各输出节点的缓存, 不加锁也不等待, 只在信号处理函数中使用
+    static void FlushOnCrash();
 
-    const std::list<LogWrite *> &GetLogWrite() const;
+    // 将已格式化的文本写入所有输出节点
+    void WriteRaw(const char *msg, size_t len);
     void addLogWriteToList(int type);
     void delLogWriteFromList(int type);
 
 private:
     LogManager();
+    class SnapshotGuard;
+    // 需持有mListMutex, 发布新快照, 返回被替换的快照, 由调用者释放锁后交给reclaim
+    LogWriteSnapshot *publishLocked(LogWrite *removed = nullptr);
+    // 不能持有mListMutex, 等待旧快照的读者退出后释放
+    void reclaim(LogWriteSnapshot *old);
+    static void freeRetired(const std::vector<LogWriteSnapshot *> &retired);
+
+    static void AtForkPrepare();
+    static void AtForkParent();
+    static void AtForkChild();
 
 private:
-    std::list<LogWrite *>   mLogWriteList;
+    std::list<LogWrite *>   mLogWriteList;      // 由mListMutex保护, 只在增删节点时使用
+    std::atomic<LogWriteSnapshot *> mSnapshot;
     std::string             mBasePath;
+    uint32_t                mBatchBytes;
+    uint32_t                mBatchDelayMs;
+    LogRotatePolicy         mRotatePolicy;
+    std::atomic<uint32_t>   mBinaryCount;
     pthread_mutex_t         mListMutex;
 };
 } // namespace eular
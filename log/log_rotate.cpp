@@ -0,0 +1,617 @@
+/*************************************************************************
+    > File Name: log_rotate.cpp
+    > Author: hsz
+    > Brief:
+    > Created Time: 2026年10月18日 星期日 17时02分18秒
+ ************************************************************************/
+
+#include "log_rotate.h"
+#include "log_format.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <pwd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <zlib.h>
+#include <algorithm>
+
+#define ROTATE_NAME_SUFFIX  ".log"
+#define ROTATE_GZ_SUFFIX    ".gz"
+#define ROTATE_MAX_SEQ      (100)           // 同一秒内创建的文件最多尝试的序号
+#define COMPRESS_CHUNK_SIZE (64 * 1024)
+
+namespace eular {
+static int32_t __lstat(const char *path)
+{
+    struct stat lst;
+    int32_t ret = lstat(path, &lst);
+    return ret;
+}
+
+static bool __mkdir(const char *path)
+{
+    if (access(path, F_OK) == 0) {
+        return 0;
+    }
+    return mkdir(path, S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH);
+}
+
+bool Mkdir(const std::string &path)
+{
+    if (__lstat(path.c_str()) == 0) {
+        return true;
+    }
+    std::string realPath = path;
+    if (path[0] == '~') {
+        uid_t uid = getuid();
+        struct passwd *p = getpwuid(uid);
+        if (p != nullptr) {
+            realPath = p->pw_dir;
+            realPath.append(path.c_str() + 1);
+        }
+    }
+    char* filePath = strdup(realPath.c_str());
+    char* ptr = strchr(filePath + 1, '/');
+    do {
+        for(; ptr; *ptr = '/', ptr = strchr(ptr + 1, '/')) {
+            *ptr = '\0';
+            if(__mkdir(filePath) != 0) {
+                break;
+            }
+        }
+        if(ptr != nullptr) {
+            break;
+        } else if(__mkdir(filePath) != 0) {
+            break;
+        }
+        free(filePath);
+        return true;
+    } while(0);
+    free(filePath);
+    return false;
+}
+
+std::string RealLogPath(const std::string &basePath)
+{
+    std::string path = basePath.length() ? basePath : std::string("~/log/");
+    if (path[0] == '~') {
+        struct passwd *p = getpwuid(getuid());
+        if (p != nullptr) {
+            path = p->pw_dir + path.substr(1);
+        }
+    }
+    if (path[path.length() - 1] != '/') {
+        path.append("/");
+    }
+    return path;
+}
+
+// 匹配log-YYYYmmdd-HHMMSS[.N].log[.gz]
+static bool IsRotateFile(const char *name)
+{
+    static const char pattern[] = "log-dddddddd-dddddd";
+    size_t i = 0;
+    for (; pattern[i] != '\0'; ++i) {
+        if (pattern[i] == 'd' ? (name[i] < '0' || name[i] > '9') : name[i] != pattern[i]) {
+            return false;
+        }
+    }
+
+    const char *ptr = name + i;
+    if (ptr[0] == '.' && ptr[1] >= '0' && ptr[1] <= '9') {
+        for (++ptr; *ptr >= '0' && *ptr <= '9'; ++ptr) {
+        }
+    }
+    if (strncmp(ptr, ROTATE_NAME_SUFFIX, sizeof(ROTATE_NAME_SUFFIX) - 1) != 0) {
+        return false;
+    }
+    ptr += sizeof(ROTATE_NAME_SUFFIX) - 1;
+    return *ptr == '\0' || strcmp(ptr, ROTATE_GZ_SUFFIX) == 0;
+}
+
+static uint64_t MonotonicMs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+LogRotator::LogRotator(uint32_t fileFlag, uint32_t fileMode) :
+    mThreadPid(0),
+    mThreadRunning(false),
+    mThreadExit(false),
+    mSpareWanted(false),
+    mSpareFd(-1),
+    mPathGen(0),
+    mRetryMs(0),
+    mFileFlag(fileFlag),
+    mFileMode(fileMode),
+    mMaxFiles(0),
+    mMaxTotalBytes(0),
+    mCompress(false),
+    mMaxFileSize(ROTATE_FILE_SIZE),
+    mIntervalSec(0)
+{
+    pthread_mutex_init(&mMutex, nullptr);
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&mCond, &attr);
+    pthread_condattr_destroy(&attr);
+}
+
+LogRotator::~LogRotator()
+{
+    stop();
+    pthread_cond_destroy(&mCond);
+    pthread_mutex_destroy(&mMutex);
+}
+
+void LogRotator::setPolicy(const LogRotatePolicy &policy)
+{
+    pthread_mutex_lock(&mMutex);
+    mMaxFiles = policy.maxFiles;
+    mMaxTotalBytes = policy.maxTotalBytes;
+    mCompress = policy.compress;
+    mMaxFileSize.store(policy.maxFileSize, std::memory_order_relaxed);
+    mIntervalSec.store(policy.intervalSec, std::memory_order_relaxed);
+    pthread_mutex_unlock(&mMutex);
+}
+
+LogRotatePolicy LogRotator::getPolicy()
+{
+    LogRotatePolicy policy;
+    pthread_mutex_lock(&mMutex);
+    policy.maxFileSize = mMaxFileSize.load(std::memory_order_relaxed);
+    policy.intervalSec = mIntervalSec.load(std::memory_order_relaxed);
+    policy.maxFiles = mMaxFiles;
+    policy.maxTotalBytes = mMaxTotalBytes;
+    policy.compress = mCompress;
+    pthread_mutex_unlock(&mMutex);
+    return policy;
+}
+
+void LogRotator::setFileOption(uint32_t fileFlag, uint32_t fileMode)
+{
+    pthread_mutex_lock(&mMutex);
+    mFileFlag = fileFlag;
+    mFileMode = fileMode;
+    pthread_mutex_unlock(&mMutex);
+}
+
+void LogRotator::setBasePath(const std::string &basePath)
+{
+    pthread_mutex_lock(&mMutex);
+    if (basePath != mBasePath) {
+        mBasePath = basePath;
+        ++mPathGen;
+        dropSpareLocked();
+    }
+    pthread_mutex_unlock(&mMutex);
+}
+
+int32_t LogRotator::check(uint64_t fileSize, time_t openTime) const
+{
+    uint64_t maxSize = mMaxFileSize.load(std::memory_order_relaxed);
+    uint32_t interval = mIntervalSec.load(std::memory_order_relaxed);
+    int32_t state = ROTATE_NONE;
+    if (maxSize > 0) {
+        if (fileSize >= maxSize) {
+            return ROTATE_NOW;
+        }
+        if (fileSize >= maxSize - maxSize / 8) {
+            state = ROTATE_SOON;
+        }
+    }
+    if (interval > 0) {
+        time_t age = time(nullptr) - openTime;
+        if (age >= (time_t)interval) {
+            return ROTATE_NOW;
+        }
+        if (age + (time_t)(interval / 8) + 1 >= (time_t)interval) {
+            state = ROTATE_SOON;
+        }
+    }
+
+    return state;
+}
+
+void LogRotator::prepare()
+{
+    pthread_mutex_lock(&mMutex);
+    if (mSpareFd < 0 && !mSpareWanted) {
+        mSpareWanted = true;
+        startThreadLocked();
+        pthread_cond_signal(&mCond);
+    }
+    pthread_mutex_unlock(&mMutex);
+}
+
+int32_t LogRotator::take(std::string &path)
+{
+    int32_t fd = -1;
+    pthread_mutex_lock(&mMutex);
+    if (mSpareFd >= 0) {
+        fd = mSpareFd;
+        path.swap(mSparePath);
+        mSpareFd = -1;
+        mSparePath.clear();
+    } else {
+        // 未准备好, 调用方继续写当前文件
+        mSpareWanted = true;
+        startThreadLocked();
+        pthread_cond_signal(&mCond);
+    }
+    pthread_mutex_unlock(&mMutex);
+    return fd;
+}
+
+void LogRotator::retire(int32_t fd, const std::string &path, const std::string &current)
+{
+    RetiredFile file;
+    file.fd = fd;
+    file.path = path;
+
+    pthread_mutex_lock(&mMutex);
+    mRetired.push_back(file);
+    mCurrent = current;
+    startThreadLocked();
+    pthread_cond_signal(&mCond);
+    pthread_mutex_unlock(&mMutex);
+}
+
+int32_t LogRotator::open(const std::string &name, std::string &path)
+{
+    pthread_mutex_lock(&mMutex);
+    std::string basePath = mBasePath;
+    pthread_mutex_unlock(&mMutex);
+
+    std::string dir = RealLogPath(basePath);
+    if (!Mkdir(dir)) {
+        return -1;
+    }
+    return openFile(dir, name, path);
+}
+
+void LogRotator::stop()
+{
+    pthread_mutex_lock(&mMutex);
+    bool join = mThreadRunning && mThreadPid == getpid();
+    mThreadExit = true;
+    mThreadRunning = false;
+    pthread_cond_signal(&mCond);
+    pthread_mutex_unlock(&mMutex);
+
+    if (join) {
+        pthread_join(mThread, nullptr);
+    }
+
+    pthread_mutex_lock(&mMutex);
+    // 线程未启动(或在子进程中)时剩余的文件只关闭, 不压缩
+    for (auto it = mRetired.begin(); it != mRetired.end(); ++it) {
+        close(it->fd);
+    }
+    mRetired.clear();
+    dropSpareLocked();
+    pthread_mutex_unlock(&mMutex);
+}
+
+void LogRotator::atForkPrepare()
+{
+    pthread_mutex_lock(&mMutex);
+}
+
+void LogRotator::atForkParent()
+{
+    pthread_mutex_unlock(&mMutex);
+}
+
+void LogRotator::atForkChild()
+{
+    // 后台线程及其任务属于父进程, 子进程只关闭继承的描述符
+    mThreadRunning = false;
+    mSpareWanted = false;
+    if (mSpareFd >= 0) {
+        close(mSpareFd);
+        mSpareFd = -1;
+        mSparePath.clear();
+    }
+    for (auto it = mRetired.begin(); it != mRetired.end(); ++it) {
+        close(it->fd);
+    }
+    mRetired.clear();
+
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&mCond, &attr);
+    pthread_condattr_destroy(&attr);
+    pthread_mutex_init(&mMutex, nullptr);
+}
+
+std::string LogRotator::FileName(time_t now)
+{
+    struct tm tmNow;
+    LogFormat::LocalTime(now, &tmNow);
+
+    char buf[64] = {0};
+    snprintf(buf, sizeof(buf), "log-%.4d%.2d%.2d-%.2d%.2d%.2d.log",
+        1900 + tmNow.tm_year,
+        1 + tmNow.tm_mon,
+        tmNow.tm_mday,
+        tmNow.tm_hour,
+        tmNow.tm_min,
+        tmNow.tm_sec);
+    return std::string(buf);
+}
+
+void LogRotator::startThreadLocked()
+{
+    pid_t pid = getpid();
+    if (mThreadExit || (mThreadRunning && mThreadPid == pid)) {
+        return;
+    }
+
+    mThreadPid = pid;
+    mThreadRunning = pthread_create(&mThread, nullptr, RotateThread, this) == 0;
+}
+
+void LogRotator::dropSpareLocked()
+{
+    // 准备好但未使用的文件为空文件, 直接删除
+    if (mSpareFd >= 0) {
+        close(mSpareFd);
+        unlink(mSparePath.c_str());
+        mSpareFd = -1;
+        mSparePath.clear();
+    }
+}
+
+int32_t LogRotator::openFile(const std::string &dir, const std::string &name, std::string &path)
+{
+    pthread_mutex_lock(&mMutex);
+    uint32_t flag = mFileFlag;
+    uint32_t mode = mFileMode;
+    pthread_mutex_unlock(&mMutex);
+
+    if (!name.empty()) {
+        // 指定文件名时保持原有打开方式, 同名文件追加写入
+        path = dir + name;
+        int32_t fd = ::open(path.c_str(), flag | O_CREAT, mode);
+        if (fd < 0) {
+            printf("open file (%s) error: %s\n", path.c_str(), strerror(errno));
+        }
+        return fd;
+    }
+
+    // 同一秒内多次切换时追加序号, 不写入已存在的文件
+    std::string base = FileName(time(nullptr));
+    std::string stem = base.substr(0, base.length() - (sizeof(ROTATE_NAME_SUFFIX) - 1));
+    flag = (flag & ~O_TRUNC) | O_CREAT | O_EXCL;
+    for (uint32_t seq = 0; seq < ROTATE_MAX_SEQ; ++seq) {
+        path = dir + (seq == 0 ? base : stem + "." + std::to_string(seq) + ROTATE_NAME_SUFFIX);
+        if (access((path + ROTATE_GZ_SUFFIX).c_str(), F_OK) == 0) {
+            // 同名文件已切换并压缩
+            continue;
+        }
+        int32_t fd = ::open(path.c_str(), flag, mode);
+        if (fd >= 0) {
+            return fd;
+        }
+        if (errno != EEXIST) {
+            printf("open file (%s) error: %s\n", path.c_str(), strerror(errno));
+            break;
+        }
+    }
+
+    return -1;
+}
+
+void LogRotator::compressFile(int32_t fd, const std::string &path)
+{
+    // 持有fd期间inode不会被复用, 据此判断path是否仍是切换出的文件(可能已被其他进程清理并重新创建)
+    struct stat origin;
+    if (fstat(fd, &origin) != 0) {
+        return;
+    }
+    int32_t in = ::open(path.c_str(), O_RDONLY);
+    if (in < 0) {
+        return;
+    }
+    struct stat st;
+    if (fstat(in, &st) != 0 || st.st_dev != origin.st_dev || st.st_ino != origin.st_ino) {
+        close(in);
+        return;
+    }
+
+    std::string gzPath = path + ROTATE_GZ_SUFFIX;
+    std::string tmpPath = gzPath + ".tmp";
+    gzFile out = gzopen(tmpPath.c_str(), "wb");
+    if (out == nullptr) {
+        close(in);
+        return;
+    }
+
+    char *buf = (char *)malloc(COMPRESS_CHUNK_SIZE);
+    bool ok = buf != nullptr;
+    while (ok) {
+        ssize_t n = ::read(in, buf, COMPRESS_CHUNK_SIZE);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            ok = n == 0;
+            break;
+        }
+        ok = gzwrite(out, buf, (unsigned)n) == n;
+        // 压缩大文件耗时较长, 期间写者请求的新文件不等待压缩完成
+        prepareSpare();
+    }
+    free(buf);
+
+    // 压缩文件沿用原文件的修改时间, 清理时按时间排序
+    bool hasTime = fstat(in, &st) == 0;
+    close(in);
+
+    // 写完后再改名, 压缩中途退出时保留原文件
+    ok = gzclose(out) == Z_OK && ok;
+    if (ok && hasTime) {
+        struct timespec times[2] = {st.st_atim, st.st_mtim};
+        utimensat(AT_FDCWD, tmpPath.c_str(), times, 0);
+    }
+    if (ok && rename(tmpPath.c_str(), gzPath.c_str()) == 0) {
+        if (stat(path.c_str(), &st) == 0 && st.st_dev == origin.st_dev && st.st_ino == origin.st_ino) {
+            unlink(path.c_str());
+        }
+    } else {
+        unlink(tmpPath.c_str());
+    }
+}
+
+void LogRotator::applyRetention(const std::string &dir, const std::string &current)
+{
+    pthread_mutex_lock(&mMutex);
+    uint32_t maxFiles = mMaxFiles;
+    uint64_t maxTotalBytes = mMaxTotalBytes;
+    pthread_mutex_unlock(&mMutex);
+    if (maxFiles == 0 && maxTotalBytes == 0) {
+        return;
+    }
+
+    struct FileItem {
+        std::string path;
+        struct timespec mtime;
+        uint64_t    size;
+    };
+    std::vector<FileItem> files;
+    uint64_t total = 0;
+
+    DIR *dp = opendir(dir.c_str());
+    if (dp == nullptr) {
+        return;
+    }
+    struct dirent *entry;
+    while ((entry = readdir(dp)) != nullptr) {
+        if (!IsRotateFile(entry->d_name)) {
+            continue;
+        }
+        FileItem item;
+        item.path = dir + entry->d_name;
+        struct stat st;
+        if (stat(item.path.c_str(), &st) != 0 || !S_ISREG(st.st_mode)) {
+            continue;
+        }
+        item.mtime = st.st_mtim;
+        item.size = st.st_size;
+        total += item.size;
+        files.push_back(item);
+    }
+    closedir(dp);
+
+    std::sort(files.begin(), files.end(), [](const FileItem &a, const FileItem &b) {
+        if (a.mtime.tv_sec != b.mtime.tv_sec) {
+            return a.mtime.tv_sec < b.mtime.tv_sec;
+        }
+        return a.mtime.tv_nsec != b.mtime.tv_nsec ? a.mtime.tv_nsec < b.mtime.tv_nsec : a.path < b.path;
+    });
+
+    // 从最旧的文件开始删除; 当前文件、已准备的空文件以及最新的文件(其他进程可能已切换到该文件)保留
+    size_t count = files.size();
+    for (auto it = files.begin(); it != files.end() && it + 1 != files.end(); ++it) {
+        bool overCount = maxFiles > 0 && count > maxFiles;
+        bool overBytes = maxTotalBytes > 0 && total > maxTotalBytes;
+        if (!overCount && !overBytes) {
+            break;
+        }
+        if (it->path == current || it->size == 0) {
+            continue;
+        }
+        if (unlink(it->path.c_str()) == 0) {
+            --count;
+            total -= it->size;
+        }
+    }
+}
+
+bool LogRotator::prepareSpare()
+{
+    pthread_mutex_lock(&mMutex);
+    bool wantSpare = mSpareWanted && mSpareFd < 0 && !mThreadExit && MonotonicMs() >= mRetryMs;
+    std::string basePath = mBasePath;
+    uint32_t pathGen = mPathGen;
+    pthread_mutex_unlock(&mMutex);
+    if (!wantSpare) {
+        return false;
+    }
+
+    std::string dir = RealLogPath(basePath);
+    std::string path;
+    int32_t fd = Mkdir(dir) ? openFile(dir, std::string(), path) : -1;
+
+    pthread_mutex_lock(&mMutex);
+    if (fd < 0) {
+        mRetryMs = MonotonicMs() + ROTATE_RETRY_MS;
+    } else if (pathGen != mPathGen || mThreadExit) {
+        close(fd);
+        unlink(path.c_str());
+    } else {
+        mSpareFd = fd;
+        mSparePath = path;
+        mSpareWanted = false;
+    }
+    pthread_mutex_unlock(&mMutex);
+    return true;
+}
+
+void *LogRotator::RotateThread(void *arg)
+{
+    LogRotator *self = static_cast<LogRotator *>(arg);
+
+    pthread_mutex_lock(&self->mMutex);
+    while (true) {
+        bool wantSpare = self->mSpareWanted && self->mSpareFd < 0 && !self->mThreadExit &&
+            MonotonicMs() >= self->mRetryMs;
+        if (!wantSpare && self->mRetired.empty()) {
+            if (self->mThreadExit) {
+                break;
+            }
+            struct timespec ts;
+            clock_gettime(CLOCK_MONOTONIC, &ts);
+            ts.tv_sec += ROTATE_RETRY_MS / 1000;
+            pthread_cond_timedwait(&self->mCond, &self->mMutex, &ts);
+            continue;
+        }
+
+        RetiredFile retired = {-1, std::string()};
+        if (!self->mRetired.empty()) {
+            retired = self->mRetired.front();
+            self->mRetired.erase(self->mRetired.begin());
+        }
+        std::string dir = self->mBasePath;
+        std::string current = self->mCurrent;
+        bool compress = self->mCompress;
+        pthread_mutex_unlock(&self->mMutex);
+
+        // 文件操作均在锁外进行, 准备新文件优先
+        self->prepareSpare();
+        if (retired.fd >= 0) {
+            if (compress && !retired.path.empty()) {
+                self->compressFile(retired.fd, retired.path);
+            }
+            close(retired.fd);
+            self->applyRetention(RealLogPath(dir), current);
+        }
+
+        pthread_mutex_lock(&self->mMutex);
+    }
+    pthread_mutex_unlock(&self->mMutex);
+
+    return nullptr;
+}
+
+} // namespace eular
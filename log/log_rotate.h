@@ -0,0 +1,148 @@
+/*************************************************************************
+    > File Name: log_rotate.h
+    > Author: hsz
+    > Brief: 文件输出的后台切换: 预先准备新文件, 关闭、压缩切换出的文件并按保留策略清理
+    > Created Time: 2026年10月18日 星期日 17时02分18秒
+ ************************************************************************/
+
+#ifndef __LOG_ROTATE_H__
+#define __LOG_ROTATE_H__
+
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+#include <string>
+#include <vector>
+#include <atomic>
+
+#define ROTATE_FILE_SIZE    (5 * 1024 * 1024)   // 默认切换大小
+#define ROTATE_RETRY_MS     (1000)              // 准备文件失败后的重试间隔
+
+namespace eular {
+struct LogRotatePolicy {
+    uint64_t    maxFileSize;    // 文件达到该大小后切换, 0表示不按大小切换
+    uint32_t    intervalSec;    // 文件打开超过该秒数后切换, 0表示不按时间切换
+    uint32_t    maxFiles;       // 目录中最多保留的日志文件数(含压缩文件与当前文件), 0表示不限制
+    uint64_t    maxTotalBytes;  // 保留文件的总字节数上限, 0表示不限制
+    bool        compress;       // 切换出的文件在后台压缩为.gz
+
+    LogRotatePolicy() :
+        maxFileSize(ROTATE_FILE_SIZE),
+        intervalSec(0),
+        maxFiles(0),
+        maxTotalBytes(0),
+        compress(false)
+    {
+    }
+};
+
+// 展开'~'并返回以'/'结尾的日志目录, 未设置时为~/log/
+std::string RealLogPath(const std::string &basePath);
+// 逐级创建目录, 已存在时返回true
+bool Mkdir(const std::string &path);
+
+/**
+ * @brief 每个文件输出节点一个LogRotator, 在各自进程内按需启动后台线程.
+ *        写者在进程锁内通过check判断是否需要切换: 接近阈值时请求后台线程预先创建下一个文件,
+ *        到达阈值时直接取走已准备好的文件描述符, 未准备好时继续写当前文件, 不等待mkdir与open.
+ *        切换出的文件由后台线程关闭、压缩, 再按maxFiles/maxTotalBytes删除最旧的文件.
+ *        只清理名称为log-YYYYmmdd-HHMMSS[.N].log[.gz]的文件, 不影响其他输出节点的文件.
+ */
+class LogRotator {
+public:
+    enum State {
+        ROTATE_NONE = 0,
+        ROTATE_SOON = 1,    // 接近阈值, 预先准备文件
+        ROTATE_NOW  = 2,
+    };
+
+    LogRotator(uint32_t fileFlag, uint32_t fileMode);
+    ~LogRotator();
+
+    LogRotator(const LogRotator&) = delete;
+    LogRotator& operator=(const LogRotator&) = delete;
+
+    void            setPolicy(const LogRotatePolicy &policy);
+    LogRotatePolicy getPolicy();
+    void            setFileOption(uint32_t fileFlag, uint32_t fileMode);
+    // 目录变化后丢弃已准备的文件
+    void            setBasePath(const std::string &basePath);
+
+    // 写者接口, 只做内存操作与唤醒, 不进行文件操作
+    int32_t         check(uint64_t fileSize, time_t openTime) const;
+    void            prepare();
+    /**
+     * @brief 取走后台准备好的文件, 未准备好时请求后台线程准备
+     *
+     * @param path 文件完整路径
+     * @return 文件描述符, 未准备好时返回-1
+     */
+    int32_t         take(std::string &path);
+    /**
+     * @brief 将切换出的文件交给后台线程关闭、压缩并清理旧文件
+     *
+     * @param current 当前正在写入的文件, 清理时保留
+     */
+    void            retire(int32_t fd, const std::string &path, const std::string &current);
+
+    /**
+     * @brief 在调用线程中创建文件, 只用于添加输出节点时打开第一个文件
+     *
+     * @param name 文件名, 为空时按当前时间生成
+     */
+    int32_t         open(const std::string &name, std::string &path);
+    // 处理完剩余的切换任务后停止后台线程
+    void            stop();
+
+    // 由文件输出节点的fork处理函数调用
+    void            atForkPrepare();
+    void            atForkParent();
+    void            atForkChild();
+
+    // log-YYYYmmdd-HHMMSS.log
+    static std::string FileName(time_t now);
+
+private:
+    struct RetiredFile {
+        int32_t     fd;
+        std::string path;
+    };
+
+    void            startThreadLocked();
+    void            dropSpareLocked();
+    // 有写者等待新文件时创建, 返回是否处理了请求; 不持有mMutex调用
+    bool            prepareSpare();
+    int32_t         openFile(const std::string &dir, const std::string &name, std::string &path);
+    // 需在关闭fd前调用
+    void            compressFile(int32_t fd, const std::string &path);
+    void            applyRetention(const std::string &dir, const std::string &current);
+    static void *   RotateThread(void *arg);
+
+private:
+    pthread_mutex_t mMutex;         // 保护以下成员, 后台线程在锁外进行文件操作
+    pthread_cond_t  mCond;
+    pthread_t       mThread;
+    pid_t           mThreadPid;     // 后台线程所在进程, fork后子进程中需重新创建
+    bool            mThreadRunning;
+    bool            mThreadExit;
+    bool            mSpareWanted;
+    int32_t         mSpareFd;
+    std::string     mSparePath;
+    std::string     mBasePath;
+    uint32_t        mPathGen;       // 目录变化时加一, 丢弃按旧目录准备的文件
+    uint64_t        mRetryMs;       // 创建文件失败后, 到该时间前不再重试
+    std::string     mCurrent;
+    std::vector<RetiredFile> mRetired;
+    uint32_t        mFileFlag;
+    uint32_t        mFileMode;
+    uint32_t        mMaxFiles;
+    uint64_t        mMaxTotalBytes;
+    bool            mCompress;
+
+    std::atomic<uint64_t>   mMaxFileSize;   // 写者无锁读取
+    std::atomic<uint32_t>   mIntervalSec;
+};
+
+} // namespace eular
+
+#endif // __LOG_ROTATE_H__
@@ -0,0 +1,242 @@
+/*************************************************************************
+    > File Name: log_shm.cpp
+    > Author: hsz
+    > Brief:
+    > Created Time: 2026年10月18日 星期日 16时10分27秒
+ ************************************************************************/
+
+#include "log_shm.h"
+#include <errno.h>
+#include <sched.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <new>
+
+#define SHM_RECORD_ALIGN    (8)
+#define SHM_RECORD_PAD      (0xFFFFFFFFu)
+
+namespace eular {
+static std::atomic<uint32_t> gAreaSeq{0};
+
+static inline uint64_t AlignRecord(uint64_t size)
+{
+    return (size + SHM_RECORD_ALIGN - 1) & ~(uint64_t)(SHM_RECORD_ALIGN - 1);
+}
+
+static inline uint64_t MonotonicMs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+ShmLogArea::ShmLogArea() :
+    mBase(nullptr),
+    mMapSize(0),
+    mHeader(nullptr),
+    mRings(nullptr),
+    mData(nullptr)
+{
+}
+
+ShmLogArea::~ShmLogArea()
+{
+    destroy();
+}
+
+bool ShmLogArea::create(uint32_t ringCount, uint32_t ringSize)
+{
+    if (mBase != nullptr || ringCount == 0 || ringSize == 0 || (ringSize & (ringSize - 1)) != 0) {
+        return false;
+    }
+
+    size_t pageSize = sysconf(_SC_PAGESIZE);
+    size_t ctrlSize = sizeof(ShmLogHeader) + sizeof(ShmRing) * ringCount;
+    ctrlSize = (ctrlSize + pageSize - 1) / pageSize * pageSize;
+    size_t mapSize = ctrlSize + (size_t)ringCount * ringSize;
+
+    // 匿名共享映射按需分配物理页, 空闲环不占内存
+    void *base = mmap(nullptr, mapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (base == MAP_FAILED) {
+        return false;
+    }
+
+    ShmLogHeader *header = new (base) ShmLogHeader();
+    header->id = ((uint64_t)getpid() << 32) | gAreaSeq.fetch_add(1, std::memory_order_relaxed);
+    header->ringCount = ringCount;
+    header->ringSize = ringSize;
+    header->collectorPid = getpid();
+    header->running.store(0, std::memory_order_relaxed);
+
+    // 持有锁的进程异常退出时, 其他进程可以恢复
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+    pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+    pthread_mutex_init(&header->sharedMutex, &attr);
+    pthread_mutexattr_destroy(&attr);
+
+    ShmRing *rings = reinterpret_cast<ShmRing *>(header + 1);
+    for (uint32_t i = 0; i < ringCount; ++i) {
+        ShmRing *ring = new (&rings[i]) ShmRing();
+        ring->state.store(i == 0 ? SHM_RING_OWNED : SHM_RING_FREE, std::memory_order_relaxed);
+        ring->pid.store(0, std::memory_order_relaxed);
+        ring->tid.store(0, std::memory_order_relaxed);
+        ring->head.store(0, std::memory_order_relaxed);
+        ring->tail.store(0, std::memory_order_relaxed);
+        ring->dropped.store(0, std::memory_order_relaxed);
+    }
+
+    mBase = base;
+    mMapSize = mapSize;
+    mHeader = header;
+    mRings = rings;
+    mData = static_cast<char *>(base) + ctrlSize;
+    return true;
+}
+
+void ShmLogArea::destroy()
+{
+    if (mBase == nullptr) {
+        return;
+    }
+
+    // 共享的锁由创建进程销毁
+    if (mHeader->collectorPid == getpid()) {
+        pthread_mutex_destroy(&mHeader->sharedMutex);
+    }
+    munmap(mBase, mMapSize);
+    mBase = nullptr;
+    mMapSize = 0;
+    mHeader = nullptr;
+    mRings = nullptr;
+    mData = nullptr;
+}
+
+uint32_t ShmLogArea::claim(int32_t pid, int32_t tid)
+{
+    for (uint32_t i = 1; i < mHeader->ringCount; ++i) {
+        ShmRing &ring = mRings[i];
+        uint32_t expected = SHM_RING_FREE;
+        if (ring.state.load(std::memory_order_relaxed) == SHM_RING_FREE &&
+            ring.state.compare_exchange_strong(expected, SHM_RING_OWNED, std::memory_order_acquire)) {
+            ring.pid.store(pid, std::memory_order_relaxed);
+            ring.tid.store(tid, std::memory_order_relaxed);
+            return i;
+        }
+    }
+
+    return 0;
+}
+
+void ShmLogArea::release(uint32_t index)
+{
+    if (index == 0 || index >= mHeader->ringCount) {
+        return;
+    }
+    mRings[index].state.store(SHM_RING_CLOSED, std::memory_order_release);
+}
+
+int32_t ShmLogArea::push(uint32_t index, uint64_t timeNs, const char *msg, size_t len)
+{
+    ShmRing &ring = mRings[index];
+    char *data = mData + (size_t)index * mHeader->ringSize;
+    if (index != 0) {
+        return pushLocked(ring, data, timeNs, msg, len);
+    }
+
+    int32_t ret = pthread_mutex_lock(&mHeader->sharedMutex);
+    if (ret == EOWNERDEAD) {
+        // 持锁进程在写入途中退出; head只在记录写完后发布, 环内不会留下半条记录, 无需重置.
+        // 也不能修改head: 收集进程不持有此锁, 可能正在消费
+        pthread_mutex_consistent(&mHeader->sharedMutex);
+    } else if (ret != 0) {
+        return -1;
+    }
+    ret = pushLocked(ring, data, timeNs, msg, len);
+    pthread_mutex_unlock(&mHeader->sharedMutex);
+    return ret;
+}
+
+int32_t ShmLogArea::pushLocked(ShmRing &ring, char *data, uint64_t timeNs, const char *msg, size_t len)
+{
+    uint64_t size = mHeader->ringSize;
+    // 单条日志最多占半个环, 保证回绕后总能放下
+    size_t maxLen = size / 2 - sizeof(ShmRecordHeader);
+    if (len > maxLen) {
+        len = maxLen;
+    }
+
+    uint64_t need = AlignRecord(sizeof(ShmRecordHeader) + len);
+    uint64_t head = ring.head.load(std::memory_order_relaxed);
+    uint64_t pos = head & (size - 1);
+    uint64_t contiguous = size - pos;
+    uint64_t total = contiguous < need ? contiguous + need : need;
+
+    uint64_t tail = ring.tail.load(std::memory_order_acquire);
+    if (size - (head - tail) < total) {
+        uint64_t deadline = MonotonicMs() + SHM_WAIT_MS;
+        while (true) {
+            sched_yield();
+            tail = ring.tail.load(std::memory_order_acquire);
+            if (size - (head - tail) >= total) {
+                break;
+            }
+            if (!mHeader->running.load(std::memory_order_relaxed) || MonotonicMs() >= deadline) {
+                ring.dropped.fetch_add(1, std::memory_order_relaxed);
+                return -1;
+            }
+        }
+    }
+
+    if (contiguous < need) {
+        ShmRecordHeader *pad = reinterpret_cast<ShmRecordHeader *>(data + pos);
+        pad->length = SHM_RECORD_PAD;
+        head += contiguous;
+        pos = 0;
+    }
+
+    ShmRecordHeader *rec = reinterpret_cast<ShmRecordHeader *>(data + pos);
+    rec->length = len;
+    rec->reserved = 0;
+    rec->timeNs = timeNs;
+    memcpy(rec + 1, msg, len);
+    ring.head.store(head + need, std::memory_order_release);
+    return len;
+}
+
+const ShmRecordHeader *ShmLogArea::peek(uint32_t index, uint64_t limit)
+{
+    ShmRing &ring = mRings[index];
+    char *data = mData + (size_t)index * mHeader->ringSize;
+    uint64_t size = mHeader->ringSize;
+    uint64_t tail = ring.tail.load(std::memory_order_relaxed);
+    while (tail < limit) {
+        uint64_t pos = tail & (size - 1);
+        const ShmRecordHeader *rec = reinterpret_cast<const ShmRecordHeader *>(data + pos);
+        if (rec->length != SHM_RECORD_PAD) {
+            return rec;
+        }
+        tail += size - pos;
+        ring.tail.store(tail, std::memory_order_release);
+    }
+
+    return nullptr;
+}
+
+void ShmLogArea::consume(uint32_t index, const ShmRecordHeader *rec)
+{
+    ShmRing &ring = mRings[index];
+    uint64_t tail = ring.tail.load(std::memory_order_relaxed);
+    ring.tail.store(tail + AlignRecord(sizeof(ShmRecordHeader) + rec->length), std::memory_order_release);
+}
+
+bool ShmLogArea::pending(uint32_t index) const
+{
+    const ShmRing &ring = mRings[index];
+    return ring.tail.load(std::memory_order_acquire) != ring.head.load(std::memory_order_acquire);
+}
+
+} // namespace eular
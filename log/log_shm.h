@@ -0,0 +1,110 @@
+/*************************************************************************
+    > File Name: log_shm.h
+    > Author: hsz
+    > Brief: 多进程共享内存日志环: 每个线程独占一个单生产者单消费者环, 由收集线程合并写入文件
+    > Created Time: 2026年10月18日 星期日 16时10分27秒
+ ************************************************************************/
+
+#ifndef __LOG_SHM_H__
+#define __LOG_SHM_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <pthread.h>
+#include <atomic>
+
+#define SHM_RING_COUNT      (64)            // 环个数, 0号为公共环
+#define SHM_RING_SIZE       (256 * 1024)    // 每个环的字节数, 须为2的幂
+#define SHM_WAIT_MS         (10)            // 环满时等待收集线程的最长时间, 超时丢弃
+
+/**
+ * 共享内存布局: ShmLogHeader + ShmRing[ringCount] + 数据区(ringCount * ringSize).
+ * 映射为MAP_SHARED|MAP_ANONYMOUS, 创建后fork出的子进程共享同一块内存.
+ * 线程首次写入时抢占一个空闲环(state由FREE改为OWNED), 只有该线程写入, 只有收集线程读取,
+ * 两端各自推进head/tail, 无需加锁. 没有空闲环时写入0号公共环, 由进程间共享的互斥锁保护.
+ * 环内记录为ShmRecordHeader + 消息, 按8字节对齐, 放不下时写入填充记录并回绕.
+ */
+namespace eular {
+enum ShmRingState {
+    SHM_RING_FREE   = 0,
+    SHM_RING_OWNED  = 1,
+    SHM_RING_CLOSED = 2,    // 所属线程已退出, 收集线程读完后置为FREE
+};
+
+struct ShmRecordHeader {
+    uint32_t    length;     // 消息长度, SHM_RECORD_PAD表示填充至环尾
+    uint32_t    reserved;
+    uint64_t    timeNs;     // 日志时间, 合并时排序
+};
+
+struct ShmRing {
+    std::atomic<uint32_t>   state;
+    std::atomic<int32_t>    pid;
+    std::atomic<int32_t>    tid;
+    alignas(64) std::atomic<uint64_t> head;     // 生产者推进
+    alignas(64) std::atomic<uint64_t> tail;     // 收集线程推进
+    std::atomic<uint64_t>   dropped;            // 等待超时丢弃的条数
+};
+
+struct ShmLogHeader {
+    uint64_t                id;             // 区分不同映射, 线程据此判断缓存的环是否有效
+    uint32_t                ringCount;
+    uint32_t                ringSize;
+    int32_t                 collectorPid;
+    std::atomic<uint32_t>   running;        // 收集线程是否在运行, 退出后写者不再等待
+    pthread_mutex_t         sharedMutex;    // 保护公共环
+};
+
+class ShmLogArea {
+public:
+    ShmLogArea();
+    ~ShmLogArea();
+
+    ShmLogArea(const ShmLogArea&) = delete;
+    ShmLogArea& operator=(const ShmLogArea&) = delete;
+
+    bool        create(uint32_t ringCount = SHM_RING_COUNT, uint32_t ringSize = SHM_RING_SIZE);
+    void        destroy();
+    bool        valid() const { return mHeader != nullptr; }
+    uint64_t    id() const { return mHeader ? mHeader->id : 0; }
+    ShmLogHeader *header() const { return mHeader; }
+    uint32_t    ringCount() const { return mHeader->ringCount; }
+    ShmRing &   ring(uint32_t index) const { return mRings[index]; }
+
+    // 生产者接口
+    /**
+     * @brief 抢占一个空闲环
+     *
+     * @return 环序号, 没有空闲环时返回0(公共环)
+     */
+    uint32_t    claim(int32_t pid, int32_t tid);
+    // 释放环, 收集线程读完剩余日志后回收
+    void        release(uint32_t index);
+    /**
+     * @brief 写入一条日志, 环满时最多等待SHM_WAIT_MS
+     *
+     * @return 写入的消息长度, 超时丢弃返回-1
+     */
+    int32_t     push(uint32_t index, uint64_t timeNs, const char *msg, size_t len);
+
+    // 收集线程接口
+    // 返回下一条记录, 为空返回nullptr; 跳过填充记录
+    const ShmRecordHeader *peek(uint32_t index, uint64_t limit);
+    void        consume(uint32_t index, const ShmRecordHeader *rec);
+    static const char *payload(const ShmRecordHeader *rec) { return reinterpret_cast<const char *>(rec + 1); }
+    // 环内是否还有未读取的日志
+    bool        pending(uint32_t index) const;
+
+private:
+    int32_t     pushLocked(ShmRing &ring, char *data, uint64_t timeNs, const char *msg, size_t len);
+
+    void *          mBase;
+    size_t          mMapSize;
+    ShmLogHeader *  mHeader;
+    ShmRing *       mRings;
+    char *          mData;
+};
+
+} // namespace eular
+
+#endif // __LOG_SHM_H__
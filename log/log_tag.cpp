@@ -0,0 +1,268 @@
+/*************************************************************************
+    > File Name: log_tag.cpp
+    > Author: hsz
+    > Brief:
+    > Created Time: 2026年10月18日 星期日 14时20分36秒
+ ************************************************************************/
+
+#include "log_tag.h"
+#include "log_event.h"
+#include <pthread.h>
+#include <string.h>
+#include <vector>
+
+#define TAG_CACHE_SIZE  (256)   // 按tag缓存的调用点个数, 须为2的幂
+
+namespace eular {
+struct TagLevel {
+    char    tag[LOG_TAG_SIZE];
+    size_t  length;     // 前缀匹配时不含'*'
+    bool    prefix;
+    int32_t level;
+};
+
+static pthread_mutex_t gTagMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t gTagOnce = PTHREAD_ONCE_INIT;
+static std::atomic<int32_t> gLevel{LogLevel::LEVEL_DEBUG};
+static std::atomic<bool> gHasTagLevel{false};
+static LogSite *gSiteList = nullptr;
+// 不释放, 避免退出阶段仍在输出日志的线程访问已析构的对象
+static std::vector<TagLevel> *gTagLevels = new std::vector<TagLevel>();
+
+/**
+ * log_write等不经过LogSite宏的输出按tag缓存一个调用点, 与宏定义的调用点一样注册到gSiteList,
+ * 级别变化时随之更新; 查询时开放寻址无锁查找, 只在首次出现的tag插入时加锁.
+ * 缓存项插入后不移除也不释放, 表满或tag过长时退回加锁查询
+ */
+struct TagSite {
+    LogSite site;
+    char    tag[LOG_TAG_SIZE];
+};
+static std::atomic<TagSite *> gTagCache[TAG_CACHE_SIZE];
+
+static void TagAtForkPrepare()
+{
+    pthread_mutex_lock(&gTagMutex);
+}
+
+static void TagAtForkParent()
+{
+    pthread_mutex_unlock(&gTagMutex);
+}
+
+static void TagAtForkChild()
+{
+    pthread_mutex_init(&gTagMutex, nullptr);
+}
+
+static void TagLock()
+{
+    pthread_once(&gTagOnce, []() {
+        pthread_atfork(TagAtForkPrepare, TagAtForkParent, TagAtForkChild);
+    });
+    pthread_mutex_lock(&gTagMutex);
+}
+
+static void TagUnlock()
+{
+    pthread_mutex_unlock(&gTagMutex);
+}
+
+// 需持有gTagMutex
+static int32_t ResolveLocked(const char *tag)
+{
+    const TagLevel *match = nullptr;
+    for (auto it = gTagLevels->begin(); it != gTagLevels->end(); ++it) {
+        if (!it->prefix) {
+            if (strcmp(it->tag, tag) == 0) {
+                return it->level;
+            }
+            continue;
+        }
+        if (strncmp(it->tag, tag, it->length) == 0 && (match == nullptr || it->length > match->length)) {
+            match = &(*it);
+        }
+    }
+
+    return match ? match->level : gLevel.load(std::memory_order_relaxed);
+}
+
+static void UpdateSitesLocked()
+{
+    bool hasTagLevel = !gTagLevels->empty();
+    for (LogSite *site = gSiteList; site != nullptr; site = site->next) {
+        int32_t level = hasTagLevel ? ResolveLocked(site->tag) : gLevel.load(std::memory_order_relaxed);
+        site->level.store(level, std::memory_order_relaxed);
+    }
+    gHasTagLevel.store(hasTagLevel, std::memory_order_release);
+}
+
+int32_t log_site_resolve(LogSite *site)
+{
+    TagLock();
+    int32_t level = site->level.load(std::memory_order_relaxed);
+    if (level == LOG_SITE_UNRESOLVED) {
+        level = ResolveLocked(site->tag);
+        site->next = gSiteList;
+        gSiteList = site;
+        site->level.store(level, std::memory_order_relaxed);
+    }
+    TagUnlock();
+
+    return level;
+}
+
+static uint32_t TagHash(const char *tag, size_t length)
+{
+    // FNV-1a
+    uint32_t hash = 2166136261U;
+    for (size_t i = 0; i < length; ++i) {
+        hash ^= (uint8_t)tag[i];
+        hash *= 16777619U;
+    }
+    return hash;
+}
+
+// 返回tag对应的缓存项; 未找到时返回nullptr, slot为可插入位置, 表满时slot为TAG_CACHE_SIZE
+static TagSite *TagCacheFind(const char *tag, uint32_t hash, size_t &slot)
+{
+    for (size_t i = 0; i < TAG_CACHE_SIZE; ++i) {
+        slot = (hash + i) & (TAG_CACHE_SIZE - 1);
+        TagSite *item = gTagCache[slot].load(std::memory_order_acquire);
+        if (item == nullptr) {
+            return nullptr;
+        }
+        if (strcmp(item->tag, tag) == 0) {
+            return item;
+        }
+    }
+
+    slot = TAG_CACHE_SIZE;
+    return nullptr;
+}
+
+// 需持有gTagMutex
+static int32_t TagCacheInsertLocked(const char *tag, size_t length, uint32_t hash)
+{
+    size_t slot = 0;
+    TagSite *item = TagCacheFind(tag, hash, slot);
+    if (item != nullptr) {
+        return item->site.level.load(std::memory_order_relaxed);
+    }
+
+    int32_t level = ResolveLocked(tag);
+    if (slot == TAG_CACHE_SIZE) {
+        return level;
+    }
+
+    item = new TagSite();
+    memcpy(item->tag, tag, length + 1);
+    item->site.tag = item->tag;
+    item->site.level.store(level, std::memory_order_relaxed);
+    item->site.next = gSiteList;
+    gSiteList = &item->site;
+    gTagCache[slot].store(item, std::memory_order_release);
+    return level;
+}
+
+int32_t log_tag_level(const char *tag)
+{
+    if (!gHasTagLevel.load(std::memory_order_acquire)) {
+        return gLevel.load(std::memory_order_relaxed);
+    }
+
+    size_t length = strnlen(tag, LOG_TAG_SIZE);
+    if (length < LOG_TAG_SIZE) {
+        uint32_t hash = TagHash(tag, length);
+        size_t slot = 0;
+        TagSite *item = TagCacheFind(tag, hash, slot);
+        if (item != nullptr) {
+            return item->site.level.load(std::memory_order_relaxed);
+        }
+
+        TagLock();
+        int32_t level = TagCacheInsertLocked(tag, length, hash);
+        TagUnlock();
+        return level;
+    }
+
+    TagLock();
+    int32_t level = ResolveLocked(tag);
+    TagUnlock();
+    return level;
+}
+
+void log_set_global_level(int32_t level)
+{
+    TagLock();
+    gLevel.store(level, std::memory_order_relaxed);
+    UpdateSitesLocked();
+    TagUnlock();
+}
+
+int32_t log_global_level()
+{
+    return gLevel.load(std::memory_order_relaxed);
+}
+
+namespace log {
+void SetTagLevel(const char *tag, LogLevel::Level lev)
+{
+    if (tag == nullptr) {
+        return;
+    }
+
+    TagLevel item;
+    memset(&item, 0, sizeof(item));
+    strncpy(item.tag, tag, LOG_TAG_SIZE - 1);
+    item.length = strlen(item.tag);
+    item.prefix = item.length > 0 && item.tag[item.length - 1] == '*';
+    if (item.prefix) {
+        item.tag[--item.length] = '\0';
+    }
+    item.level = lev;
+
+    TagLock();
+    auto it = gTagLevels->begin();
+    for (; it != gTagLevels->end(); ++it) {
+        if (it->prefix == item.prefix && strcmp(it->tag, item.tag) == 0) {
+            it->level = item.level;
+            break;
+        }
+    }
+    if (it == gTagLevels->end()) {
+        gTagLevels->push_back(item);
+    }
+    UpdateSitesLocked();
+    TagUnlock();
+}
+
+void ResetTagLevel(const char *tag)
+{
+    TagLock();
+    if (tag == nullptr) {
+        gTagLevels->clear();
+    } else {
+        size_t length = strlen(tag);
+        bool prefix = length > 0 && tag[length - 1] == '*';
+        if (prefix) {
+            --length;
+        }
+        for (auto it = gTagLevels->begin(); it != gTagLevels->end(); ++it) {
+            if (it->prefix == prefix && it->length == length && strncmp(it->tag, tag, length) == 0) {
+                gTagLevels->erase(it);
+                break;
+            }
+        }
+    }
+    UpdateSitesLocked();
+    TagUnlock();
+}
+
+LogLevel::Level GetTagLevel(const char *tag)
+{
+    return (LogLevel::Level)log_tag_level(tag ? tag : "");
+}
+} // namespace log
+
+} // namespace eular
@@ -0,0 +1,58 @@
+/*************************************************************************
+    > File Name: log_tag.h
+    > Author: hsz
+    > Brief: 按tag设置日志级别, 每个调用点缓存自身生效的级别
+    > Created Time: 2026年10月18日 星期日 14时20分36秒
+ ************************************************************************/
+
+#ifndef __LOG_TAG_H__
+#define __LOG_TAG_H__
+
+#include "log_level.h"
+#include <stdint.h>
+#include <atomic>
+
+#define LOG_SITE_UNRESOLVED     INT32_MIN   // 调用点尚未注册, 首次调用时解析级别
+
+namespace eular {
+/**
+ * @brief LOGD等宏在每个调用点定义一个静态LogSite, 常量初始化, 无构造开销.
+ *        首次调用时注册到全局链表并解析生效级别, 之后判断是否输出只需一次relaxed读取.
+ *        修改全局或tag级别时遍历链表更新所有匹配的调用点.
+ * NOTE 调用点注册后不会移除, 不要在会被dlclose卸载的库中输出日志后卸载该库
+ */
+struct LogSite {
+    const char *            tag;
+    std::atomic<int32_t>    level;
+    LogSite *               next;
+};
+
+namespace log {
+/**
+ * @brief 设置tag的最小输出级别, 优先于全局级别
+ *
+ * @param tag 完整tag, 或以'*'结尾的前缀(如"net.*")用于一组模块; 精确匹配优先, 其次最长前缀
+ * @param lev 最小输出级别
+ */
+void SetTagLevel(const char *tag, LogLevel::Level lev);
+/**
+ * @brief 清除tag的级别设置, 恢复为全局级别; tag为nullptr时清除全部
+ */
+void ResetTagLevel(const char *tag = nullptr);
+/**
+ * @brief 获取tag当前生效的最小输出级别
+ */
+LogLevel::Level GetTagLevel(const char *tag);
+}
+
+// 注册调用点并返回其生效级别
+int32_t log_site_resolve(LogSite *site);
+// 不经过调用点的输出(如log_write)按tag查询生效级别, 每个tag缓存一个调用点, 查询无锁
+int32_t log_tag_level(const char *tag);
+// 设置全局级别, 同步更新未单独设置级别的调用点
+void log_set_global_level(int32_t level);
+int32_t log_global_level();
+
+} // namespace eular
+
+#endif // __LOG_TAG_H__
@@ -1,7 +1,7 @@
 #include "log_write.h"
 #include "mutex.hpp"
 #include "log_format.h"
-#include "callstack.h"
+#include "log_tag.h"
 #include "nlohmann/json.hpp"
 #include <assert.h>
 #include <string>
@@ -12,6 +12,11 @@
 #include <pwd.h>
 #include <sys/socket.h>
 #include <sys/mman.h>
+#include <sys/syscall.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <poll.h>
+#include <list>
 
 namespace eular {
 LogWrite::LogWrite()
@@ -24,28 +29,106 @@ LogWrite::~LogWrite()
 }
 
 int32_t StdoutLogWrite::WriteToFile(std::string msg)
+{
+    return WriteToFile(msg.c_str(), msg.length());
+}
+
+int32_t StdoutLogWrite::WriteToFile(const LogEvent &ev)
+{
+    LogBuffer buffer;
+    size_t len = buffer.append(&ev);
+    return WriteToFile(ev, buffer.data(), len);
+}
+
+int32_t StdoutLogWrite::WriteToFile(const char *msg, size_t len)
 {
     int32_t ret = 0;
-    if (msg.length()) {
+    if (len) {
         AutoLock<ProcessMutex> lock(mMutex);
-        ret = write(STDOUT_FILENO, msg.c_str(), msg.length());
+        ret = ::write(STDOUT_FILENO, msg, len);
     }
 
     return ret;
 }
 
-int32_t StdoutLogWrite::WriteToFile(const LogEvent &ev)
+int32_t StdoutLogWrite::WriteToFile(const LogEvent &ev, const char *msg, size_t len)
 {
-    const std::string &format_string = LogFormat::Format(&ev);
-    int32_t ret = format_string.length();
-    if (ret > 0) {
-        AutoLock<ProcessMutex> lock(mMutex);;
-        ret = ::write(STDOUT_FILENO, format_string.c_str(), ret);
+    if (!ev.enableColor) {
+        return WriteToFile(msg, len);
+    }
+
+    int32_t ret = 0;
+    if (len) {
+        const char *colorBegin = LogFormat::ColorBegin(ev.level);
+        const char *colorEnd = LogFormat::ColorEnd();
+        struct iovec iov[3];
+        iov[0].iov_base = (void *)colorBegin;
+        iov[0].iov_len = strlen(colorBegin);
+        iov[1].iov_base = (void *)msg;
+        iov[1].iov_len = len;
+        iov[2].iov_base = (void *)colorEnd;
+        iov[2].iov_len = strlen(colorEnd);
+
+        AutoLock<ProcessMutex> lock(mMutex);
+        ret = ::writev(STDOUT_FILENO, iov, 3);
     }
 
     return ret;
 }
 
+void StdoutLogWrite::WriteBatch(LogEvent **events, uint32_t count, const char *text, const size_t *ends)
+{
+    bool color = false;
+    for (uint32_t i = 0; i < count && !color; ++i) {
+        color = events[i]->enableColor;
+    }
+    if (!color) {
+        if (count > 0) {
+            WriteToFile(text, ends[count - 1]);
+        }
+        return;
+    }
+
+    // 每条日志占用3个iovec, 按IOV_MAX分段写入
+    static const uint32_t BATCH_IOV = IOV_MAX / 3 * 3;
+    struct iovec iov[BATCH_IOV];
+    const char *colorEnd = LogFormat::ColorEnd();
+    size_t colorEndLen = strlen(colorEnd);
+    uint32_t n = 0;
+    size_t begin = 0;
+
+    AutoLock<ProcessMutex> lock(mMutex);
+    for (uint32_t i = 0; i < count; ++i) {
+        const char *msg = text + begin;
+        size_t len = ends[i] - begin;
+        begin = ends[i];
+        if (len == 0) {
+            continue;
+        }
+        if (events[i]->enableColor) {
+            const char *colorBegin = LogFormat::ColorBegin(events[i]->level);
+            iov[n].iov_base = (void *)colorBegin;
+            iov[n].iov_len = strlen(colorBegin);
+            ++n;
+        }
+        iov[n].iov_base = (void *)msg;
+        iov[n].iov_len = len;
+        ++n;
+        if (events[i]->enableColor) {
+            iov[n].iov_base = (void *)colorEnd;
+            iov[n].iov_len = colorEndLen;
+            ++n;
+        }
+        if (n + 3 > BATCH_IOV) {
+            ::writev(STDOUT_FILENO, iov, n);
+            n = 0;
+        }
+    }
+    if (n > 0) {
+        ::writev(STDOUT_FILENO, iov, n);
+    }
+}
+
 std::string StdoutLogWrite::getFileName()
 {
     return std::string("stdout");
@@ -89,86 +172,379 @@ bool StdoutLogWrite::CloseFile()
     return true;
 }
 
+static uint32_t gForkGeneration = 0;
+static pthread_once_t gForkOnce = PTHREAD_ONCE_INIT;
+static pthread_mutex_t gFileListMutex = PTHREAD_MUTEX_INITIALIZER;
+static std::list<FileLogWrite *> gFileList;
+
+static uint64_t MonotonicMs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
 FileLogWrite::FileLogWrite(uint32_t fileFlag, uint32_t fileMode) :
+    mFileDesc(-1),
+    mFileGen(0),
     mFileMode(fileMode),
-    mFileFlag(fileFlag)
+    mFileFlag(fileFlag),
+    mRotator(fileFlag, fileMode),
+    mStage(nullptr),
+    mStageSize(0),
+    mStageCap(0),
+    mFlushDelayMs(FILE_BATCH_DELAY_MS),
+    mStageSinceMs(0),
+    mFlushThreadGen(0),
+    mFlushThreadRunning(false),
+    mFlushThreadExit(false),
+    mOwnerPid(getpid())
 {
-    mFileDesc = (int32_t *)mmap(nullptr, sizeof(int32_t),
+    mShared = (FileShared *)mmap(nullptr, sizeof(FileShared),
         PROT_WRITE|PROT_READ, MAP_SHARED|MAP_ANONYMOUS, -1, 0);
-    mFileSize = (uint64_t *)mmap(nullptr, sizeof(uint64_t), 
-        PROT_WRITE|PROT_READ, MAP_SHARED|MAP_ANONYMOUS, -1, 0);
-    assert(mFileDesc && mFileSize);
+    assert(mShared != MAP_FAILED);
+    memset(mShared, 0, sizeof(FileShared));
+
+    pthread_mutex_init(&mStageMutex, nullptr);
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&mStageCond, &attr);
+    pthread_condattr_destroy(&attr);
+
+    pthread_mutex_lock(&gFileListMutex);
+    gFileList.push_back(this);
+    pthread_mutex_unlock(&gFileListMutex);
 }
 
 FileLogWrite::~FileLogWrite()
 {
+    pthread_mutex_lock(&gFileListMutex);
+    gFileList.remove(this);
+    pthread_mutex_unlock(&gFileListMutex);
+
+    setBatch(0, 0);
+    // 等待切换出的文件关闭与压缩完成
+    mRotator.stop();
     CloseFile();
-    munmap(mFileDesc, sizeof(int32_t));
-    munmap(mFileSize, sizeof(uint64_t));
+    munmap(mShared, sizeof(FileShared));
+    pthread_cond_destroy(&mStageCond);
+    pthread_mutex_destroy(&mStageMutex);
+}
+
+void FileLogWrite::setBatch(uint32_t maxBytes, uint32_t maxDelayMs)
+{
+    bool stopThread = false;
+    pthread_mutex_lock(&mStageMutex);
+    flushStageLocked();
+    if (maxBytes == 0) {
+        free(mStage);
+        mStage = nullptr;
+        mStageCap = 0;
+    } else if (maxBytes != mStageCap) {
+        char *stage = (char *)realloc(mStage, maxBytes);
+        if (stage != nullptr) {
+            mStage = stage;
+            mStageCap = maxBytes;
+        }
+    }
+    mFlushDelayMs = maxDelayMs ? maxDelayMs : 1;
+
+    if (mFlushThreadRunning && mFlushThreadGen != gForkGeneration) {
+        // 继承自父进程, 线程在当前进程中不存在
+        mFlushThreadRunning = false;
+    }
+    if (mStageCap > 0) {
+        startFlushThreadLocked();
+    } else if (mFlushThreadRunning) {
+        mFlushThreadExit = true;
+        mFlushThreadRunning = false;
+        stopThread = true;
+        pthread_cond_signal(&mStageCond);
+    }
+    pthread_mutex_unlock(&mStageMutex);
+
+    if (stopThread) {
+        pthread_join(mFlushThread, nullptr);
+    }
+}
+
+void FileLogWrite::RegisterForkHandler()
+{
+    pthread_once(&gForkOnce, []() {
+        pthread_atfork(AtForkPrepare, AtForkParent, AtForkChild);
+    });
+}
+
+void FileLogWrite::AtForkPrepare()
+{
+    pthread_mutex_lock(&gFileListMutex);
+    for (auto it = gFileList.begin(); it != gFileList.end(); ++it) {
+        pthread_mutex_lock(&(*it)->mStageMutex);
+        (*it)->mRotator.atForkPrepare();
+    }
+}
+
+void FileLogWrite::AtForkParent()
+{
+    for (auto it = gFileList.begin(); it != gFileList.end(); ++it) {
+        (*it)->mRotator.atForkParent();
+        pthread_mutex_unlock(&(*it)->mStageMutex);
+    }
+    pthread_mutex_unlock(&gFileListMutex);
+}
+
+void FileLogWrite::AtForkChild()
+{
+    ++gForkGeneration;
+    for (auto it = gFileList.begin(); it != gFileList.end(); ++it) {
+        // 父进程刷新线程等待中的条件变量在子进程内状态无效, 重新初始化
+        pthread_condattr_t attr;
+        pthread_condattr_init(&attr);
+        pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+        pthread_cond_init(&(*it)->mStageCond, &attr);
+        pthread_condattr_destroy(&attr);
+        (*it)->mRotator.atForkChild();
+        pthread_mutex_unlock(&(*it)->mStageMutex);
+    }
+    pthread_mutex_unlock(&gFileListMutex);
+}
+
+void FileLogWrite::startFlushThreadLocked()
+{
+    if (mFlushThreadRunning && mFlushThreadGen == gForkGeneration) {
+        return;
+    }
+
+    mFlushThreadExit = false;
+    mFlushThreadGen = gForkGeneration;
+    mFlushThreadRunning = pthread_create(&mFlushThread, nullptr, FlushThread, this) == 0;
+}
+
+void FileLogWrite::Flush()
+{
+    pthread_mutex_lock(&mStageMutex);
+    flushStageLocked();
+    pthread_mutex_unlock(&mStageMutex);
+}
+
+void FileLogWrite::FlushOnCrash()
+{
+    // 不加锁, 缓存可能正在被其他线程修改, 只保证不越界
+    uint32_t size = mStageSize;
+    if (mStage == nullptr || mFileDesc < 0 || size == 0) {
+        return;
+    }
+    if (size > mStageCap) {
+        size = mStageCap;
+    }
+    ::write(mFileDesc, mStage, size);
+}
+
+void FileLogWrite::flushStageLocked()
+{
+    if (mStageSize > 0) {
+        struct iovec iov;
+        iov.iov_base = mStage;
+        iov.iov_len = mStageSize;
+        writeFile(&iov, 1);
+        mStageSize = 0;
+    }
+}
+
+void *FileLogWrite::FlushThread(void *arg)
+{
+    FileLogWrite *self = static_cast<FileLogWrite *>(arg);
+
+    pthread_mutex_lock(&self->mStageMutex);
+    while (!self->mFlushThreadExit) {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        ts.tv_nsec += (long)self->mFlushDelayMs * 1000000;
+        ts.tv_sec += ts.tv_nsec / 1000000000;
+        ts.tv_nsec %= 1000000000;
+        pthread_cond_timedwait(&self->mStageCond, &self->mStageMutex, &ts);
+
+        if (self->mStageSize > 0 && MonotonicMs() - self->mStageSinceMs >= self->mFlushDelayMs) {
+            self->flushStageLocked();
+        }
+    }
+    pthread_mutex_unlock(&self->mStageMutex);
+
+    return nullptr;
 }
 
 std::string FileLogWrite::getFileName()
 {
-    time_t curr = time(nullptr);
-    struct tm *p = localtime(&curr);
-
-    char buf[1024] = {0};
-    sprintf(buf, "log-%.4d%.2d%.2d-%.2d%.2d%.2d.log",
-        1900 + p->tm_year,
-        1 + p->tm_mon,
-        p->tm_mday,
-        p->tm_hour,
-        p->tm_min,
-        p->tm_sec);
-    return std::string(buf);
+    return LogRotator::FileName(time(nullptr));
 }
 
 void FileLogWrite::maintainFile()
 {
     AutoLock<ProcessMutex> lock(mMutex);
-    if (*mFileDesc <= 0 || *mFileSize > MAX_FILE_SIZE) {
-        CloseFile();
-        CreateNewFile(getFileName());
+    if (mFileGen != mShared->generation) {
+        reopenLocked();
     }
+    int32_t state = mRotator.check(mShared->fileSize, mShared->openTime);
+    if (state == LogRotator::ROTATE_NOW) {
+        rotateLocked();
+    } else if (state == LogRotator::ROTATE_SOON) {
+        mRotator.setBasePath(mBasePath);
+        mRotator.prepare();
+    }
+}
+
+void FileLogWrite::setRotatePolicy(const LogRotatePolicy &policy)
+{
+    mRotator.setPolicy(policy);
 }
 
 int32_t FileLogWrite::WriteToFile(std::string msg)
 {
-    int32_t ret = 0;
-    maintainFile();
+    return writeMsg(msg.c_str(), msg.length());
+}
+
+int32_t FileLogWrite::WriteToFile(const LogEvent &ev)
+{
+    LogBuffer buffer;
+    size_t len = buffer.append(&ev);
+    return writeMsg(buffer.data(), len);
+}
+
+int32_t FileLogWrite::WriteToFile(const char *msg, size_t len)
+{
+    return writeMsg(msg, len);
+}
+
+void FileLogWrite::WriteBatch(LogEvent **events, uint32_t count, const char *text, const size_t *ends)
+{
+    (void)events;
+    if (count > 0) {
+        writeMsg(text, ends[count - 1]);
+    }
+}
+
+int32_t FileLogWrite::writeMsg(const char *msg, size_t len)
+{
+    if (len == 0) {
+        return 0;
+    }
+
+    struct iovec iov[2];
+    if (mStageCap == 0) {
+        iov[0].iov_base = (void *)msg;
+        iov[0].iov_len = len;
+        return writeFile(iov, 1);
+    }
+
+    int32_t ret = len;
+    pthread_mutex_lock(&mStageMutex);
+    if (mStageSize + len > mStageCap) {
+        // 缓存不足, 与暂存的日志合并为一次writev
+        int32_t count = 0;
+        if (mStageSize > 0) {
+            iov[count].iov_base = mStage;
+            iov[count++].iov_len = mStageSize;
+        }
+        iov[count].iov_base = (void *)msg;
+        iov[count++].iov_len = len;
+        if (writeFile(iov, count) < 0) {
+            ret = -1;
+        }
+        mStageSize = 0;
+    } else {
+        uint64_t nowMs = MonotonicMs();
+        if (mStageSize == 0) {
+            mStageSinceMs = nowMs;
+        }
+        memcpy(mStage + mStageSize, msg, len);
+        mStageSize += len;
+        if (mFlushThreadGen != gForkGeneration) {
+            startFlushThreadLocked();
+        }
+        if (nowMs - mStageSinceMs >= mFlushDelayMs) {
+            flushStageLocked();
+        }
+    }
+    pthread_mutex_unlock(&mStageMutex);
+
+    return ret;
+}
+
+int32_t FileLogWrite::writeFile(const struct iovec *iov, int32_t count)
+{
+    // 检查文件与写入在同一次加锁内完成
     AutoLock<ProcessMutex> lock(mMutex);
-    if (msg.length()) {
-        ret = write(*mFileDesc, msg.c_str(), msg.length());
+    if (mFileGen != mShared->generation) {
+        reopenLocked();
+    }
+    int32_t state = mFileDesc < 0 ? (int32_t)LogRotator::ROTATE_NOW :
+        mRotator.check(mShared->fileSize, mShared->openTime);
+    if (state == LogRotator::ROTATE_NOW) {
+        rotateLocked();
+    } else if (state == LogRotator::ROTATE_SOON) {
+        mRotator.setBasePath(mBasePath);
+        mRotator.prepare();
     }
+    if (mFileDesc < 0) {
+        // 还没有可写的文件, 后台线程准备好后恢复写入
+        return -1;
+    }
+
+    ssize_t ret = ::writev(mFileDesc, iov, count);
     if (ret > 0) {
-        *mFileSize += ret;
+        mShared->fileSize += ret;
     } else if (ret < 0) {
         perror("write error");
     }
     return ret;
 }
 
-int32_t FileLogWrite::WriteToFile(const LogEvent &ev)
+void FileLogWrite::reopenLocked()
 {
-    const std::string &format_string = LogFormat::Format(&ev);
-    int32_t ret = format_string.length();
-    if (ret > 0) {
-        maintainFile();
-        AutoLock<ProcessMutex> lock(mMutex);
-        ret = write(*mFileDesc, format_string.c_str(), format_string.length());
-        if (ret > 0) {
-            *mFileSize += ret;
-        } else if (ret < 0) {
-            perror("write error");
-        }
+    // 其他进程已切换文件, 按共享的路径打开, 目录已存在
+    if (mFileDesc >= 0) {
+        close(mFileDesc);
+    }
+    mFileDesc = -1;
+    if (mShared->path[0] != '\0') {
+        mFileDesc = open(mShared->path, (mFileFlag & ~(O_TRUNC | O_EXCL)) | O_APPEND, mFileMode);
     }
+    mFileGen = mShared->generation;
+}
 
-    return ret;
+bool FileLogWrite::rotateLocked()
+{
+    std::string path;
+    mRotator.setBasePath(mBasePath);
+    int32_t fd = mRotator.take(path);
+    if (fd < 0) {
+        // 新文件未准备好, 继续写当前文件
+        return false;
+    }
+    installLocked(fd, path);
+    return true;
+}
+
+void FileLogWrite::installLocked(int32_t fd, const std::string &path)
+{
+    int32_t oldFd = mFileDesc;
+    std::string oldPath = mShared->path;
+
+    mFileDesc = fd;
+    snprintf(mShared->path, sizeof(mShared->path), "%s", path.c_str());
+    mShared->fileSize = 0;
+    mShared->openTime = time(nullptr);
+    mFileGen = ++mShared->generation;
+    if (oldFd >= 0) {
+        // 切换出的文件由后台线程关闭, 描述符仍指向同一文件时只关闭
+        mRotator.retire(oldFd, oldPath == path ? std::string() : oldPath, path);
+    }
 }
 
 uint32_t FileLogWrite::getFileSize()
 {
-    return *mFileSize;
+    return mShared->fileSize;
 }
 
 uint32_t FileLogWrite::getFileMode()
@@ -178,6 +554,7 @@ uint32_t FileLogWrite::getFileMode()
 bool FileLogWrite::setFileMode(uint32_t mode)
 {
     mFileMode = mode;
+    mRotator.setFileOption(mFileFlag, mFileMode);
     return true;
 }
 uint32_t FileLogWrite::getFileFlag()
@@ -187,268 +564,1494 @@ uint32_t FileLogWrite::getFileFlag()
 bool FileLogWrite::setFileFlag(uint32_t flag)
 {
     mFileFlag = flag;
+    mRotator.setFileOption(mFileFlag, mFileMode);
     return true;
 }
 
-static int32_t __lstat(const char *path)
+bool FileLogWrite::CreateNewFile(std::string fileName)
 {
-    struct stat lst;
-    int32_t ret = lstat(path, &lst);
-    return ret;
-}
+    mRotator.setBasePath(mBasePath);
+    {
+        AutoLock<ProcessMutex> lock(mMutex);
+        if (mFileGen != mShared->generation) {
+            reopenLocked();
+        }
+        if (mFileDesc >= 0 && mRotator.check(mShared->fileSize, mShared->openTime) != LogRotator::ROTATE_NOW) {
+            return true;
+        }
+    }
 
-static bool __mkdir(const char *path)
-{
-    if (access(path, F_OK) == 0) {
-        return 0;
+    // 创建目录与文件不持有进程锁
+    std::string path;
+    int32_t fd = mRotator.open(fileName, path);
+    if (fd < 0) {
+        return false;
     }
-    return mkdir(path, S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH);
+
+    AutoLock<ProcessMutex> lock(mMutex);
+    installLocked(fd, path);
+    return true;
 }
 
-bool Mkdir(const std::string &path)
+bool FileLogWrite::CloseFile()
 {
-    if (__lstat(path.c_str()) == 0) {
+    if (mFileDesc < 0) {
         return true;
     }
-    std::string realPath = path;
-    if (path[0] == '~') {
-        uid_t uid = getuid();
-        struct passwd *p = getpwuid(uid);
-        if (p != nullptr) {
-            realPath = p->pw_dir;
-            realPath.append(path.c_str() + 1);
-        }
-    }
-    char* filePath = strdup(realPath.c_str());
-    char* ptr = strchr(filePath + 1, '/');
-    do {
-        for(; ptr; *ptr = '/', ptr = strchr(ptr + 1, '/')) {
-            *ptr = '\0';
-            if(__mkdir(filePath) != 0) {
-                break;
-            }
-        }
-        if(ptr != nullptr) {
-            break;
-        } else if(__mkdir(filePath) != 0) {
-            break;
-        }
-        free(filePath);
-        return true;
-    } while(0);
-    free(filePath);
-    return false;
+    int32_t fd = mFileDesc;
+    mFileDesc = -1;
+    return !close(fd);
 }
 
-bool FileLogWrite::CreateNewFile(std::string fileName)
+static pthread_once_t gMmapForkOnce = PTHREAD_ONCE_INIT;
+static pthread_mutex_t gMmapListMutex = PTHREAD_MUTEX_INITIALIZER;
+static std::list<MmapLogWrite *> gMmapList;
+
+MmapLogWrite::MmapLogWrite(uint32_t segmentSize, uint32_t fileMode) :
+    mSegment(nullptr),
+    mSegmentSize(segmentSize ? segmentSize : MAX_FILE_SIZE),
+    mFileMode(fileMode),
+    mFileSeq(0),
+    mForkGen(gForkGeneration)
 {
-    if (*mFileDesc > 0 && *mFileSize < MAX_FILE_SIZE) {
-        return true;
+    for (uint32_t i = 0; i < SEGMENT_POOL_SIZE; ++i) {
+        Segment &seg = mSegmentPool[i];
+        seg.offset.store(0, std::memory_order_relaxed);
+        seg.writers.store(0, std::memory_order_relaxed);
+        seg.busy.store(false, std::memory_order_relaxed);
+        seg.base = nullptr;
+        seg.size = 0;
+        seg.fd = -1;
+        seg.path[0] = '\0';
     }
+    pthread_mutex_init(&mCreateMutex, nullptr);
 
-    std::string path = "~/log/";
-    if (mBasePath.length()) {
-        path = mBasePath;
-    }
+    pthread_mutex_lock(&gMmapListMutex);
+    gMmapList.push_back(this);
+    pthread_mutex_unlock(&gMmapListMutex);
+}
 
-    std::string realPath = path;
-    if (path[0] == '~') {
-        uid_t uid = getuid();
-        struct passwd *p = getpwuid(uid);
-        if (p != nullptr) {
-            // printf("\tname = %s\n", p->pw_name);
-            // printf("\tpasswd = %s", p->pw_passwd);
-            // printf("\tuid = %u", p->pw_uid);
-            // printf("\tuid = %u", p->pw_gid);
-            // printf("\tdir = %s", p->pw_dir);
-            // printf("\tshell = %s", p->pw_shell);
-            realPath = p->pw_dir;
-            realPath.append(path.c_str() + 1);
-        }
-    }
-    if (!Mkdir(path)) {
-        return false;
-    }
-    realPath += fileName;
+MmapLogWrite::~MmapLogWrite()
+{
+    pthread_mutex_lock(&gMmapListMutex);
+    gMmapList.remove(this);
+    pthread_mutex_unlock(&gMmapListMutex);
 
-    *mFileDesc = open(realPath.c_str(), mFileFlag, mFileMode);
-    if (*mFileDesc < 0) {
-        printf("open file (%s) error: %s\n", realPath.c_str(), strerror(errno));
-        return false;
+    pthread_mutex_lock(&mCreateMutex);
+    if (mForkGen != gForkGeneration) {
+        detachInheritedLocked();
     }
-    *mFileSize = 0;
-    return true;
+    pthread_mutex_unlock(&mCreateMutex);
+
+    CloseFile();
+    pthread_mutex_destroy(&mCreateMutex);
 }
 
-bool FileLogWrite::CloseFile()
+void MmapLogWrite::RegisterForkHandler()
 {
-    *mFileSize = 0;
-    if (*mFileDesc <= 0) {
-        return true;
-    }
-    return !close(*mFileDesc);
+    pthread_once(&gMmapForkOnce, []() {
+        pthread_atfork(AtForkPrepare, AtForkParent, AtForkChild);
+    });
 }
 
-#define LOCAL_SOCKET_SERVER_PATH        "/tmp/log_sock_server"
-#define LOCAL_SOCKET_CLIENT_PATH_FMT    "/tmp/log_sock_client_%d"   // %d 是父进程的ID，使用子进程ID时多进程时容易出问题
-#define MAX_SIZE_OF_SUNPATH             108
-static std::string gClientSockPath;
-ConsoleLogWrite *pConsoleLogWrite = nullptr;
+void MmapLogWrite::AtForkPrepare()
+{
+    pthread_mutex_lock(&gMmapListMutex);
+    for (auto it = gMmapList.begin(); it != gMmapList.end(); ++it) {
+        pthread_mutex_lock(&(*it)->mCreateMutex);
+    }
+}
 
-ConsoleLogWrite::ConsoleLogWrite() :
-    mClientFd(-1)
+void MmapLogWrite::AtForkParent()
 {
-    mClientSockAddr.sun_family = AF_LOCAL;
-    snprintf(mClientSockAddr.sun_path, MAX_SIZE_OF_SUNPATH, LOCAL_SOCKET_CLIENT_PATH_FMT, getppid());
-    mLocalClientSockPath = mClientSockAddr.sun_path;
-    gClientSockPath = mLocalClientSockPath;
+    for (auto it = gMmapList.begin(); it != gMmapList.end(); ++it) {
+        pthread_mutex_unlock(&(*it)->mCreateMutex);
+    }
+    pthread_mutex_unlock(&gMmapListMutex);
+}
 
-    mServerSockAddr.sun_family = AF_LOCAL;
-    snprintf(mServerSockAddr.sun_path, MAX_SIZE_OF_SUNPATH, LOCAL_SOCKET_SERVER_PATH);
-    mLocalServerSockPath = mServerSockAddr.sun_path;
+void MmapLogWrite::AtForkChild()
+{
+    // 继承的段在子进程首次写入时由detachInheritedLocked解除
+    AtForkParent();
+}
 
-    // 捕获信号
-    signal(SIGINT, signalHandler);
-    signal(SIGQUIT, signalHandler);
-    signal(SIGSEGV, signalHandler);
-    signal(SIGABRT, signalHandler);
-    signal(SIGPIPE, SIG_IGN);
+int32_t MmapLogWrite::WriteToFile(std::string msg)
+{
+    return append(msg.c_str(), msg.length());
+}
 
-    InitParams();
-    pConsoleLogWrite = this;
+int32_t MmapLogWrite::WriteToFile(const LogEvent &ev)
+{
+    LogBuffer buffer;
+    size_t len = buffer.append(&ev);
+    return append(buffer.data(), len);
 }
 
-ConsoleLogWrite::~ConsoleLogWrite()
+int32_t MmapLogWrite::WriteToFile(const char *msg, size_t len)
 {
-    Destroy();
-    pConsoleLogWrite = nullptr;
+    return append(msg, len);
 }
 
-void ConsoleLogWrite::InitParams()
+void MmapLogWrite::WriteBatch(LogEvent **events, uint32_t count, const char *text, const size_t *ends)
 {
-    if (mClientFd > 0) {
-        return;
+    (void)events;
+    if (count > 0) {
+        append(text, ends[count - 1]);
     }
+}
 
-    mClientFd = ::socket(AF_LOCAL, SOCK_STREAM, 0);
-    if (mClientFd < 0) {
-        perror("socket error:");
-        return;
+int32_t MmapLogWrite::append(const char *msg, size_t len)
+{
+    if (len == 0) {
+        return 0;
     }
-
-    int flags = fcntl(mClientFd, F_GETFL,0);
-    if (-1 == fcntl(mClientFd, F_SETFL, flags | O_NONBLOCK)) {
-        perror("Set socket unblock failed!");
+    if (len > mSegmentSize) {
+        len = mSegmentSize;
     }
 
-    do {
-        int32_t nRetCode = ::bind(mClientFd, (const sockaddr *)&mClientSockAddr, sizeof(mClientSockAddr));
-        if (nRetCode < 0) {
-            break;
-        }
-        nRetCode = ::connect(mClientFd, (sockaddr *)&mServerSockAddr, sizeof(mServerSockAddr));
-        if (nRetCode < 0) {
-            if (errno != EINPROGRESS) {
-                printf("[%s %d] Connect fail!\n",__FILE__,__LINE__);
-                break;
+    for (;;) {
+        Segment *seg = mSegment.load(std::memory_order_acquire);
+        if (seg == nullptr || mForkGen != gForkGeneration) {
+            seg = acquireSegment();
+            if (seg == nullptr) {
+                return -1;
             }
+        }
 
-            fd_set rset, wset;
-            FD_ZERO(&rset);
-            FD_SET(mClientFd, &rset);
-            wset = rset;
-            struct timeval tv;
-            tv.tv_sec = 0;
-            tv.tv_usec = 200 * 1000;
-            if (select(mClientFd + 1, &rset, &wset, NULL, &tv) == 0) {
-                printf("%s() select failed!\n", __func__);
-                break;
+        // 先登记再确认仍是当前段, 保证切换者等待写者归零后不会再有人写入旧映射
+        seg->writers.fetch_add(1, std::memory_order_seq_cst);
+        if (mSegment.load(std::memory_order_seq_cst) != seg) {
+            seg->writers.fetch_sub(1, std::memory_order_release);
+            continue;
+        }
+
+        uint64_t offset = seg->offset.fetch_add(len, std::memory_order_relaxed);
+        if (offset + len <= seg->size) {
+            memcpy(seg->base + offset, msg, len);
+            seg->writers.fetch_sub(1, std::memory_order_release);
+            return len;
+        }
+        seg->writers.fetch_sub(1, std::memory_order_release);
+
+        if (offset <= seg->size) {
+            // 分配区间跨越段尾的写者只有一个, 由其创建新段并回收旧段
+            Segment *next = createSegment(getFileName());
+            mSegment.store(next, std::memory_order_seq_cst);
+            retireSegment(seg, offset);
+            if (next == nullptr) {
+                return -1;
             }
+            continue;
         }
 
-        const char *jsonLevel = "{  \
-        \"id\": \"notice\",         \
-        \"keywords\": \"level\",    \
-        \"level\": [                \
-            { \"key\": \"DEBUG\", \"type\": \"int\", \"value\": 0 }, \
-            { \"key\": \"INFO\",  \"type\": \"int\", \"value\": 1 }, \
-            { \"key\": \"WARN\",  \"type\": \"int\", \"value\": 2 }, \
-            { \"key\": \"ERROR\", \"type\": \"int\", \"value\": 3 }, \
-            { \"key\": \"FATAL\", \"type\": \"int\", \"value\": 4 }, \
-            { \"key\": \"UNKNOW\", \"type\": \"int\", \"value\": -1 }\
-        ]}\r\n\r\n";
+        while (mSegment.load(std::memory_order_acquire) == seg) {
+            sched_yield();
+        }
+    }
+}
 
-        ::send(mClientFd, jsonLevel, strlen(jsonLevel), 0);
-        return;
-    } while(0);
+MmapLogWrite::Segment *MmapLogWrite::acquireSegment()
+{
+    pthread_mutex_lock(&mCreateMutex);
+    if (mForkGen != gForkGeneration) {
+        detachInheritedLocked();
+    }
 
-    Destroy();
+    Segment *seg = mSegment.load(std::memory_order_acquire);
+    if (seg == nullptr) {
+        seg = createSegment(getFileName());
+        mSegment.store(seg, std::memory_order_seq_cst);
+    }
+    pthread_mutex_unlock(&mCreateMutex);
+
+    return seg;
 }
 
-void ConsoleLogWrite::Destroy()
+void MmapLogWrite::detachInheritedLocked()
 {
-    if (mClientFd > 0) {
-        close(mClientFd);
-        mClientFd = -1;
+    // 继承自父进程的段仍由父进程使用, 子进程只解除自己的映射, 之后写入自己的文件
+    for (uint32_t i = 0; i < SEGMENT_POOL_SIZE; ++i) {
+        Segment &seg = mSegmentPool[i];
+        if (seg.base != nullptr) {
+            munmap(seg.base, seg.size);
+            seg.base = nullptr;
+        }
+        if (seg.fd >= 0) {
+            close(seg.fd);
+            seg.fd = -1;
+        }
+        // fork时正在拷贝的父进程写者不存在于子进程, 其计数不会再减少
+        seg.writers.store(0, std::memory_order_relaxed);
+        seg.offset.store(0, std::memory_order_relaxed);
+        seg.busy.store(false, std::memory_order_relaxed);
     }
-    unlink(mLocalClientSockPath.c_str());
+    mSegment.store(nullptr, std::memory_order_seq_cst);
+    mForkGen = gForkGeneration;
 }
 
-#define tostr(code) #code
-
-void ConsoleLogWrite::signalHandler(int32_t sig)
+MmapLogWrite::Segment *MmapLogWrite::createSegment(const std::string &fileName)
 {
-    const char *pSignal = nullptr;
-    switch (sig) {
-    case SIGINT:
-        pSignal = tostr(SIGINT);
-        break;
-    case SIGQUIT:
-        pSignal = tostr(SIGQUIT);
-        break;
-    case SIGSEGV:
-        pSignal = tostr(SIGSEGV);
-        break;
-    case SIGABRT:
-        pSignal = tostr(SIGABRT);
-        break;
-    default:
-        pSignal = "UNKNOW";
-        break;
+    Segment *seg = nullptr;
+    for (uint32_t i = 0; i < SEGMENT_POOL_SIZE; ++i) {
+        bool expected = false;
+        if (mSegmentPool[i].busy.compare_exchange_strong(expected, true)) {
+            seg = &mSegmentPool[i];
+            break;
+        }
+    }
+    if (seg == nullptr) {
+        return nullptr;
+    }
+
+    std::string path = RealLogPath(mBasePath);
+    if (!Mkdir(path)) {
+        seg->busy.store(false, std::memory_order_release);
+        return nullptr;
+    }
+    path += fileName;
+
+    int32_t fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, mFileMode);
+    if (fd < 0) {
+        printf("open file (%s) error: %s\n", path.c_str(), strerror(errno));
+        seg->busy.store(false, std::memory_order_release);
+        return nullptr;
+    }
+
+    // 预分配磁盘空间, 避免写入映射时因空间不足触发SIGBUS
+    if (fallocate(fd, 0, 0, mSegmentSize) < 0 && ftruncate(fd, mSegmentSize) < 0) {
+        printf("fallocate (%s) error: %s\n", path.c_str(), strerror(errno));
+        close(fd);
+        unlink(path.c_str());
+        seg->busy.store(false, std::memory_order_release);
+        return nullptr;
     }
-    char log[128] = {0};
-    sprintf(log, "%s() catch signal %s\n", __func__, pSignal);
-    pConsoleLogWrite->WriteToFile(log);
-    CallStack stack;
-    stack.update();
-    if (sig == SIGSEGV || sig == SIGABRT) {
-        pConsoleLogWrite->WriteToFile(stack.toString());
+
+    void *base = mmap(nullptr, mSegmentSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED) {
+        printf("mmap (%s) error: %s\n", path.c_str(), strerror(errno));
+        close(fd);
+        unlink(path.c_str());
+        seg->busy.store(false, std::memory_order_release);
+        return nullptr;
     }
-    unlink(gClientSockPath.c_str());
-    _exit(0);
+
+    seg->base = static_cast<char *>(base);
+    seg->size = mSegmentSize;
+    seg->fd = fd;
+    snprintf(seg->path, sizeof(seg->path), "%s", path.c_str());
+    seg->offset.store(0, std::memory_order_relaxed);
+    return seg;
 }
 
-int32_t ConsoleLogWrite::WriteToFile(std::string msg)
+void MmapLogWrite::retireSegment(Segment *seg, uint64_t used)
 {
-    AutoLock<ProcessMutex> lock(mMutex);
-    InitParams();
-
-    int32_t sendSize = 0;
-    if (mClientFd > 0) {
-        sendSize = ::send(mClientFd, msg.c_str(), msg.length(), 0);
-        if (sendSize <= 0) { // 服务端不在线
-            Destroy();
-        }
+    while (seg->writers.load(std::memory_order_acquire) != 0) {
+        sched_yield();
     }
 
-    return sendSize;
+    munmap(seg->base, seg->size);
+    seg->base = nullptr;
+    // 去掉未使用的预分配空间
+    if (ftruncate(seg->fd, used < seg->size ? used : seg->size) < 0) {
+        perror("ftruncate error");
+    }
+    close(seg->fd);
+    seg->fd = -1;
+    seg->busy.store(false, std::memory_order_release);
 }
 
-int32_t ConsoleLogWrite::WriteToFile(const LogEvent &ev)
+std::string MmapLogWrite::getFileName()
 {
-    uint64_t milliSecond = ev.time.tv_sec * 1000 + ev.time.tv_usec / 1000;
+    time_t curr = time(nullptr);
+    struct tm tmNow;
+    LogFormat::LocalTime(curr, &tmNow);
+
+    // 同一秒内可能多次切换, 加上进程ID与序号
+    char buf[128] = {0};
+    snprintf(buf, sizeof(buf), "log-%.4d%.2d%.2d-%.2d%.2d%.2d-%d-%u.log",
+        1900 + tmNow.tm_year,
+        1 + tmNow.tm_mon,
+        tmNow.tm_mday,
+        tmNow.tm_hour,
+        tmNow.tm_min,
+        tmNow.tm_sec,
+        getpid(),
+        mFileSeq.fetch_add(1, std::memory_order_relaxed));
+    return std::string(buf);
+}
 
-    nlohmann::json logJsonObj;
+uint32_t MmapLogWrite::getFileSize()
+{
+    Segment *seg = mSegment.load(std::memory_order_acquire);
+    if (seg == nullptr) {
+        return 0;
+    }
+    uint64_t offset = seg->offset.load(std::memory_order_relaxed);
+    return offset < seg->size ? offset : seg->size;
+}
+
+uint32_t MmapLogWrite::getFileMode()
+{
+    return mFileMode;
+}
+
+bool MmapLogWrite::setFileMode(uint32_t mode)
+{
+    mFileMode = mode;
+    return true;
+}
+
+uint32_t MmapLogWrite::getFileFlag()
+{
+    return O_RDWR | O_CREAT | O_TRUNC;
+}
+
+bool MmapLogWrite::setFileFlag(uint32_t flag)
+{
+    (void)flag;
+    return false;
+}
+
+bool MmapLogWrite::CreateNewFile(std::string fileName)
+{
+    Segment *next = createSegment(fileName);
+    if (next == nullptr) {
+        return false;
+    }
+
+    Segment *prev = mSegment.exchange(next, std::memory_order_seq_cst);
+    if (prev != nullptr) {
+        uint64_t offset = prev->offset.load(std::memory_order_relaxed);
+        retireSegment(prev, offset);
+    }
+    return true;
+}
+
+bool MmapLogWrite::CloseFile()
+{
+    Segment *seg = mSegment.exchange(nullptr, std::memory_order_seq_cst);
+    if (seg != nullptr) {
+        // 等待写者结束后再读取偏移, 此时不会再有新的分配
+        while (seg->writers.load(std::memory_order_acquire) != 0) {
+            sched_yield();
+        }
+        retireSegment(seg, seg->offset.load(std::memory_order_relaxed));
+    }
+    return true;
+}
+
+static pthread_once_t gBinaryForkOnce = PTHREAD_ONCE_INIT;
+static pthread_mutex_t gBinaryListMutex = PTHREAD_MUTEX_INITIALIZER;
+static std::list<BinaryLogWrite *> gBinaryList;
+static thread_local LogBuffer gBinaryArgs;
+
+BinaryLogWrite::BinaryLogWrite(uint32_t fileMode) :
+    mFileGen(0),
+    mFileDesc(-1),
+    mFileSize(0),
+    mFileMode(fileMode),
+    mFileSeq(0),
+    mStageSize(0),
+    mStageSinceMs(0),
+    mFlushThreadRunning(false),
+    mFlushThreadExit(false)
+{
+    mStage = (char *)malloc(FILE_BATCH_BYTES);
+    pthread_mutex_init(&mMutex, nullptr);
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&mStageCond, &attr);
+    pthread_condattr_destroy(&attr);
+
+    pthread_mutex_lock(&gBinaryListMutex);
+    gBinaryList.push_back(this);
+    pthread_mutex_unlock(&gBinaryListMutex);
+}
+
+BinaryLogWrite::~BinaryLogWrite()
+{
+    pthread_mutex_lock(&gBinaryListMutex);
+    gBinaryList.remove(this);
+    pthread_mutex_unlock(&gBinaryListMutex);
+
+    pthread_mutex_lock(&mMutex);
+    bool running = mFlushThreadRunning;
+    mFlushThreadExit = true;
+    mFlushThreadRunning = false;
+    pthread_cond_signal(&mStageCond);
+    pthread_mutex_unlock(&mMutex);
+    if (running) {
+        pthread_join(mFlushThread, nullptr);
+    }
+
+    CloseFile();
+    free(mStage);
+    pthread_cond_destroy(&mStageCond);
+    pthread_mutex_destroy(&mMutex);
+}
+
+void BinaryLogWrite::RegisterForkHandler()
+{
+    pthread_once(&gBinaryForkOnce, []() {
+        pthread_atfork(AtForkPrepare, AtForkParent, AtForkChild);
+    });
+}
+
+void BinaryLogWrite::AtForkPrepare()
+{
+    pthread_mutex_lock(&gBinaryListMutex);
+    for (auto it = gBinaryList.begin(); it != gBinaryList.end(); ++it) {
+        pthread_mutex_lock(&(*it)->mMutex);
+    }
+}
+
+void BinaryLogWrite::AtForkParent()
+{
+    for (auto it = gBinaryList.begin(); it != gBinaryList.end(); ++it) {
+        pthread_mutex_unlock(&(*it)->mMutex);
+    }
+    pthread_mutex_unlock(&gBinaryListMutex);
+}
+
+void BinaryLogWrite::AtForkChild()
+{
+    for (auto it = gBinaryList.begin(); it != gBinaryList.end(); ++it) {
+        // 缓存中是父进程的日志, 由父进程写出; 字典ID只在单个文件内有效, 子进程写自己的文件
+        BinaryLogWrite *self = *it;
+        if (self->mFileDesc >= 0) {
+            close(self->mFileDesc);
+            self->mFileDesc = -1;
+        }
+        self->mFileSize = 0;
+        self->mStageSize = 0;
+        // 刷新线程只存在于父进程, 子进程写入时重新创建
+        pthread_condattr_t attr;
+        pthread_condattr_init(&attr);
+        pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+        pthread_cond_init(&self->mStageCond, &attr);
+        pthread_condattr_destroy(&attr);
+        self->mFlushThreadRunning = false;
+        self->mFlushThreadExit = false;
+    }
+    AtForkParent();
+}
+
+void BinaryLogWrite::startFlushThreadLocked()
+{
+    if (mFlushThreadRunning) {
+        return;
+    }
+
+    mFlushThreadExit = false;
+    mFlushThreadRunning = pthread_create(&mFlushThread, nullptr, FlushThread, this) == 0;
+}
+
+void *BinaryLogWrite::FlushThread(void *arg)
+{
+    BinaryLogWrite *self = static_cast<BinaryLogWrite *>(arg);
+
+    pthread_mutex_lock(&self->mMutex);
+    while (!self->mFlushThreadExit) {
+        if (self->mStageSize == 0) {
+            // 缓存为空时不定时唤醒, 等待写入
+            pthread_cond_wait(&self->mStageCond, &self->mMutex);
+            continue;
+        }
+
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        ts.tv_nsec += (long)FILE_BATCH_DELAY_MS * 1000000;
+        ts.tv_sec += ts.tv_nsec / 1000000000;
+        ts.tv_nsec %= 1000000000;
+        pthread_cond_timedwait(&self->mStageCond, &self->mMutex, &ts);
+
+        if (self->mStageSize > 0 && MonotonicMs() - self->mStageSinceMs >= FILE_BATCH_DELAY_MS) {
+            self->flushStageLocked();
+        }
+    }
+    pthread_mutex_unlock(&self->mMutex);
+
+    return nullptr;
+}
+
+int32_t BinaryLogWrite::WriteToFile(std::string msg)
+{
+    return WriteToFile(msg.c_str(), msg.length());
+}
+
+int32_t BinaryLogWrite::WriteToFile(const LogEvent &ev)
+{
+    pthread_mutex_lock(&mMutex);
+    int32_t ret = writeEventLocked(ev);
+    pthread_mutex_unlock(&mMutex);
+    return ret;
+}
+
+void BinaryLogWrite::WriteBatch(LogEvent **events, uint32_t count, const char *text, const size_t *ends)
+{
+    // 只保存消息本身, 不使用已格式化的文本
+    (void)text;
+    (void)ends;
+    pthread_mutex_lock(&mMutex);
+    for (uint32_t i = 0; i < count; ++i) {
+        writeEventLocked(*events[i]);
+    }
+    pthread_mutex_unlock(&mMutex);
+}
+
+int32_t BinaryLogWrite::writeEventLocked(const LogEvent &ev)
+{
+    LogBuffer &args = gBinaryArgs;
+    args.clear();
+    if (ev.fieldCount > 0) {
+        // 消息作为字典字符串保存, 字段保留类型
+        size_t fieldsSize = LogFieldCodec::EncodeSize(ev.fields, ev.fieldCount);
+        char *out = args.tail(sizeof(uint32_t) + fieldsSize);
+        if (out == nullptr) {
+            return -1;
+        }
+        uint32_t fieldsLen = LogFieldCodec::Encode(ev.fields, ev.fieldCount, out + sizeof(uint32_t));
+        memcpy(out, &fieldsLen, sizeof(fieldsLen));
+        args.commit(sizeof(uint32_t) + fieldsLen);
+        return writeRecordLocked(ev, false, ev.msg, args.data(), args.size(), BINARY_RECORD_FIELDS);
+    }
+    BinaryCodec::EncodeString(args, ev.msg, strlen(ev.msg));
+    return writeRecordLocked(ev, false, BINARY_TEXT_FORMAT, args.data(), args.size());
+}
+
+int32_t BinaryLogWrite::WriteToFile(const char *msg, size_t len)
+{
+    // 无事件的文本(断言、信号处理), 原样保存
+    LogEvent ev;
+    memset(&ev, 0, sizeof(ev));
+    LogEventTime(ev);
+    ev.pid = getpid();
+    ev.level = LogLevel::UNKNOW;
+
+    LogBuffer &args = gBinaryArgs;
+    args.clear();
+    BinaryCodec::EncodeString(args, msg, len);
+    return writeRecord(ev, true, BINARY_TEXT_FORMAT, args.data(), args.size());
+}
+
+int32_t BinaryLogWrite::WriteToFile(const LogEvent &ev, const char *msg, size_t len)
+{
+    // 只保存消息本身, 前缀由解码时生成
+    (void)msg;
+    (void)len;
+    return WriteToFile(ev);
+}
+
+int32_t BinaryLogWrite::WriteFormat(const LogEvent &ev, const char *fmt, va_list ap)
+{
+    LogBuffer &args = gBinaryArgs;
+    args.clear();
+
+    va_list tmpArgs;
+    va_copy(tmpArgs, ap);
+    bool encoded = BinaryCodec::EncodeArgs(args, fmt, tmpArgs);
+    va_end(tmpArgs);
+    if (encoded) {
+        return writeRecord(ev, false, fmt, args.data(), args.size());
+    }
+
+    // 格式串不支持延迟格式化, 以文本保存
+    args.clear();
+    va_copy(tmpArgs, ap);
+    int32_t n = vsnprintf(nullptr, 0, fmt, tmpArgs);
+    va_end(tmpArgs);
+    if (n < 0) {
+        return -1;
+    }
+
+    // 文本紧跟在长度字段之后, 多预留\0
+    char *out = args.tail(sizeof(uint32_t) + n + 1);
+    if (out == nullptr) {
+        return -1;
+    }
+    va_copy(tmpArgs, ap);
+    vsnprintf(out + sizeof(uint32_t), n + 1, fmt, tmpArgs);
+    va_end(tmpArgs);
+
+    uint32_t len = (uint32_t)n < BINARY_MAX_STRING ? n : BINARY_MAX_STRING;
+    memcpy(out, &len, sizeof(len));
+    args.commit(sizeof(uint32_t) + len);
+    return writeRecord(ev, false, BINARY_TEXT_FORMAT, args.data(), args.size());
+}
+
+int32_t BinaryLogWrite::writeRecord(const LogEvent &ev, bool raw, const char *fmt, const char *args, size_t argsLen,
+    uint16_t flags)
+{
+    pthread_mutex_lock(&mMutex);
+    int32_t ret = writeRecordLocked(ev, raw, fmt, args, argsLen, flags);
+    pthread_mutex_unlock(&mMutex);
+    return ret;
+}
+
+int32_t BinaryLogWrite::writeRecordLocked(const LogEvent &ev, bool raw, const char *fmt, const char *args,
+    size_t argsLen, uint16_t flags)
+{
+    BinaryRecord record;
+    memset(&record, 0, sizeof(record));
+    record.timeNs = (uint64_t)ev.time.tv_sec * 1000000000 + ev.nsec;
+    record.pid = ev.pid;
+    record.tid = (int32_t)ev.tid;
+    record.level = ev.level;
+
+    BinaryEntryHeader entry;
+    entry.type = BINARY_ENTRY_RECORD;
+    entry.flags = flags;
+    entry.length = sizeof(record) + argsLen;
+
+    // 字典条目与记录必须落在同一文件, 预留两个字典条目的空间后再判断是否切换文件
+    size_t reserve = sizeof(entry) * 3 + sizeof(record) + argsLen + 2 * sizeof(uint32_t) +
+        strlen(fmt) + (raw ? 0 : strlen(ev.tag));
+
+    if (mFileDesc < 0 || mFileSize + mStageSize + reserve > MAX_FILE_SIZE) {
+        flushStageLocked();
+        closeFileLocked();
+        if (!openFileLocked(getFileName())) {
+            return -1;
+        }
+    }
+
+    record.tagId = raw ? 0 : internLocked(ev.tag);
+    record.fmtId = internLocked(fmt);
+    appendLocked(&entry, sizeof(entry));
+    appendLocked(&record, sizeof(record));
+    appendLocked(args, argsLen);
+
+    if (mStageSize > 0 && MonotonicMs() - mStageSinceMs >= FILE_BATCH_DELAY_MS) {
+        flushStageLocked();
+    }
+
+    return sizeof(entry) + entry.length;
+}
+
+uint32_t BinaryLogWrite::internLocked(const char *str)
+{
+    bool needWrite = false;
+    uint32_t id = mDict.intern(str, mFileGen, needWrite);
+    if (needWrite) {
+        size_t len = strlen(str);
+        BinaryEntryHeader entry;
+        entry.type = BINARY_ENTRY_STRING;
+        entry.flags = 0;
+        entry.length = sizeof(id) + len;
+        appendLocked(&entry, sizeof(entry));
+        appendLocked(&id, sizeof(id));
+        appendLocked(str, len);
+    }
+    return id;
+}
+
+void BinaryLogWrite::appendLocked(const void *data, size_t len)
+{
+    if (mStage == nullptr || len > FILE_BATCH_BYTES) {
+        flushStageLocked();
+        writeAllLocked(data, len);
+        return;
+    }
+
+    if (mStageSize + len > FILE_BATCH_BYTES) {
+        flushStageLocked();
+    }
+    if (mStageSize == 0) {
+        mStageSinceMs = MonotonicMs();
+        startFlushThreadLocked();
+        pthread_cond_signal(&mStageCond);
+    }
+    memcpy(mStage + mStageSize, data, len);
+    mStageSize += len;
+}
+
+void BinaryLogWrite::flushStageLocked()
+{
+    if (mStageSize > 0) {
+        writeAllLocked(mStage, mStageSize);
+        mStageSize = 0;
+    }
+}
+
+void BinaryLogWrite::writeAllLocked(const void *data, size_t len)
+{
+    const char *ptr = static_cast<const char *>(data);
+    while (len > 0 && mFileDesc >= 0) {
+        ssize_t n = ::write(mFileDesc, ptr, len);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("write error");
+            return;
+        }
+        ptr += n;
+        len -= n;
+        mFileSize += n;
+    }
+}
+
+bool BinaryLogWrite::openFileLocked(const std::string &fileName)
+{
+    std::string path = RealLogPath(mBasePath);
+    if (!Mkdir(path)) {
+        return false;
+    }
+    path += fileName;
+
+    mFileDesc = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, mFileMode);
+    if (mFileDesc < 0) {
+        printf("open file (%s) error: %s\n", path.c_str(), strerror(errno));
+        return false;
+    }
+
+    BinaryFileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, BINARY_LOG_MAGIC, sizeof(header.magic));
+    header.version = BINARY_LOG_VERSION;
+    header.headerSize = sizeof(header);
+    mFileSize = 0;
+    writeAllLocked(&header, sizeof(header));
+    ++mFileGen;
+    return true;
+}
+
+void BinaryLogWrite::closeFileLocked()
+{
+    if (mFileDesc >= 0) {
+        close(mFileDesc);
+        mFileDesc = -1;
+    }
+    mFileSize = 0;
+}
+
+std::string BinaryLogWrite::getFileName()
+{
+    time_t curr = time(nullptr);
+    struct tm tmNow;
+    LogFormat::LocalTime(curr, &tmNow);
+
+    char buf[128] = {0};
+    snprintf(buf, sizeof(buf), "log-%.4d%.2d%.2d-%.2d%.2d%.2d-%d-%u.bin",
+        1900 + tmNow.tm_year,
+        1 + tmNow.tm_mon,
+        tmNow.tm_mday,
+        tmNow.tm_hour,
+        tmNow.tm_min,
+        tmNow.tm_sec,
+        getpid(),
+        mFileSeq++);
+    return std::string(buf);
+}
+
+uint32_t BinaryLogWrite::getFileSize()
+{
+    return mFileSize + mStageSize;
+}
+
+uint32_t BinaryLogWrite::getFileMode()
+{
+    return mFileMode;
+}
+
+bool BinaryLogWrite::setFileMode(uint32_t mode)
+{
+    mFileMode = mode;
+    return true;
+}
+
+uint32_t BinaryLogWrite::getFileFlag()
+{
+    return O_WRONLY | O_CREAT | O_TRUNC;
+}
+
+bool BinaryLogWrite::setFileFlag(uint32_t flag)
+{
+    (void)flag;
+    return false;
+}
+
+bool BinaryLogWrite::CreateNewFile(std::string fileName)
+{
+    pthread_mutex_lock(&mMutex);
+    flushStageLocked();
+    closeFileLocked();
+    bool ret = openFileLocked(fileName);
+    pthread_mutex_unlock(&mMutex);
+    return ret;
+}
+
+bool BinaryLogWrite::CloseFile()
+{
+    pthread_mutex_lock(&mMutex);
+    flushStageLocked();
+    closeFileLocked();
+    pthread_mutex_unlock(&mMutex);
+    return true;
+}
+
+void BinaryLogWrite::Flush()
+{
+    pthread_mutex_lock(&mMutex);
+    flushStageLocked();
+    pthread_mutex_unlock(&mMutex);
+}
+
+void BinaryLogWrite::FlushOnCrash()
+{
+    // 不加锁, 缓存可能正在被其他线程修改, 只保证不越界
+    uint32_t size = mStageSize;
+    if (mStage == nullptr || mFileDesc < 0 || size == 0) {
+        return;
+    }
+    if (size > FILE_BATCH_BYTES) {
+        size = FILE_BATCH_BYTES;
+    }
+    ::write(mFileDesc, mStage, size);
+}
+
+#define SHM_IDLE_US         (1000)      // 收集线程空闲时的休眠间隔
+#define SHM_RECLAIM_MS      (1000)      // 检查已退出进程所占环的间隔
+
+// 线程缓存的环, 子进程继承的缓存属于父进程的线程, 通过fork代数区分
+struct ShmRingHandle {
+    uint64_t    areaId;
+    uint32_t    index;
+    uint32_t    forkGen;
+
+    ~ShmRingHandle()
+    {
+        ShmLogWrite::ReleaseRing(areaId, index, forkGen);
+        areaId = 0;
+    }
+};
+
+static pthread_once_t gShmForkOnce = PTHREAD_ONCE_INIT;
+static pthread_mutex_t gShmListMutex = PTHREAD_MUTEX_INITIALIZER;
+static std::list<ShmLogWrite *> gShmList;
+static thread_local ShmRingHandle gShmRing = {0, 0, 0};
+
+ShmLogWrite::ShmLogWrite(uint32_t fileMode) :
+    mOwnerPid(getpid()),
+    mCollectorRunning(false),
+    mCollectorExit(false),
+    mFileDesc(-1),
+    mFileSize(0),
+    mFileMode(fileMode),
+    mFileSeq(0),
+    mReclaimMs(0)
+{
+    pthread_mutex_init(&mCollectMutex, nullptr);
+    if (!mArea.create()) {
+        perror("create shared memory log area error");
+    } else {
+        mArea.header()->running.store(1, std::memory_order_release);
+        mCollectorRunning = pthread_create(&mCollector, nullptr, CollectThread, this) == 0;
+        if (!mCollectorRunning) {
+            mArea.header()->running.store(0, std::memory_order_release);
+        }
+    }
+
+    pthread_mutex_lock(&gShmListMutex);
+    gShmList.push_back(this);
+    pthread_mutex_unlock(&gShmListMutex);
+}
+
+ShmLogWrite::~ShmLogWrite()
+{
+    pthread_mutex_lock(&gShmListMutex);
+    gShmList.remove(this);
+    pthread_mutex_unlock(&gShmListMutex);
+
+    if (isCollector()) {
+        if (mCollectorRunning) {
+            mCollectorExit.store(true, std::memory_order_release);
+            pthread_join(mCollector, nullptr);
+            mCollectorRunning = false;
+        }
+        if (mArea.valid()) {
+            // 收集线程已退出, 写者不再等待; 写出剩余日志
+            mArea.header()->running.store(0, std::memory_order_release);
+            pthread_mutex_lock(&mCollectMutex);
+            collectLocked();
+            pthread_mutex_unlock(&mCollectMutex);
+        }
+        CloseFile();
+    } else {
+        // 子进程: 等待本进程的日志被收集后释放环
+        Flush();
+        if (mArea.valid()) {
+            pid_t pid = getpid();
+            for (uint32_t i = 1; i < mArea.ringCount(); ++i) {
+                if (mArea.ring(i).pid.load(std::memory_order_relaxed) == pid) {
+                    mArea.release(i);
+                }
+            }
+        }
+    }
+
+    mArea.destroy();
+    pthread_mutex_destroy(&mCollectMutex);
+}
+
+void ShmLogWrite::RegisterForkHandler()
+{
+    pthread_once(&gShmForkOnce, []() {
+        pthread_atfork(AtForkPrepare, AtForkParent, AtForkChild);
+    });
+}
+
+void ShmLogWrite::AtForkPrepare()
+{
+    pthread_mutex_lock(&gShmListMutex);
+}
+
+void ShmLogWrite::AtForkParent()
+{
+    pthread_mutex_unlock(&gShmListMutex);
+}
+
+void ShmLogWrite::AtForkChild()
+{
+    // 收集线程与其持有的锁只存在于父进程, 子进程不会使用mCollectMutex
+    AtForkParent();
+}
+
+void ShmLogWrite::ReleaseRing(uint64_t areaId, uint32_t index, uint32_t forkGen)
+{
+    if (areaId == 0 || forkGen != gForkGeneration) {
+        return;
+    }
+
+    pthread_mutex_lock(&gShmListMutex);
+    for (auto it = gShmList.begin(); it != gShmList.end(); ++it) {
+        if ((*it)->mArea.id() == areaId) {
+            (*it)->mArea.release(index);
+            break;
+        }
+    }
+    pthread_mutex_unlock(&gShmListMutex);
+}
+
+bool ShmLogWrite::isCollector() const
+{
+    return mOwnerPid == getpid();
+}
+
+uint32_t ShmLogWrite::ringIndex()
+{
+    ShmRingHandle &handle = gShmRing;
+    uint64_t id = mArea.id();
+    if (handle.areaId != id || handle.forkGen != gForkGeneration) {
+        handle.index = mArea.claim(getpid(), syscall(__NR_gettid));
+        handle.areaId = id;
+        handle.forkGen = gForkGeneration;
+    }
+    return handle.index;
+}
+
+int32_t ShmLogWrite::push(uint64_t timeNs, const char *msg, size_t len)
+{
+    if (!mArea.valid() || len == 0) {
+        return 0;
+    }
+    return mArea.push(ringIndex(), timeNs, msg, len);
+}
+
+int32_t ShmLogWrite::WriteToFile(std::string msg)
+{
+    return WriteToFile(msg.c_str(), msg.length());
+}
+
+int32_t ShmLogWrite::WriteToFile(const LogEvent &ev)
+{
+    LogBuffer buffer;
+    size_t len = buffer.append(&ev);
+    return WriteToFile(ev, buffer.data(), len);
+}
+
+int32_t ShmLogWrite::WriteToFile(const char *msg, size_t len)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return push((uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec, msg, len);
+}
+
+int32_t ShmLogWrite::WriteToFile(const LogEvent &ev, const char *msg, size_t len)
+{
+    uint64_t timeNs = (uint64_t)ev.time.tv_sec * 1000000000 + ev.nsec;
+    return push(timeNs, msg, len);
+}
+
+void *ShmLogWrite::CollectThread(void *arg)
+{
+    ShmLogWrite *self = static_cast<ShmLogWrite *>(arg);
+    while (!self->mCollectorExit.load(std::memory_order_acquire)) {
+        pthread_mutex_lock(&self->mCollectMutex);
+        size_t count = self->collectLocked();
+        uint64_t nowMs = MonotonicMs();
+        if (nowMs - self->mReclaimMs >= SHM_RECLAIM_MS) {
+            self->mReclaimMs = nowMs;
+            self->reclaimLocked();
+        }
+        pthread_mutex_unlock(&self->mCollectMutex);
+
+        if (count == 0) {
+            usleep(SHM_IDLE_US);
+        }
+    }
+
+    return nullptr;
+}
+
+size_t ShmLogWrite::collectLocked()
+{
+    if (!mArea.valid()) {
+        return 0;
+    }
+
+    // 只读取本轮开始时已写入的记录, 写者持续写入时也能按时返回
+    const ShmRecordHeader *records[SHM_RING_COUNT];
+    uint64_t limits[SHM_RING_COUNT];
+    uint32_t active[SHM_RING_COUNT];
+    uint32_t activeCount = 0;
+    uint32_t ringCount = mArea.ringCount() < SHM_RING_COUNT ? mArea.ringCount() : SHM_RING_COUNT;
+    for (uint32_t i = 0; i < ringCount; ++i) {
+        ShmRing &ring = mArea.ring(i);
+        if (ring.state.load(std::memory_order_acquire) == SHM_RING_FREE) {
+            continue;
+        }
+
+        uint64_t dropped = ring.dropped.exchange(0, std::memory_order_relaxed);
+        if (dropped > 0) {
+            char *out = mOutput.tail(128);
+            if (out != nullptr) {
+                mOutput.commit(snprintf(out, 128, "shm ring %u (pid %d, tid %d) dropped %lu messages\n",
+                    i, ring.pid.load(std::memory_order_relaxed), ring.tid.load(std::memory_order_relaxed),
+                    (unsigned long)dropped));
+            }
+        }
+
+        limits[i] = ring.head.load(std::memory_order_acquire);
+        records[i] = mArea.peek(i, limits[i]);
+        if (records[i] != nullptr) {
+            active[activeCount++] = i;
+        }
+    }
+
+    // 各环内按时间有序, 每次取时间最早的一条
+    size_t count = 0;
+    while (activeCount > 0) {
+        uint32_t pick = 0;
+        for (uint32_t k = 1; k < activeCount; ++k) {
+            if (records[active[k]]->timeNs < records[active[pick]]->timeNs) {
+                pick = k;
+            }
+        }
+
+        uint32_t index = active[pick];
+        const ShmRecordHeader *rec = records[index];
+        char *out = mOutput.tail(rec->length);
+        if (out != nullptr) {
+            memcpy(out, ShmLogArea::payload(rec), rec->length);
+            mOutput.commit(rec->length);
+        }
+        mArea.consume(index, rec);
+        ++count;
+
+        if (mOutput.size() >= FILE_BATCH_BYTES) {
+            writeOutLocked();
+        }
+
+        records[index] = mArea.peek(index, limits[index]);
+        if (records[index] == nullptr) {
+            active[pick] = active[--activeCount];
+        }
+    }
+
+    writeOutLocked();
+    return count;
+}
+
+void ShmLogWrite::reclaimLocked()
+{
+    // 线程退出后的环, 以及未正常退出的进程所占的环, 读完后回收
+    for (uint32_t i = 1; i < mArea.ringCount(); ++i) {
+        ShmRing &ring = mArea.ring(i);
+        uint32_t state = ring.state.load(std::memory_order_acquire);
+        if (state == SHM_RING_FREE || mArea.pending(i)) {
+            continue;
+        }
+        if (state == SHM_RING_CLOSED || (kill(ring.pid.load(std::memory_order_relaxed), 0) < 0 && errno == ESRCH)) {
+            // 先清除pid, 避免新抢占者写入pid前被误判为已退出进程的环
+            ring.pid.store(0, std::memory_order_relaxed);
+            ring.state.store(SHM_RING_FREE, std::memory_order_release);
+        }
+    }
+}
+
+void ShmLogWrite::writeOutLocked()
+{
+    if (mOutput.size() == 0) {
+        return;
+    }
+
+    if (mFileDesc < 0 || mFileSize >= MAX_FILE_SIZE) {
+        CreateNewFile(getFileName());
+    }
+
+    const char *ptr = mOutput.data();
+    size_t len = mOutput.size();
+    while (len > 0 && mFileDesc >= 0) {
+        ssize_t n = ::write(mFileDesc, ptr, len);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("write error");
+            break;
+        }
+        ptr += n;
+        len -= n;
+        mFileSize += n;
+    }
+    mOutput.clear();
+}
+
+void ShmLogWrite::Flush()
+{
+    if (!mArea.valid()) {
+        return;
+    }
+
+    if (isCollector()) {
+        pthread_mutex_lock(&mCollectMutex);
+        collectLocked();
+        pthread_mutex_unlock(&mCollectMutex);
+        return;
+    }
+
+    // 子进程不能读取环, 等待父进程的收集线程
+    pid_t pid = getpid();
+    uint64_t deadline = MonotonicMs() + SHM_WAIT_MS * 10;
+    for (uint32_t i = 0; i < mArea.ringCount(); ++i) {
+        ShmRing &ring = mArea.ring(i);
+        if (i != 0 && ring.pid.load(std::memory_order_relaxed) != pid) {
+            continue;
+        }
+        while (mArea.pending(i) && mArea.header()->running.load(std::memory_order_acquire) &&
+            MonotonicMs() < deadline) {
+            usleep(SHM_IDLE_US);
+        }
+    }
+}
+
+std::string ShmLogWrite::getFileName()
+{
+    time_t curr = time(nullptr);
+    struct tm tmNow;
+    LogFormat::LocalTime(curr, &tmNow);
+
+    char buf[128] = {0};
+    snprintf(buf, sizeof(buf), "log-%.4d%.2d%.2d-%.2d%.2d%.2d-%d-%u.log",
+        1900 + tmNow.tm_year,
+        1 + tmNow.tm_mon,
+        tmNow.tm_mday,
+        tmNow.tm_hour,
+        tmNow.tm_min,
+        tmNow.tm_sec,
+        mOwnerPid,
+        mFileSeq++);
+    return std::string(buf);
+}
+
+uint32_t ShmLogWrite::getFileSize()
+{
+    return mFileSize;
+}
+
+uint32_t ShmLogWrite::getFileMode()
+{
+    return mFileMode;
+}
+
+bool ShmLogWrite::setFileMode(uint32_t mode)
+{
+    mFileMode = mode;
+    return true;
+}
+
+uint32_t ShmLogWrite::getFileFlag()
+{
+    return O_WRONLY | O_CREAT | O_APPEND;
+}
+
+bool ShmLogWrite::setFileFlag(uint32_t flag)
+{
+    (void)flag;
+    return false;
+}
+
+// 只由收集线程或持有mCollectMutex的线程调用
+bool ShmLogWrite::CreateNewFile(std::string fileName)
+{
+    CloseFile();
+
+    std::string path = RealLogPath(mBasePath);
+    if (!Mkdir(path)) {
+        return false;
+    }
+    path += fileName;
+
+    // 同一秒内重新添加输出节点时文件名相同, 追加写入
+    mFileDesc = open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND, mFileMode);
+    if (mFileDesc < 0) {
+        printf("open file (%s) error: %s\n", path.c_str(), strerror(errno));
+        return false;
+    }
+    mFileSize = 0;
+    return true;
+}
+
+bool ShmLogWrite::CloseFile()
+{
+    if (mFileDesc >= 0) {
+        close(mFileDesc);
+        mFileDesc = -1;
+    }
+    mFileSize = 0;
+    return true;
+}
+
+#define LOCAL_SOCKET_SERVER_PATH        "/tmp/log_sock_server"
+#define CONSOLE_CONTROL_INTERVAL_MS     (100)               // 检查控制命令的最小间隔
+#define CONSOLE_RETRY_MS                (1000)              // 连接失败后的重试间隔
+#define CONSOLE_QUEUE_BYTES             (1024 * 1024)       // 每个进程发送队列的上限
+#define CONSOLE_SEND_WAIT_MS            (100)               // 发送缓冲区满时每次等待的时间
+#define CONSOLE_FLUSH_MS                (100)
+#define CONSOLE_ACK_MS                  (100)               // 连接后等待logcat确认帧版本的时间
+#define MAX_SIZE_OF_SUNPATH             108
+static pthread_once_t gConsoleForkOnce = PTHREAD_ONCE_INIT;
+static pthread_mutex_t gConsoleListMutex = PTHREAD_MUTEX_INITIALIZER;
+static std::list<ConsoleLogWrite *> gConsoleList;
+ConsoleLogWrite::ConsoleLogWrite() :
+    mClientFd(-1),
+    mSending(false),
+    mSenderRunning(false),
+    mSenderGen(0),
+    mDropped(0),
+    mSenderExit(false),
+    mState(CONSOLE_DISCONNECTED),
+    mFrameVersion(0),
+    mRetryMs(0)
+{
+    mServerSockAddr.sun_family = AF_LOCAL;
+    snprintf(mServerSockAddr.sun_path, MAX_SIZE_OF_SUNPATH, LOCAL_SOCKET_SERVER_PATH);
+    mLocalServerSockPath = mServerSockAddr.sun_path;
+
+    pthread_mutex_init(&mQueueMutex, nullptr);
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&mQueueCond, &attr);
+    pthread_cond_init(&mIdleCond, &attr);
+    pthread_condattr_destroy(&attr);
+
+    // 崩溃信号由log::InstallCrashHandler处理
+    signal(SIGPIPE, SIG_IGN);
+
+    pthread_mutex_lock(&gConsoleListMutex);
+    gConsoleList.push_back(this);
+    pthread_mutex_unlock(&gConsoleListMutex);
+
+    // 添加节点时连接一次, logcat已启动时之后的日志不会丢失
+    pthread_mutex_lock(&mQueueMutex);
+    mState.store(CONSOLE_CONNECTING, std::memory_order_relaxed);
+    startSenderLocked();
+    pthread_mutex_unlock(&mQueueMutex);
+}
+
+ConsoleLogWrite::~ConsoleLogWrite()
+{
+    pthread_mutex_lock(&gConsoleListMutex);
+    gConsoleList.remove(this);
+    pthread_mutex_unlock(&gConsoleListMutex);
+
+    Flush();
+    pthread_mutex_lock(&mQueueMutex);
+    bool join = mSenderRunning && mSenderGen == gForkGeneration;
+    mSenderExit.store(true, std::memory_order_relaxed);
+    mSenderRunning = false;
+    pthread_cond_signal(&mQueueCond);
+    pthread_mutex_unlock(&mQueueMutex);
+    if (join) {
+        pthread_join(mSender, nullptr);
+    }
+
+    Destroy();
+    pthread_cond_destroy(&mQueueCond);
+    pthread_cond_destroy(&mIdleCond);
+    pthread_mutex_destroy(&mQueueMutex);
+}
+
+void ConsoleLogWrite::RegisterForkHandler()
+{
+    pthread_once(&gConsoleForkOnce, []() {
+        pthread_atfork(AtForkPrepare, AtForkParent, AtForkChild);
+    });
+}
+
+void ConsoleLogWrite::AtForkPrepare()
+{
+    pthread_mutex_lock(&gConsoleListMutex);
+    for (auto it = gConsoleList.begin(); it != gConsoleList.end(); ++it) {
+        pthread_mutex_lock(&(*it)->mQueueMutex);
+    }
+}
+
+void ConsoleLogWrite::AtForkParent()
+{
+    for (auto it = gConsoleList.begin(); it != gConsoleList.end(); ++it) {
+        pthread_mutex_unlock(&(*it)->mQueueMutex);
+    }
+    pthread_mutex_unlock(&gConsoleListMutex);
+}
+
+void ConsoleLogWrite::AtForkChild()
+{
+    for (auto it = gConsoleList.begin(); it != gConsoleList.end(); ++it) {
+        // 连接与发送线程属于父进程, 子进程在下一次写日志时建立自己的连接
+        ConsoleLogWrite *self = *it;
+        if (self->mClientFd >= 0) {
+            close(self->mClientFd);
+            self->mClientFd = -1;
+        }
+        self->mQueue.clear();
+        self->mControlBuffer.clear();
+        self->mSending = false;
+        self->mSenderRunning = false;
+        self->mDropped = 0;
+        self->mState.store(CONSOLE_DISCONNECTED, std::memory_order_relaxed);
+        self->mFrameVersion.store(0, std::memory_order_relaxed);
+        self->mRetryMs.store(0, std::memory_order_relaxed);
+
+        pthread_condattr_t attr;
+        pthread_condattr_init(&attr);
+        pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+        pthread_cond_init(&self->mQueueCond, &attr);
+        pthread_cond_init(&self->mIdleCond, &attr);
+        pthread_condattr_destroy(&attr);
+    }
+    AtForkParent();
+}
+
+void ConsoleLogWrite::startSenderLocked()
+{
+    if (mSenderRunning && mSenderGen == gForkGeneration) {
+        pthread_cond_signal(&mQueueCond);
+        return;
+    }
+
+    mSenderExit.store(false, std::memory_order_relaxed);
+    mSenderGen = gForkGeneration;
+    mSenderRunning = pthread_create(&mSender, nullptr, SendThread, this) == 0;
+    if (!mSenderRunning) {
+        mState.store(CONSOLE_DISCONNECTED, std::memory_order_relaxed);
+        mRetryMs.store(MonotonicMs() + CONSOLE_RETRY_MS, std::memory_order_relaxed);
+    }
+}
+
+bool ConsoleLogWrite::Connect()
+{
+    int32_t fd = ::socket(AF_LOCAL, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return false;
+    }
+
+    // 阻塞连接, 本地套接字服务端未监听时立即失败; 连接后改为非阻塞
+    if (::connect(fd, (sockaddr *)&mServerSockAddr, sizeof(mServerSockAddr)) < 0) {
+        close(fd);
+        return false;
+    }
+    int32_t flags = fcntl(fd, F_GETFL, 0);
+    fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+
+    char notice[512];
+    int32_t len = snprintf(notice, sizeof(notice), "{"
+        "\"id\": \"notice\", \"keywords\": \"level\", \"frame\": %d, \"pid\": %d, "
+        "\"level\": ["
+            "{ \"key\": \"DEBUG\", \"type\": \"int\", \"value\": 0 }, "
+            "{ \"key\": \"INFO\",  \"type\": \"int\", \"value\": 1 }, "
+            "{ \"key\": \"WARN\",  \"type\": \"int\", \"value\": 2 }, "
+            "{ \"key\": \"ERROR\", \"type\": \"int\", \"value\": 3 }, "
+            "{ \"key\": \"FATAL\", \"type\": \"int\", \"value\": 4 }, "
+            "{ \"key\": \"UNKNOW\", \"type\": \"int\", \"value\": -1 }"
+        "]}" CONSOLE_SEP_STR, CONSOLE_FRAME_VERSION, getpid());
+
+    pthread_mutex_lock(&mQueueMutex);
+    mClientFd = fd;
+    pthread_mutex_unlock(&mQueueMutex);
+    if (!SendAll(notice, len)) {
+        return false;
+    }
+
+    // 等待logcat确认帧版本, 旧版logcat不回复, 超时后使用JSON
+    uint64_t deadline = MonotonicMs() + CONSOLE_ACK_MS;
+    while (mClientFd >= 0 && mFrameVersion.load(std::memory_order_relaxed) == 0) {
+        uint64_t nowMs = MonotonicMs();
+        if (nowMs >= deadline) {
+            break;
+        }
+        struct pollfd pfd;
+        pfd.fd = mClientFd;
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+        if (poll(&pfd, 1, (int)(deadline - nowMs)) <= 0) {
+            break;
+        }
+        ReadControl();
+    }
+    return mClientFd >= 0;
+}
+
+void ConsoleLogWrite::Destroy()
+{
+    pthread_mutex_lock(&mQueueMutex);
+    if (mClientFd >= 0) {
+        close(mClientFd);
+        mClientFd = -1;
+    }
+    mQueue.clear();
+    mDropped = 0;
+    mControlBuffer.clear();
+    mFrameVersion.store(0, std::memory_order_relaxed);
+    mState.store(CONSOLE_DISCONNECTED, std::memory_order_relaxed);
+    mRetryMs.store(MonotonicMs() + CONSOLE_RETRY_MS, std::memory_order_relaxed);
+    pthread_mutex_unlock(&mQueueMutex);
+}
+
+int32_t ConsoleLogWrite::WriteToFile(std::string msg)
+{
+    LogEvent ev;
+    LogEventTime(ev);
+    ev.pid = getpid();
+    ev.tid = syscall(SYS_gettid);
+    ev.level = LogLevel::LEVEL_FATAL;
+    ev.tag[0] = '\0';
+    ev.msg = const_cast<char *>(msg.c_str());
+    ev.enableColor = false;
+    ev.fields = nullptr;
+    ev.fieldCount = 0;
+    return WriteToFile(ev);
+}
+
+void ConsoleLogWrite::EncodeJson(const LogEvent &ev, std::string &out)
+{
+    uint64_t milliSecond = ev.time.tv_sec * 1000 + ev.time.tv_usec / 1000;
+
+    nlohmann::json logJsonObj;
     logJsonObj["id"] = "data";
     logJsonObj["time"] = milliSecond;
     logJsonObj["pid"] = ev.pid;
@@ -456,29 +2059,363 @@ int32_t ConsoleLogWrite::WriteToFile(const LogEvent &ev)
     logJsonObj["level"] = ev.level;
     logJsonObj["tag"] = ev.tag;
     logJsonObj["msg"] = ev.msg;
+    if (ev.fieldCount > 0) {
+        nlohmann::json fields = nlohmann::json::object();
+        for (uint32_t i = 0; i < ev.fieldCount; ++i) {
+            const LogField &field = ev.fields[i];
+            std::string key(field.key, field.keyLen);
+            switch (field.type) {
+            case LOG_FIELD_INT:
+                fields[key] = field.value.i;
+                break;
+            case LOG_FIELD_UINT:
+                fields[key] = field.value.u;
+                break;
+            case LOG_FIELD_DOUBLE:
+                fields[key] = field.value.d;
+                break;
+            case LOG_FIELD_BOOL:
+                fields[key] = field.value.b;
+                break;
+            case LOG_FIELD_STRING:
+                fields[key] = std::string(field.value.s, field.len);
+                break;
+            default:
+                break;
+            }
+        }
+        logJsonObj["fields"] = fields;
+    }
 
-    std::stringstream ss;
-    ss << logJsonObj;
-    std::string msg = ss.str();
-    msg.append("\r\n\r\n");
+    out = logJsonObj.dump();
+    out.append(CONSOLE_SEP_STR);
+}
 
-    AutoLock<ProcessMutex> lock(mMutex);
-    InitParams();
+int32_t ConsoleLogWrite::WriteToFile(const LogEvent &ev)
+{
+    if (checkConnect()) {
+        const LogEvent *events[] = { &ev };
+        enqueue(events, 1);
+    }
+    return 0;
+}
 
-    int32_t sendSize = 0;
-    if (mClientFd > 0) {
-        sendSize = ::send(mClientFd, msg.c_str(), msg.length(), 0);
-        if (sendSize <= 0) { // 服务端不在线
-            Destroy();
+bool ConsoleLogWrite::checkConnect()
+{
+    int32_t state = mState.load(std::memory_order_relaxed);
+    if (state == CONSOLE_DISCONNECTED) {
+        // logcat不在线, 不编码日志, 到重试时间后唤醒发送线程重连
+        if (MonotonicMs() < mRetryMs.load(std::memory_order_relaxed)) {
+            return false;
         }
+        pthread_mutex_lock(&mQueueMutex);
+        if (mState.load(std::memory_order_relaxed) == CONSOLE_DISCONNECTED) {
+            mState.store(CONSOLE_CONNECTING, std::memory_order_relaxed);
+            startSenderLocked();
+        }
+        pthread_mutex_unlock(&mQueueMutex);
     }
 
-    return 0;
+    return true;
+}
+
+void ConsoleLogWrite::Encode(const LogEvent &ev, uint32_t version, std::string &out)
+{
+    if (version == 0) {
+        // 旧版logcat不识别二进制帧
+        std::string json;
+        EncodeJson(ev, json);
+        out.append(json);
+        return;
+    }
+
+    std::string text;
+    size_t fieldsLen = 0;
+    const LogEvent *frameEv = &ev;
+    LogEvent textEv;
+    if (ev.fieldCount > 0 && version >= 2) {
+        fieldsLen = LogFieldCodec::EncodeSize(ev.fields, ev.fieldCount);
+    } else if (ev.fieldCount > 0) {
+        // 版本1的帧不携带字段, 渲染到消息文本中
+        text.assign(ev.msg);
+        size_t offset = text.length();
+        text.resize(offset + LogFieldCodec::FormatSize(ev.fields, ev.fieldCount));
+        text.resize(offset + LogFieldCodec::Format(ev.fields, ev.fieldCount, &text[offset], text.length() - offset));
+        textEv = ev;
+        textEv.msg = &text[0];
+        textEv.fields = nullptr;
+        textEv.fieldCount = 0;
+        frameEv = &textEv;
+    }
+    size_t tagLen = strnlen(ev.tag, LOG_TAG_SIZE);
+    size_t msgLen = strlen(frameEv->msg);
+    if (ConsoleFrameSize(tagLen, msgLen, fieldsLen) > CONSOLE_FRAME_MAX) {
+        msgLen = CONSOLE_FRAME_MAX - ConsoleFrameSize(tagLen, 0, fieldsLen);
+    }
+    size_t offset = out.size();
+    out.resize(offset + ConsoleFrameSize(tagLen, msgLen, fieldsLen));
+    ConsoleFrameEncode(&out[offset], *frameEv, (uint8_t)version, tagLen, msgLen, fieldsLen);
+}
+
+void ConsoleLogWrite::enqueue(const LogEvent *const *events, uint32_t count)
+{
+    // 编码在锁外进行, 各条日志的结束偏移记录在ends中, 入队时逐条检查队列上限
+    static thread_local std::string encoded;
+    static thread_local std::vector<size_t> ends;
+    encoded.clear();
+    ends.clear();
+    uint32_t version = mFrameVersion.load(std::memory_order_acquire);
+    for (uint32_t i = 0; i < count; ++i) {
+        Encode(*events[i], version, encoded);
+        ends.push_back(encoded.size());
+    }
+
+    pthread_mutex_lock(&mQueueMutex);
+    if (mState.load(std::memory_order_relaxed) == CONSOLE_DISCONNECTED) {
+        pthread_mutex_unlock(&mQueueMutex);
+        return;
+    }
+
+    bool wakeup = mQueue.empty() && !mSending;
+    size_t begin = 0;
+    for (uint32_t i = 0; i < count; ++i) {
+        size_t need = ends[i] - begin;
+        if (mQueue.size() + need > CONSOLE_QUEUE_BYTES) {
+            ++mDropped;
+        } else {
+            mQueue.append(encoded, begin, need);
+        }
+        begin = ends[i];
+    }
+    if (wakeup && !mQueue.empty()) {
+        pthread_cond_signal(&mQueueCond);
+    }
+    pthread_mutex_unlock(&mQueueMutex);
+}
+
+bool ConsoleLogWrite::SendAll(const char *data, size_t size)
+{
+    size_t offset = 0;
+    while (offset < size) {
+        ssize_t nSend = ::send(mClientFd, data + offset, size - offset, MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (nSend > 0) {
+            offset += nSend;
+            continue;
+        }
+        if (nSend < 0 && errno == EINTR) {
+            continue;
+        }
+        if (nSend < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            // 帧已部分发出, 只能等待logcat读取, 期间新日志在队列中累积
+            if (mSenderExit.load(std::memory_order_relaxed)) {
+                return false;
+            }
+            struct pollfd pfd;
+            pfd.fd = mClientFd;
+            pfd.events = POLLOUT;
+            pfd.revents = 0;
+            poll(&pfd, 1, CONSOLE_SEND_WAIT_MS);
+            continue;
+        }
+
+        Destroy();  // 服务端不在线
+        return false;
+    }
+
+    return true;
+}
+
+void *ConsoleLogWrite::SendThread(void *arg)
+{
+    ConsoleLogWrite *self = static_cast<ConsoleLogWrite *>(arg);
+    std::string batch;
+    uint64_t lastControlMs = 0;
+
+    pthread_mutex_lock(&self->mQueueMutex);
+    while (!self->mSenderExit.load(std::memory_order_relaxed)) {
+        int32_t state = self->mState.load(std::memory_order_relaxed);
+        if (state == CONSOLE_CONNECTING) {
+            pthread_mutex_unlock(&self->mQueueMutex);
+            bool connected = self->Connect();
+            pthread_mutex_lock(&self->mQueueMutex);
+            if (connected) {
+                self->mState.store(CONSOLE_CONNECTED, std::memory_order_relaxed);
+            } else {
+                // Connect失败时已关闭连接, 连接期间入队的日志丢弃
+                self->mState.store(CONSOLE_DISCONNECTED, std::memory_order_relaxed);
+                self->mRetryMs.store(MonotonicMs() + CONSOLE_RETRY_MS, std::memory_order_relaxed);
+                self->mQueue.clear();
+                self->mDropped = 0;
+                pthread_cond_broadcast(&self->mIdleCond);
+            }
+            continue;
+        }
+
+        if (state != CONSOLE_CONNECTED) {
+            // 未连接时队列为空, 等待写者请求重连
+            pthread_cond_wait(&self->mQueueCond, &self->mQueueMutex);
+            continue;
+        }
+        if (self->mQueue.empty() && self->mDropped == 0) {
+            // 空闲时也定期读取logcat转发的控制命令
+            struct timespec ts;
+            clock_gettime(CLOCK_MONOTONIC, &ts);
+            ts.tv_nsec += (long)CONSOLE_CONTROL_INTERVAL_MS * 1000000;
+            ts.tv_sec += ts.tv_nsec / 1000000000;
+            ts.tv_nsec %= 1000000000;
+            pthread_cond_timedwait(&self->mQueueCond, &self->mQueueMutex, &ts);
+            if (self->mSenderExit.load(std::memory_order_relaxed)) {
+                break;
+            }
+        }
+
+        uint64_t dropped = self->mDropped;
+        self->mDropped = 0;
+        batch.swap(self->mQueue);
+        self->mSending = true;
+        pthread_mutex_unlock(&self->mQueueMutex);
+
+        // 只有发送线程会断开连接, 解锁后状态仍为已连接
+        if (dropped > 0) {
+            char msg[128];
+            snprintf(msg, sizeof(msg), "console queue full, dropped %lu messages", (unsigned long)dropped);
+            LogEvent ev;
+            LogEventTime(ev);
+            ev.pid = getpid();
+            ev.tid = syscall(SYS_gettid);
+            ev.level = LogLevel::LEVEL_WARN;
+            ev.tag[0] = '\0';
+            ev.msg = msg;
+            ev.enableColor = false;
+            ev.fields = nullptr;
+            ev.fieldCount = 0;
+            std::string notice;
+            uint32_t version = self->mFrameVersion.load(std::memory_order_relaxed);
+            if (version > 0) {
+                notice.resize(ConsoleFrameSize(0, strlen(msg)));
+                ConsoleFrameEncode(&notice[0], ev, (uint8_t)version, 0, strlen(msg));
+            } else {
+                EncodeJson(ev, notice);
+            }
+            self->SendAll(notice.c_str(), notice.size());
+        }
+        if (!batch.empty() && self->mClientFd >= 0) {
+            self->SendAll(batch.c_str(), batch.size());
+        }
+
+        uint64_t nowMs = MonotonicMs();
+        if (self->mClientFd >= 0 && nowMs - lastControlMs >= CONSOLE_CONTROL_INTERVAL_MS) {
+            lastControlMs = nowMs;
+            self->ReadControl();
+        }
+        batch.clear();
+        if (batch.capacity() > CONSOLE_QUEUE_BYTES) {
+            std::string().swap(batch);
+        }
+
+        pthread_mutex_lock(&self->mQueueMutex);
+        self->mSending = false;
+        if (self->mQueue.empty()) {
+            pthread_cond_broadcast(&self->mIdleCond);
+        }
+    }
+    pthread_mutex_unlock(&self->mQueueMutex);
+
+    return nullptr;
+}
+
+void ConsoleLogWrite::Flush()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    ts.tv_nsec += (long)CONSOLE_FLUSH_MS * 1000000;
+    ts.tv_sec += ts.tv_nsec / 1000000000;
+    ts.tv_nsec %= 1000000000;
+
+    pthread_mutex_lock(&mQueueMutex);
+    while ((!mQueue.empty() || mSending) && mSenderRunning && mSenderGen == gForkGeneration) {
+        if (pthread_cond_timedwait(&mIdleCond, &mQueueMutex, &ts) == ETIMEDOUT) {
+            break;
+        }
+    }
+    pthread_mutex_unlock(&mQueueMutex);
+}
+
+void ConsoleLogWrite::ReadControl()
+{
+    char buf[1024];
+    while (mClientFd >= 0) {
+        ssize_t nRecv = ::recv(mClientFd, buf, sizeof(buf), MSG_DONTWAIT);
+        if (nRecv <= 0) {
+            if (nRecv == 0) {
+                Destroy();
+            }
+            break;
+        }
+        mControlBuffer.append(buf, nRecv);
+    }
+
+    size_t pos = 0;
+    while ((pos = mControlBuffer.find(CONSOLE_SEP_STR)) != std::string::npos) {
+        OnControl(mControlBuffer.substr(0, pos));
+        mControlBuffer.erase(0, pos + strlen(CONSOLE_SEP_STR));
+    }
+}
+
+void ConsoleLogWrite::OnControl(const std::string &content)
+{
+    // {"id": "level", "tag": "net.*", "level": "debug"}, 无tag时修改全局级别, level为"default"时清除tag的设置
+    // {"id": "frame", "version": 1}, logcat支持的帧版本
+    try {
+        nlohmann::json obj = nlohmann::json::parse(content);
+        std::string id = obj.value("id", "");
+        if (id == "frame") {
+            uint32_t version = obj.value("version", 0);
+            mFrameVersion.store(version < CONSOLE_FRAME_VERSION ? version : CONSOLE_FRAME_VERSION,
+                std::memory_order_release);
+            return;
+        }
+        if (id != "level") {
+            return;
+        }
+
+        std::string tag = obj.value("tag", "");
+        std::string strLevel = obj.value("level", "default");
+        LogLevel::Level level = LogLevel::String2Level(strLevel);
+        if (tag.empty()) {
+            if (level != LogLevel::UNKNOW) {
+                log_set_global_level(level);
+            }
+        } else if (level != LogLevel::UNKNOW) {
+            log::SetTagLevel(tag.c_str(), level);
+        } else if (strLevel == "default") {
+            log::ResetTagLevel(tag.c_str());
+        }
+    } catch (const std::exception &e) {
+        (void)e;
+    }
+}
+
+int32_t ConsoleLogWrite::WriteToFile(const LogEvent &ev, const char *msg, size_t len)
+{
+    // logcat需要原始字段, 不使用已格式化的文本
+    (void)msg;
+    (void)len;
+    return WriteToFile(ev);
+}
+
+void ConsoleLogWrite::WriteBatch(LogEvent **events, uint32_t count, const char *text, const size_t *ends)
+{
+    (void)text;
+    (void)ends;
+    if (count > 0 && checkConnect()) {
+        enqueue(events, count);
+    }
 }
 
 std::string ConsoleLogWrite::getFileName()
 {
-    return mLocalClientSockPath;
+    return mLocalServerSockPath;
 }
 
 uint32_t ConsoleLogWrite::getFileSize()
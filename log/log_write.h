@@ -9,25 +9,34 @@
 #define __LOG_WRITE_H__
 
 #include "log_event.h"
+#include "log_binary.h"
+#include "log_shm.h"
+#include "log_rotate.h"
+#include "log_console.h"
 #include <string>
 #include <error.h>
 #include <errno.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdint.h>
+#include <limits.h>
 #include <memory>
 #include <signal.h>
 #include <unistd.h>
 #include <pthread.h>
 #include <arpa/inet.h>
 #include <sys/un.h>
+#include <sys/uio.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <semaphore.h>
+#include <atomic>
 
 #define MAX_FILE_SIZE       (5 * 1024 * 1024)  // one file' max size is 5mb
 #define DEFAULT_NAME_SIZE   (64)
+#define FILE_BATCH_BYTES    (64 * 1024)         // 批量写入默认缓存大小
+#define FILE_BATCH_DELAY_MS (5)                 // 批量写入默认最长延迟
 
 class NonCopyAndAssign
 {
@@ -59,6 +68,26 @@ public:
     }
     virtual int32_t      WriteToFile(std::string msg) = 0;
     virtual int32_t      WriteToFile(const LogEvent &ev) = 0;
+    // 写入已格式化的日志, 避免构造std::string
+    virtual int32_t      WriteToFile(const char *msg, size_t len) { return WriteToFile(std::string(msg, len)); }
+    // 写入由LogFormat::Format格式化的ev, 需要颜色或原始字段的输出节点重写
+    virtual int32_t      WriteToFile(const LogEvent &ev, const char *msg, size_t len)
+    {
+        (void)ev;
+        return WriteToFile(msg, len);
+    }
+    /**
+     * @brief 批量写入, 由异步写线程调用. text为各条日志由LogFormat::Format格式化后连续存放的文本,
+     *        第i条位于[i ? ends[i - 1] : 0, ends[i]). 默认逐条写入, 能合并写入的输出节点重写
+     */
+    virtual void         WriteBatch(LogEvent **events, uint32_t count, const char *text, const size_t *ends)
+    {
+        size_t begin = 0;
+        for (uint32_t i = 0; i < count; ++i) {
+            WriteToFile(*events[i], text + begin, ends[i] - begin);
+            begin = ends[i];
+        }
+    }
     virtual std::string  getFileName() = 0;
     virtual uint32_t     getFileSize() = 0;
     virtual uint32_t     getFileMode() = 0;
@@ -69,12 +98,19 @@ public:
     virtual bool         CreateNewFile(std::string fileName) = 0;
     virtual bool         CloseFile() = 0;
     virtual uint16_t     type() const = 0;
+    // 将缓存中的日志写出, 无缓存的输出节点无需实现
+    virtual void         Flush() {}
+    // 崩溃时由信号处理函数调用, 只能使用异步信号安全的操作, 不加锁
+    virtual void         FlushOnCrash() {}
 
 public:
     enum Type {
         STDOUT = 0,
         FILEOUT = 1,
         CONSOLEOUT = 2,
+        MMAPOUT = 3,
+        BINOUT = 4,
+        SHMOUT = 5,
         UNKNOW
     };
 
@@ -90,6 +126,10 @@ public:
 
     virtual int32_t      WriteToFile(std::string msg) override;
     virtual int32_t      WriteToFile(const LogEvent &ev) override;
+    virtual int32_t      WriteToFile(const char *msg, size_t len) override;
+    virtual int32_t      WriteToFile(const LogEvent &ev, const char *msg, size_t len) override;
+    // 加锁一次, 无颜色时整批一次write, 有颜色时按IOV_MAX分段writev
+    virtual void         WriteBatch(LogEvent **events, uint32_t count, const char *text, const size_t *ends) override;
     virtual std::string  getFileName();
     virtual uint32_t     getFileSize();
     virtual uint32_t     getFileMode();
@@ -105,14 +145,23 @@ private:
     bool isInterrupt;
 };
 
+/**
+ * @brief 文件输出. 父子进程共享文件路径、大小与切换代数, 各进程持有自己的文件描述符,
+ *        其他进程切换文件后按路径重新打开. 切换由LogRotator在后台准备, 写者不执行mkdir与创建文件.
+ */
 class FileLogWrite : public LogWrite {
 public:
     FileLogWrite(uint32_t fileFlag = O_RDWR | O_CREAT | O_APPEND, uint32_t fileMode = 0664);
     virtual ~FileLogWrite();
 
+    // 检查是否需要切换文件, 不阻塞
     void                 maintainFile();
     virtual int32_t      WriteToFile(std::string msg) override;
     virtual int32_t      WriteToFile(const LogEvent &ev) override;
+    virtual int32_t      WriteToFile(const char *msg, size_t len) override;
+    using LogWrite::WriteToFile;
+    // 整批文本一次写入
+    virtual void         WriteBatch(LogEvent **events, uint32_t count, const char *text, const size_t *ends) override;
     virtual std::string  getFileName();
     virtual uint32_t     getFileSize();
     virtual uint32_t     getFileMode();
@@ -120,19 +169,271 @@ public:
     virtual uint32_t     getFileFlag();
     virtual bool         setFileFlag(uint32_t flag);
 
+    // 在调用线程中打开文件, 添加输出节点时使用; 已有未到切换条件的文件时直接返回
     virtual bool         CreateNewFile(std::string fileName);
     virtual bool         CloseFile();
     virtual uint16_t     type() const { return FILEOUT; }
+    virtual void         Flush() override;
+    virtual void         FlushOnCrash() override;
+
+    /**
+     * @brief 开启批量写入, 日志先写入进程内缓存, 缓存满或超过延迟时间后一次写入文件
+     *
+     * @param maxBytes 缓存大小, 为0时关闭批量写入
+     * @param maxDelayMs 日志在缓存中的最长停留时间
+     */
+    void                 setBatch(uint32_t maxBytes, uint32_t maxDelayMs);
+    // 设置文件切换与保留策略, 下一次写入时生效
+    void                 setRotatePolicy(const LogRotatePolicy &policy);
+
+    /**
+     * @brief 注册fork处理函数, fork时持有所有批量缓存锁, 防止子进程继承被刷新线程持有的锁.
+     *        须早于异步日志的fork处理函数注册, 由LogManager构造时调用
+     */
+    static void          RegisterForkHandler();
+
+private:
+    // 进程间共享的文件状态, 由mMutex保护
+    struct FileShared {
+        uint64_t    fileSize;
+        uint32_t    generation;     // 每切换一次加一
+        time_t      openTime;
+        char        path[PATH_MAX];
+    };
+
+    int32_t              writeMsg(const char *msg, size_t len);
+    int32_t              writeFile(const struct iovec *iov, int32_t count);
+    // 以下需持有mMutex
+    void                 reopenLocked();
+    bool                 rotateLocked();
+    void                 installLocked(int32_t fd, const std::string &path);
+    void                 flushStageLocked();
+    void                 startFlushThreadLocked();
+    static void *        FlushThread(void *arg);
+    static void          AtForkPrepare();
+    static void          AtForkParent();
+    static void          AtForkChild();
 
 private:
     bool        isInterrupt;
-    int32_t*    mFileDesc;
+    int32_t     mFileDesc;          // 当前进程打开的描述符
+    uint32_t    mFileGen;           // mFileDesc对应的切换代数
     uint32_t    mFileMode;
     uint32_t    mFileFlag;
-    uint64_t*   mFileSize;
+    FileShared* mShared;
+    LogRotator  mRotator;
+
+    // 批量写入缓存, 每个进程独立, 仅在写文件时获取进程锁
+    pthread_mutex_t mStageMutex;
+    pthread_cond_t  mStageCond;
+    char*       mStage;
+    uint32_t    mStageSize;
+    uint32_t    mStageCap;
+    uint32_t    mFlushDelayMs;
+    uint64_t    mStageSinceMs;
+    pthread_t   mFlushThread;
+    uint32_t    mFlushThreadGen;    // 创建刷新线程时的fork代数, 子进程中需重新创建
+    bool        mFlushThreadRunning;
+    bool        mFlushThreadExit;
+    pid_t       mOwnerPid;          // 创建此节点的进程
 };
 
+/**
+ * @brief 内存映射文件输出. 预分配MAX_FILE_SIZE大小的文件段并映射, 写日志只需原子地推进偏移并拷贝,
+ *        写满时由跨越段尾的写者切换到新段, 无需全局锁. 进程崩溃时已拷贝的日志仍保留在页缓存中,
+ *        异常退出的文件尾部为预分配的'\0'.
+ */
+class MmapLogWrite : public LogWrite {
+public:
+    MmapLogWrite(uint32_t segmentSize = MAX_FILE_SIZE, uint32_t fileMode = 0664);
+    virtual ~MmapLogWrite();
 
+    virtual int32_t      WriteToFile(std::string msg) override;
+    virtual int32_t      WriteToFile(const LogEvent &ev) override;
+    virtual int32_t      WriteToFile(const char *msg, size_t len) override;
+    using LogWrite::WriteToFile;
+    // 整批文本一次分配与拷贝
+    virtual void         WriteBatch(LogEvent **events, uint32_t count, const char *text, const size_t *ends) override;
+    virtual std::string  getFileName();
+    virtual uint32_t     getFileSize();
+    virtual uint32_t     getFileMode();
+    virtual bool         setFileMode(uint32_t mode);
+    virtual uint32_t     getFileFlag();
+    virtual bool         setFileFlag(uint32_t flag);
+
+    virtual bool         CreateNewFile(std::string fileName);
+    virtual bool         CloseFile();
+    virtual uint16_t     type() const { return MMAPOUT; }
+
+    // fork时持有所有创建锁, 防止子进程继承正在创建段的写者持有的锁
+    static void          RegisterForkHandler();
+
+private:
+    struct Segment {
+        std::atomic<uint64_t>   offset;     // 已分配的偏移
+        std::atomic<uint32_t>   writers;    // 正在拷贝的写者数
+        std::atomic<bool>       busy;       // 使用中或尚未回收
+        char*                   base;
+        uint64_t                size;
+        int32_t                 fd;
+        char                    path[256];
+    };
+
+    int32_t              append(const char *msg, size_t len);
+    Segment *            acquireSegment();
+    Segment *            createSegment(const std::string &fileName);
+    void                 retireSegment(Segment *seg, uint64_t used);
+    void                 detachInheritedLocked();
+    static void          AtForkPrepare();
+    static void          AtForkParent();
+    static void          AtForkChild();
+
+private:
+    // 段控制块不释放, 持有旧段指针的写者只会在计数上短暂加减而不会访问已回收的映射
+    static const uint32_t   SEGMENT_POOL_SIZE = 4;
+    Segment                 mSegmentPool[SEGMENT_POOL_SIZE];
+    std::atomic<Segment *>  mSegment;
+    pthread_mutex_t         mCreateMutex;   // 仅首次创建或创建失败后重建时使用
+    uint32_t                mSegmentSize;
+    uint32_t                mFileMode;
+    std::atomic<uint32_t>   mFileSeq;
+    uint32_t                mForkGen;
+};
+
+/**
+ * @brief 二进制日志输出, 格式见log_binary.h. 经WriteFormat写入时只编码参数, 不在调用线程格式化文本,
+ *        由logdecode离线还原. 每个进程写独立文件, 日志缓存在进程内, 缓存满、FATAL日志、Flush及崩溃时
+ *        写入文件; 缓存中最早的日志停留超过FILE_BATCH_DELAY_MS后由刷新线程写出.
+ */
+class BinaryLogWrite : public LogWrite {
+public:
+    BinaryLogWrite(uint32_t fileMode = 0664);
+    virtual ~BinaryLogWrite();
+
+    virtual int32_t      WriteToFile(std::string msg) override;
+    virtual int32_t      WriteToFile(const LogEvent &ev) override;
+    virtual int32_t      WriteToFile(const char *msg, size_t len) override;
+    virtual int32_t      WriteToFile(const LogEvent &ev, const char *msg, size_t len) override;
+    // 整批只加锁一次
+    virtual void         WriteBatch(LogEvent **events, uint32_t count, const char *text, const size_t *ends) override;
+    // 编码格式串与参数, ev.msg被忽略
+    int32_t              WriteFormat(const LogEvent &ev, const char *fmt, va_list ap);
+    virtual std::string  getFileName();
+    virtual uint32_t     getFileSize();
+    virtual uint32_t     getFileMode();
+    virtual bool         setFileMode(uint32_t mode);
+    virtual uint32_t     getFileFlag();
+    virtual bool         setFileFlag(uint32_t flag);
+
+    virtual bool         CreateNewFile(std::string fileName);
+    virtual bool         CloseFile();
+    virtual uint16_t     type() const { return BINOUT; }
+    virtual void         Flush() override;
+    virtual void         FlushOnCrash() override;
+
+    // 注册fork处理函数, 子进程丢弃继承的缓存并写入自己的文件
+    static void          RegisterForkHandler();
+
+private:
+    int32_t              writeRecord(const LogEvent &ev, bool raw, const char *fmt, const char *args, size_t argsLen,
+                                     uint16_t flags = 0);
+    // 以下需持有mMutex
+    int32_t              writeEventLocked(const LogEvent &ev);
+    int32_t              writeRecordLocked(const LogEvent &ev, bool raw, const char *fmt, const char *args, size_t argsLen,
+                                           uint16_t flags = 0);
+    uint32_t             internLocked(const char *str);
+    void                 appendLocked(const void *data, size_t len);
+    void                 flushStageLocked();
+    void                 writeAllLocked(const void *data, size_t len);
+    bool                 openFileLocked(const std::string &fileName);
+    void                 closeFileLocked();
+    void                 startFlushThreadLocked();
+    static void *        FlushThread(void *arg);
+    static void          AtForkPrepare();
+    static void          AtForkParent();
+    static void          AtForkChild();
+
+private:
+    pthread_mutex_t     mMutex;
+    BinaryDictionary    mDict;
+    uint32_t            mFileGen;       // 每打开一个文件加一, 字典据此判断是否需要重新写入
+    int32_t             mFileDesc;
+    uint64_t            mFileSize;
+    uint32_t            mFileMode;
+    uint32_t            mFileSeq;
+    char*               mStage;
+    uint32_t            mStageSize;
+    uint64_t            mStageSinceMs;
+    pthread_cond_t      mStageCond;     // 缓存由空变为非空时唤醒刷新线程
+    pthread_t           mFlushThread;
+    bool                mFlushThreadRunning;
+    bool                mFlushThreadExit;
+};
+
+/**
+ * @brief 多进程共享内存输出. 创建时映射共享内存环并启动收集线程, 之后fork出的子进程共享这块内存.
+ *        每个线程写入自己的环, 不与其他线程或进程竞争锁; 收集线程按时间戳合并各环的日志后写入文件,
+ *        合并只在一轮收集内进行, 取得时间后被调度出去的线程其日志可能略晚于后续时间戳出现;
+ *        文件只由创建输出节点的进程打开. 创建进程退出后子进程的日志不再被收集.
+ */
+class ShmLogWrite : public LogWrite {
+public:
+    ShmLogWrite(uint32_t fileMode = 0664);
+    virtual ~ShmLogWrite();
+
+    virtual int32_t      WriteToFile(std::string msg) override;
+    virtual int32_t      WriteToFile(const LogEvent &ev) override;
+    virtual int32_t      WriteToFile(const char *msg, size_t len) override;
+    virtual int32_t      WriteToFile(const LogEvent &ev, const char *msg, size_t len) override;
+    virtual std::string  getFileName();
+    virtual uint32_t     getFileSize();
+    virtual uint32_t     getFileMode();
+    virtual bool         setFileMode(uint32_t mode);
+    virtual uint32_t     getFileFlag();
+    virtual bool         setFileFlag(uint32_t flag);
+
+    virtual bool         CreateNewFile(std::string fileName);
+    virtual bool         CloseFile();
+    virtual uint16_t     type() const { return SHMOUT; }
+    // 创建进程内立即收集并写出; 子进程等待自己的环被收集完
+    virtual void         Flush() override;
+
+    static void          RegisterForkHandler();
+    // 线程退出时释放其占用的环
+    static void          ReleaseRing(uint64_t areaId, uint32_t index, uint32_t forkGen);
+
+private:
+    int32_t              push(uint64_t timeNs, const char *msg, size_t len);
+    uint32_t             ringIndex();
+    bool                 isCollector() const;
+    size_t               collectLocked();
+    void                 reclaimLocked();
+    void                 writeOutLocked();
+    static void *        CollectThread(void *arg);
+    static void          AtForkPrepare();
+    static void          AtForkParent();
+    static void          AtForkChild();
+
+private:
+    ShmLogArea          mArea;
+    pid_t               mOwnerPid;
+    pthread_t           mCollector;
+    bool                mCollectorRunning;
+    std::atomic<bool>   mCollectorExit;
+    pthread_mutex_t     mCollectMutex;      // 收集线程与Flush互斥, 保证环只有一个读者
+    LogBuffer           mOutput;
+    int32_t             mFileDesc;
+    uint64_t            mFileSize;
+    uint32_t            mFileMode;
+    uint32_t            mFileSeq;
+    uint64_t            mReclaimMs;
+};
+
+/**
+ * @brief 输出到logcat. 每个进程建立自己的连接并启动发送线程, 写日志的线程只将编码后的日志追加到本进程的队列,
+ *        由发送线程批量非阻塞发送; logcat未启动时直接返回, 按CONSOLE_RETRY_MS间隔重连.
+ *        队列超过CONSOLE_QUEUE_BYTES时丢弃新日志, 丢弃条数在之后的发送中汇总为一条日志.
+ */
 class ConsoleLogWrite : public LogWrite
 {
 public:
@@ -141,6 +442,10 @@ public:
 
     int32_t      WriteToFile(std::string msg) override;
     int32_t      WriteToFile(const LogEvent &ev) override;
+    int32_t      WriteToFile(const LogEvent &ev, const char *msg, size_t len) override;
+    using LogWrite::WriteToFile;
+    // 在锁外编码整批日志, 加锁一次入队
+    void         WriteBatch(LogEvent **events, uint32_t count, const char *text, const size_t *ends) override;
     std::string  getFileName();
     uint32_t     getFileSize();
     uint32_t     getFileMode();
@@ -151,19 +456,58 @@ public:
     bool         CreateNewFile(std::string fileName);
     bool         CloseFile();
     uint16_t     type() const { return CONSOLEOUT; }
+    // 等待队列中的日志发送完成, 最多等待CONSOLE_FLUSH_MS
+    void         Flush() override;
+
+    static void  RegisterForkHandler();
+
+    enum State {
+        CONSOLE_DISCONNECTED = 0,
+        CONSOLE_CONNECTING   = 1,   // 发送线程正在连接, 期间的日志进入队列
+        CONSOLE_CONNECTED    = 2,
+    };
 
 protected:
-    void         InitParams();
+    bool         Connect();
     void         Destroy();
-    static void  signalHandler(int32_t sig);        // 信号捕获处理函数
+    // 以下由发送线程调用
+    bool         SendAll(const char *data, size_t size);
+    void         ReadControl();
+    void         OnControl(const std::string &content);
 
 private:
-    std::string         mLocalClientSockPath;
-    std::string         mLocalServerSockPath;
+    // 连接或入队前确认本进程的发送线程已启动, 需持有mQueueMutex
+    void         startSenderLocked();
+    // logcat不在线且未到重试时间时返回false
+    bool         checkConnect();
+    void         enqueue(const LogEvent *const *events, uint32_t count);
+    static void  Encode(const LogEvent &ev, uint32_t version, std::string &out);
+    static void  EncodeJson(const LogEvent &ev, std::string &out);
+    static void *SendThread(void *arg);
+    static void  AtForkPrepare();
+    static void  AtForkParent();
+    static void  AtForkChild();
 
+private:
+    std::string         mControlBuffer;
+    std::string         mLocalServerSockPath;
     struct sockaddr_un  mServerSockAddr;
-    struct sockaddr_un  mClientSockAddr;
-    int32_t             mClientFd;
+    int32_t             mClientFd;              // 只由发送线程读写, 修改时持有mQueueMutex
+
+    pthread_mutex_t     mQueueMutex;            // 保护以下成员
+    pthread_cond_t      mQueueCond;
+    pthread_cond_t      mIdleCond;              // 队列发送完成时通知Flush
+    std::string         mQueue;
+    bool                mSending;
+    pthread_t           mSender;
+    bool                mSenderRunning;
+    uint32_t            mSenderGen;             // 发送线程所在进程的fork代数
+    uint64_t            mDropped;
+
+    std::atomic<bool>       mSenderExit;
+    std::atomic<int32_t>    mState;
+    std::atomic<uint32_t>   mFrameVersion;      // logcat确认的帧版本, 0表示使用JSON
+    std::atomic<uint64_t>   mRetryMs;           // 连接失败后, 到该时间前不再重试
 };
 
 } // namespace eular
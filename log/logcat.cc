@@ -12,15 +12,23 @@
 #include <stdint.h>
 #include <stdarg.h>
 #include <assert.h>
+#include <time.h>
+#include <ctype.h>
+#include <regex.h>
+#include <strings.h>
 #include <map>
+#include <deque>
+#include <vector>
 #include <string>
-#include <sstream>
+#include <memory>
+#include <algorithm>
 
 #include <signal.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <arpa/inet.h>
 #include <sys/un.h>
+#include <sys/uio.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/wait.h>
@@ -28,23 +36,635 @@
 
 #include "nlohmann/json.hpp"
 #include "callstack.h"
+#include "log_console.h"
 
-#define LOCAL_SOCK_PATH "/tmp/log_sock_server"
-#define EPOLL_SIZE      (1024)
+#define LOCAL_SOCK_PATH     "/tmp/log_sock_server"
+#define EPOLL_SIZE          (1024)
+#define NET_QUEUE_BYTES     (4 * 1024 * 1024)   // 每个订阅者待发送数据的上限, 超过后丢弃新日志
+#define SLOW_CLIENT_MS      (5000)              // 订阅者队列持续满超过该时间后断开
+#define WRITEV_IOV_COUNT    (64)
+#define NET_RECV_MAX        (16 * 1024)         // 订阅者未解析完的控制消息上限, 超过后断开
+#define FILTER_MAX_LENGTH   (4096)              // 过滤表达式的最大长度
+#define FILTER_MAX_DEPTH    (64)                // 括号与!的最大嵌套层数, 避免远端订阅者耗尽栈
 
 #define SEP_STR "\r\n\r\n"
 static const uint32_t SEP_LEN = strlen(SEP_STR);
 
+typedef nlohmann::json Json;
+typedef std::shared_ptr<const std::string> Message;
+
+// 一条日志的各字段, 指向接收缓存或JSON解析结果, 只在处理期间有效
+struct LogRecord {
+    uint64_t    timeMs;
+    int32_t     pid;
+    int32_t     tid;
+    int32_t     level;
+    const char *tag;
+    size_t      tagLen;
+    const char *msg;
+    size_t      msgLen;
+    const char *fields;     // LogFieldCodec编码的字段, 只有二进制帧携带
+    size_t      fieldsLen;
+};
+
+/**
+ * 订阅者的过滤表达式, 收到时编译为语法树, 每条日志按树求值:
+ *   level >= warn && (tag in (net.*, db) || pid == 100) && msg ~ "time(out)?"
+ * 字段: level pid tid tag msg
+ * 比较: == != < <= > >=; in (a, b, ...); ~ !~ 为扩展正则; contains 为子串
+ * 逻辑: && || ! 及括号, 也可写作 and or not
+ * tag的值以*结尾为前缀匹配; 含空格等字符的值加双引号, 正则也可写作/.../, 按行匹配, $不受消息末尾换行影响
+ */
+enum FilterOp {
+    FILTER_AND,
+    FILTER_OR,
+    FILTER_NOT,
+    FILTER_LEVEL,
+    FILTER_PID,
+    FILTER_TID,
+    FILTER_TAG,
+    FILTER_MSG_CONTAINS,
+    FILTER_MSG_REGEX,
+};
+
+enum FilterCmp {
+    CMP_EQ,
+    CMP_NE,
+    CMP_LT,
+    CMP_LE,
+    CMP_GT,
+    CMP_GE,
+    CMP_IN,
+};
+
+struct FilterNode {
+    FilterOp                    op;
+    FilterCmp                   cmp;
+    bool                        negate;     // != 与 !~
+    std::vector<int64_t>        values;     // 数值字段的比较值, in时为集合
+    std::vector<std::string>    strings;    // tag的值或子串
+    regex_t                     regex;
+    bool                        hasRegex;
+    std::vector<std::unique_ptr<FilterNode>> children;
+
+    FilterNode(FilterOp o) : op(o), cmp(CMP_EQ), negate(false), hasRegex(false) {}
+    ~FilterNode()
+    {
+        if (hasRegex) {
+            regfree(&regex);
+        }
+    }
+    FilterNode(const FilterNode&) = delete;
+    FilterNode& operator=(const FilterNode&) = delete;
+
+    // 求值代价, 用于调整与/或的子节点顺序, 先算便宜的条件
+    int cost() const
+    {
+        switch (op) {
+        case FILTER_AND:
+        case FILTER_OR:
+        case FILTER_NOT: {
+            int sum = 0;
+            for (const auto &child : children) {
+                sum += child->cost();
+            }
+            return sum;
+        }
+        case FILTER_TAG:
+            return 2;
+        case FILTER_MSG_CONTAINS:
+            return 8;
+        case FILTER_MSG_REGEX:
+            return 32;
+        default:
+            return 1;
+        }
+    }
+
+    static bool Compare(int64_t lhs, FilterCmp cmp, const std::vector<int64_t> &values)
+    {
+        switch (cmp) {
+        case CMP_EQ: return lhs == values[0];
+        case CMP_NE: return lhs != values[0];
+        case CMP_LT: return lhs < values[0];
+        case CMP_LE: return lhs <= values[0];
+        case CMP_GT: return lhs > values[0];
+        case CMP_GE: return lhs >= values[0];
+        case CMP_IN: return std::binary_search(values.begin(), values.end(), lhs);
+        }
+        return false;
+    }
+
+    bool matchTag(const LogRecord &rec) const
+    {
+        for (const auto &tag : strings) {
+            size_t len = tag.length();
+            if (len > 0 && tag[len - 1] == '*') {
+                if (rec.tagLen >= len - 1 && memcmp(rec.tag, tag.c_str(), len - 1) == 0) {
+                    return true;
+                }
+            } else if (rec.tagLen == len && memcmp(rec.tag, tag.c_str(), len) == 0) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool eval(const LogRecord &rec) const
+    {
+        switch (op) {
+        case FILTER_AND:
+            for (const auto &child : children) {
+                if (!child->eval(rec)) {
+                    return false;
+                }
+            }
+            return true;
+        case FILTER_OR:
+            for (const auto &child : children) {
+                if (child->eval(rec)) {
+                    return true;
+                }
+            }
+            return false;
+        case FILTER_NOT:
+            return !children[0]->eval(rec);
+        case FILTER_LEVEL:
+            return Compare(rec.level, cmp, values);
+        case FILTER_PID:
+            return Compare(rec.pid, cmp, values);
+        case FILTER_TID:
+            return Compare(rec.tid, cmp, values);
+        case FILTER_TAG:
+            return matchTag(rec) != negate;
+        case FILTER_MSG_CONTAINS:
+            return (memmem(rec.msg, rec.msgLen, strings[0].c_str(), strings[0].length()) != nullptr) != negate;
+        case FILTER_MSG_REGEX: {
+            // REG_STARTEND: 消息不以'\0'结尾, 按长度匹配
+            regmatch_t range;
+            range.rm_so = 0;
+            range.rm_eo = rec.msgLen;
+            return (regexec(&regex, rec.msg, 1, &range, REG_STARTEND) == 0) != negate;
+        }
+        }
+        return false;
+    }
+};
+
+class FilterParser {
+public:
+    FilterParser(const std::string &expr) : mExpr(expr), mPos(0), mDepth(0) {}
+
+    /**
+     * @brief 编译过滤表达式
+     *
+     * @return 语法树, 出错时返回nullptr, 错误信息由error()获取
+     */
+    std::unique_ptr<FilterNode> compile()
+    {
+        if (mExpr.length() > FILTER_MAX_LENGTH) {
+            mError = "expression too long";
+            return nullptr;
+        }
+
+        next();
+        std::unique_ptr<FilterNode> root = parseOr();
+        if (root && mToken.type != TOKEN_END) {
+            fail("unexpected '" + mToken.text + "'");
+            root.reset();
+        }
+        if (root) {
+            optimize(root.get());
+        }
+        return root;
+    }
+
+    const std::string &error() const { return mError; }
+
+private:
+    enum TokenType {
+        TOKEN_END,
+        TOKEN_WORD,     // 字段名、关键字及不加引号的值
+        TOKEN_STRING,   // 加双引号的值
+        TOKEN_REGEX,    // /.../
+        TOKEN_OP,       // 运算符与括号
+        TOKEN_ERROR,
+    };
+
+    struct Token {
+        TokenType   type;
+        std::string text;
+        size_t      pos;
+    };
+
+    static bool IsWordChar(char c)
+    {
+        return isalnum((unsigned char)c) || c == '_' || c == '.' || c == '*' || c == '-' || c == ':';
+    }
+
+    void next()
+    {
+        while (mPos < mExpr.length() && isspace((unsigned char)mExpr[mPos])) {
+            ++mPos;
+        }
+
+        mToken.pos = mPos;
+        mToken.text.clear();
+        if (mPos >= mExpr.length()) {
+            mToken.type = TOKEN_END;
+            return;
+        }
+
+        char c = mExpr[mPos];
+        if (c == '"' || c == '/') {
+            // 引号内\"与正则内\/转义, 其余反斜杠原样保留
+            mToken.type = c == '"' ? TOKEN_STRING : TOKEN_REGEX;
+            for (++mPos; mPos < mExpr.length() && mExpr[mPos] != c; ++mPos) {
+                if (mExpr[mPos] == '\\' && mPos + 1 < mExpr.length() && mExpr[mPos + 1] == c) {
+                    ++mPos;
+                } else if (mExpr[mPos] == '\\' && c == '"' && mPos + 1 < mExpr.length() && mExpr[mPos + 1] == '\\') {
+                    ++mPos;
+                }
+                mToken.text.push_back(mExpr[mPos]);
+            }
+            if (mPos >= mExpr.length()) {
+                mToken.type = TOKEN_ERROR;
+                mToken.text = "unterminated string";
+                return;
+            }
+            ++mPos;
+            return;
+        }
+
+        if (IsWordChar(c)) {
+            mToken.type = TOKEN_WORD;
+            while (mPos < mExpr.length() && IsWordChar(mExpr[mPos])) {
+                mToken.text.push_back(mExpr[mPos++]);
+            }
+            return;
+        }
+
+        static const char *ops[] = { "&&", "||", "==", "!=", "<=", ">=", "!~", "<", ">", "~", "!", "(", ")", ",", "=" };
+        for (const char *op : ops) {
+            size_t len = strlen(op);
+            if (mExpr.compare(mPos, len, op) == 0) {
+                mToken.type = TOKEN_OP;
+                mToken.text = op;
+                mPos += len;
+                return;
+            }
+        }
+
+        mToken.type = TOKEN_ERROR;
+        mToken.text = std::string("invalid character '") + c + "'";
+    }
+
+    bool isOp(const char *op) const { return mToken.type == TOKEN_OP && mToken.text == op; }
+    bool isWord(const char *word) const { return mToken.type == TOKEN_WORD && strcasecmp(mToken.text.c_str(), word) == 0; }
+
+    void fail(const std::string &msg)
+    {
+        if (mError.empty()) {
+            mError = msg + " at column " + std::to_string(mToken.pos + 1);
+        }
+    }
+
+    std::unique_ptr<FilterNode> parseOr()
+    {
+        std::unique_ptr<FilterNode> lhs = parseAnd();
+        if (!lhs || !(isOp("||") || isWord("or"))) {
+            return lhs;
+        }
+
+        std::unique_ptr<FilterNode> node(new FilterNode(FILTER_OR));
+        node->children.push_back(std::move(lhs));
+        while (isOp("||") || isWord("or")) {
+            next();
+            std::unique_ptr<FilterNode> rhs = parseAnd();
+            if (!rhs) {
+                return nullptr;
+            }
+            node->children.push_back(std::move(rhs));
+        }
+        return node;
+    }
+
+    std::unique_ptr<FilterNode> parseAnd()
+    {
+        std::unique_ptr<FilterNode> lhs = parseUnary();
+        if (!lhs || !(isOp("&&") || isWord("and"))) {
+            return lhs;
+        }
+
+        std::unique_ptr<FilterNode> node(new FilterNode(FILTER_AND));
+        node->children.push_back(std::move(lhs));
+        while (isOp("&&") || isWord("and")) {
+            next();
+            std::unique_ptr<FilterNode> rhs = parseUnary();
+            if (!rhs) {
+                return nullptr;
+            }
+            node->children.push_back(std::move(rhs));
+        }
+        return node;
+    }
+
+    std::unique_ptr<FilterNode> parseUnary()
+    {
+        // 每层括号或!递归一次, 语法树的求值与释放也按此深度递归
+        if (mDepth >= FILTER_MAX_DEPTH) {
+            fail("expression too deep");
+            return nullptr;
+        }
+
+        ++mDepth;
+        std::unique_ptr<FilterNode> node = parseOperand();
+        --mDepth;
+        return node;
+    }
+
+    std::unique_ptr<FilterNode> parseOperand()
+    {
+        if (isOp("!") || isWord("not")) {
+            next();
+            std::unique_ptr<FilterNode> child = parseUnary();
+            if (!child) {
+                return nullptr;
+            }
+            std::unique_ptr<FilterNode> node(new FilterNode(FILTER_NOT));
+            node->children.push_back(std::move(child));
+            return node;
+        }
+
+        if (isOp("(")) {
+            next();
+            std::unique_ptr<FilterNode> node = parseOr();
+            if (!node) {
+                return nullptr;
+            }
+            if (!isOp(")")) {
+                fail("expect ')'");
+                return nullptr;
+            }
+            next();
+            return node;
+        }
+
+        return parseCondition();
+    }
+
+    // 值: 不加引号的单词或加引号的字符串
+    bool parseValue(std::string &value)
+    {
+        if (mToken.type != TOKEN_WORD && mToken.type != TOKEN_STRING) {
+            fail(mToken.type == TOKEN_ERROR ? mToken.text : "expect value");
+            return false;
+        }
+        value = mToken.text;
+        next();
+        return true;
+    }
+
+    // (a, b, ...)
+    bool parseList(std::vector<std::string> &values)
+    {
+        if (!isOp("(")) {
+            fail("expect '('");
+            return false;
+        }
+        next();
+        while (true) {
+            std::string value;
+            if (!parseValue(value)) {
+                return false;
+            }
+            values.push_back(value);
+            if (isOp(")")) {
+                next();
+                return true;
+            }
+            if (!isOp(",")) {
+                fail("expect ',' or ')'");
+                return false;
+            }
+            next();
+        }
+    }
+
+    bool parseNumber(FilterOp op, const std::string &text, int64_t &out)
+    {
+        if (op == FILTER_LEVEL) {
+            eular::LogLevel::Level level = eular::LogLevel::String2Level(text);
+            if (level != eular::LogLevel::UNKNOW) {
+                out = level;
+                return true;
+            }
+        }
+
+        char *end = nullptr;
+        errno = 0;
+        long long value = strtoll(text.c_str(), &end, 10);
+        if (text.empty() || *end != '\0' || errno != 0) {
+            fail("invalid number '" + text + "'");
+            return false;
+        }
+        out = value;
+        return true;
+    }
+
+    std::unique_ptr<FilterNode> parseCondition()
+    {
+        if (mToken.type != TOKEN_WORD) {
+            fail(mToken.type == TOKEN_ERROR ? mToken.text :
+                 mToken.type == TOKEN_END ? "unexpected end" : "expect field");
+            return nullptr;
+        }
+
+        std::string field = mToken.text;
+        std::transform(field.begin(), field.end(), field.begin(), ::tolower);
+        next();
+
+        if (field == "level" || field == "pid" || field == "tid") {
+            FilterOp op = field == "level" ? FILTER_LEVEL : field == "pid" ? FILTER_PID : FILTER_TID;
+            std::unique_ptr<FilterNode> node(new FilterNode(op));
+            std::vector<std::string> texts;
+            if (isWord("in")) {
+                next();
+                node->cmp = CMP_IN;
+                if (!parseList(texts)) {
+                    return nullptr;
+                }
+            } else {
+                static const struct { const char *text; FilterCmp cmp; } cmps[] = {
+                    { "==", CMP_EQ }, { "=", CMP_EQ }, { "!=", CMP_NE }, { "<", CMP_LT },
+                    { "<=", CMP_LE }, { ">", CMP_GT }, { ">=", CMP_GE },
+                };
+                bool found = false;
+                for (const auto &it : cmps) {
+                    if (isOp(it.text)) {
+                        node->cmp = it.cmp;
+                        found = true;
+                        break;
+                    }
+                }
+                if (!found) {
+                    fail("expect comparison after '" + field + "'");
+                    return nullptr;
+                }
+                next();
+                texts.resize(1);
+                if (!parseValue(texts[0])) {
+                    return nullptr;
+                }
+            }
+
+            for (const auto &text : texts) {
+                int64_t value = 0;
+                if (!parseNumber(op, text, value)) {
+                    return nullptr;
+                }
+                node->values.push_back(value);
+            }
+            std::sort(node->values.begin(), node->values.end());
+            return node;
+        }
+
+        if (field == "tag") {
+            std::unique_ptr<FilterNode> node(new FilterNode(FILTER_TAG));
+            if (isWord("in")) {
+                next();
+                if (!parseList(node->strings)) {
+                    return nullptr;
+                }
+                return node;
+            }
+            if (!isOp("==") && !isOp("=") && !isOp("!=")) {
+                fail("expect '==', '!=' or 'in' after 'tag'");
+                return nullptr;
+            }
+            node->negate = isOp("!=");
+            next();
+            node->strings.resize(1);
+            if (!parseValue(node->strings[0])) {
+                return nullptr;
+            }
+            return node;
+        }
+
+        if (field == "msg") {
+            if (isWord("contains")) {
+                next();
+                std::unique_ptr<FilterNode> node(new FilterNode(FILTER_MSG_CONTAINS));
+                node->strings.resize(1);
+                if (!parseValue(node->strings[0])) {
+                    return nullptr;
+                }
+                return node;
+            }
+            if (!isOp("~") && !isOp("!~")) {
+                fail("expect '~', '!~' or 'contains' after 'msg'");
+                return nullptr;
+            }
+
+            std::unique_ptr<FilterNode> node(new FilterNode(FILTER_MSG_REGEX));
+            node->negate = isOp("!~");
+            next();
+            if (mToken.type != TOKEN_REGEX && mToken.type != TOKEN_STRING && mToken.type != TOKEN_WORD) {
+                fail(mToken.type == TOKEN_ERROR ? mToken.text : "expect regular expression");
+                return nullptr;
+            }
+            int ret = regcomp(&node->regex, mToken.text.c_str(), REG_EXTENDED | REG_NOSUB | REG_NEWLINE);
+            if (ret != 0) {
+                char buf[128];
+                regerror(ret, &node->regex, buf, sizeof(buf));
+                fail(std::string("invalid regex: ") + buf);
+                return nullptr;
+            }
+            node->hasRegex = true;
+            next();
+            return node;
+        }
+
+        fail("unknown field '" + field + "'");
+        return nullptr;
+    }
+
+    // 合并相同的与/或节点, 并把代价低的条件排在前面
+    static void optimize(FilterNode *node)
+    {
+        if (node->op != FILTER_AND && node->op != FILTER_OR && node->op != FILTER_NOT) {
+            return;
+        }
+
+        std::vector<std::unique_ptr<FilterNode>> children;
+        for (auto &child : node->children) {
+            optimize(child.get());
+            if (node->op != FILTER_NOT && child->op == node->op) {
+                for (auto &grandChild : child->children) {
+                    children.push_back(std::move(grandChild));
+                }
+            } else {
+                children.push_back(std::move(child));
+            }
+        }
+        std::stable_sort(children.begin(), children.end(),
+            [](const std::unique_ptr<FilterNode> &a, const std::unique_ptr<FilterNode> &b) {
+                return a->cost() < b->cost();
+            });
+        node->children = std::move(children);
+    }
+
+private:
+    const std::string & mExpr;
+    size_t              mPos;
+    int32_t             mDepth;
+    Token               mToken;
+    std::string         mError;
+};
+
+// 订阅者的过滤条件, 为空时转发全部日志
+struct LogFilter {
+    std::unique_ptr<FilterNode> root;
+
+    bool match(const LogRecord &rec) const
+    {
+        return root == nullptr || root->eval(rec);
+    }
+};
+
+// 日志进程, 每个进程一个连接
+struct LocalClient {
+    std::string     recv;
+    int32_t         pid;    // notice中的进程ID, 用于只向指定进程转发控制命令
+
+    LocalClient() : pid(0) {}
+};
+
+// 网络订阅者, 待发送的消息在多个订阅者之间共享
+struct NetClient {
+    sockaddr_in         addr;
+    std::string         recv;
+    std::deque<Message> queue;
+    size_t              queueBytes;
+    size_t              headOffset;     // 队首消息已发送的字节数
+    uint64_t            dropped;        // 队列满时丢弃的条数, 恢复后通知订阅者
+    uint64_t            fullSinceMs;    // 队列开始丢弃的时间, 0表示未满
+    bool                dirty;          // 有新消息待发送
+    LogFilter           filter;
+
+    NetClient() : queueBytes(0), headOffset(0), dropped(0), fullSinceMs(0), dirty(false) {}
+};
+
 int gLocalServerSocket = -1;    // 本地套接字服务端
-int gLocalClientSocket = -1;    // 本地套接字客户端
 int tcpServerSocket = -1;       // 网络套接字服务端
-std::map<int, sockaddr_in> gNetClientMap; // 网络套接字客户端map
-
-typedef nlohmann::json Json;
+int gEpollFd = -1;
+std::map<int, LocalClient> gLocalClientMap;  // 本地套接字客户端
+std::map<int, NetClient> gNetClientMap;      // 网络套接字客户端
+std::vector<int> gDirtyClients;              // 本轮事件中有新消息的订阅者
 
 std::string gJsonNotice; // 已携带分割符
 
-#define RECV_BUFFER_SIZE    8192
+#define RECV_BUFFER_SIZE    (64 * 1024)
 static char gRecvBuf[RECV_BUFFER_SIZE];
 
 void print(const char *perfix)
@@ -56,6 +676,13 @@ void print(const char *perfix)
     exit(0);
 }
 
+static uint64_t MonotonicMs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
 void catch_signal(int sig)
 {
     std::string signalMsg;
@@ -95,23 +722,28 @@ void catch_signal(int sig)
     root["keywords"] = "msg";
     root["msg"] = signalMsg;
 
-    std::stringstream ss;
-    ss << root;
-    const std::string &jsonMsg = ss.str();
-
+    const std::string &jsonMsg = root.dump() + SEP_STR;
     for (auto it = gNetClientMap.begin(); it != gNetClientMap.end();) {
-        ::send(it->first, jsonMsg.c_str(), jsonMsg.length(), 0);
+        ::send(it->first, jsonMsg.c_str(), jsonMsg.length(), MSG_NOSIGNAL);
         close(it->first);
         it = gNetClientMap.erase(it);
     }
+    for (auto it = gLocalClientMap.begin(); it != gLocalClientMap.end(); ++it) {
+        close(it->first);
+    }
 
     close(tcpServerSocket);
-    close(gLocalClientSocket);
     close(gLocalServerSocket);
     unlink(LOCAL_SOCK_PATH);
     exit(0);
 }
 
+static void SetNonBlock(int fd)
+{
+    int flag = fcntl(fd, F_GETFL);
+    fcntl(fd, F_SETFL, flag | O_NONBLOCK);
+}
+
 int InitSocket()
 {
     gLocalServerSocket = ::socket(AF_LOCAL, SOCK_STREAM, 0);
@@ -130,12 +762,13 @@ int InitSocket()
         goto error;
     }
 
-    nRetCode = ::listen(gLocalServerSocket, 14);
+    nRetCode = ::listen(gLocalServerSocket, 128);
     if (nRetCode < 0) {
         printf("%s() listen error. %d %s\n", __func__, errno, strerror(errno));
         goto error;
     }
 
+    SetNonBlock(gLocalServerSocket);
     return gLocalServerSocket;
 
 error:
@@ -147,38 +780,563 @@ error:
     return nRetCode;
 }
 
-void OnLocalSocketReadEvent(std::string jsonContent)
+void CloseNetClient(int fd)
+{
+    printf("net client %d exit.\n", fd);
+    epoll_ctl(gEpollFd, EPOLL_CTL_DEL, fd, nullptr);
+    close(fd);
+    gNetClientMap.erase(fd);
+}
+
+void CloseLocalClient(int fd)
+{
+    printf("local client %d exit.\n", fd);
+    epoll_ctl(gEpollFd, EPOLL_CTL_DEL, fd, nullptr);
+    close(fd);
+    gLocalClientMap.erase(fd);
+}
+
+/**
+ * @brief 追加到订阅者的发送队列, 在本轮事件处理完后统一发送
+ *
+ * @return 订阅者持续跟不上需要断开时返回false
+ */
+bool Enqueue(int fd, NetClient &client, const Message &msg)
+{
+    if (client.queueBytes + msg->length() > NET_QUEUE_BYTES) {
+        uint64_t nowMs = MonotonicMs();
+        if (client.fullSinceMs == 0) {
+            client.fullSinceMs = nowMs;
+        } else if (nowMs - client.fullSinceMs >= SLOW_CLIENT_MS) {
+            printf("net client %d too slow, %lu messages dropped\n", fd, (unsigned long)client.dropped);
+            return false;
+        }
+        ++client.dropped;
+        return true;
+    }
+
+    if (client.dropped > 0) {
+        // 订阅者据此得知中间有日志缺失
+        char buf[128];
+        int len = snprintf(buf, sizeof(buf), "{\"id\": \"dropped\", \"count\": %lu}" SEP_STR, (unsigned long)client.dropped);
+        Message notice = std::make_shared<const std::string>(buf, len);
+        client.queue.push_back(notice);
+        client.queueBytes += notice->length();
+        client.dropped = 0;
+    }
+    client.fullSinceMs = 0;
+    client.queue.push_back(msg);
+    client.queueBytes += msg->length();
+    if (!client.dirty) {
+        client.dirty = true;
+        gDirtyClients.push_back(fd);
+    }
+    return true;
+}
+
+/**
+ * @brief 用writev发送队列中的消息, 直到发完或套接字缓冲区满; 缓冲区满时等待EPOLLOUT
+ *
+ * @return 连接出错返回false
+ */
+bool FlushNetClient(int fd, NetClient &client)
+{
+    struct iovec iov[WRITEV_IOV_COUNT];
+    while (!client.queue.empty()) {
+        int count = 0;
+        for (auto it = client.queue.begin(); it != client.queue.end() && count < WRITEV_IOV_COUNT; ++it, ++count) {
+            size_t offset = count == 0 ? client.headOffset : 0;
+            iov[count].iov_base = const_cast<char *>((*it)->c_str()) + offset;
+            iov[count].iov_len = (*it)->length() - offset;
+        }
+
+        ssize_t nSend = ::writev(fd, iov, count);
+        if (nSend < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return errno == EAGAIN || errno == EWOULDBLOCK;
+        }
+
+        size_t left = nSend;
+        while (left > 0) {
+            size_t remain = client.queue.front()->length() - client.headOffset;
+            if (left < remain) {
+                client.headOffset += left;
+                break;
+            }
+            left -= remain;
+            client.queueBytes -= client.queue.front()->length();
+            client.queue.pop_front();
+            client.headOffset = 0;
+        }
+    }
+    return true;
+}
+
+void FlushDirtyClients()
+{
+    for (int fd : gDirtyClients) {
+        auto it = gNetClientMap.find(fd);
+        if (it == gNetClientMap.end()) {
+            continue;
+        }
+        it->second.dirty = false;
+        if (!FlushNetClient(fd, it->second)) {
+            CloseNetClient(fd);
+        }
+    }
+    gDirtyClients.clear();
+}
+
+// 日志转为JSON转发给网络客户端, 网络侧协议不变
+Message RecordToJson(const LogRecord &rec)
+{
+    Json root;
+    root["id"] = "data";
+    root["time"] = rec.timeMs;
+    root["pid"] = rec.pid;
+    root["tid"] = rec.tid;
+    root["level"] = rec.level;
+    root["tag"] = std::string(rec.tag, rec.tagLen);
+    root["msg"] = std::string(rec.msg, rec.msgLen);
+    std::vector<eular::LogField> fields;
+    if (rec.fieldsLen > 0 && eular::LogFieldCodec::Decode(rec.fields, rec.fieldsLen, fields)) {
+        Json obj = Json::object();
+        for (const eular::LogField &field : fields) {
+            std::string key(field.key, field.keyLen);
+            switch (field.type) {
+            case eular::LOG_FIELD_INT:
+                obj[key] = field.value.i;
+                break;
+            case eular::LOG_FIELD_UINT:
+                obj[key] = field.value.u;
+                break;
+            case eular::LOG_FIELD_DOUBLE:
+                obj[key] = field.value.d;
+                break;
+            case eular::LOG_FIELD_BOOL:
+                obj[key] = field.value.b;
+                break;
+            case eular::LOG_FIELD_STRING:
+                obj[key] = std::string(field.value.s, field.len);
+                break;
+            default:
+                break;
+            }
+        }
+        root["fields"] = obj;
+    }
+
+    std::string jsonContent = root.dump(-1, ' ', false, Json::error_handler_t::replace);
+    jsonContent.append(SEP_STR);
+    return std::make_shared<const std::string>(std::move(jsonContent));
+}
+
+/**
+ * @brief 转发给过滤条件匹配的订阅者, 只有存在匹配的订阅者时才序列化, 且只序列化一次
+ *
+ * @param rec 为nullptr时转发给所有订阅者
+ * @param msg 已序列化的消息, 为空时由rec生成
+ */
+void Broadcast(const LogRecord *rec, Message msg)
+{
+    std::vector<int> slowClients;
+    for (auto it = gNetClientMap.begin(); it != gNetClientMap.end(); ++it) {
+        if (rec != nullptr && !it->second.filter.match(*rec)) {
+            continue;
+        }
+        if (!msg) {
+            msg = RecordToJson(*rec);
+        }
+        if (!Enqueue(it->first, it->second, msg)) {
+            slowClients.push_back(it->first);
+        }
+    }
+
+    for (int fd : slowClients) {
+        CloseNetClient(fd);
+    }
+}
+
+void OnLocalSocketReadEvent(int fd, LocalClient &client, const std::string &jsonContent)
 {
     if (jsonContent.length() == 0) {
         return;
     }
 
+    Json jsonConfig;
+    try {
+        jsonConfig = Json::parse(jsonContent);
+    } catch(const std::exception& e) {
+        printf("json parse error: %s\n", e.what());
+        return;
+    }
+
+    std::string id = jsonConfig.value("id", "");
+    if (id == "data") {
+        // 未协商二进制帧的日志进程逐条发送JSON
+        std::string tag = jsonConfig.value("tag", "");
+        std::string msg = jsonConfig.value("msg", "");
+        LogRecord rec;
+        rec.timeMs = jsonConfig.value("time", (uint64_t)0);
+        rec.pid = jsonConfig.value("pid", 0);
+        rec.tid = jsonConfig.value("tid", 0);
+        rec.level = jsonConfig.value("level", 0);
+        rec.tag = tag.c_str();
+        rec.tagLen = tag.length();
+        rec.msg = msg.c_str();
+        rec.msgLen = msg.length();
+        rec.fields = nullptr;
+        rec.fieldsLen = 0;
+        Broadcast(&rec, std::make_shared<const std::string>(jsonContent + SEP_STR));
+        return;
+    }
+
     printf("json: %s\n", jsonContent.c_str());
+    if (id == "notice") {
+        gJsonNotice = jsonContent;
+        gJsonNotice.append(SEP_STR);
+        client.pid = jsonConfig.value("pid", 0);
 
-    try
-    {
-        auto jsonConfig = Json::parse(jsonContent);
-        if (jsonConfig["id"].get<std::string>() == "notice") {
-            gJsonNotice = jsonContent;
-            gJsonNotice.append(SEP_STR);
+        // 日志进程支持二进制帧时回复双方都支持的版本, 之后的日志不再逐条序列化为JSON
+        int frame = jsonConfig.value("frame", 0);
+        if (frame > 0) {
+            char ack[64];
+            int len = snprintf(ack, sizeof(ack), "{\"id\": \"frame\", \"version\": %d}" SEP_STR,
+                frame < CONSOLE_FRAME_VERSION ? frame : CONSOLE_FRAME_VERSION);
+            ::send(fd, ack, len, MSG_NOSIGNAL);
         }
     }
-    catch(const std::exception& e)
-    {
+
+    Broadcast(nullptr, std::make_shared<const std::string>(jsonContent + SEP_STR));
+}
+
+void OnLocalFrameEvent(const eular::ConsoleFrameHeader &header, const char *frame)
+{
+    if (gNetClientMap.empty() || header.type != eular::CONSOLE_FRAME_LOG) {
+        return;
+    }
+
+    LogRecord rec;
+    rec.timeMs = header.timeMs;
+    rec.pid = header.pid;
+    rec.tid = header.tid;
+    rec.level = header.level;
+    rec.tag = frame + sizeof(eular::ConsoleFrameHeader);
+    rec.tagLen = header.tagLen;
+    rec.msg = rec.tag + header.tagLen;
+    rec.msgLen = header.msgLen;
+    rec.fields = rec.msg + header.msgLen;
+    rec.fieldsLen = eular::ConsoleFrameFieldsLen(header);
+    Broadcast(&rec, nullptr);
+}
+
+/**
+ * @brief 解析本地客户端的数据, 以CONSOLE_FRAME_MAGIC开头的为二进制帧, 否则为以SEP_STR结尾的JSON
+ *
+ * @return 格式错误返回false
+ */
+bool ParseLocalContent(int fd, LocalClient &client)
+{
+    std::string &content = client.recv;
+    size_t offset = 0;
+    while (offset < content.length()) {
+        const char *data = content.c_str() + offset;
+        size_t size = content.length() - offset;
+        if ((uint8_t)data[0] == CONSOLE_FRAME_MAGIC) {
+            eular::ConsoleFrameHeader header;
+            int64_t frameLen = eular::ConsoleFrameParse(data, size, &header);
+            if (frameLen < 0) {
+                return false;
+            }
+            if (frameLen == 0) {
+                break;
+            }
+            OnLocalFrameEvent(header, data);
+            offset += frameLen;
+            continue;
+        }
+
+        size_t sepIndex = content.find(SEP_STR, offset);
+        if (sepIndex == std::string::npos) {
+            break;
+        }
+        OnLocalSocketReadEvent(fd, client, content.substr(offset, sepIndex - offset));
+        offset = sepIndex + SEP_LEN;
+    }
+
+    content.erase(0, offset);
+    return true;
+}
+
+void OnLocalReadable(int fd)
+{
+    auto it = gLocalClientMap.find(fd);
+    if (it == gLocalClientMap.end()) {
+        return;
+    }
+
+    // 边沿触发, 读到EAGAIN为止
+    bool closed = false;
+    while (true) {
+        ssize_t nRecv = ::recv(fd, gRecvBuf, sizeof(gRecvBuf), 0);
+        if (nRecv > 0) {
+            it->second.recv.append(gRecvBuf, nRecv);
+            // 每次读取后立即解析, 接收缓存不随积压增长
+            if (!ParseLocalContent(fd, it->second)) {
+                printf("local client %d protocol error\n", fd);
+                closed = true;
+                break;
+            }
+            continue;
+        }
+        if (nRecv < 0 && errno == EINTR) {
+            continue;
+        }
+        if (nRecv == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) {
+            closed = true;
+        }
+        break;
+    }
+
+    if (closed) {
+        CloseLocalClient(fd);
+    }
+}
+
+// 引号包围并转义, 作为过滤表达式中的值
+static std::string QuoteFilterValue(const std::string &value)
+{
+    std::string out = "\"";
+    for (char c : value) {
+        if (c == '"' || c == '\\') {
+            out.push_back('\\');
+        }
+        out.push_back(c);
+    }
+    out.push_back('"');
+    return out;
+}
+
+// 将字段形式的过滤条件转为过滤表达式
+std::string FilterFromFields(const Json &jsonConfig)
+{
+    std::vector<std::string> conditions;
+    std::string level = jsonConfig.value("level", "");
+    if (!level.empty()) {
+        conditions.push_back("level >= " + QuoteFilterValue(level));
+    }
+
+    std::vector<std::string> tags;
+    if (jsonConfig.contains("tag")) {
+        const Json &tagJson = jsonConfig["tag"];
+        if (tagJson.is_array()) {
+            for (const auto &tag : tagJson) {
+                if (tag.is_string()) {
+                    tags.push_back(QuoteFilterValue(tag.get<std::string>()));
+                }
+            }
+        } else if (tagJson.is_string()) {
+            tags.push_back(QuoteFilterValue(tagJson.get<std::string>()));
+        }
+    }
+    std::vector<std::string> pids;
+    if (jsonConfig.contains("pid")) {
+        const Json &pidJson = jsonConfig["pid"];
+        if (pidJson.is_array()) {
+            for (const auto &pid : pidJson) {
+                if (pid.is_number_integer()) {
+                    pids.push_back(std::to_string(pid.get<int32_t>()));
+                }
+            }
+        } else if (pidJson.is_number_integer()) {
+            pids.push_back(std::to_string(pidJson.get<int32_t>()));
+        }
+    }
+
+    for (auto list : { std::make_pair("tag", &tags), std::make_pair("pid", &pids) }) {
+        if (list.second->empty()) {
+            continue;
+        }
+        std::string cond = std::string(list.first) + " in (";
+        for (size_t i = 0; i < list.second->size(); ++i) {
+            cond += (i ? ", " : "") + (*list.second)[i];
+        }
+        conditions.push_back(cond + ")");
+    }
+
+    std::string expr;
+    for (size_t i = 0; i < conditions.size(); ++i) {
+        expr += (i ? " && " : "") + conditions[i];
+    }
+    return expr;
+}
+
+void OnTcpSocketReadEvent(int fd, NetClient &client, const std::string &jsonContent)
+{
+    Json jsonConfig;
+    try {
+        jsonConfig = Json::parse(jsonContent);
+    } catch(const std::exception& e) {
         printf("json parse error: %s\n", e.what());
         return;
     }
 
-    jsonContent.append(SEP_STR);
-    for (auto it  = gNetClientMap.begin(); it != gNetClientMap.end(); ++it) {
-        ::send(it->first, jsonContent.c_str(), jsonContent.length(), 0);
+    std::string id = jsonConfig.value("id", "");
+    if (id == "filter") {
+        std::string expr;
+        if (jsonConfig.contains("expr")) {
+            // {"id": "filter", "expr": "level >= warn && tag in (net.*)"}, 空表达式表示不过滤
+            expr = jsonConfig.value("expr", "");
+        } else {
+            // {"id": "filter", "level": "warn", "tag": ["net.*"], "pid": [100]}, tag与pid可为单个值
+            expr = FilterFromFields(jsonConfig);
+        }
+
+        std::unique_ptr<FilterNode> root;
+        if (!expr.empty()) {
+            FilterParser parser(expr);
+            root = parser.compile();
+            if (!root) {
+                // 编译失败时保留原来的过滤条件
+                Json error;
+                error["id"] = "error";
+                error["keywords"] = "msg";
+                error["msg"] = "filter: " + parser.error();
+                Enqueue(fd, client, std::make_shared<const std::string>(error.dump() + SEP_STR));
+                printf("net client %d filter error: %s\n", fd, parser.error().c_str());
+                return;
+            }
+        }
+        client.filter.root = std::move(root);
+        printf("net client %d filter: %s\n", fd, expr.c_str());
+        return;
+    }
+
+    // 级别控制命令转发给日志进程: {"id": "level", "tag": "net.*", "level": "debug"}, 带pid时只发给该进程
+    if (id != "level") {
+        return;
+    }
+    int32_t pid = jsonConfig.value("pid", 0);
+    std::string cmd = jsonContent + SEP_STR;
+    for (auto it = gLocalClientMap.begin(); it != gLocalClientMap.end(); ++it) {
+        if (pid == 0 || it->second.pid == pid) {
+            ::send(it->first, cmd.c_str(), cmd.length(), MSG_NOSIGNAL);
+        }
+    }
+}
+
+void OnNetReadable(int fd)
+{
+    auto it = gNetClientMap.find(fd);
+    if (it == gNetClientMap.end()) {
+        return;
+    }
+
+    bool closed = false;
+    std::string &content = it->second.recv;
+    while (true) {
+        ssize_t nRecv = ::recv(fd, gRecvBuf, sizeof(gRecvBuf), 0);
+        if (nRecv > 0) {
+            // 每次接收后立即解析, 只有不完整的消息留在缓存中
+            size_t offset = 0;
+            size_t sepIndex = 0;
+            size_t from = content.length() >= SEP_LEN ? content.length() - SEP_LEN + 1 : 0;
+            content.append(gRecvBuf, nRecv);
+            while ((sepIndex = content.find(SEP_STR, from)) != std::string::npos) {
+                OnTcpSocketReadEvent(fd, it->second, content.substr(offset, sepIndex - offset));
+                offset = sepIndex + SEP_LEN;
+                from = offset;
+            }
+            content.erase(0, offset);
+
+            // 控制消息都很短, 一直收不到分隔符的对端直接断开
+            if (content.length() > NET_RECV_MAX) {
+                printf("net client %d message too long, disconnect\n", fd);
+                closed = true;
+                break;
+            }
+            continue;
+        }
+        if (nRecv < 0 && errno == EINTR) {
+            continue;
+        }
+        if (nRecv == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) {
+            closed = true;
+        }
+        break;
+    }
+
+    if (closed) {
+        CloseNetClient(fd);
     }
 }
 
-void OnTcpSocketReadEvent(const std::string &jsonContent)
+void OnLocalAccept()
 {
-    (void)jsonContent;
-    // TODO 解析json
+    while (true) {
+        int localFd = ::accept4(gLocalServerSocket, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (localFd < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                perror("accept error");
+            }
+            break;
+        }
+
+        epoll_event event;
+        event.data.fd = localFd;
+        event.events = EPOLLIN | EPOLLRDHUP | EPOLLET;
+        if (epoll_ctl(gEpollFd, EPOLL_CTL_ADD, localFd, &event) != 0) {
+            perror("epoll_ctl error");
+            close(localFd);
+            continue;
+        }
+        printf("accept local socket client. %d\n", localFd);
+        gLocalClientMap[localFd];
+    }
+}
+
+void OnNetAccept()
+{
+    while (true) {
+        sockaddr_in clientAddr;
+        socklen_t addrLen = sizeof(sockaddr_in);
+        int clientFd = ::accept4(tcpServerSocket, (sockaddr *)&clientAddr, &addrLen, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (clientFd < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                perror("accept error");
+            }
+            break;
+        }
+
+        epoll_event epEvent;
+        epEvent.data.fd = clientFd;
+        epEvent.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+        if (epoll_ctl(gEpollFd, EPOLL_CTL_ADD, clientFd, &epEvent) != 0) {
+            static const char *errorMsgJson =
+                "{\"id\": \"error\", \"keywords\": [\"msg\"], \"msg\": \"epoll_ctl error: %s\"}" SEP_STR;
+            char msg[256] = { '\0' };
+            snprintf(msg, sizeof(msg), errorMsgJson, strerror(errno));
+            ::send(clientFd, msg, strlen(msg), MSG_NOSIGNAL);
+            perror("epoll_ctl error");
+            close(clientFd);
+            continue;
+        }
+
+        printf("accept net client. %d %s:%d\n", clientFd, inet_ntoa(clientAddr.sin_addr), ntohs(clientAddr.sin_port));
+        NetClient &client = gNetClientMap[clientFd];
+        client.addr = clientAddr;
+        if (!gJsonNotice.empty()) {
+            Enqueue(clientFd, client, std::make_shared<const std::string>(gJsonNotice));
+        }
+    }
 }
 
 int32_t _main(int32_t port)
@@ -191,12 +1349,15 @@ int32_t _main(int32_t port)
 
     assert(InitSocket() > 0);
 
-    int tcpServerSocket = ::socket(AF_INET, SOCK_STREAM, 0);
+    tcpServerSocket = ::socket(AF_INET, SOCK_STREAM, 0);
     if (tcpServerSocket < 0) {
         printf("%s() socket error. %d %s\n", __func__, errno, strerror(errno));
         return -1;
     }
 
+    int reuse = 1;
+    setsockopt(tcpServerSocket, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
     sockaddr_in srvAddr;
     srvAddr.sin_family = AF_INET;
     srvAddr.sin_port = htons(port > 0 ? port : 8000);
@@ -208,147 +1369,77 @@ int32_t _main(int32_t port)
     }
 
     ::listen(tcpServerSocket, 128);
-
-    int reuse = 1;
-    setsockopt(tcpServerSocket, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    SetNonBlock(tcpServerSocket);
 
     epoll_event events[EPOLL_SIZE];
-    int epollFd = epoll_create(EPOLL_SIZE);
-    if (epollFd < 0) {
+    gEpollFd = epoll_create(EPOLL_SIZE);
+    if (gEpollFd < 0) {
         printf("%s() epoll_create error. %d %s\n", __func__, errno, strerror(errno));
         return -1;
     }
 
-    int flag = fcntl(tcpServerSocket, F_GETFL);
-    flag |= O_NONBLOCK;
-    fcntl(tcpServerSocket, F_SETFL, flag);
-
     epoll_event event;
     event.data.fd = gLocalServerSocket;
-    event.events = EPOLLIN;
-    assert(epoll_ctl(epollFd, EPOLL_CTL_ADD, gLocalServerSocket, &event) == 0);
+    event.events = EPOLLIN | EPOLLET;
+    assert(epoll_ctl(gEpollFd, EPOLL_CTL_ADD, gLocalServerSocket, &event) == 0);
 
     event.data.fd = tcpServerSocket;
-    event.events = EPOLLIN;
-    assert(epoll_ctl(epollFd, EPOLL_CTL_ADD, tcpServerSocket, &event) == 0);
+    event.events = EPOLLIN | EPOLLET;
+    assert(epoll_ctl(gEpollFd, EPOLL_CTL_ADD, tcpServerSocket, &event) == 0);
 
-    printf("LocalServerSocket = %d, NetServerSocket = %d, epollFd = %d, waiting...\n", gLocalServerSocket, tcpServerSocket, epollFd);
+    printf("LocalServerSocket = %d, NetServerSocket = %d, epollFd = %d, waiting...\n", gLocalServerSocket, tcpServerSocket, gEpollFd);
     while (true) {
-        int nev = epoll_wait(epollFd, events, EPOLL_SIZE, -1);
+        int nev = epoll_wait(gEpollFd, events, EPOLL_SIZE, -1);
         if (nev < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
             printf("epoll_wait error. [%d,%s]\n", errno, strerror(errno));
             exit(0);
         }
         for (int i = 0; i < nev; ++i) {
             epoll_event &ev = events[i];
+            int fd = ev.data.fd;
 
-            if (ev.data.fd == gLocalServerSocket && gLocalClientSocket <= 0) {
-                sockaddr_un client;
-                socklen_t len = sizeof(client);
-                gLocalClientSocket = ::accept(gLocalServerSocket, (sockaddr *)&client, &len);
-                if (gLocalClientSocket <= 0) {
-                    perror("accept error");
-                } else {
-                    printf("accept local socket client. %d %s\n", gLocalClientSocket, client.sun_path);
-                    flag = fcntl(gLocalClientSocket, F_GETFL);
-                    flag |= O_NONBLOCK;
-                    fcntl(gLocalClientSocket, F_SETFL, flag);
-
-                    event.data.fd = gLocalClientSocket;
-                    event.events = EPOLLIN;
-                    epoll_ctl(epollFd, EPOLL_CTL_ADD, gLocalClientSocket, &event);
-                }
-
+            if (fd == gLocalServerSocket) {
+                OnLocalAccept();
                 continue;
             }
-
-            if (ev.data.fd == tcpServerSocket) {
-                sockaddr_in clientAddr;
-                socklen_t addrLen = sizeof(sockaddr_in);
-
-                int clientFd = ::accept(tcpServerSocket, (sockaddr *)&clientAddr, &addrLen);
-                if (clientFd > 0) {
-                    flag = fcntl(clientFd, F_GETFL);
-                    flag |= O_NONBLOCK;
-                    fcntl(clientFd, F_SETFL, flag);
-
-                    epoll_event epEvent;
-                    epEvent.data.fd = clientFd;
-                    epEvent.events = EPOLLIN;
-                    int32_t nRet = epoll_ctl(epollFd, EPOLL_CTL_ADD, clientFd, &epEvent);
-                    if (0 != nRet) {
-                        static const char *errorMsgJson =
-                            "{\"id\": \"error\", \"keywords\": [\"msg\"], \"msg\": \"epoll_ctl error: %s\"}";
-                        char msg[256] = { '\0' };
-                        snprintf(msg, sizeof(msg), errorMsgJson, strerror(errno));
-                        ::send(clientFd, msg, strlen(msg), 0);
-                        perror("epoll_ctl error");
-                        close(clientFd);
-                    } else {
-                        gNetClientMap[clientFd] = clientAddr;
-                        if (!gJsonNotice.empty()) {
-                            ::send(clientFd, gJsonNotice.c_str(), gJsonNotice.length(), 0);
-                        }
-                    }
-                }
-
+            if (fd == tcpServerSocket) {
+                OnNetAccept();
                 continue;
             }
 
-            if (ev.events & EPOLLIN) {  // 本地套接字读事件
-                if (ev.data.fd == gLocalClientSocket) {
-                    static std::string jsonContent;
-                    jsonContent.reserve(RECV_BUFFER_SIZE);
-
-                    while (true) {
-                        memset(gRecvBuf, 0, sizeof(gRecvBuf));
-                        int32_t nRecv = ::recv(ev.data.fd, gRecvBuf, sizeof(gRecvBuf), 0);
-                        if (nRecv == 0) { // 没有携带结束符
-                            break;
-                        }
-
-                        if (nRecv < 0) {
-                            if (errno != EAGAIN) {
-                                printf("recv(%d) error: %d, %s\n", ev.data.fd, errno, strerror(errno));
-                                close(ev.data.fd);
-                                epoll_ctl(epollFd, EPOLL_CTL_DEL, ev.data.fd, nullptr);
-                            }
-                            break;
-                        }
-
-                        jsonContent.append(gRecvBuf);
-                        size_t sepIndex = jsonContent.find(SEP_STR);
-                        if (sepIndex != std::string::npos)
-                        {
-                            std::string jsonConfig(jsonContent.c_str(), sepIndex);
-                            jsonContent.erase(0, sepIndex + SEP_LEN);
-
-                            // 将本地套接字发送的数据转发
-                            OnLocalSocketReadEvent(std::move(jsonConfig));
-                        }
-                    }
-                } else {
-                    // FIXME 暂时不知客户端数据怎么处理 TCP 客户端数据
-                    while (true) {
-                        int32_t nRecv = ::recv(ev.data.fd, gRecvBuf, sizeof(gRecvBuf), MSG_PEEK);
-                        if (nRecv <= 0) {
-                            break;
-                        }
-                    }
+            if (gLocalClientMap.count(fd)) {
+                // 本地套接字读事件, 对端关闭时也读出剩余的日志
+                OnLocalReadable(fd);
+                if ((ev.events & (EPOLLHUP | EPOLLERR)) && gLocalClientMap.count(fd)) {
+                    CloseLocalClient(fd);
                 }
+                continue;
             }
 
+            auto it = gNetClientMap.find(fd);
+            if (it == gNetClientMap.end()) {
+                continue;
+            }
             if (ev.events & (EPOLLHUP | EPOLLRDHUP | EPOLLERR)) { // 退出事件
-                printf("EPOLLERR 0x%X client %d exit.\n", ev.events, ev.data.fd);
-                close(ev.data.fd);
-                epoll_ctl(epollFd, EPOLL_CTL_DEL, ev.data.fd, nullptr);
-                if (ev.data.fd == gLocalClientSocket) {
-                    gLocalClientSocket = -1;
-                } else {
-                    gNetClientMap.erase(ev.data.fd);
+                CloseNetClient(fd);
+                continue;
+            }
+            if (ev.events & EPOLLOUT) {
+                if (!FlushNetClient(fd, it->second)) {
+                    CloseNetClient(fd);
+                    continue;
                 }
             }
+            if (ev.events & EPOLLIN) {
+                OnNetReadable(fd);
+            }
         }
+
+        // 本轮收到的日志合并发送, 每个订阅者一次writev
+        FlushDirtyClients();
     }
 
     return 0;
@@ -0,0 +1,90 @@
+/*************************************************************************
+    > File Name: logdecode.cc
+    > Author: hsz
+    > Brief: 将BINOUT输出的二进制日志还原为文本
+    > Created Time: 2026年10月18日 星期日 13时05分12秒
+ ************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <string>
+
+#include "log_binary.h"
+#include "log_format.h"
+
+void print(const char *perfix)
+{
+    printf("%s [-c] file...\n", perfix);
+    printf("-h get help\n");
+    printf("-c output with color\n");
+    exit(0);
+}
+
+int32_t decode(const char *path, bool color)
+{
+    eular::BinaryLogReader reader;
+    if (!reader.open(path)) {
+        fprintf(stderr, "%s: %s\n", path, reader.error().c_str());
+        return -1;
+    }
+
+    eular::LogEvent ev;
+    std::string msg;
+    eular::LogBuffer buffer;
+    while (reader.next(ev, msg)) {
+        if (ev.tag[0] == '\0') {
+            // 断言、信号处理等写入的原始文本
+            fwrite(msg.c_str(), 1, msg.length(), stdout);
+            continue;
+        }
+
+        buffer.clear();
+        size_t len = buffer.append(&ev);
+        if (color) {
+            fputs(eular::LogFormat::ColorBegin(ev.level), stdout);
+        }
+        fwrite(buffer.data(), 1, len, stdout);
+        if (color) {
+            fputs(eular::LogFormat::ColorEnd(), stdout);
+        }
+    }
+
+    if (reader.error().length()) {
+        fprintf(stderr, "%s: %s\n", path, reader.error().c_str());
+        return -1;
+    }
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    int32_t cmd = '\0';
+    bool color = false;
+    while ((cmd = ::getopt(argc, argv, "hc")) != -1) {
+        switch (cmd) {
+        case 'h':
+            print(argv[0]);
+            break;
+        case 'c':
+            color = true;
+            break;
+        default:
+            break;
+        }
+    }
+
+    if (optind >= argc) {
+        print(argv[0]);
+    }
+
+    int32_t ret = 0;
+    for (int32_t i = optind; i < argc; ++i) {
+        if (decode(argv[i], color) != 0) {
+            ret = 1;
+        }
+    }
+
+    return ret;
+}
@@ -31,6 +31,7 @@ public:
         _mutex = (pthread_mutex_t *)malloc(sizeof(pthread_mutex_t));
 #endif
         assert(_mutex);
+        _owner = getpid();
         pthread_mutex_init(_mutex, &attr);
         pthread_mutexattr_destroy(&attr);
     }
@@ -38,7 +39,10 @@ public:
     ~ProcessMutex()
     {
         if (_mutex != nullptr) {
-            pthread_mutex_destroy(_mutex);
+            // 子进程退出时不能销毁与父进程共享的锁, 否则父进程后续加解锁失败
+            if (_owner == getpid()) {
+                pthread_mutex_destroy(_mutex);
+            }
 #if defined(_POSIX_THREAD_PROCESS_SHARED)
             munmap(_mutex, sizeof(pthread_mutex_t));
 #else
@@ -60,6 +64,7 @@ public:
 
 private:
     pthread_mutex_t *_mutex;
+    pid_t _owner;
 };
 
 template<typename T>
@@ -1,10 +1,12 @@
 #define CATCH_CONFIG_MAIN
+#define CATCH_CONFIG_ENABLE_BENCHMARKING
 #include <bits/move.h>
 
 #include <unordered_map>
 
 #include "catch/catch.hpp"
 #include "utils/buffer.h"
+#include "utils/fast_hash.h"
 #include "utils/utils.h"
 
 using namespace eular;
@@ -95,4 +97,121 @@ TEST_CASE("std_hash_", "support_std_hash") {
     hashMap.insert(std::make_pair(buffer, ByteBuffer::hash(buffer)));
 
     CHECK(2 == hashMap.size());
-}
\ No newline at end of file
+}
+
+TEST_CASE("copy_on_write", "[ByteBuffer]") {
+    ByteBuffer buffer(128);
+    buffer.append("Hello World");
+
+    ByteBuffer buf = buffer;
+    CHECK(buf.const_data() == buffer.const_data());
+
+    // 修改前复制一份, 另一方不受影响
+    buf[0] = 'h';
+    CHECK(buf.const_data() != buffer.const_data());
+    CHECK(buffer[0] == 'H');
+    CHECK(buf[0] == 'h');
+
+    // 独占时不再复制
+    const uint8_t *data = buf.const_data();
+    buf.append("!");
+    CHECK(buf.const_data() == data);
+
+    ByteBuffer other = buffer;
+    other.data()[1] = 'E';
+    CHECK(std::string((const char *)buffer.const_data(), buffer.size()) == "Hello World");
+    CHECK(std::string((const char *)other.const_data(), other.size()) == "HEllo World");
+
+    ByteBuffer cleared = buffer;
+    cleared.clear();
+    CHECK(cleared.size() == 0);
+    CHECK(buffer.size() == 11);
+}
+
+TEST_CASE("small_buffer", "[ByteBuffer]") {
+    ByteBuffer buffer("Hello");
+    CHECK(buffer.capacity() == BYTE_BUFFER_INLINE_SIZE);
+
+    ByteBuffer buf = buffer;
+    CHECK(buf.const_data() != buffer.const_data());
+    CHECK(buf == buffer);
+
+    ByteBuffer moved = std::move(buf);
+    CHECK(buf.size() == 0);
+    CHECK(moved == buffer);
+
+    // 超出内联容量后转为共享缓存
+    std::string large(BYTE_BUFFER_INLINE_SIZE, 'x');
+    moved.append(large.c_str());
+    CHECK(moved.size() == 5 + large.size());
+    CHECK(moved.capacity() > BYTE_BUFFER_INLINE_SIZE);
+    CHECK(std::string((const char *)moved.const_data(), moved.size()) == "Hello" + large);
+
+    // 追加自身
+    buffer.append(buffer);
+    CHECK(std::string((const char *)buffer.const_data(), buffer.size()) == "HelloHello");
+}
+
+TEST_CASE("growth", "[ByteBuffer]") {
+    ByteBuffer buffer;
+    size_t reallocCount = 0;
+    size_t capacity = buffer.capacity();
+    for (int32_t i = 0; i < 100000; ++i) {
+        uint8_t ch = i & 0xff;
+        buffer.append(&ch, 1);
+        if (buffer.capacity() != capacity) {
+            capacity = buffer.capacity();
+            ++reallocCount;
+        }
+    }
+
+    CHECK(buffer.size() == 100000);
+    CHECK(reallocCount < 30);
+    CHECK(buffer[99999] == (99999 & 0xff));
+
+    // set的数据来自自身且需要扩充
+    buffer.set(buffer.const_data() + 10, 100, buffer.size());
+    CHECK(buffer.size() == 100100);
+    CHECK(buffer[100000] == 10);
+}
+
+// 默认不运行, 使用 ./test_buffer.out "[benchmark]" 执行
+TEST_CASE("benchmark", "[.][benchmark]") {
+    std::string small(16, 'a');
+    std::string large(4096, 'b');
+    ByteBuffer largeBuffer(large.c_str());
+
+    BENCHMARK("append 16B x 1024") {
+        ByteBuffer buffer;
+        for (int32_t i = 0; i < 1024; ++i) {
+            buffer.append(small.c_str(), small.size());
+        }
+        return buffer.size();
+    };
+
+    BENCHMARK("construct and copy 16B") {
+        ByteBuffer buffer(small.c_str(), small.size());
+        ByteBuffer copy = buffer;
+        return copy.size();
+    };
+
+    BENCHMARK("copy 4KB") {
+        ByteBuffer copy = largeBuffer;
+        return copy.size();
+    };
+
+    BENCHMARK("hash 16B") {
+        ByteBuffer buffer(small.c_str(), small.size());
+        return ByteBuffer::hash(buffer);
+    };
+
+    BENCHMARK("FastHash64 4KB") {
+        return FastHash64(largeBuffer.const_data(), largeBuffer.size());
+    };
+
+    // 哈希缓存在ByteBuffer中, 每次修改一个字节使缓存失效
+    BENCHMARK("hash 4KB") {
+        largeBuffer[0] ^= 1;
+        return ByteBuffer::hash(largeBuffer);
+    };
+}
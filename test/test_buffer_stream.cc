@@ -7,10 +7,14 @@
 
 #define CATCH_CONFIG_MAIN
 #include <stdio.h>
+#include <unistd.h>
 #include <iostream>
+#include <vector>
+#include <algorithm>
 
 #include "catch/catch.hpp"
 #include "utils/buffer_stream.h"
+#include "utils/iobuffer.h"
 
 #define BYTE_64     64
 #define BYTE_128    128
@@ -151,4 +155,250 @@ TEST_CASE("buffer_stream_char_array_char_pointer_write_read", "[buffer_stream]")
         REQUIRE(str == temp);
         REQUIRE(str.size() == temp.size());
     }
-}
\ No newline at end of file
+}
+
+// 测试只读流直接读取外部内存
+TEST_CASE("buffer_stream_memory_view", "[buffer_stream]") {
+    DeviceInfo deviceInfo;
+    strcpy(deviceInfo._name, "HelloWorld");
+    deviceInfo._age = 20;
+
+    eular::ByteBuffer buffer;
+    eular::BufferStream writer(buffer);
+    writer << deviceInfo;
+    writer << std::string("Hello") << std::string("World");
+    writer << (uint64_t)0x0102030405060708;
+
+    eular::BufferStream stream(buffer.const_data(), buffer.size());
+    CHECK(stream.readOnly());
+    CHECK(stream.readable() == buffer.size());
+
+    DeviceInfo deviceInfo2;
+    stream >> deviceInfo2;
+    CHECK(std::string(deviceInfo2._name) == "HelloWorld");
+    CHECK(deviceInfo2._age == 20);
+
+    // 片段指向源数据
+    eular::BufferSlice slice;
+    stream >> slice;
+    CHECK(slice.toString() == "Hello");
+    CHECK((const uint8_t *)slice.data >= buffer.const_data());
+    CHECK((const uint8_t *)slice.data < buffer.const_data() + buffer.size());
+
+    std::string world;
+    stream >> world;
+    CHECK(world == "World");
+
+    uint64_t value = 0;
+    stream >> value;
+    CHECK(value == 0x0102030405060708);
+    CHECK(stream.readable() == 0);
+    CHECK(stream.tell() == buffer.size());
+    CHECK_THROWS(stream >> value);
+    CHECK_THROWS(stream << value);
+}
+
+// 测试跨分段读取IOBuffer
+TEST_CASE("buffer_stream_iobuffer", "[buffer_stream]") {
+    eular::IOBuffer chain("Hel", 3);
+    eular::IOBuffer part("lo\0Wor", 6);
+    chain.append(part);
+    eular::IOBuffer tail("ld\0", 3);
+    chain.append(tail);
+    uint32_t number = 0x11223344;
+    eular::IOBuffer num(&number, sizeof(number));
+    chain.append(num.split(1));
+    chain.append(num);
+    REQUIRE(chain.segments() == 5);
+
+    eular::BufferStream stream(chain);
+    eular::BufferSlice slice;
+    stream >> slice;
+    CHECK(slice.toString() == "Hello");
+
+    CHECK(stream.readSlice(slice, 3));
+    CHECK(slice.toString() == "Wor");
+    std::string str;
+    stream >> str;
+    CHECK(str == "ld");
+
+    uint32_t value = 0;
+    stream >> value;
+    CHECK(value == number);
+    CHECK(stream.readable() == 0);
+    CHECK_FALSE(stream.skip(1));
+    CHECK_THROWS(stream >> slice);
+}
+
+// 测试映射文件
+TEST_CASE("buffer_stream_map_file", "[buffer_stream]") {
+    char path[] = "/tmp/test_buffer_stream_XXXXXX";
+    int fd = mkstemp(path);
+    REQUIRE(fd >= 0);
+    REQUIRE(write(fd, "Hello\0\x01\x00\x00\x00", 10) == 10);
+    close(fd);
+
+    eular::BufferStream stream;
+    REQUIRE(stream.mapFile(path));
+    eular::BufferStream moved(std::move(stream));
+    std::string hello;
+    int32_t one = 0;
+    moved >> hello >> one;
+    CHECK(hello == "Hello");
+    CHECK(one == 1);
+    CHECK_FALSE(moved.read(&one, 1));
+
+    unlink(path);
+    CHECK_FALSE(stream.mapFile(path));
+}
+
+// 测试变长编码
+TEST_CASE("buffer_stream_varint", "[buffer_stream]") {
+    eular::ByteBuffer buffer;
+    eular::BufferStream stream(buffer);
+    stream.setEncoding(eular::BufferStream::ENCODING_VARINT);
+
+    stream << (uint32_t)1 << (int32_t)-1 << (int16_t)-64 << (uint16_t)300;
+    CHECK(buffer.size() == 5);
+    stream << (uint64_t)UINT64_MAX << (int64_t)INT64_MIN << (int64_t)INT64_MAX;
+    CHECK(buffer.size() == 35);
+    stream << std::string() << std::string("Hello");
+    CHECK(buffer.size() == 42);
+    // 非整数类型不变
+    stream << (uint8_t)0xff << 1.5;
+    CHECK(buffer.size() == 51);
+
+    uint32_t u32 = 0;
+    int32_t i32 = 0;
+    int16_t i16 = 0;
+    uint16_t u16 = 0;
+    uint64_t u64 = 0;
+    int64_t i64min = 0, i64max = 0;
+    std::string empty("x"), hello;
+    uint8_t u8 = 0;
+    double d = 0;
+    stream >> u32 >> i32 >> i16 >> u16 >> u64 >> i64min >> i64max;
+    empty.clear();
+    stream >> empty >> hello >> u8 >> d;
+    CHECK(u32 == 1);
+    CHECK(i32 == -1);
+    CHECK(i16 == -64);
+    CHECK(u16 == 300);
+    CHECK(u64 == UINT64_MAX);
+    CHECK(i64min == INT64_MIN);
+    CHECK(i64max == INT64_MAX);
+    CHECK(empty.empty());
+    CHECK(hello == "Hello");
+    CHECK(u8 == 0xff);
+    CHECK(d == 1.5);
+
+    // 超出类型范围时抛出异常且读索引不变
+    stream << (uint32_t)70000;
+    size_t pos = stream.tell();
+    CHECK_THROWS(stream >> u16);
+    CHECK(stream.tell() == pos);
+    stream >> u32;
+    CHECK(u32 == 70000);
+}
+
+// 测试第10字节溢出64位的varint被拒绝
+TEST_CASE("buffer_stream_varint_overflow", "[buffer_stream]") {
+    uint8_t bad[10];
+    memset(bad, 0xFF, 9);
+    bad[9] = 0x02;
+
+    uint64_t u64 = 0;
+    eular::BufferStream memory(bad, sizeof(bad));
+    memory.setEncoding(eular::BufferStream::ENCODING_VARINT);
+    CHECK_THROWS(memory >> u64);
+    CHECK(memory.tell() == 0);
+
+    // 跨分段时走逐字节路径
+    eular::IOBuffer chain;
+    for (size_t i = 0; i < sizeof(bad); i += 3) {
+        eular::IOBuffer segment(bad + i, sizeof(bad) - i < 3 ? sizeof(bad) - i : 3);
+        chain.append(segment);
+    }
+    eular::BufferStream chainReader(chain);
+    chainReader.setEncoding(eular::BufferStream::ENCODING_VARINT);
+    CHECK_THROWS(chainReader >> u64);
+    CHECK(chainReader.tell() == 0);
+
+    // 第10字节为1时恰好是UINT64_MAX
+    bad[9] = 0x01;
+    eular::BufferStream max(bad, sizeof(bad));
+    max.setEncoding(eular::BufferStream::ENCODING_VARINT);
+    max >> u64;
+    CHECK(u64 == UINT64_MAX);
+}
+
+// 测试批量读写整数数组
+TEST_CASE("buffer_stream_varint_array", "[buffer_stream]") {
+    std::vector<int32_t> values;
+    uint64_t seed = 1;
+    for (int32_t i = 0; i < 10000; ++i) {
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        int32_t value = static_cast<int32_t>(seed >> 32);
+        // 以小整数为主, 夹杂部分大数
+        values.push_back((seed & 0xF) == 0 ? value : value % 64);
+    }
+
+    eular::ByteBuffer buffer;
+    eular::BufferStream writer(buffer);
+    writer.setEncoding(eular::BufferStream::ENCODING_VARINT);
+    writer.writeArray(values.data(), values.size());
+    CHECK(buffer.size() < values.size() * sizeof(int32_t) / 2);
+
+    eular::BufferStream reader(buffer.const_data(), buffer.size());
+    reader.setEncoding(eular::BufferStream::ENCODING_VARINT);
+    std::vector<int32_t> decoded(values.size());
+    REQUIRE(reader.readArray(decoded.data(), decoded.size()));
+    CHECK(decoded == values);
+    CHECK(reader.readable() == 0);
+
+    // IOBuffer中的值可能跨分段
+    eular::IOBuffer chain;
+    for (size_t offset = 0; offset < buffer.size(); offset += 7) {
+        size_t size = buffer.size() - offset < 7 ? buffer.size() - offset : 7;
+        eular::IOBuffer segment(buffer.const_data() + offset, size);
+        chain.append(segment);
+    }
+    eular::BufferStream chainReader(chain);
+    chainReader.setEncoding(eular::BufferStream::ENCODING_VARINT);
+    std::fill(decoded.begin(), decoded.end(), 0);
+    REQUIRE(chainReader.readArray(decoded.data(), decoded.size()));
+    CHECK(decoded == values);
+
+    // 数据不足或超出范围时读索引不变
+    eular::BufferStream partial(buffer.const_data(), buffer.size() - 1);
+    partial.setEncoding(eular::BufferStream::ENCODING_VARINT);
+    CHECK_FALSE(partial.readArray(decoded.data(), decoded.size()));
+    CHECK(partial.tell() == 0);
+    std::vector<int16_t> narrow(values.size());
+    CHECK_FALSE(partial.readArray(narrow.data(), narrow.size()));
+    CHECK(partial.tell() == 0);
+
+    // 定长编码与write/read一致
+    eular::ByteBuffer fixed;
+    eular::BufferStream fixedStream(fixed);
+    fixedStream.writeArray(values.data(), values.size());
+    CHECK(fixed.size() == values.size() * sizeof(int32_t));
+}
+
+// 测试数组模板按编码方式读写
+TEST_CASE("buffer_stream_varint_fundamental_array", "[buffer_stream]") {
+    uint64_t numbers[4] = {0, 1, 127, 128};
+    char name[4] = "abc";
+
+    eular::ByteBuffer buffer;
+    eular::BufferStream stream(buffer);
+    stream.setEncoding(eular::BufferStream::ENCODING_VARINT);
+    stream << numbers << name;
+    CHECK(buffer.size() == 5 + 4);
+
+    uint64_t numbers2[4] = {0};
+    char name2[4] = {0};
+    stream >> numbers2 >> name2;
+    CHECK(memcmp(numbers, numbers2, sizeof(numbers)) == 0);
+    CHECK(std::string(name2) == "abc");
+}
@@ -0,0 +1,141 @@
+#define CATCH_CONFIG_MAIN
+#include <string.h>
+#include <set>
+#include <vector>
+
+#include "catch/catch.hpp"
+#include "utils/fast_hash.h"
+#include "utils/buffer.h"
+
+using namespace eular;
+
+static std::vector<uint8_t> RandomBytes(size_t size)
+{
+    std::vector<uint8_t> bytes(size);
+    uint64_t x = 0x9E3779B97F4A7C15ULL;
+    for (uint8_t &b : bytes) {
+        x = x * 6364136223846793005ULL + 1442695040888963407ULL;
+        b = static_cast<uint8_t>(x >> 56);
+    }
+    return bytes;
+}
+
+TEST_CASE("deterministic", "[FastHash]") {
+    std::vector<uint8_t> bytes = RandomBytes(8192 + 8);
+    // 不同对齐的相同内容结果一致
+    for (size_t size : {0, 1, 7, 16, 17, 100, 512, 513, 1024, 4096, 8192}) {
+        uint64_t expected = FastHash64(bytes.data(), size);
+        for (size_t offset = 1; offset < 8; ++offset) {
+            std::vector<uint8_t> copy(size + offset);
+            if (size > 0) {
+                memcpy(copy.data() + offset, bytes.data(), size);
+            }
+            CHECK(FastHash64(copy.data() + offset, size) == expected);
+        }
+    }
+
+    CHECK(FastHash64(bytes.data(), 100, 1) != FastHash64(bytes.data(), 100, 2));
+    CHECK(FastHash64(bytes.data(), 4096, 1) != FastHash64(bytes.data(), 4096, 2));
+}
+
+TEST_CASE("implementations", "[FastHash]") {
+    std::vector<uint8_t> bytes = RandomBytes(8192 + 8);
+    std::vector<detail::FastHashImpl> impls;
+    for (detail::FastHashImpl type : {detail::FAST_HASH_SSE2, detail::FAST_HASH_AVX2}) {
+        if (detail::FastHash64Supported(type)) {
+            impls.push_back(type);
+        }
+    }
+    REQUIRE(detail::FastHash64Supported(detail::FAST_HASH_SCALAR));
+
+    // 各实现与标量实现逐个长度对比, 包括非零种子与非对齐地址
+    size_t mismatch = 0;
+    for (uint64_t seed : {0ULL, 1ULL, 0x9E3779B97F4A7C15ULL}) {
+        for (size_t size = 0; size <= 8192; ++size) {
+            const uint8_t *data = bytes.data() + (size % 8);
+            uint64_t expected = detail::FastHash64With(detail::FAST_HASH_SCALAR, data, size, seed);
+            if (FastHash64(data, size, seed) != expected) {
+                ++mismatch;
+            }
+            for (detail::FastHashImpl type : impls) {
+                if (detail::FastHash64With(type, data, size, seed) != expected) {
+                    ++mismatch;
+                }
+            }
+        }
+    }
+    CHECK(mismatch == 0);
+}
+
+TEST_CASE("distinct", "[FastHash]") {
+    std::vector<uint8_t> bytes = RandomBytes(2048);
+    std::set<uint64_t> hashes;
+    for (size_t size = 0; size <= 2000; ++size) {
+        hashes.insert(FastHash64(bytes.data(), size));
+    }
+    CHECK(hashes.size() == 2001);
+
+    // 逐个翻转每一位
+    std::set<uint64_t> flipped;
+    for (size_t bit = 0; bit < 1024 * 8; bit += 7) {
+        std::vector<uint8_t> copy(bytes.begin(), bytes.begin() + 1024);
+        copy[bit / 8] ^= static_cast<uint8_t>(1 << (bit % 8));
+        flipped.insert(FastHash64(copy.data(), copy.size()));
+    }
+    CHECK(flipped.size() == (1024 * 8 + 6) / 7);
+
+    // 交换两个64字节条带
+    std::vector<uint8_t> swapped(bytes.begin(), bytes.begin() + 1024);
+    for (size_t i = 0; i < 64; ++i) {
+        std::swap(swapped[i], swapped[64 + i]);
+    }
+    CHECK(FastHash64(swapped.data(), 1024) != FastHash64(bytes.data(), 1024));
+}
+
+TEST_CASE("byte_buffer_hash", "[FastHash]") {
+    std::vector<uint8_t> bytes = RandomBytes(4096);
+    ByteBuffer buffer(bytes.data(), bytes.size());
+    size_t hash = ByteBuffer::hash(buffer);
+    CHECK(hash == std::hash<ByteBuffer>()(buffer));
+
+    // 共享的副本沿用缓存, 修改后重新计算
+    ByteBuffer copy = buffer;
+    CHECK(ByteBuffer::hash(copy) == hash);
+    copy[0] ^= 1;
+    CHECK(ByteBuffer::hash(copy) != hash);
+    CHECK(ByteBuffer::hash(buffer) == hash);
+    CHECK_FALSE(copy == buffer);
+    copy[0] ^= 1;
+    CHECK(ByteBuffer::hash(copy) == hash);
+    CHECK(copy == buffer);
+
+    copy.append("x", 1);
+    CHECK(ByteBuffer::hash(copy) != hash);
+    copy.resize(bytes.size());
+    CHECK(ByteBuffer::hash(copy) == hash);
+    copy.clear();
+    CHECK(ByteBuffer::hash(copy) == ByteBuffer::hash(ByteBuffer()));
+
+    ByteBuffer moved(std::move(buffer));
+    CHECK(ByteBuffer::hash(moved) == hash);
+    CHECK(ByteBuffer::hash(buffer) == ByteBuffer::hash(ByteBuffer()));
+}
+
+TEST_CASE("byte_buffer_equal", "[FastHash]") {
+    ByteBuffer lhs("0123456789abcdef0123456789abcdef0123456789abcdef0123456789abcdef");
+    ByteBuffer rhs("0123456789abcdef0123456789abcdef0123456789abcdef0123456789abcdeF");
+    CHECK_FALSE(lhs == rhs);
+    ByteBuffer::hash(lhs);
+    ByteBuffer::hash(rhs);
+    CHECK_FALSE(lhs == rhs);
+
+    rhs.data()[63] = 'f';
+    CHECK(lhs == rhs);
+    CHECK(ByteBuffer::hash(lhs) == ByteBuffer::hash(rhs));
+
+    ByteBuffer small("abc");
+    ByteBuffer other("abc");
+    CHECK(small == other);
+    ByteBuffer::hash(small);
+    CHECK(small == other);
+}
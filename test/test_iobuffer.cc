@@ -0,0 +1,128 @@
+#define CATCH_CONFIG_MAIN
+#include <unistd.h>
+#include <string.h>
+#include <string>
+
+#include "catch/catch.hpp"
+#include "utils/iobuffer.h"
+
+using namespace eular;
+
+TEST_CASE("append_prepend", "[IOBuffer]") {
+    IOBuffer buffer;
+    CHECK(buffer.empty());
+
+    buffer.append("Hello", 5);
+    buffer.append(std::string(" World"));
+    CHECK(buffer.size() == 11);
+    // 独占的尾部分段有空闲时直接写入
+    CHECK(buffer.segments() == 1);
+
+    buffer.prepend(">> ", 3);
+    buffer.prepend("#", 1);
+    CHECK(buffer.toString() == "#>> Hello World");
+    CHECK(buffer.segments() == 2);
+
+    std::string large(10000, 'x');
+    buffer.append(large);
+    CHECK(buffer.size() == 15 + large.size());
+    CHECK(buffer.toString() == "#>> Hello World" + large);
+}
+
+TEST_CASE("share_segments", "[IOBuffer]") {
+    IOBuffer buffer("Hello", 5);
+    IOBuffer copy = buffer;
+    CHECK(copy.toString() == "Hello");
+
+    // 分段共享后不再写入原内存块
+    buffer.append("!!", 2);
+    copy.append("??", 2);
+    CHECK(buffer.toString() == "Hello!!");
+    CHECK(copy.toString() == "Hello??");
+
+    IOBuffer chain;
+    chain.append(buffer);
+    chain.append(copy);
+    chain.append(chain);
+    CHECK(chain.toString() == "Hello!!Hello??Hello!!Hello??");
+
+    IOBuffer moved(std::move(chain));
+    CHECK(chain.empty());
+    CHECK(moved.size() == 28);
+}
+
+TEST_CASE("consume_split_slice", "[IOBuffer]") {
+    IOBuffer buffer;
+    buffer.append("0123456789", 10);
+    IOBuffer tail("abcdefghij", 10);
+    buffer.append(tail);
+
+    IOBuffer view = buffer.slice(8, 4);
+    CHECK(view.toString() == "89ab");
+    CHECK(view.segments() == 2);
+    CHECK(buffer.slice(18, 100).toString() == "ij");
+    CHECK(buffer.slice(30, 1).empty());
+
+    IOBuffer head = buffer.split(5);
+    CHECK(head.toString() == "01234");
+    CHECK(buffer.toString() == "56789abcdefghij");
+
+    CHECK(buffer.consume(7) == 7);
+    CHECK(buffer.toString() == "cdefghij");
+    CHECK(buffer.trimBack(3) == 3);
+    CHECK(buffer.toString() == "cdefg");
+    CHECK(buffer.consume(100) == 5);
+    CHECK(buffer.empty());
+
+    // 切片不受原对象修改影响
+    CHECK(view.toString() == "89ab");
+
+    char out[4] = {0};
+    CHECK(head.copyOut(3, out, sizeof(out)) == 2);
+    CHECK(std::string(out, 2) == "34");
+}
+
+TEST_CASE("pullup", "[IOBuffer]") {
+    IOBuffer buffer("ab", 2);
+    IOBuffer other("cdef", 4);
+    buffer.append(other);
+    CHECK(buffer.segments() == 2);
+
+    const uint8_t *data = buffer.pullup(4);
+    REQUIRE(data != nullptr);
+    CHECK(std::string((const char *)data, 4) == "abcd");
+    CHECK(buffer.toString() == "abcdef");
+    CHECK(buffer.pullup(7) == nullptr);
+}
+
+TEST_CASE("iovec", "[IOBuffer]") {
+    int fds[2];
+    REQUIRE(pipe(fds) == 0);
+
+    IOBuffer out("Hello ", 6);
+    IOBuffer world("World", 5);
+    out.append(world);
+    struct iovec iov[4];
+    CHECK(out.peekIovec(iov, 4) == 2);
+    CHECK(out.writeTo(fds[1]) == 11);
+    CHECK(out.empty());
+
+    IOBuffer in("> ", 2);
+    CHECK(in.readFrom(fds[0], 64) == 11);
+    CHECK(in.toString() == "> Hello World");
+
+    // 预留后只提交部分字节
+    size_t count = in.reserveIovec(iov, 4, 8192);
+    REQUIRE(count > 0);
+    size_t total = 0;
+    for (size_t i = 0; i < count; ++i) {
+        total += iov[i].iov_len;
+    }
+    CHECK(total == 8192);
+    memcpy(iov[0].iov_base, "!", 1);
+    in.commit(1);
+    CHECK(in.toString() == "> Hello World!");
+
+    close(fds[0]);
+    close(fds[1]);
+}
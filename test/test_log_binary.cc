@@ -0,0 +1,184 @@
+#define CATCH_CONFIG_MAIN
+#define LOG_TAG "test_log_binary"
+#include <stdarg.h>
+#include <string.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <string>
+#include <vector>
+
+#include "catch/catch.hpp"
+#include "log/log.h"
+#include "log/log_binary.h"
+
+using namespace eular;
+
+// 编码后按同一格式串解码, 与vsnprintf的结果比较
+static void RoundTrip(const char *fmt, ...)
+{
+    char expected[512];
+    va_list ap;
+    va_start(ap, fmt);
+    vsnprintf(expected, sizeof(expected), fmt, ap);
+    va_end(ap);
+
+    LogBuffer args;
+    va_start(ap, fmt);
+    bool encoded = BinaryCodec::EncodeArgs(args, fmt, ap);
+    va_end(ap);
+    REQUIRE(encoded);
+
+    std::string decoded;
+    REQUIRE(BinaryCodec::DecodeArgs(fmt, args.data(), args.size(), decoded));
+    CHECK(decoded == expected);
+}
+
+TEST_CASE("floating", "[BinaryCodec]") {
+    RoundTrip("%lf %d", 3.5, 7);
+    RoundTrip("%f %.2lf %e %g", 1.25, -2.5, 1e10, 0.1);
+    RoundTrip("%Lf %lf", (long double)2.75, 0.5);
+    RoundTrip("%10.3Lf|%-8.1lf|", (long double)-1.5, 3.25);
+}
+
+TEST_CASE("integer", "[BinaryCodec]") {
+    RoundTrip("%ld %lu %lx", -1234567890123L, 18446744073709551615UL, 0xdeadbeefcafeUL);
+    RoundTrip("%lld %llu %zu %jd", -1LL, 1ULL << 63, (size_t)42, (intmax_t)-42);
+    RoundTrip("%hd %hhu %d %u %o", (short)-12, (unsigned char)250, -7, 7u, 8u);
+    RoundTrip("%*d|%-*.*s|", 6, 42, 8, 3, "abcdef");
+    RoundTrip("%c %s %p %%", 'x', "str", (void *)0x1234);
+}
+
+TEST_CASE("unsupported", "[BinaryCodec]") {
+    LogBuffer args;
+    va_list ap;
+    memset(&ap, 0, sizeof(ap));
+    // 宽字符与%n不编码, 调用者按文本保存
+    CHECK_FALSE(BinaryCodec::EncodeArgs(args, "%ls", ap));
+    CHECK_FALSE(BinaryCodec::EncodeArgs(args, "%lls", ap));
+    CHECK_FALSE(BinaryCodec::EncodeArgs(args, "%lc", ap));
+    CHECK_FALSE(BinaryCodec::EncodeArgs(args, "%n", ap));
+}
+
+static std::vector<std::string> ListFiles(const char *dir)
+{
+    std::vector<std::string> files;
+    DIR *dp = opendir(dir);
+    if (dp == nullptr) {
+        return files;
+    }
+    for (struct dirent *ent = readdir(dp); ent != nullptr; ent = readdir(dp)) {
+        if (ent->d_name[0] != '.') {
+            files.push_back(std::string(dir) + "/" + ent->d_name);
+        }
+    }
+    closedir(dp);
+    return files;
+}
+
+// 写入后不再有日志时, 缓存由刷新线程按时写出, 时间戳保留纳秒
+TEST_CASE("idle_flush", "[BinaryLogWrite]") {
+    char dir[] = "/tmp/test_log_binary_XXXXXX";
+    REQUIRE(mkdtemp(dir) != nullptr);
+    int32_t fds[2];
+    REQUIRE(pipe(fds) == 0);
+
+    pid_t pid = fork();
+    REQUIRE(pid >= 0);
+    if (pid == 0) {
+        log::InitLog();
+        log::SetPath(dir);
+        log::addOutputNode(LogWrite::BINOUT);
+        log::delOutputNode(LogWrite::STDOUT);
+        for (int32_t i = 0; i < 20; ++i) {
+            LOGI("idle %d", i);
+        }
+        char c = 0;
+        (void)write(fds[1], &c, 1);
+        pause();
+        _exit(0);
+    }
+
+    char c = 0;
+    REQUIRE(read(fds[0], &c, 1) == 1);
+    usleep(100 * 1000);
+
+    std::vector<std::string> files = ListFiles(dir);
+    REQUIRE(files.size() == 1);
+    BinaryLogReader reader;
+    REQUIRE(reader.open(files[0].c_str()));
+    LogEvent ev;
+    std::string msg;
+    int32_t count = 0;
+    bool subMicro = false;
+    while (reader.next(ev, msg)) {
+        CHECK(msg == "idle " + std::to_string(count));
+        CHECK(ev.nsec / 1000 == (uint32_t)ev.time.tv_usec);
+        subMicro = subMicro || ev.nsec % 1000 != 0;
+        ++count;
+    }
+    CHECK(count == 20);
+    CHECK(subMicro);
+
+    kill(pid, SIGKILL);
+    waitpid(pid, nullptr, 0);
+    close(fds[0]);
+    close(fds[1]);
+    reader.close();
+    for (const std::string &file : files) {
+        unlink(file.c_str());
+    }
+    rmdir(dir);
+}
+
+// 崩溃前暂存在BINOUT缓存中的日志由信号处理函数写出
+TEST_CASE("crash_flush", "[BinaryLogWrite]") {
+    char dir[] = "/tmp/test_log_binary_XXXXXX";
+    REQUIRE(mkdtemp(dir) != nullptr);
+
+    pid_t pid = fork();
+    REQUIRE(pid >= 0);
+    if (pid == 0) {
+        signal(SIGSEGV, SIG_DFL);
+        log::InitLog();
+        log::SetPath(dir);
+        log::addOutputNode(LogWrite::BINOUT);
+        log::delOutputNode(LogWrite::STDOUT);
+        log::InstallCrashHandler(open("/dev/null", O_WRONLY));
+        for (int32_t i = 0; i < 100; ++i) {
+            LOGI("before crash %d", i);
+        }
+        *(volatile int32_t *)nullptr = 0;
+        _exit(0);
+    }
+
+    int32_t status = 0;
+    REQUIRE(waitpid(pid, &status, 0) == pid);
+    CHECK(WIFSIGNALED(status));
+    CHECK(WTERMSIG(status) == SIGSEGV);
+
+    std::vector<std::string> files = ListFiles(dir);
+    REQUIRE(files.size() == 1);
+
+    BinaryLogReader reader;
+    REQUIRE(reader.open(files[0].c_str()));
+    LogEvent ev;
+    std::string msg;
+    int32_t count = 0;
+    while (reader.next(ev, msg)) {
+        CHECK(msg == "before crash " + std::to_string(count));
+        CHECK(std::string(ev.tag) == LOG_TAG);
+        ++count;
+    }
+    CHECK(reader.error().empty());
+    CHECK(count == 100);
+
+    reader.close();
+    for (const std::string &file : files) {
+        unlink(file.c_str());
+    }
+    rmdir(dir);
+}
@@ -13,8 +13,17 @@
 #include <stdlib.h>
 #include <string.h>
 #include <string>
+#include <atomic>
 
 namespace eular {
+#define BYTE_BUFFER_INLINE_SIZE (48)    // 不超过此大小的数据存放在对象内, 不分配内存
+
+/**
+ * 超过BYTE_BUFFER_INLINE_SIZE的数据存放在SharedBuffer中, 拷贝时共享, 修改前(含非const的data()与operator[])
+ * 仅在引用计数大于1时复制一份(写时复制); 内联数据拷贝时直接复制.
+ * 容量不足时按1.5倍扩充, 追加的均摊复杂度为O(1).
+ * hash()的结果缓存在对象内, 修改数据时失效; operator==在双方都已缓存且不同时不再比较内容
+ */
 class ByteBuffer final
 {
 public:
@@ -29,6 +38,7 @@ public:
     ByteBuffer& operator=(const ByteBuffer& other);
     ByteBuffer& operator=(ByteBuffer&& other);
     uint8_t&    operator[](size_t index);
+    const uint8_t& operator[](size_t index) const;
 
     // 在offset之后设为data
     size_t      set(const uint8_t *data, size_t dataSize, size_t offset = 0);
@@ -38,7 +48,8 @@ public:
     // 在offset之后插入数据而不覆盖之后的数据
     size_t      insert(const uint8_t *data, size_t dataSize, size_t offset = 0);
 
-    uint8_t *   data() { return mBuffer ? mBuffer : nullptr; }
+    // 返回可写地址, 共享时先复制一份; 缓存的哈希随之失效, 不要在hash()之后继续通过旧指针修改
+    uint8_t *   data();
     const uint8_t *const_data() const { return mBuffer ? mBuffer : nullptr; }
     const uint8_t *begin() const { return mBuffer ? mBuffer : nullptr; }                       // 返回数据开始地址
     const uint8_t *end() const { return mBuffer ? (mBuffer + mDataSize - 1) : nullptr; }       // 返回数据结束地址
@@ -46,23 +57,28 @@ public:
     size_t      capacity() const { return mCapacity; }
     size_t      size() const { return mDataSize; }
     void        clear();
-    void        resize(size_t sz) { mDataSize = sz > mCapacity ? mCapacity : sz; }
+    void        resize(size_t sz) { mDataSize = sz > mCapacity ? mCapacity : sz; mHash.store(0, std::memory_order_relaxed); }
 
     std::string dump()  const;
+    // 基于FastHash64, 结果缓存至下次修改
     static size_t hash(const ByteBuffer &buf);
     bool        operator==(const ByteBuffer &other) const;
 
 private:
+    bool        isInline() const { return mBuffer == mInline; }
     size_t      calculate(size_t);
-    size_t      allocBuffer(size_t size);
+    bool        reallocate(size_t capacity);
+    bool        detach(size_t capacity);
+    void        copyFrom(const ByteBuffer &other);
     void        freeBuffer();
     void        moveAssign(ByteBuffer &other);
-    void        detach();
 
 private:
     uint8_t*    mBuffer;
     size_t      mDataSize;
     size_t      mCapacity;
+    uint8_t     mInline[BYTE_BUFFER_INLINE_SIZE];
+    mutable std::atomic<size_t> mHash;  // 缓存的哈希, 0表示未计算
 };
 
 } // namespace eular
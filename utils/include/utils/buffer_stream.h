@@ -9,19 +9,50 @@
 #define __EULAR_BUFFER_STREAM_H__
 
 #include <memory>
+#include <vector>
+#include <string>
+#include <sys/uio.h>
 
 #include <utils/exception.h>
 #include <utils/buffer.h>
 
 namespace eular {
+class IOBuffer;
+
+// 指向流内数据的只读片段, 不拥有数据, 相当于C++17的std::string_view
+struct BufferSlice
+{
+    const char *    data;
+    size_t          size;
+
+    BufferSlice() : data(nullptr), size(0) {}
+    BufferSlice(const char *d, size_t s) : data(d), size(s) {}
+
+    bool        empty() const { return size == 0; }
+    std::string toString() const { return size ? std::string(data, size) : std::string(); }
+};
+
+/**
+ * 基于ByteBuffer时可读可写; 基于外部内存、映射的文件或IOBuffer时只读, 读取时不拷贝源数据,
+ * 写入抛出异常. 外部内存与IOBuffer在流使用期间不得释放或修改.
+ * 读取BufferSlice得到的片段指向源数据, 仅在IOBuffer中跨分段时指向流内部的临时缓存, 下次读取片段前有效
+ */
 class BufferStream
 {
 public:
     typedef std::shared_ptr<BufferStream>   SP;
     typedef std::weak_ptr<BufferStream>     WP;
 
+    // 整数与字符串的编码方式, 读写双方需一致
+    enum Encoding {
+        ENCODING_FIXED,     // 整数按本机字节序定长, 字符串以\0结尾
+        ENCODING_VARINT,    // 16位及以上的整数按LEB128变长, 有符号数先zigzag; 字符串以varint长度为前缀
+    };
+
     BufferStream();
     BufferStream(ByteBuffer &buffer);
+    BufferStream(const void *data, size_t size);
+    BufferStream(const IOBuffer &buffer);
     BufferStream(const BufferStream &) = delete;
     BufferStream(BufferStream &&other);
     ~BufferStream();
@@ -56,17 +87,92 @@ public:
     BufferStream &operator>>(int64_t &item);
     BufferStream &operator>>(uint64_t &item);
     BufferStream &operator>>(std::string &item);
+    // 读取字符串, 片段不含结尾的\0
+    BufferStream &operator>>(BufferSlice &item);
 
-    void write(const void *data, uint32_t size);
-    bool read(void *data, uint32_t size);
+    void     setEncoding(Encoding encoding) { m_encoding = encoding; }
+    Encoding encoding() const { return m_encoding; }
+
+    // 批量写入整数数组, 按当前编码方式
+    void writeArray(const int16_t *values, size_t count);
+    void writeArray(const uint16_t *values, size_t count);
+    void writeArray(const int32_t *values, size_t count);
+    void writeArray(const uint32_t *values, size_t count);
+    void writeArray(const int64_t *values, size_t count);
+    void writeArray(const uint64_t *values, size_t count);
+    // 批量读取整数数组, 数据不足或超出类型范围时返回false, 读索引不变
+    bool readArray(int16_t *values, size_t count);
+    bool readArray(uint16_t *values, size_t count);
+    bool readArray(int32_t *values, size_t count);
+    bool readArray(uint32_t *values, size_t count);
+    bool readArray(int64_t *values, size_t count);
+    bool readArray(uint64_t *values, size_t count);
+
+    /**
+     * @brief 以只读方式映射文件并从头读取, 映射随流析构或重新映射时解除
+     *
+     * @return 成功返回true, 失败时流不可用
+     */
+    bool mapFile(const String8 &path);
+
+    void write(const void *data, size_t size);
+    bool read(void *data, size_t size);
+    // 读取size字节的片段, 数据不足返回false
+    bool readSlice(BufferSlice &slice, size_t size);
+    bool skip(size_t size);
+
+    size_t readable() const { return m_wpos - m_rpos; }
+    size_t tell() const { return m_rpos; }
+    bool   readOnly() const { return m_source != SOURCE_BUFFER; }
 
 private:
+    enum SourceType {
+        SOURCE_NONE,
+        SOURCE_BUFFER,  // ByteBuffer
+        SOURCE_MEMORY,  // 外部内存
+        SOURCE_MAPPED,  // 映射的文件
+        SOURCE_CHAIN,   // IOBuffer的分段
+    };
+
+    struct ReadPosition {
+        size_t  rpos;
+        size_t  chainIndex;
+        size_t  chainOffset;
+    };
+
     void checkBuffer() const;
+    void release();
+    const uint8_t *contiguous() const;
+    // 读索引起连续可读的数据, IOBuffer时为当前分段的剩余部分
+    const uint8_t *window(size_t &avail) const;
+    size_t findZero() const;
+    void advance(size_t size);
+    void advanceChain(uint8_t *out, size_t size);
+    ReadPosition position() const;
+    void restore(const ReadPosition &pos);
+
+    void writeVarint(uint64_t value);
+    bool readVarint(uint64_t &value);
+    template<typename T>
+    void writeInteger(T value);
+    template<typename T>
+    void readInteger(T &value);
+    template<typename T>
+    void writeIntegerArray(const T *values, size_t count);
+    template<typename T>
+    bool readIntegerArray(T *values, size_t count);
 
 private:
+    SourceType      m_source;
+    Encoding        m_encoding;
     ByteBuffer*     m_buffer;   // 缓存
-    uint32_t        m_rpos;     // 读索引
-    uint32_t        m_wpos;     // 写索引
+    const uint8_t*  m_data;     // 外部内存或映射地址
+    std::vector<struct iovec> m_chain;  // IOBuffer的分段
+    size_t          m_chainIndex;       // 读索引所在分段
+    size_t          m_chainOffset;      // 读索引在分段内的偏移
+    std::string     m_scratch;  // 跨分段的片段
+    size_t          m_rpos;     // 读索引
+    size_t          m_wpos;     // 写索引
 };
 
 } // namespace eular
@@ -11,20 +11,71 @@
 #include "buffer_stream.h"
 
 namespace eular {
+namespace detail {
+// 整数数组按流的编码方式批量读写, 其他基础类型整体拷贝
+template<typename T>
+inline auto WriteFundamentalArray(BufferStream &stream, const T *item, size_t size, int) -> decltype(stream.writeArray(item, size))
+{
+    stream.writeArray(item, size);
+}
+
+template<typename T>
+inline void WriteFundamentalArray(BufferStream &stream, const T *item, size_t size, long)
+{
+    stream.write(item, sizeof(T) * size);
+}
+
+template<typename T>
+inline auto ReadFundamentalArray(BufferStream &stream, T *item, size_t size, int) -> decltype(stream.readArray(item, size))
+{
+    return stream.readArray(item, size);
+}
+
+template<typename T>
+inline bool ReadFundamentalArray(BufferStream &stream, T *item, size_t size, long)
+{
+    return stream.read(item, sizeof(T) * size);
+}
+
+// 按是否为基础类型分派, 避免实例化另一分支
+template<typename T>
+inline void WriteArray(BufferStream &stream, const T *item, size_t size, std::true_type)
+{
+    WriteFundamentalArray(stream, item, size, 0);
+}
+
+template<typename T>
+inline void WriteArray(BufferStream &stream, const T *item, size_t size, std::false_type)
+{
+    for (size_t i = 0; i < size; ++i) {
+        // 非基础类型由外部进行重载, 自定义输入
+        ::operator<<(stream, item[i]);
+    }
+}
+
+template<typename T>
+inline void ReadArray(BufferStream &stream, T *item, size_t size, std::true_type)
+{
+    if (!ReadFundamentalArray(stream, item, size, 0)) {
+        throw Exception(String8::format("Read error, maybe insufficient data. [%s:%d]", __FILE__, __LINE__));
+    }
+}
+
+template<typename T>
+inline void ReadArray(BufferStream &stream, T *item, size_t size, std::false_type)
+{
+    for (size_t i = 0; i < size; ++i) {
+        // 非基础类型由外部进行重载, 自定义输出
+        ::operator>>(stream, item[i]);
+    }
+}
+} // namespace detail
 
 template<typename T, size_t size>
 BufferStream &operator<<(BufferStream &stream, const T (&item)[size])
 {
     static_assert(!std::is_same<T, nullptr_t>::value, "no support nullptr_t");
-    if (std::is_fundamental<T>::value) {
-        stream.write(item, sizeof(T) * size);
-    } else {
-        for (size_t i = 0; i < size; ++i) {
-            // 非基础类型由外部进行重载, 自定义输入
-            ::operator<<(stream, item[i]);
-        }
-    }
-
+    detail::WriteArray(stream, item, size, typename std::is_fundamental<T>::type());
     return stream;
 }
 
@@ -32,17 +83,7 @@ template<typename T, size_t size>
 BufferStream &operator>>(BufferStream &stream, T (&item)[size])
 {
     static_assert(!std::is_same<T, nullptr_t>::value, "no support nullptr_t");
-    if (std::is_fundamental<T>::value) {
-        if (!stream.read(item, sizeof(T) * size)) {
-            throw Exception(String8::format("Read error, maybe insufficient data. [%s:%d]", __FILE__, __LINE__));
-        }
-    } else {
-        for (size_t i = 0; i < size; ++i) {
-            // 非基础类型由外部进行重载, 自定义输出
-            ::operator>>(stream, item[i]);
-        }
-    }
-
+    detail::ReadArray(stream, item, size, typename std::is_fundamental<T>::type());
     return stream;
 }
 
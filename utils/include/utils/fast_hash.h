@@ -0,0 +1,39 @@
+/*************************************************************************
+    > File Name: fast_hash.h
+    > Author: hsz
+    > Brief: 非加密64位哈希, 用于哈希表等场景, 不可用于安全校验
+    > Created Time: 2026年10月18日 星期日 22时05分17秒
+ ************************************************************************/
+
+#ifndef __EULAR_FAST_HASH_H__
+#define __EULAR_FAST_HASH_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+namespace eular {
+/**
+ * @brief 计算data的64位哈希
+ *        不超过FAST_HASH_LONG_SIZE字节时按wyhash方式每16字节一次128位乘法;
+ *        更长的数据按xxh3方式分为64字节条带累加, x86_64上使用SSE2, 运行时支持AVX2时使用AVX2,
+ *        各实现结果一致. 编译时定义FAST_HASH_NO_SIMD可关闭SIMD
+ *
+ * @param seed 种子, 不同种子得到不同的哈希
+ */
+uint64_t FastHash64(const void *data, size_t size, uint64_t seed = 0);
+
+namespace detail {
+enum FastHashImpl {
+    FAST_HASH_SCALAR,
+    FAST_HASH_SSE2,
+    FAST_HASH_AVX2,
+};
+
+// 以下仅供测试各实现结果一致, 调用前需确认当前平台支持
+bool FastHash64Supported(FastHashImpl type);
+uint64_t FastHash64With(FastHashImpl type, const void *data, size_t size, uint64_t seed);
+} // namespace detail
+
+} // namespace eular
+
+#endif // __EULAR_FAST_HASH_H__
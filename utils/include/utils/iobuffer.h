@@ -0,0 +1,111 @@
+/*************************************************************************
+    > File Name: iobuffer.h
+    > Author: hsz
+    > Brief: 由引用计数的SharedBuffer分段组成的链式缓存, 追加/拆分/切片不拷贝已有数据
+    > Created Time: 2026年10月18日 星期日 21时10分23秒
+ ************************************************************************/
+
+#ifndef __EULAR_IOBUFFER_H__
+#define __EULAR_IOBUFFER_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <deque>
+#include <vector>
+#include <string>
+
+namespace eular {
+class SharedBuffer;
+
+/**
+ * 每个分段引用一块SharedBuffer中的[offset, offset + length), 多个IOBuffer可共享同一块内存.
+ * 只有分段独占内存块(引用计数为1)时才在其前后空闲处直接写入, 否则分配新块, 共享的数据不会被修改.
+ * 对象本身非线程安全; 共享分段的对象可以在不同线程使用.
+ */
+class IOBuffer final
+{
+public:
+    IOBuffer();
+    IOBuffer(const void *data, size_t size);
+    IOBuffer(const IOBuffer &other);        // 共享other的分段, 不拷贝数据
+    IOBuffer(IOBuffer &&other);
+    ~IOBuffer();
+
+    IOBuffer &operator=(const IOBuffer &other);
+    IOBuffer &operator=(IOBuffer &&other);
+
+    size_t      size() const { return mSize; }
+    bool        empty() const { return mSize == 0; }
+    size_t      segments() const { return mSegments.size(); }
+    void        clear();
+
+    // 拷贝数据到尾部, 优先写入尾部分段的空闲空间
+    void        append(const void *data, size_t size);
+    void        append(const std::string &str) { append(str.data(), str.length()); }
+    // 共享other的分段, 不拷贝数据
+    void        append(const IOBuffer &other);
+    void        append(IOBuffer &&other);
+    // 拷贝数据到头部, 优先写入头部分段之前的空闲空间
+    void        prepend(const void *data, size_t size);
+
+    // 丢弃头部n字节, 返回实际丢弃的字节数
+    size_t      consume(size_t n);
+    // 丢弃尾部n字节, 返回实际丢弃的字节数
+    size_t      trimBack(size_t n);
+    // 拆出头部n字节作为新对象返回, 边界所在的分段由两者共享
+    IOBuffer    split(size_t n);
+    // 返回[offset, offset + length)的共享视图, 超出部分忽略
+    IOBuffer    slice(size_t offset, size_t length) const;
+
+    // 从offset开始拷贝最多length字节到out, 返回拷贝的字节数
+    size_t      copyOut(size_t offset, void *out, size_t length) const;
+    std::string toString() const;
+    /**
+     * @brief 保证头部n字节连续存放, 用于解析跨分段的报文头
+     *
+     * @return 头部n字节的地址, size()小于n或内存不足时返回nullptr
+     */
+    const uint8_t *pullup(size_t n);
+
+    /**
+     * @brief 导出可读数据的iovec, 用于writev
+     *
+     * @return 填充的iovec个数, 最多maxIov个
+     */
+    size_t      peekIovec(struct iovec *iov, size_t maxIov) const;
+    /**
+     * @brief 预留尾部至少size字节的可写空间并导出iovec, 用于readv; 之后调用commit提交实际写入的字节数.
+     *        reserveIovec与commit之间不得修改对象
+     *
+     * @return 填充的iovec个数, 最多maxIov个; 内存不足返回0
+     */
+    size_t      reserveIovec(struct iovec *iov, size_t maxIov, size_t size);
+    void        commit(size_t n);
+
+    // 以writev写出并丢弃已写出的数据, 返回值同writev
+    ssize_t     writeTo(int fd);
+    // 以readv读取最多maxSize字节追加到尾部, 返回值同readv
+    ssize_t     readFrom(int fd, size_t maxSize);
+
+private:
+    struct Segment {
+        SharedBuffer *  block;
+        size_t          offset;
+        size_t          length;
+    };
+
+    size_t      tailRoom() const;
+    void        releaseReserved();
+
+private:
+    std::deque<Segment>         mSegments;
+    size_t                      mSize;
+    std::vector<SharedBuffer *> mReserved;      // reserveIovec分配的新块
+    bool                        mReserveTail;   // reserveIovec是否使用了尾部分段的空闲空间
+};
+
+} // namespace eular
+
+#endif // __EULAR_IOBUFFER_H__
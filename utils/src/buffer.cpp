@@ -8,6 +8,7 @@
 #include "utils/buffer.h"
 #include "utils/shared_buffer.h"
 #include "utils/exception.h"
+#include "utils/fast_hash.h"
 
 #define DEFAULT_BUFFER_SIZE (256)
 
@@ -29,28 +30,27 @@ namespace eular {
 ByteBuffer::ByteBuffer():
     mBuffer(GetEmptyBuffer()),
     mDataSize(0),
-    mCapacity(0)
+    mCapacity(0),
+    mHash(0)
 {
 }
 
 ByteBuffer::ByteBuffer(size_t size) :
     mBuffer(GetEmptyBuffer()),
     mDataSize(0),
-    mCapacity(0)
+    mCapacity(0),
+    mHash(0)
 {
     if (size > 0) {
-        SharedBuffer *newBuf = SharedBuffer::bufferFromData(mBuffer)->reset(size);
-        if (newBuf != nullptr) {
-            mBuffer = static_cast<uint8_t *>(newBuf->data());
-            mCapacity = newBuf->size();
-        }
+        reallocate(size);
     }
 }
 
 ByteBuffer::ByteBuffer(const char *data, size_t dataLength) :
     mBuffer(GetEmptyBuffer()),
     mDataSize(0),
-    mCapacity(0)
+    mCapacity(0),
+    mHash(0)
 {
     if (data == nullptr || dataLength == 0) {
         return;
@@ -63,31 +63,29 @@ ByteBuffer::ByteBuffer(const char *data, size_t dataLength) :
 }
 
 ByteBuffer::ByteBuffer(const uint8_t *data, size_t dataLength) :
-    mBuffer(nullptr),
+    mBuffer(GetEmptyBuffer()),
     mDataSize(0),
-    mCapacity(0)
+    mCapacity(0),
+    mHash(0)
 {
-    mCapacity = allocBuffer(dataLength);
     set(data, dataLength);
 }
 
 ByteBuffer::ByteBuffer(const ByteBuffer& other) :
-    mBuffer(other.mBuffer),
-    mDataSize(other.mDataSize),
-    mCapacity(other.mCapacity)
+    mBuffer(nullptr),
+    mDataSize(0),
+    mCapacity(0),
+    mHash(0)
 {
-    SharedBuffer::bufferFromData(mBuffer)->acquire();
+    copyFrom(other);
 }
 
 ByteBuffer::ByteBuffer(ByteBuffer&& other) :
-    mBuffer(GetEmptyBuffer()),
+    mBuffer(nullptr),
     mDataSize(0),
-    mCapacity(0)
+    mCapacity(0),
+    mHash(0)
 {
-    if (std::addressof(other) == this) {
-        return;
-    }
-
     moveAssign(other);
 }
 
@@ -99,10 +97,8 @@ ByteBuffer::~ByteBuffer()
 ByteBuffer& ByteBuffer::operator=(const ByteBuffer& other)
 {
     if (std::addressof(other) != this) {
-        mBuffer = other.mBuffer;
-        mCapacity = other.mCapacity;
-        mDataSize = other.mDataSize;
-        SharedBuffer::bufferFromData(mBuffer)->acquire();
+        freeBuffer();
+        copyFrom(other);
     }
 
     return *this;
@@ -111,6 +107,7 @@ ByteBuffer& ByteBuffer::operator=(const ByteBuffer& other)
 ByteBuffer& ByteBuffer::operator=(ByteBuffer&& other)
 {
     if (std::addressof(other) != this) {
+        freeBuffer();
         moveAssign(other);
     }
 
@@ -123,6 +120,18 @@ uint8_t& ByteBuffer::operator[](size_t index)
         throw Exception("Index out of range");
     }
 
+    if (!detach(mCapacity)) {
+        throw Exception("Not enough memory");
+    }
+    return mBuffer[index];
+}
+
+const uint8_t& ByteBuffer::operator[](size_t index) const
+{
+    if (index >= mCapacity) {
+        throw Exception("Index out of range");
+    }
+
     return mBuffer[index];
 }
 
@@ -139,18 +148,17 @@ size_t ByteBuffer::set(const uint8_t *data, size_t dataSize, size_t offset)
         return 0;
     }
 
-    SharedBuffer *buf = nullptr;
-    if (mCapacity < newSize) { // capacity exceeded
-        buf = SharedBuffer::bufferFromData(mBuffer)->editResize(calculate(newSize));
-    } else {
-        buf = SharedBuffer::bufferFromData(mBuffer)->edit();
-    }
-    if (buf == nullptr) {
+    // data可能指向自身, 重新分配后按偏移找回
+    uintptr_t begin = (uintptr_t)mBuffer;
+    bool alias = mBuffer != nullptr && (uintptr_t)data >= begin && (uintptr_t)data < begin + mDataSize;
+    size_t aliasOffset = (uintptr_t)data - begin;
+    if (!detach(mCapacity < newSize ? calculate(newSize) : mCapacity)) {
         return 0;
     }
+    if (alias) {
+        data = mBuffer + aliasOffset;
+    }
 
-    mBuffer = static_cast<uint8_t *>(buf->data());
-    mCapacity = buf->size();
     mDataSize = newSize;
     memmove(mBuffer + real_offset, data, dataSize);
 
@@ -177,6 +185,12 @@ void ByteBuffer::append(const uint8_t *data, size_t dataSize)
 
 void ByteBuffer::append(const ByteBuffer &other)
 {
+    if (std::addressof(other) == this) {
+        // 追加自身, 先保留一份共享引用
+        ByteBuffer temp(other);
+        set(temp.const_data(), temp.size(), size());
+        return;
+    }
     set(other.const_data(), other.size(), size());
 }
 
@@ -186,74 +200,63 @@ size_t ByteBuffer::insert(const uint8_t *data, size_t dataSize, size_t offset)
         return 0;
     }
 
+    uintptr_t begin = (uintptr_t)mBuffer;
+    if (mBuffer != nullptr && (uintptr_t)data >= begin && (uintptr_t)data < begin + mDataSize) {
+        // 插入自身的数据, 移动后原位置会被覆盖, 先拷贝一份
+        ByteBuffer temp(data, dataSize);
+        return insert(temp.const_data(), dataSize, offset);
+    }
+
     size_t newSize = 0;
     size_t copySize = mDataSize - offset;
-    size_t oldDataSize = mDataSize;
     if (__builtin_add_overflow(dataSize, mDataSize, &newSize)) {
         return 0;
     }
 
-    SharedBuffer *buf = nullptr;
-    if (mCapacity < newSize) {
-        buf = SharedBuffer::bufferFromData(mBuffer)->editResize(calculate(newSize));
-    } else {
-        buf = SharedBuffer::bufferFromData(mBuffer)->edit();
-    }
-
-    if (buf == nullptr) {
+    if (!detach(mCapacity < newSize ? calculate(newSize) : mCapacity)) {
         return 0;
     }
 
-    mBuffer = static_cast<uint8_t *>(buf->data());
-    mCapacity = buf->size();
+    memmove(mBuffer + offset + dataSize, mBuffer + offset, copySize);
+    memcpy(mBuffer + offset, data, dataSize);
     mDataSize = newSize;
 
-    if (copySize == 0) {
-        memmove(mBuffer + oldDataSize, data, dataSize);
-    } else {
-        uint8_t *temp = (uint8_t *)malloc(copySize);
-        if (temp == nullptr) {
-            return 0;
-        }
-        memmove(temp, mBuffer + offset, copySize);
-        memmove(mBuffer + offset, data, dataSize);
-        memmove(mBuffer + offset + dataSize, temp, copySize);
-        free(temp);
-    }
-
     return dataSize;
 }
 
-void ByteBuffer::reserve(size_t newSize)
+uint8_t *ByteBuffer::data()
 {
-    if (newSize == 0) {
-        return;
+    if (!detach(mCapacity)) {
+        return nullptr;
     }
 
-    // NOTE 移动构造的mBuffer可能会是null
-    if (mBuffer == nullptr) {
-        mCapacity = allocBuffer(newSize);
-        mDataSize = 0;
+    return mBuffer;
+}
+
+void ByteBuffer::reserve(size_t newSize)
+{
+    if (newSize <= mCapacity) {
         return;
     }
 
-    SharedBuffer *buf = SharedBuffer::bufferFromData(mBuffer)->editResize(newSize);
-    if (buf) {
-        mBuffer = static_cast<uint8_t *>(buf->data());
-        mCapacity = buf->size();
-    }
+    reallocate(newSize);
 }
 
 void ByteBuffer::clear() 
 {
-    detach();
+    if (!isInline() && mCapacity > 0 && !SharedBuffer::bufferFromData(mBuffer)->onlyOwner()) {
+        // 共享的数据不必复制, 直接放弃引用
+        freeBuffer();
+        mBuffer = GetEmptyBuffer();
+    }
 
 #ifdef _DEBUG
-    if (mBuffer) {
+    if (mBuffer && mCapacity > 0) {
         memset(mBuffer, 0, mCapacity);
     }
 #endif
     mDataSize = 0;
+    mHash.store(0, std::memory_order_relaxed);
 }
 
 std::string ByteBuffer::dump() const
@@ -282,17 +285,33 @@ std::string ByteBuffer::dump() const
 
 size_t ByteBuffer::hash(const ByteBuffer &buf)
 {
-    return std::_Hash_impl::hash(buf.const_data(), buf.size());
+    size_t value = buf.mHash.load(std::memory_order_relaxed);
+    if (value != 0) {
+        return value;
+    }
+
+    // 0留作未计算的标记
+    value = static_cast<size_t>(FastHash64(buf.const_data(), buf.size()));
+    value = value ? value : 1;
+    buf.mHash.store(value, std::memory_order_relaxed);
+    return value;
 }
 
 bool ByteBuffer::operator==(const ByteBuffer &other) const
 {
+    if (mDataSize != other.mDataSize) {
+        return false;
+    }
+
     // 共享状态下一定是同一份数据
     if (mBuffer == other.mBuffer) {
         return true;
     }
 
-    if (mDataSize != other.mDataSize) {
+    // 双方都已计算过哈希时, 哈希不同则内容一定不同
+    size_t lhs = mHash.load(std::memory_order_relaxed);
+    size_t rhs = other.mHash.load(std::memory_order_relaxed);
+    if (lhs != 0 && rhs != 0 && lhs != rhs) {
         return false;
     }
 
@@ -301,63 +320,128 @@ bool ByteBuffer::operator==(const ByteBuffer &other) const
 
 size_t ByteBuffer::calculate(size_t dataSize)
 {
-    if (dataSize >= DEFAULT_BUFFER_SIZE) {
-        dataSize *= 1.5;
-    } else {
-        dataSize = DEFAULT_BUFFER_SIZE;
+    if (dataSize <= BYTE_BUFFER_INLINE_SIZE) {
+        return BYTE_BUFFER_INLINE_SIZE;
     }
-    return dataSize;
+
+    // 按当前容量的1.5倍扩充, 而不是按所需大小, 逐字节追加时也只有对数次分配
+    size_t capacity = mCapacity + mCapacity / 2;
+    if (capacity < DEFAULT_BUFFER_SIZE) {
+        capacity = DEFAULT_BUFFER_SIZE;
+    }
+    return capacity < dataSize ? dataSize : capacity;
 }
 
-size_t ByteBuffer::allocBuffer(size_t size)
+bool ByteBuffer::reallocate(size_t capacity)
 {
-    if (size == 0) {
-        size = DEFAULT_BUFFER_SIZE;
+    if (capacity < mDataSize) {
+        capacity = mDataSize;
+    }
+
+    if (capacity <= BYTE_BUFFER_INLINE_SIZE) {
+        if (!isInline()) {
+            if (mDataSize > 0) {
+                memcpy(mInline, mBuffer, mDataSize);
+            }
+            size_t dataSize = mDataSize;
+            freeBuffer();
+            mDataSize = dataSize;
+            mBuffer = mInline;
+        }
+        mCapacity = BYTE_BUFFER_INLINE_SIZE;
+        return true;
     }
 
-    if (mBuffer == nullptr) { 
-        mBuffer = static_cast<uint8_t *>(SharedBuffer::alloc(size)->data());
-        if (mBuffer) {
-            memset(mBuffer, 0, size);
-            return size;
+    SharedBuffer *psb = (isInline() || mBuffer == nullptr) ? nullptr : SharedBuffer::bufferFromData(mBuffer);
+    SharedBuffer *newSb = nullptr;
+    if (psb != nullptr && psb->onlyOwner()) {
+        // 独占时原地扩充
+        newSb = psb->editResize(capacity);
+        if (newSb == nullptr) {
+            return false;
+        }
+    } else {
+        newSb = SharedBuffer::alloc(capacity);
+        if (newSb == nullptr) {
+            return false;
+        }
+        if (mDataSize > 0) {
+            memcpy(newSb->data(), mBuffer, mDataSize);
+        }
+        if (psb != nullptr) {
+            psb->release();
         }
     }
 
-    return 0;
+    mBuffer = static_cast<uint8_t *>(newSb->data());
+    mCapacity = capacity;
+    return true;
+}
+
+bool ByteBuffer::detach(size_t capacity)
+{
+    // 调用者随后会修改数据, 缓存的哈希失效
+    mHash.store(0, std::memory_order_relaxed);
+    if (isInline()) {
+        return capacity <= BYTE_BUFFER_INLINE_SIZE ? true : reallocate(capacity);
+    }
+
+    // 空缓存由所有对象共享, 也需要重新分配
+    SharedBuffer *psb = SharedBuffer::bufferFromData(mBuffer);
+    if (psb != nullptr && mCapacity > 0 && psb->onlyOwner() && capacity <= mCapacity) {
+        return true;
+    }
+    if (capacity == 0) {
+        return true;
+    }
+
+    return reallocate(capacity);
+}
+
+void ByteBuffer::copyFrom(const ByteBuffer &other)
+{
+    if (other.isInline()) {
+        memcpy(mInline, other.mInline, other.mDataSize);
+        mBuffer = mInline;
+    } else {
+        mBuffer = other.mBuffer;
+        if (mBuffer != nullptr) {
+            SharedBuffer::bufferFromData(mBuffer)->acquire();
+        }
+    }
+    mDataSize = other.mDataSize;
+    mCapacity = other.mCapacity;
+    mHash.store(other.mHash.load(std::memory_order_relaxed), std::memory_order_relaxed);
 }
 
 void ByteBuffer::freeBuffer()
 {
-    if (mBuffer) {
+    if (mBuffer && !isInline()) {
         SharedBuffer::bufferFromData(mBuffer)->release();
     }
     mBuffer = nullptr;
     mDataSize = 0;
     mCapacity = 0;
+    mHash.store(0, std::memory_order_relaxed);
 }
 
 void ByteBuffer::moveAssign(ByteBuffer &other)
 {
-    std::swap(mBuffer, other.mBuffer);
-    std::swap(mDataSize, other.mDataSize);
-    std::swap(mCapacity, other.mCapacity);
-}
-
-void ByteBuffer::detach()
-{
-    SharedBuffer *psb = SharedBuffer::bufferFromData(mBuffer);
-    if (psb == nullptr) {
-        mCapacity = allocBuffer(DEFAULT_BUFFER_SIZE);
-        mDataSize = 0;
-        return;
+    // 接管other的内存, other置为空缓存
+    if (other.isInline()) {
+        memcpy(mInline, other.mInline, other.mDataSize);
+        mBuffer = mInline;
+    } else {
+        mBuffer = other.mBuffer;
     }
+    mDataSize = other.mDataSize;
+    mCapacity = other.mCapacity;
+    mHash.store(other.mHash.load(std::memory_order_relaxed), std::memory_order_relaxed);
 
-    if (psb->onlyOwner() == false) {
-        SharedBuffer *newSb = psb->edit();
-        if (newSb) {
-            mBuffer = static_cast<uint8_t *>(newSb->data());
-        }
-    }
+    other.mBuffer = GetEmptyBuffer();
+    other.mDataSize = 0;
+    other.mCapacity = 0;
+    other.mHash.store(0, std::memory_order_relaxed);
 }
 
 } // namespace eular
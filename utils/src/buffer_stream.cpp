@@ -6,41 +6,227 @@
  ************************************************************************/
 
 #include "utils/buffer_stream.h"
+#include "utils/iobuffer.h"
 #include "utils/utils.h"
 
+#include <limits>
+#include <type_traits>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#define VARINT_MAX_BYTES    (10)    // 64位整数的LEB128最长字节数
+#define VARINT_CHUNK_SIZE   (256)   // 批量写入时先在栈上编码, 每满一块写入一次
+
+static inline uint64_t ZigzagEncode(int64_t value)
+{
+    return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+}
+
+static inline int64_t ZigzagDecode(uint64_t value)
+{
+    return static_cast<int64_t>((value >> 1) ^ (~(value & 1) + 1));
+}
+
+static inline size_t EncodeVarint(uint64_t value, uint8_t *out)
+{
+    size_t size = 0;
+    while (value >= 0x80) {
+        out[size++] = static_cast<uint8_t>(value | 0x80);
+        value >>= 7;
+    }
+    out[size++] = static_cast<uint8_t>(value);
+    return size;
+}
+
+// 第10字节只剩1位有效, 大于1表示溢出64位
+static inline bool VarintOverflow(size_t index, uint8_t byte)
+{
+    return index == VARINT_MAX_BYTES - 1 && byte > 1;
+}
+
+// 返回消耗的字节数, 数据不完整、溢出或超过VARINT_MAX_BYTES时返回0
+static inline size_t DecodeVarint(const uint8_t *in, size_t avail, uint64_t &value)
+{
+    uint64_t result = 0;
+    size_t limit = avail < VARINT_MAX_BYTES ? avail : VARINT_MAX_BYTES;
+    for (size_t i = 0; i < limit; ++i) {
+        if (VarintOverflow(i, in[i])) {
+            return 0;
+        }
+        result |= static_cast<uint64_t>(in[i] & 0x7F) << (7 * i);
+        if ((in[i] & 0x80) == 0) {
+            value = result;
+            return i + 1;
+        }
+    }
+
+    return 0;
+}
+
+// 开头连续的单字节varint(最高位为0)个数, 一次检查16(SSE2)或8个字节
+static inline size_t SingleByteRun(const uint8_t *in, size_t avail)
+{
+#if defined(__SSE2__)
+    if (avail >= 16) {
+        int mask = _mm_movemask_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(in)));
+        return mask == 0 ? 16 : __builtin_ctz(mask);
+    }
+#elif __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    if (avail >= 8) {
+        uint64_t word;
+        memcpy(&word, in, sizeof(word));
+        uint64_t mask = word & 0x8080808080808080ULL;
+        return mask == 0 ? 8 : __builtin_ctzll(mask) / 8;
+    }
+#endif
+    size_t run = 0;
+    while (run < avail && in[run] < 0x80) {
+        ++run;
+    }
+    return run;
+}
+
+template<typename T>
+static inline uint64_t IntegerToVarint(T value, std::true_type)
+{
+    return ZigzagEncode(value);
+}
+
+template<typename T>
+static inline uint64_t IntegerToVarint(T value, std::false_type)
+{
+    return value;
+}
+
+template<typename T>
+static inline bool VarintToInteger(uint64_t raw, T &value, std::true_type)
+{
+    int64_t result = ZigzagDecode(raw);
+    if (result < std::numeric_limits<T>::min() || result > std::numeric_limits<T>::max()) {
+        return false;
+    }
+    value = static_cast<T>(result);
+    return true;
+}
+
+template<typename T>
+static inline bool VarintToInteger(uint64_t raw, T &value, std::false_type)
+{
+    if (raw > std::numeric_limits<T>::max()) {
+        return false;
+    }
+    value = static_cast<T>(raw);
+    return true;
+}
+
+// 单字节varint一定在类型范围内
+template<typename T>
+static inline T SmallVarintToInteger(uint8_t raw, std::true_type)
+{
+    return static_cast<T>((raw >> 1) ^ -(raw & 1));
+}
+
+template<typename T>
+static inline T SmallVarintToInteger(uint8_t raw, std::false_type)
+{
+    return static_cast<T>(raw);
+}
+
 namespace eular {
 BufferStream::BufferStream() :
+    m_source(SOURCE_NONE),
+    m_encoding(ENCODING_FIXED),
     m_buffer(nullptr),
+    m_data(nullptr),
+    m_chainIndex(0),
+    m_chainOffset(0),
     m_rpos(0),
     m_wpos(0)
 {
 }
 
 BufferStream::BufferStream(ByteBuffer &buffer) :
+    m_source(SOURCE_BUFFER),
+    m_encoding(ENCODING_FIXED),
     m_buffer(std::addressof(buffer)),
+    m_data(nullptr),
+    m_chainIndex(0),
+    m_chainOffset(0),
     m_rpos(0),
     m_wpos(buffer.size())
 {
 }
 
+BufferStream::BufferStream(const void *data, size_t size) :
+    m_source(SOURCE_MEMORY),
+    m_encoding(ENCODING_FIXED),
+    m_buffer(nullptr),
+    m_data(static_cast<const uint8_t *>(data)),
+    m_chainIndex(0),
+    m_chainOffset(0),
+    m_rpos(0),
+    m_wpos(data ? size : 0)
+{
+}
+
+BufferStream::BufferStream(const IOBuffer &buffer) :
+    m_source(SOURCE_CHAIN),
+    m_encoding(ENCODING_FIXED),
+    m_buffer(nullptr),
+    m_data(nullptr),
+    m_chainIndex(0),
+    m_chainOffset(0),
+    m_rpos(0),
+    m_wpos(buffer.size())
+{
+    // 只记录各分段的地址, 不持有引用
+    m_chain.resize(buffer.segments());
+    if (!m_chain.empty()) {
+        buffer.peekIovec(m_chain.data(), m_chain.size());
+    }
+}
+
 BufferStream::BufferStream(BufferStream &&other) :
+    m_source(other.m_source),
+    m_encoding(other.m_encoding),
     m_buffer(other.m_buffer),
+    m_data(other.m_data),
+    m_chain(std::move(other.m_chain)),
+    m_chainIndex(other.m_chainIndex),
+    m_chainOffset(other.m_chainOffset),
+    m_scratch(std::move(other.m_scratch)),
     m_rpos(other.m_rpos),
     m_wpos(other.m_wpos)
 {
+    // 映射随之转移, other不再解除映射
+    other.m_source = SOURCE_NONE;
     other.m_buffer = nullptr;
-    other.m_rpos = 0;
-    other.m_wpos = 0;
+    other.m_data = nullptr;
+    other.release();
 }
 
 BufferStream::~BufferStream()
 {
+    release();
 }
 
 BufferStream &BufferStream::operator=(BufferStream &&other)
 {
     if (this != std::addressof(other)) {
+        std::swap(m_source, other.m_source);
+        std::swap(m_encoding, other.m_encoding);
         std::swap(m_buffer, other.m_buffer);
+        std::swap(m_data, other.m_data);
+        std::swap(m_chain, other.m_chain);
+        std::swap(m_chainIndex, other.m_chainIndex);
+        std::swap(m_chainOffset, other.m_chainOffset);
+        std::swap(m_scratch, other.m_scratch);
         std::swap(m_rpos, other.m_rpos);
         std::swap(m_wpos, other.m_wpos);
     }
@@ -74,13 +260,13 @@ BufferStream &BufferStream::operator<<(wchar_t item)
 
 BufferStream &BufferStream::operator<<(int16_t item)
 {
-    write(&item, sizeof(item));
+    writeInteger(item);
     return *this;
 }
 
 BufferStream &BufferStream::operator<<(uint16_t item)
 {
-    write(&item, sizeof(item));
+    writeInteger(item);
     return *this;
 }
 
@@ -92,13 +278,13 @@ BufferStream &BufferStream::operator<<(float item)
 
 BufferStream &BufferStream::operator<<(int32_t item)
 {
-    write(&item, sizeof(item));
+    writeInteger(item);
     return *this;
 }
 
 BufferStream &BufferStream::operator<<(uint32_t item)
 {
-    write(&item, sizeof(item));
+    writeInteger(item);
     return *this;
 }
 
@@ -110,19 +296,22 @@ BufferStream &BufferStream::operator<<(double item)
 
 BufferStream &BufferStream::operator<<(int64_t item)
 {
-    write(&item, sizeof(item));
+    writeInteger(item);
     return *this;
 }
 
 BufferStream &BufferStream::operator<<(uint64_t item)
 {
-    write(&item, sizeof(item));
+    writeInteger(item);
     return *this;
 }
 
 BufferStream &BufferStream::operator<<(const std::string &item)
 {
-    if (!item.empty()) {
+    if (m_encoding == ENCODING_VARINT) {
+        writeVarint(item.length());
+        write(item.data(), item.length());
+    } else if (!item.empty()) {
         // 将\0保存到缓存中
         write(item.c_str(), item.length() + 1);
     }
@@ -168,19 +357,13 @@ BufferStream &BufferStream::operator>>(wchar_t &item)
 
 BufferStream &BufferStream::operator>>(int16_t &item)
 {
-    if (!read(&item, sizeof(item))) {
-        throw Exception(String8::format("Read error, maybe insufficient data. [%s:%d]", __FILE__, __LINE__));
-    }
-
+    readInteger(item);
     return *this;
 }
 
 BufferStream &BufferStream::operator>>(uint16_t &item)
 {
-    if (!read(&item, sizeof(item))) {
-        throw Exception(String8::format("Read error, maybe insufficient data. [%s:%d]", __FILE__, __LINE__));
-    }
-
+    readInteger(item);
     return *this;
 }
 
@@ -195,19 +378,13 @@ BufferStream &BufferStream::operator>>(float &item)
 
 BufferStream &BufferStream::operator>>(int32_t &item)
 {
-    if (!read(&item, sizeof(item))) {
-        throw Exception(String8::format("Read error, maybe insufficient data. [%s:%d]", __FILE__, __LINE__));
-    }
-
+    readInteger(item);
     return *this;
 }
 
 BufferStream &BufferStream::operator>>(uint32_t &item)
 {
-    if (!read(&item, sizeof(item))) {
-        throw Exception(String8::format("Read error, maybe insufficient data. [%s:%d]", __FILE__, __LINE__));
-    }
-
+    readInteger(item);
     return *this;
 }
 
@@ -222,49 +399,152 @@ BufferStream &BufferStream::operator>>(double &item)
 
 BufferStream &BufferStream::operator>>(int64_t &item)
 {
-    if (!read(&item, sizeof(item))) {
-        throw Exception(String8::format("Read error, maybe insufficient data. [%s:%d]", __FILE__, __LINE__));
-    }
-
+    readInteger(item);
     return *this;
 }
 
 BufferStream &BufferStream::operator>>(uint64_t &item)
 {
-    if (!read(&item, sizeof(item))) {
-        throw Exception(String8::format("Read error, maybe insufficient data. [%s:%d]", __FILE__, __LINE__));
-    }
-
+    readInteger(item);
     return *this;
 }
 
 BufferStream &BufferStream::operator>>(std::string &item)
+{
+    BufferSlice slice;
+    *this >> slice;
+    item.append(slice.data, slice.size);
+
+    return *this;
+}
+
+BufferStream &BufferStream::operator>>(BufferSlice &item)
 {
     checkBuffer();
-    std::string temp = item;
-    char ch = 1;
-    do {
-        if (!read(&ch, sizeof(ch))) {
+    if (m_encoding == ENCODING_VARINT) {
+        ReadPosition pos = position();
+        uint64_t length = 0;
+        if (!readVarint(length) || !readSlice(item, length)) {
+            restore(pos);
             throw Exception(String8::format("Read error, maybe insufficient data. [%s:%d]", __FILE__, __LINE__));
         }
-        temp.push_back(ch);
-    } while (ch != '\0');
+        return *this;
+    }
 
-    // 去掉结尾\0
-    item.assign(temp.c_str(), temp.size() - 1);
+    size_t length = findZero();
+    if (length == SIZE_MAX || !readSlice(item, length + 1)) {
+        throw Exception(String8::format("Read error, maybe insufficient data. [%s:%d]", __FILE__, __LINE__));
+    }
 
+    // 去掉结尾\0
+    item.size = length;
     return *this;
 }
 
-void BufferStream::write(const void *data, uint32_t size)
+void BufferStream::writeArray(const int16_t *values, size_t count)
+{
+    writeIntegerArray(values, count);
+}
+
+void BufferStream::writeArray(const uint16_t *values, size_t count)
+{
+    writeIntegerArray(values, count);
+}
+
+void BufferStream::writeArray(const int32_t *values, size_t count)
+{
+    writeIntegerArray(values, count);
+}
+
+void BufferStream::writeArray(const uint32_t *values, size_t count)
+{
+    writeIntegerArray(values, count);
+}
+
+void BufferStream::writeArray(const int64_t *values, size_t count)
+{
+    writeIntegerArray(values, count);
+}
+
+void BufferStream::writeArray(const uint64_t *values, size_t count)
+{
+    writeIntegerArray(values, count);
+}
+
+bool BufferStream::readArray(int16_t *values, size_t count)
+{
+    return readIntegerArray(values, count);
+}
+
+bool BufferStream::readArray(uint16_t *values, size_t count)
+{
+    return readIntegerArray(values, count);
+}
+
+bool BufferStream::readArray(int32_t *values, size_t count)
+{
+    return readIntegerArray(values, count);
+}
+
+bool BufferStream::readArray(uint32_t *values, size_t count)
+{
+    return readIntegerArray(values, count);
+}
+
+bool BufferStream::readArray(int64_t *values, size_t count)
+{
+    return readIntegerArray(values, count);
+}
+
+bool BufferStream::readArray(uint64_t *values, size_t count)
+{
+    return readIntegerArray(values, count);
+}
+
+bool BufferStream::mapFile(const String8 &path)
+{
+    release();
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat st;
+    if (::fstat(fd, &st) < 0) {
+        ::close(fd);
+        return false;
+    }
+
+    void *addr = nullptr;
+    if (st.st_size > 0) {
+        addr = ::mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (addr == MAP_FAILED) {
+            ::close(fd);
+            return false;
+        }
+        ::madvise(addr, st.st_size, MADV_SEQUENTIAL);
+    }
+    ::close(fd);
+
+    m_source = SOURCE_MAPPED;
+    m_data = static_cast<const uint8_t *>(addr);
+    m_wpos = st.st_size;
+    return true;
+}
+
+void BufferStream::write(const void *data, size_t size)
 {
     checkBuffer();
-    uint32_t cap = static_cast<uint32_t>(m_buffer->capacity());
-    uint32_t wpos = m_wpos + size;
+    if (m_source != SOURCE_BUFFER) {
+        throw Exception(String8::format("Read-only stream. [%s:%d]", __FILE__, __LINE__));
+    }
+
+    size_t cap = m_buffer->capacity();
+    size_t wpos = m_wpos + size;
     if (m_rpos != 0 && wpos > cap) {
         // 当前读位置不在起点, 且已无法写入这么多字节数, 移除旧的数据
         uint8_t *pBegin = m_buffer->data() + m_rpos;
-        uint32_t copySize = m_wpos - m_rpos;
+        size_t copySize = m_wpos - m_rpos;
 
         size_t realCopySize = m_buffer->set(pBegin, copySize);
         if (eular_unlikely(realCopySize != copySize)) {
@@ -279,25 +559,342 @@ void BufferStream::write(const void *data, uint32_t size)
     m_wpos += size;
 }
 
-bool BufferStream::read(void *data, uint32_t size)
+bool BufferStream::read(void *data, size_t size)
+{
+    checkBuffer();
+    if (size > m_wpos - m_rpos) {
+        return false;
+    }
+
+    const uint8_t *base = contiguous();
+    if (base == nullptr) {
+        advanceChain(static_cast<uint8_t *>(data), size);
+        return true;
+    }
+
+    // 有足够多的数据可读, 只读取不修改, 避免共享的ByteBuffer被复制
+    if (size > 0) {
+        memcpy(data, base + m_rpos, size);
+    }
+    m_rpos += size;
+    return true;
+}
+
+bool BufferStream::readSlice(BufferSlice &slice, size_t size)
 {
     checkBuffer();
-    uint32_t rpos = m_rpos + size;
-    if (rpos <= m_wpos) {
-        // 有足够多的数据可读
-        memcpy(data, m_buffer->data() + m_rpos, size);
+    if (size > m_wpos - m_rpos) {
+        return false;
+    }
+
+    const uint8_t *base = contiguous();
+    if (base != nullptr) {
+        slice = BufferSlice(reinterpret_cast<const char *>(base + m_rpos), size);
         m_rpos += size;
         return true;
     }
 
-    return false;
+    if (m_chainIndex < m_chain.size() && m_chain[m_chainIndex].iov_len - m_chainOffset >= size) {
+        const struct iovec &seg = m_chain[m_chainIndex];
+        slice = BufferSlice(static_cast<const char *>(seg.iov_base) + m_chainOffset, size);
+        advanceChain(nullptr, size);
+        return true;
+    }
+
+    // 跨分段时才拷贝
+    m_scratch.resize(size);
+    advanceChain(reinterpret_cast<uint8_t *>(&m_scratch[0]), size);
+    slice = BufferSlice(m_scratch.data(), size);
+    return true;
+}
+
+bool BufferStream::skip(size_t size)
+{
+    checkBuffer();
+    if (size > m_wpos - m_rpos) {
+        return false;
+    }
+
+    advance(size);
+    return true;
 }
 
 void BufferStream::checkBuffer() const
 {
-    if (m_buffer == nullptr) {
+    if (m_source == SOURCE_NONE) {
         throw Exception("Invalid call");
     }
 }
 
+void BufferStream::release()
+{
+    if (m_source == SOURCE_MAPPED && m_data != nullptr) {
+        ::munmap(const_cast<uint8_t *>(m_data), m_wpos);
+    }
+
+    m_source = SOURCE_NONE;
+    m_buffer = nullptr;
+    m_data = nullptr;
+    m_chain.clear();
+    m_chainIndex = 0;
+    m_chainOffset = 0;
+    m_scratch.clear();
+    m_rpos = 0;
+    m_wpos = 0;
+}
+
+const uint8_t *BufferStream::contiguous() const
+{
+    switch (m_source) {
+    case SOURCE_BUFFER:
+        return m_buffer->const_data();
+    case SOURCE_MEMORY:
+    case SOURCE_MAPPED:
+        return m_data;
+    default:
+        break;
+    }
+
+    return nullptr;
+}
+
+const uint8_t *BufferStream::window(size_t &avail) const
+{
+    const uint8_t *base = contiguous();
+    if (base != nullptr) {
+        avail = m_wpos - m_rpos;
+        return base + m_rpos;
+    }
+
+    if (m_chainIndex < m_chain.size()) {
+        const struct iovec &seg = m_chain[m_chainIndex];
+        avail = seg.iov_len - m_chainOffset;
+        return static_cast<const uint8_t *>(seg.iov_base) + m_chainOffset;
+    }
+
+    avail = 0;
+    return nullptr;
+}
+
+size_t BufferStream::findZero() const
+{
+    const uint8_t *base = contiguous();
+    if (base != nullptr) {
+        const void *pos = memchr(base + m_rpos, '\0', m_wpos - m_rpos);
+        return pos ? static_cast<const uint8_t *>(pos) - (base + m_rpos) : SIZE_MAX;
+    }
+
+    size_t length = 0;
+    size_t offset = m_chainOffset;
+    for (size_t i = m_chainIndex; i < m_chain.size(); ++i) {
+        const uint8_t *begin = static_cast<const uint8_t *>(m_chain[i].iov_base) + offset;
+        size_t remain = m_chain[i].iov_len - offset;
+        const void *pos = memchr(begin, '\0', remain);
+        if (pos != nullptr) {
+            return length + (static_cast<const uint8_t *>(pos) - begin);
+        }
+        length += remain;
+        offset = 0;
+    }
+
+    return SIZE_MAX;
+}
+
+void BufferStream::advance(size_t size)
+{
+    if (m_source == SOURCE_CHAIN) {
+        advanceChain(nullptr, size);
+    } else {
+        m_rpos += size;
+    }
+}
+
+void BufferStream::advanceChain(uint8_t *out, size_t size)
+{
+    // 调用者已检查可读字节数; out为空时只移动读索引
+    m_rpos += size;
+    while (size > 0) {
+        const struct iovec &seg = m_chain[m_chainIndex];
+        size_t n = seg.iov_len - m_chainOffset;
+        n = n < size ? n : size;
+        if (out != nullptr) {
+            memcpy(out, static_cast<const uint8_t *>(seg.iov_base) + m_chainOffset, n);
+            out += n;
+        }
+        m_chainOffset += n;
+        size -= n;
+        if (m_chainOffset == seg.iov_len) {
+            ++m_chainIndex;
+            m_chainOffset = 0;
+        }
+    }
+}
+
+BufferStream::ReadPosition BufferStream::position() const
+{
+    return ReadPosition{m_rpos, m_chainIndex, m_chainOffset};
+}
+
+void BufferStream::restore(const ReadPosition &pos)
+{
+    m_rpos = pos.rpos;
+    m_chainIndex = pos.chainIndex;
+    m_chainOffset = pos.chainOffset;
+}
+
+void BufferStream::writeVarint(uint64_t value)
+{
+    uint8_t buf[VARINT_MAX_BYTES];
+    write(buf, EncodeVarint(value, buf));
+}
+
+bool BufferStream::readVarint(uint64_t &value)
+{
+    checkBuffer();
+    size_t avail = 0;
+    const uint8_t *in = window(avail);
+    size_t size = DecodeVarint(in, avail, value);
+    if (size > 0) {
+        advance(size);
+        return true;
+    }
+    if (avail >= VARINT_MAX_BYTES || m_source != SOURCE_CHAIN) {
+        // 超长或数据不足
+        return false;
+    }
+
+    // 跨分段, 逐字节读取
+    ReadPosition pos = position();
+    uint64_t result = 0;
+    for (size_t i = 0; i < VARINT_MAX_BYTES; ++i) {
+        uint8_t byte = 0;
+        if (!read(&byte, sizeof(byte)) || VarintOverflow(i, byte)) {
+            break;
+        }
+        result |= static_cast<uint64_t>(byte & 0x7F) << (7 * i);
+        if ((byte & 0x80) == 0) {
+            value = result;
+            return true;
+        }
+    }
+
+    restore(pos);
+    return false;
+}
+
+template<typename T>
+void BufferStream::writeInteger(T value)
+{
+    if (m_encoding == ENCODING_VARINT) {
+        writeVarint(IntegerToVarint(value, typename std::is_signed<T>::type()));
+    } else {
+        write(&value, sizeof(value));
+    }
+}
+
+template<typename T>
+void BufferStream::readInteger(T &value)
+{
+    bool success = false;
+    if (m_encoding == ENCODING_VARINT) {
+        ReadPosition pos = position();
+        uint64_t raw = 0;
+        success = readVarint(raw) && VarintToInteger(raw, value, typename std::is_signed<T>::type());
+        if (!success) {
+            restore(pos);
+        }
+    } else {
+        success = read(&value, sizeof(value));
+    }
+
+    if (!success) {
+        throw Exception(String8::format("Read error, maybe insufficient data. [%s:%d]", __FILE__, __LINE__));
+    }
+}
+
+template<typename T>
+void BufferStream::writeIntegerArray(const T *values, size_t count)
+{
+    if (m_encoding != ENCODING_VARINT) {
+        write(values, sizeof(T) * count);
+        return;
+    }
+
+    uint8_t chunk[VARINT_CHUNK_SIZE + VARINT_MAX_BYTES];
+    size_t size = 0;
+    for (size_t i = 0; i < count; ++i) {
+        size += EncodeVarint(IntegerToVarint(values[i], typename std::is_signed<T>::type()), chunk + size);
+        if (size >= VARINT_CHUNK_SIZE) {
+            write(chunk, size);
+            size = 0;
+        }
+    }
+    if (size > 0) {
+        write(chunk, size);
+    }
+}
+
+template<typename T>
+bool BufferStream::readIntegerArray(T *values, size_t count)
+{
+    if (m_encoding != ENCODING_VARINT) {
+        return read(values, sizeof(T) * count);
+    }
+
+    checkBuffer();
+    typename std::is_signed<T>::type sign;
+    ReadPosition pos = position();
+    size_t n = 0;
+    while (n < count) {
+        size_t avail = 0;
+        const uint8_t *in = window(avail);
+        size_t used = 0;
+        bool valid = true;
+        while (n < count) {
+            // 小整数占多数, 连续的单字节值直接展开
+            size_t run = SingleByteRun(in + used, avail - used);
+            run = run < count - n ? run : count - n;
+            for (size_t i = 0; i < run; ++i) {
+                values[n + i] = SmallVarintToInteger<T>(in[used + i], sign);
+            }
+            n += run;
+            used += run;
+            if (n == count) {
+                break;
+            }
+
+            uint64_t raw = 0;
+            size_t size = DecodeVarint(in + used, avail - used, raw);
+            if (size == 0) {
+                // 窗口内不完整, 交给readVarint处理
+                break;
+            }
+            if (!VarintToInteger(raw, values[n], sign)) {
+                valid = false;
+                break;
+            }
+            ++n;
+            used += size;
+        }
+
+        advance(used);
+        if (!valid) {
+            restore(pos);
+            return false;
+        }
+        if (n == count) {
+            break;
+        }
+
+        uint64_t raw = 0;
+        if (!readVarint(raw) || !VarintToInteger(raw, values[n], sign)) {
+            restore(pos);
+            return false;
+        }
+        ++n;
+    }
+
+    return true;
+}
+
 } // namespace eular
@@ -0,0 +1,319 @@
+/*************************************************************************
+    > File Name: fast_hash.cpp
+    > Author: hsz
+    > Brief:
+    > Created Time: 2026年10月18日 星期日 22时05分24秒
+ ************************************************************************/
+
+#include "utils/fast_hash.h"
+
+#include <string.h>
+
+#if defined(__x86_64__) && !defined(FAST_HASH_NO_SIMD)
+#define FAST_HASH_X86   1
+#include <immintrin.h>
+#endif
+
+#define FAST_HASH_LONG_SIZE     (512)   // 超过此长度使用条带累加
+#define STRIPE_SIZE             (64)    // 每个条带的字节数, 对应8个64位累加器
+#define SECRET_SIZE             (192)
+#define STRIPES_PER_BLOCK       ((SECRET_SIZE - STRIPE_SIZE) / 8)   // 每个条带的密钥右移8字节
+#define BLOCK_SIZE              (STRIPE_SIZE * STRIPES_PER_BLOCK)
+
+namespace eular {
+static const uint64_t WY_P0 = 0xa0761d6478bd642fULL;
+static const uint64_t WY_P1 = 0xe7037ed1a0b428dbULL;
+static const uint64_t WY_P2 = 0x8ebc6af09c88c6e3ULL;
+static const uint64_t WY_P3 = 0x589965cc75374cc3ULL;
+
+static const uint32_t PRIME32_1 = 0x9E3779B1U;
+static const uint32_t PRIME32_2 = 0x85EBCA77U;
+static const uint32_t PRIME32_3 = 0xC2B2AE3DU;
+static const uint64_t PRIME64_1 = 0x9E3779B185EBCA87ULL;
+static const uint64_t PRIME64_2 = 0xC2B2AE3D27D4EB4FULL;
+static const uint64_t PRIME64_3 = 0x165667B19E3779F9ULL;
+static const uint64_t PRIME64_4 = 0x85EBCA77C2B2AE63ULL;
+static const uint64_t PRIME64_5 = 0x27D4EB2F165667C5ULL;
+
+// splitmix64生成的密钥
+alignas(64) static const uint64_t kSecret[SECRET_SIZE / 8] = {
+    0xda44c99091995a91ULL, 0x2c5aa78e889f6eb2ULL, 0x732f2e57065e7b75ULL,
+    0xe8ad7c3340c22011ULL, 0x7e15bca0594b03a9ULL, 0xc4e6fdef2357348fULL,
+    0x9fd83b6c73f38a22ULL, 0x341e7e959241c886ULL, 0x6e576ca334e2ec1cULL,
+    0x2055469c3eb2a1a0ULL, 0xff3704d0ee7861dcULL, 0xd1ec893ab9aed109ULL,
+    0x7a8ebd1f5088cc80ULL, 0xba3ba73c1038b6baULL, 0x91fedc6086fb5c2eULL,
+    0xc5fc1c534671c8aaULL, 0x9b63d7058fa02d52ULL, 0xd6f76b096d9dc83bULL,
+    0x254fe4fa00acde87ULL, 0xfc9400ff3a2adfd7ULL, 0x66c84469d25203c3ULL,
+    0x81441af6612b9857ULL, 0x3144278ff102e843ULL, 0x6327118172140cbaULL,
+};
+
+static inline uint64_t Read64(const uint8_t *p)
+{
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint64_t Read32(const uint8_t *p)
+{
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint64_t Mix(uint64_t a, uint64_t b)
+{
+    __uint128_t r = (__uint128_t)a * b;
+    return (uint64_t)r ^ (uint64_t)(r >> 64);
+}
+
+static inline uint64_t Avalanche(uint64_t h)
+{
+    h ^= h >> 37;
+    h *= 0x165667919E3779F9ULL;
+    h ^= h >> 32;
+    return h;
+}
+
+static uint64_t HashShort(const uint8_t *p, size_t size, uint64_t seed)
+{
+    uint64_t a = 0;
+    uint64_t b = 0;
+    seed ^= Mix(seed ^ WY_P0, WY_P1);
+    if (size <= 16) {
+        if (size >= 4) {
+            // 4~16字节用首尾各两个可能重叠的4字节
+            size_t mid = (size >> 3) << 2;
+            a = (Read32(p) << 32) | Read32(p + mid);
+            b = (Read32(p + size - 4) << 32) | Read32(p + size - 4 - mid);
+        } else if (size > 0) {
+            a = ((uint64_t)p[0] << 16) | ((uint64_t)p[size >> 1] << 8) | p[size - 1];
+        }
+    } else {
+        size_t i = size;
+        if (i > 48) {
+            uint64_t see1 = seed;
+            uint64_t see2 = seed;
+            do {
+                seed = Mix(Read64(p) ^ WY_P1, Read64(p + 8) ^ seed);
+                see1 = Mix(Read64(p + 16) ^ WY_P2, Read64(p + 24) ^ see1);
+                see2 = Mix(Read64(p + 32) ^ WY_P3, Read64(p + 40) ^ see2);
+                p += 48;
+                i -= 48;
+            } while (i > 48);
+            seed ^= see1 ^ see2;
+        }
+        while (i > 16) {
+            seed = Mix(Read64(p) ^ WY_P1, Read64(p + 8) ^ seed);
+            p += 16;
+            i -= 16;
+        }
+        a = Read64(p + i - 16);
+        b = Read64(p + i - 8);
+    }
+
+    __uint128_t r = (__uint128_t)(a ^ WY_P1) * (b ^ seed);
+    return Mix((uint64_t)r ^ WY_P0 ^ size, (uint64_t)(r >> 64) ^ WY_P1);
+}
+
+/**
+ * 长数据: 8个累加器, 每个条带中第i个64位数据与密钥异或后高低32位相乘加到acc[i], 原始数据加到acc[i ^ 1];
+ * 每个块(16个条带)结束后打散累加器. 各实现只在累加与打散上不同
+ */
+static void AccumulateScalar(uint64_t *acc, const uint8_t *in, const uint8_t *secret, size_t stripes)
+{
+    for (size_t n = 0; n < stripes; ++n) {
+        const uint8_t *p = in + n * STRIPE_SIZE;
+        const uint8_t *key = secret + n * 8;
+        for (size_t i = 0; i < 8; ++i) {
+            uint64_t data = Read64(p + i * 8);
+            uint64_t dk = data ^ Read64(key + i * 8);
+            acc[i ^ 1] += data;
+            acc[i] += (dk & 0xFFFFFFFF) * (dk >> 32);
+        }
+    }
+}
+
+static void ScrambleScalar(uint64_t *acc, const uint8_t *secret)
+{
+    for (size_t i = 0; i < 8; ++i) {
+        uint64_t a = acc[i];
+        a ^= a >> 47;
+        a ^= Read64(secret + i * 8);
+        a *= PRIME32_1;
+        acc[i] = a;
+    }
+}
+
+#ifdef FAST_HASH_X86
+static void AccumulateSSE2(uint64_t *acc, const uint8_t *in, const uint8_t *secret, size_t stripes)
+{
+    __m128i *xacc = reinterpret_cast<__m128i *>(acc);
+    for (size_t n = 0; n < stripes; ++n) {
+        const uint8_t *p = in + n * STRIPE_SIZE;
+        const uint8_t *key = secret + n * 8;
+        for (size_t i = 0; i < 4; ++i) {
+            __m128i data = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p) + i);
+            __m128i dk = _mm_xor_si128(data, _mm_loadu_si128(reinterpret_cast<const __m128i *>(key) + i));
+            // _mm_mul_epu32取每个64位的低32位相乘, 高32位移到低位后即为lo * hi
+            __m128i product = _mm_mul_epu32(dk, _mm_shuffle_epi32(dk, _MM_SHUFFLE(0, 3, 0, 1)));
+            __m128i swapped = _mm_shuffle_epi32(data, _MM_SHUFFLE(1, 0, 3, 2));
+            xacc[i] = _mm_add_epi64(xacc[i], _mm_add_epi64(product, swapped));
+        }
+    }
+}
+
+static void ScrambleSSE2(uint64_t *acc, const uint8_t *secret)
+{
+    __m128i *xacc = reinterpret_cast<__m128i *>(acc);
+    const __m128i prime = _mm_set1_epi32((int)PRIME32_1);
+    for (size_t i = 0; i < 4; ++i) {
+        __m128i a = xacc[i];
+        a = _mm_xor_si128(a, _mm_srli_epi64(a, 47));
+        a = _mm_xor_si128(a, _mm_loadu_si128(reinterpret_cast<const __m128i *>(secret) + i));
+        // 64位乘32位: 低32位乘积 + 高32位乘积左移32位
+        __m128i lo = _mm_mul_epu32(a, prime);
+        __m128i hi = _mm_mul_epu32(_mm_shuffle_epi32(a, _MM_SHUFFLE(2, 3, 0, 1)), prime);
+        xacc[i] = _mm_add_epi64(lo, _mm_slli_epi64(hi, 32));
+    }
+}
+
+__attribute__((target("avx2")))
+static void AccumulateAVX2(uint64_t *acc, const uint8_t *in, const uint8_t *secret, size_t stripes)
+{
+    __m256i *xacc = reinterpret_cast<__m256i *>(acc);
+    for (size_t n = 0; n < stripes; ++n) {
+        const uint8_t *p = in + n * STRIPE_SIZE;
+        const uint8_t *key = secret + n * 8;
+        for (size_t i = 0; i < 2; ++i) {
+            __m256i data = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p) + i);
+            __m256i dk = _mm256_xor_si256(data, _mm256_loadu_si256(reinterpret_cast<const __m256i *>(key) + i));
+            __m256i product = _mm256_mul_epu32(dk, _mm256_shuffle_epi32(dk, _MM_SHUFFLE(0, 3, 0, 1)));
+            __m256i swapped = _mm256_shuffle_epi32(data, _MM_SHUFFLE(1, 0, 3, 2));
+            xacc[i] = _mm256_add_epi64(xacc[i], _mm256_add_epi64(product, swapped));
+        }
+    }
+}
+
+__attribute__((target("avx2")))
+static void ScrambleAVX2(uint64_t *acc, const uint8_t *secret)
+{
+    __m256i *xacc = reinterpret_cast<__m256i *>(acc);
+    const __m256i prime = _mm256_set1_epi32((int)PRIME32_1);
+    for (size_t i = 0; i < 2; ++i) {
+        __m256i a = xacc[i];
+        a = _mm256_xor_si256(a, _mm256_srli_epi64(a, 47));
+        a = _mm256_xor_si256(a, _mm256_loadu_si256(reinterpret_cast<const __m256i *>(secret) + i));
+        __m256i lo = _mm256_mul_epu32(a, prime);
+        __m256i hi = _mm256_mul_epu32(_mm256_shuffle_epi32(a, _MM_SHUFFLE(2, 3, 0, 1)), prime);
+        xacc[i] = _mm256_add_epi64(lo, _mm256_slli_epi64(hi, 32));
+    }
+}
+#endif
+
+typedef void (*AccumulateFunc)(uint64_t *, const uint8_t *, const uint8_t *, size_t);
+typedef void (*ScrambleFunc)(uint64_t *, const uint8_t *);
+
+struct LongHashImpl {
+    AccumulateFunc  accumulate;
+    ScrambleFunc    scramble;
+};
+
+static bool ImplSupported(detail::FastHashImpl type)
+{
+    switch (type) {
+    case detail::FAST_HASH_SCALAR:
+        return true;
+#ifdef FAST_HASH_X86
+    case detail::FAST_HASH_SSE2:
+        return true;
+    case detail::FAST_HASH_AVX2:
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2");
+#endif
+    default:
+        return false;
+    }
+}
+
+static LongHashImpl GetImpl(detail::FastHashImpl type)
+{
+    switch (type) {
+#ifdef FAST_HASH_X86
+    case detail::FAST_HASH_SSE2:
+        return LongHashImpl{AccumulateSSE2, ScrambleSSE2};
+    case detail::FAST_HASH_AVX2:
+        return LongHashImpl{AccumulateAVX2, ScrambleAVX2};
+#endif
+    default:
+        return LongHashImpl{AccumulateScalar, ScrambleScalar};
+    }
+}
+
+static LongHashImpl SelectImpl()
+{
+    if (ImplSupported(detail::FAST_HASH_AVX2)) {
+        return GetImpl(detail::FAST_HASH_AVX2);
+    }
+    if (ImplSupported(detail::FAST_HASH_SSE2)) {
+        return GetImpl(detail::FAST_HASH_SSE2);
+    }
+    return GetImpl(detail::FAST_HASH_SCALAR);
+}
+
+static uint64_t HashLong(const LongHashImpl &impl, const uint8_t *p, size_t size, uint64_t seed)
+{
+    const uint8_t *secret = reinterpret_cast<const uint8_t *>(kSecret);
+
+    alignas(32) uint64_t acc[8] = {
+        PRIME32_3, PRIME64_1, PRIME64_2, PRIME64_3,
+        PRIME64_4, PRIME32_2, PRIME64_5, PRIME32_1
+    };
+
+    size_t blocks = (size - 1) / BLOCK_SIZE;
+    for (size_t n = 0; n < blocks; ++n) {
+        impl.accumulate(acc, p + n * BLOCK_SIZE, secret, STRIPES_PER_BLOCK);
+        impl.scramble(acc, secret + SECRET_SIZE - STRIPE_SIZE);
+    }
+
+    // 最后一个块的完整条带, 以及以末尾对齐的最后一个条带
+    size_t stripes = ((size - 1) - BLOCK_SIZE * blocks) / STRIPE_SIZE;
+    impl.accumulate(acc, p + blocks * BLOCK_SIZE, secret, stripes);
+    impl.accumulate(acc, p + size - STRIPE_SIZE, secret + SECRET_SIZE - STRIPE_SIZE - 7, 1);
+
+    uint64_t result = size * PRIME64_1 ^ seed;
+    for (size_t i = 0; i < 4; ++i) {
+        result += Mix(acc[2 * i] ^ Read64(secret + 11 + 16 * i), acc[2 * i + 1] ^ Read64(secret + 19 + 16 * i));
+    }
+    return Avalanche(result);
+}
+
+uint64_t FastHash64(const void *data, size_t size, uint64_t seed)
+{
+    const uint8_t *p = static_cast<const uint8_t *>(data);
+    if (size <= FAST_HASH_LONG_SIZE) {
+        return HashShort(p, size, seed);
+    }
+
+    static const LongHashImpl impl = SelectImpl();
+    return HashLong(impl, p, size, seed);
+}
+
+namespace detail {
+bool FastHash64Supported(FastHashImpl type)
+{
+    return ImplSupported(type);
+}
+
+uint64_t FastHash64With(FastHashImpl type, const void *data, size_t size, uint64_t seed)
+{
+    const uint8_t *p = static_cast<const uint8_t *>(data);
+    if (size <= FAST_HASH_LONG_SIZE) {
+        return HashShort(p, size, seed);
+    }
+
+    return HashLong(GetImpl(type), p, size, seed);
+}
+} // namespace detail
+
+} // namespace eular
@@ -0,0 +1,447 @@
+/*************************************************************************
+    > File Name: iobuffer.cpp
+    > Author: hsz
+    > Brief:
+    > Created Time: 2026年10月18日 星期日 21时10分29秒
+ ************************************************************************/
+
+#include "utils/iobuffer.h"
+#include "utils/shared_buffer.h"
+
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+
+#define IOBUFFER_BLOCK_SIZE     (4096 - sizeof(eular::SharedBuffer))    // 连同头部恰好一页
+#define IOBUFFER_HEADROOM       (128)   // prepend新块的大小, 数据放在末尾以便继续向前写入
+#define IOBUFFER_MAX_IOV        (64)
+
+namespace eular {
+IOBuffer::IOBuffer() :
+    mSize(0),
+    mReserveTail(false)
+{
+}
+
+IOBuffer::IOBuffer(const void *data, size_t size) :
+    mSize(0),
+    mReserveTail(false)
+{
+    append(data, size);
+}
+
+IOBuffer::IOBuffer(const IOBuffer &other) :
+    mSize(0),
+    mReserveTail(false)
+{
+    append(other);
+}
+
+IOBuffer::IOBuffer(IOBuffer &&other) :
+    mSize(0),
+    mReserveTail(false)
+{
+    mSegments.swap(other.mSegments);
+    std::swap(mSize, other.mSize);
+}
+
+IOBuffer::~IOBuffer()
+{
+    clear();
+}
+
+IOBuffer &IOBuffer::operator=(const IOBuffer &other)
+{
+    if (std::addressof(other) != this) {
+        IOBuffer temp(other);
+        clear();
+        mSegments.swap(temp.mSegments);
+        std::swap(mSize, temp.mSize);
+    }
+
+    return *this;
+}
+
+IOBuffer &IOBuffer::operator=(IOBuffer &&other)
+{
+    if (std::addressof(other) != this) {
+        clear();
+        mSegments.swap(other.mSegments);
+        std::swap(mSize, other.mSize);
+    }
+
+    return *this;
+}
+
+void IOBuffer::clear()
+{
+    releaseReserved();
+    for (const Segment &seg : mSegments) {
+        seg.block->release();
+    }
+    mSegments.clear();
+    mSize = 0;
+}
+
+void IOBuffer::append(const void *data, size_t size)
+{
+    if (data == nullptr || size == 0) {
+        return;
+    }
+
+    const uint8_t *src = static_cast<const uint8_t *>(data);
+    size_t room = tailRoom();
+    if (room > 0) {
+        Segment &tail = mSegments.back();
+        size_t n = room < size ? room : size;
+        memcpy(static_cast<uint8_t *>(tail.block->data()) + tail.offset + tail.length, src, n);
+        tail.length += n;
+        mSize += n;
+        src += n;
+        size -= n;
+    }
+
+    if (size > 0) {
+        SharedBuffer *block = SharedBuffer::alloc(size > IOBUFFER_BLOCK_SIZE ? size : IOBUFFER_BLOCK_SIZE);
+        if (block == nullptr) {
+            return;
+        }
+        memcpy(block->data(), src, size);
+        mSegments.push_back(Segment{block, 0, size});
+        mSize += size;
+    }
+}
+
+void IOBuffer::append(const IOBuffer &other)
+{
+    // other可能就是自身, 先记录分段数
+    size_t count = other.mSegments.size();
+    for (size_t i = 0; i < count; ++i) {
+        Segment seg = other.mSegments[i];
+        seg.block->acquire();
+        mSegments.push_back(seg);
+        mSize += seg.length;
+    }
+}
+
+void IOBuffer::append(IOBuffer &&other)
+{
+    if (std::addressof(other) == this) {
+        append(static_cast<const IOBuffer &>(other));
+        return;
+    }
+
+    other.releaseReserved();
+    for (const Segment &seg : other.mSegments) {
+        mSegments.push_back(seg);
+    }
+    mSize += other.mSize;
+    other.mSegments.clear();
+    other.mSize = 0;
+}
+
+void IOBuffer::prepend(const void *data, size_t size)
+{
+    if (data == nullptr || size == 0) {
+        return;
+    }
+
+    if (!mSegments.empty()) {
+        Segment &head = mSegments.front();
+        if (head.offset >= size && head.block->onlyOwner()) {
+            head.offset -= size;
+            head.length += size;
+            mSize += size;
+            memcpy(static_cast<uint8_t *>(head.block->data()) + head.offset, data, size);
+            return;
+        }
+    }
+
+    size_t blockSize = size > IOBUFFER_HEADROOM ? size : IOBUFFER_HEADROOM;
+    SharedBuffer *block = SharedBuffer::alloc(blockSize);
+    if (block == nullptr) {
+        return;
+    }
+    size_t offset = blockSize - size;
+    memcpy(static_cast<uint8_t *>(block->data()) + offset, data, size);
+    mSegments.push_front(Segment{block, offset, size});
+    mSize += size;
+}
+
+size_t IOBuffer::consume(size_t n)
+{
+    size_t consumed = 0;
+    while (n > 0 && !mSegments.empty()) {
+        Segment &head = mSegments.front();
+        if (head.length > n) {
+            head.offset += n;
+            head.length -= n;
+            consumed += n;
+            break;
+        }
+
+        n -= head.length;
+        consumed += head.length;
+        head.block->release();
+        mSegments.pop_front();
+    }
+
+    mSize -= consumed;
+    return consumed;
+}
+
+size_t IOBuffer::trimBack(size_t n)
+{
+    size_t trimmed = 0;
+    while (n > 0 && !mSegments.empty()) {
+        Segment &tail = mSegments.back();
+        if (tail.length > n) {
+            tail.length -= n;
+            trimmed += n;
+            break;
+        }
+
+        n -= tail.length;
+        trimmed += tail.length;
+        tail.block->release();
+        mSegments.pop_back();
+    }
+
+    mSize -= trimmed;
+    return trimmed;
+}
+
+IOBuffer IOBuffer::split(size_t n)
+{
+    IOBuffer front;
+    while (n > 0 && !mSegments.empty()) {
+        Segment &head = mSegments.front();
+        if (head.length > n) {
+            // 边界落在分段内部, 两边各引用一部分
+            head.block->acquire();
+            front.mSegments.push_back(Segment{head.block, head.offset, n});
+            front.mSize += n;
+            head.offset += n;
+            head.length -= n;
+            mSize -= n;
+            break;
+        }
+
+        n -= head.length;
+        front.mSize += head.length;
+        mSize -= head.length;
+        front.mSegments.push_back(head);
+        mSegments.pop_front();
+    }
+
+    return front;
+}
+
+IOBuffer IOBuffer::slice(size_t offset, size_t length) const
+{
+    IOBuffer view;
+    for (const Segment &seg : mSegments) {
+        if (length == 0) {
+            break;
+        }
+        if (offset >= seg.length) {
+            offset -= seg.length;
+            continue;
+        }
+
+        size_t n = seg.length - offset;
+        n = n < length ? n : length;
+        seg.block->acquire();
+        view.mSegments.push_back(Segment{seg.block, seg.offset + offset, n});
+        view.mSize += n;
+        length -= n;
+        offset = 0;
+    }
+
+    return view;
+}
+
+size_t IOBuffer::copyOut(size_t offset, void *out, size_t length) const
+{
+    uint8_t *dst = static_cast<uint8_t *>(out);
+    size_t copied = 0;
+    for (const Segment &seg : mSegments) {
+        if (copied == length) {
+            break;
+        }
+        if (offset >= seg.length) {
+            offset -= seg.length;
+            continue;
+        }
+
+        size_t n = seg.length - offset;
+        n = n < length - copied ? n : length - copied;
+        memcpy(dst + copied, static_cast<const uint8_t *>(seg.block->data()) + seg.offset + offset, n);
+        copied += n;
+        offset = 0;
+    }
+
+    return copied;
+}
+
+std::string IOBuffer::toString() const
+{
+    std::string str;
+    str.resize(mSize);
+    if (mSize > 0) {
+        copyOut(0, &str[0], mSize);
+    }
+    return str;
+}
+
+const uint8_t *IOBuffer::pullup(size_t n)
+{
+    if (n == 0 || n > mSize) {
+        return nullptr;
+    }
+
+    Segment &head = mSegments.front();
+    if (head.length >= n) {
+        return static_cast<const uint8_t *>(head.block->data()) + head.offset;
+    }
+
+    SharedBuffer *block = SharedBuffer::alloc(n);
+    if (block == nullptr) {
+        return nullptr;
+    }
+    copyOut(0, block->data(), n);
+    consume(n);
+    mSegments.push_front(Segment{block, 0, n});
+    mSize += n;
+    return static_cast<const uint8_t *>(block->data());
+}
+
+size_t IOBuffer::peekIovec(struct iovec *iov, size_t maxIov) const
+{
+    size_t count = 0;
+    for (const Segment &seg : mSegments) {
+        if (count == maxIov) {
+            break;
+        }
+        iov[count].iov_base = static_cast<uint8_t *>(seg.block->data()) + seg.offset;
+        iov[count].iov_len = seg.length;
+        ++count;
+    }
+
+    return count;
+}
+
+size_t IOBuffer::reserveIovec(struct iovec *iov, size_t maxIov, size_t size)
+{
+    releaseReserved();
+    if (maxIov == 0 || size == 0) {
+        return 0;
+    }
+
+    size_t count = 0;
+    size_t room = tailRoom();
+    if (room > 0) {
+        const Segment &tail = mSegments.back();
+        iov[count].iov_base = static_cast<uint8_t *>(tail.block->data()) + tail.offset + tail.length;
+        iov[count].iov_len = room < size ? room : size;
+        size -= iov[count].iov_len;
+        ++count;
+        mReserveTail = true;
+    }
+
+    if (size > 0 && count < maxIov) {
+        // 剩余空间分配一块, 避免拆成多个小块
+        SharedBuffer *block = SharedBuffer::alloc(size > IOBUFFER_BLOCK_SIZE ? size : IOBUFFER_BLOCK_SIZE);
+        if (block == nullptr) {
+            if (count == 0) {
+                return 0;
+            }
+        } else {
+            mReserved.push_back(block);
+            iov[count].iov_base = block->data();
+            iov[count].iov_len = size;
+            ++count;
+        }
+    }
+
+    return count;
+}
+
+void IOBuffer::commit(size_t n)
+{
+    if (mReserveTail && n > 0) {
+        Segment &tail = mSegments.back();
+        size_t room = tailRoom();
+        size_t used = room < n ? room : n;
+        tail.length += used;
+        mSize += used;
+        n -= used;
+    }
+
+    for (SharedBuffer *block : mReserved) {
+        if (n == 0) {
+            block->release();
+            continue;
+        }
+        size_t used = block->size() < n ? block->size() : n;
+        mSegments.push_back(Segment{block, 0, used});
+        mSize += used;
+        n -= used;
+    }
+    mReserved.clear();
+    mReserveTail = false;
+}
+
+ssize_t IOBuffer::writeTo(int fd)
+{
+    struct iovec iov[IOBUFFER_MAX_IOV];
+    size_t count = peekIovec(iov, IOBUFFER_MAX_IOV);
+    if (count == 0) {
+        return 0;
+    }
+
+    ssize_t n = ::writev(fd, iov, count);
+    if (n > 0) {
+        consume(n);
+    }
+    return n;
+}
+
+ssize_t IOBuffer::readFrom(int fd, size_t maxSize)
+{
+    struct iovec iov[2];
+    size_t count = reserveIovec(iov, 2, maxSize);
+    if (count == 0) {
+        errno = ENOMEM;
+        return -1;
+    }
+
+    ssize_t n = ::readv(fd, iov, count);
+    commit(n > 0 ? n : 0);
+    return n;
+}
+
+size_t IOBuffer::tailRoom() const
+{
+    if (mSegments.empty()) {
+        return 0;
+    }
+
+    // 只有独占内存块时, 分段之后的空间才不会被其他对象引用
+    const Segment &tail = mSegments.back();
+    if (!tail.block->onlyOwner()) {
+        return 0;
+    }
+    return tail.block->size() - tail.offset - tail.length;
+}
+
+void IOBuffer::releaseReserved()
+{
+    for (SharedBuffer *block : mReserved) {
+        block->release();
+    }
+    mReserved.clear();
+    mReserveTail = false;
+}
+
+} // namespace eular